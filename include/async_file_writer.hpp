@@ -0,0 +1,121 @@
+#ifndef ASYNC_FILE_WRITER_HPP
+#define ASYNC_FILE_WRITER_HPP
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class AsyncFileWriter
+ * @brief Writes a received file on a background thread
+ *
+ * The client's receiver thread used to write() each chunk before it
+ * could recv() the next one, so a slow disk stalled the socket (and the
+ * chat lines queued behind the file). Here the receiver only copies
+ * into memory; a dedicated writer thread does the disk I/O:
+ *
+ *   receiver:  recv -> [fill buffer] --full--> hand off, swap
+ *   writer:                  [disk buffer] -> write() -> give back
+ *
+ * Two BUFFER_SIZE buffers alternate, so the receiver blocks only when
+ * the disk is slower than the network for more than a whole buffer.
+ *
+ * - Buffers are page aligned (posix_memalign), which O_DIRECT requires
+ * - CHAT_DIRECT_IO=1 opens the file with O_DIRECT so received data does
+ *   not evict the page cache; the unaligned tail is written after
+ *   clearing O_DIRECT with fcntl(). Filesystems without O_DIRECT
+ *   support silently fall back to buffered writes
+ * - The expected size is preallocated with fallocate() so the file is
+ *   laid out contiguously and a full disk fails up front
+ * - Buffered writes start writeback per buffer (sync_file_range), so
+ *   dirty pages do not pile up into one long stall at close
+ *
+ * Usage:
+ *   AsyncFileWriter writer;
+ *   if (!writer.open(path, size)) ...
+ *   writer.write(data, len);             // or buffer()/commit() to recv in place
+ *   if (!writer.close()) ... writer.error()
+ */
+class AsyncFileWriter {
+private:
+    int fd;
+    bool direct;                        // O_DIRECT currently set on fd
+    uint8_t* buffers[2];                // Page-aligned, BUFFER_SIZE each
+    int fill_index;                     // Buffer the receiver copies into
+    size_t fill_len;                    // Bytes in the fill buffer
+    long written;                       // Bytes handed to the writer so far
+
+    std::thread writer_thread;
+    std::mutex writer_mutex;            // Protects the fields below
+    std::condition_variable writer_cv;
+    uint8_t* pending;                   // Buffer waiting to be written (nullptr = none)
+    size_t pending_len;
+    long pending_offset;
+    bool stopping;
+    std::string failure;                // First write error, empty if none
+
+    /**
+     * @brief Writer thread: writes each handed-off buffer at its offset
+     */
+    void writerLoop();
+
+    /**
+     * @brief pwrite() loop; drops O_DIRECT for unaligned or refused writes
+     */
+    bool writeAt(const uint8_t* data, size_t len, long offset);
+
+    /**
+     * @brief Waits for the writer to go idle, then hands it the fill buffer
+     */
+    bool flushFill();
+
+public:
+    static constexpr size_t BUFFER_SIZE = 2 * 1024 * 1024;  // Per buffer
+    static constexpr size_t ALIGNMENT = 4096;               // O_DIRECT alignment
+
+    AsyncFileWriter();
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    /**
+     * @brief Creates/truncates the file, preallocates it and starts the writer
+     * @param expected_size Final size if known (0 = no preallocation)
+     */
+    bool open(const std::string& path, long expected_size);
+
+    /**
+     * @brief Copies data into the fill buffer, handing full buffers off
+     * @return false once a write has failed
+     */
+    bool write(const void* data, size_t len);
+
+    /**
+     * @brief Free space in the fill buffer, for receiving in place
+     * @param room Set to the number of writable bytes (always > 0)
+     */
+    uint8_t* buffer(size_t& room);
+
+    /**
+     * @brief Marks len bytes written into buffer() as filled
+     * @return false once a write has failed
+     */
+    bool commit(size_t len);
+
+    /**
+     * @brief Writes the tail, waits for the writer and closes the file
+     * @return true if every byte reached the file
+     */
+    bool close();
+
+    /**
+     * @brief Description of the first failure
+     */
+    std::string error();
+};
+
+#endif // ASYNC_FILE_WRITER_HPP
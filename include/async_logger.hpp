@@ -0,0 +1,84 @@
+#ifndef ASYNC_LOGGER_HPP
+#define ASYNC_LOGGER_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class AsyncLogger
+ * @brief Log lines handed off to a background writer thread
+ *
+ * Utils::logEvent() used to open server_log.txt, write one line, flush
+ * and close it, and flush stdout, for every chat message. Here a
+ * logging thread only moves the finished line into its own lock-free
+ * ring (SpscQueue); one writer thread drains all rings, restores the
+ * order the lines were logged in, and appends each batch with a single
+ * write() to the log file (kept open) and one to stdout.
+ *
+ *   thread A: line -> [ring A] \
+ *   thread B: line -> [ring B] --> writer: sort by sequence -> write()
+ *
+ * The writer sleeps while there is nothing to do; a producer wakes it
+ * only when it was idle or its ring is half full, so a burst costs no
+ * syscalls on the logging threads. Lines reach the file within a few milliseconds.
+ *
+ * Memory is bounded: CHAT_LOG_BUFFER_KB (default 4096) caps the bytes
+ * queued across all threads, and each ring holds RING_ENTRIES lines.
+ * When either is full, CHAT_LOG_OVERFLOW picks what happens:
+ *   drop  (default) the line is discarded and counted; the writer
+ *         logs the count (LOG_DROPPED) once it can
+ *   block the logging thread waits for the writer (nothing is lost,
+ *         but a stalled disk then stalls the caller)
+ *
+ * The writer starts on first use, so programs that never log (the
+ * client) never start it. flush() waits until everything logged so far
+ * is written; it also runs at exit. After shutdown() lines are written
+ * synchronously.
+ *
+ * The log file is rotated by size and/or age and old segments are
+ * compressed and pruned in the background (see LogArchiver).
+ */
+class AsyncLogger {
+public:
+    static constexpr size_t RING_ENTRIES = 4096;        // Lines queued per thread
+    static constexpr const char* LOG_FILE = "server_log.txt";
+    static constexpr const char* BINARY_LOG_FILE = "server_log.bin";
+
+    /**
+     * @brief Queues one line (without trailing newline)
+     * @param echo Also write it to stdout
+     */
+    static void write(std::string line, bool echo);
+
+    /**
+     * @brief Queues an encoded BinaryLog record (binary mode)
+     */
+    static void writeRecord(std::string record);
+
+    /**
+     * @brief True when CHAT_LOG_FORMAT=binary: events go to
+     * BINARY_LOG_FILE as BinaryLog records and nothing is echoed
+     */
+    static bool binary();
+
+    /**
+     * @brief Blocks until every line queued before the call is written
+     */
+    static void flush();
+
+    /**
+     * @brief Flushes and stops the writer thread
+     */
+    static void shutdown();
+
+    /**
+     * @brief Lines discarded by the drop policy so far
+     */
+    static uint64_t dropped();
+
+private:
+    static void enqueue(std::string data, bool echo);
+};
+
+#endif // ASYNC_LOGGER_HPP
@@ -0,0 +1,129 @@
+#ifndef BINARY_LOG_HPP
+#define BINARY_LOG_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include "log_events.hpp"
+#include "log_policy.hpp"
+
+/**
+ * @class BinaryLog
+ * @brief Compact binary log format (CHAT_LOG_FORMAT=binary)
+ *
+ * Text logging formats a timestamp and concatenates every argument into
+ * a line for each chat message. In binary mode a record holds only the
+ * event id, a CLOCK_MONOTONIC timestamp and the raw arguments; turning
+ * it into text happens offline in log_decode.
+ *
+ * Every record, little endian:
+ *
+ *   u16 length (of what follows) | u16 event id | u64 monotonic ns |
+ *   u8 argument count | arguments
+ *
+ *   argument: 's' varint length, bytes | 'u' varint | 'i' zigzag varint
+ *   (a redacted content field is 'u' with the text's length)
+ *
+ * A segment (server_log.bin, and each run appending to it) starts with a
+ * header record, event id SEGMENT_HEADER:
+ *
+ *   "CHATLOG1" | u64 wall-clock ns | u64 monotonic ns (same instant) |
+ *   u16 event count | per event: u8 name length, name, u16 format
+ *   length, format
+ *
+ * so timestamps map to wall-clock time and the catalog travels with
+ * the data. Records are at most MAX_RECORD bytes; longer strings are
+ * cut to fit.
+ */
+class BinaryLog {
+public:
+    static constexpr uint16_t SEGMENT_HEADER = 0xFFFF;
+    static constexpr size_t MAX_RECORD = 65535;
+    static constexpr const char* MAGIC = "CHATLOG1";     // 8 bytes, no terminator on disk
+
+    static const char* eventName(LogEvent id);
+    static const char* eventFormat(LogEvent id);
+
+    /**
+     * @brief Header record that opens a segment
+     */
+    static std::string segmentHeader();
+
+    /**
+     * @brief CLOCK_MONOTONIC in nanoseconds
+     */
+    static uint64_t monotonicNanos();
+
+    enum class FieldKind { PLAIN, SIZE, CONTENT };      // "{f}", "{f:size}", "{f:content}"
+
+    /**
+     * @brief Steps over the next placeholder in a format
+     * @param pos In: where to continue; out: just past the placeholder
+     * @param out Literal text before the placeholder is appended here
+     * @param name Field name, if wanted
+     * @param kind Set from the placeholder's spec
+     * @return false when the format ended (rest appended to out)
+     */
+    static bool nextField(const char*& pos, std::string& out, std::string* name, FieldKind& kind);
+
+    /**
+     * @brief Text for a redacted content field
+     */
+    static std::string redacted(uint64_t bytes);
+
+    static void putVarint(std::string& out, uint64_t value);
+
+    /**
+     * @brief Appends the low `bytes` bytes of value, little-endian
+     */
+    static void putLe(std::string& out, uint64_t value, int bytes);
+};
+
+/**
+ * @class LogRecord
+ * @brief Builds one event in the active format and queues it
+ *
+ * Text mode fills in the format as arguments arrive; binary mode
+ * appends them raw. Content fields that LogPolicy redacts are stored as
+ * their length. Used through Utils::logEvent(LogEvent, args...), which
+ * asks LogPolicy::admit() first.
+ */
+class LogRecord {
+private:
+    std::string buffer;
+    bool binary;
+    const char* format;             // Text mode: rest of the format
+    BinaryLog::FieldKind kind;      // Text mode: kind of the next placeholder
+    uint8_t args;                   // Binary mode: arguments written
+    uint8_t field;                  // Index of the next argument
+    uint32_t redact;                // LogPolicy::redactedFields() for this event
+
+    void addText(const std::string& text);
+    bool hasRoom() const;
+    void addUnsigned(uint64_t value);
+    void addSigned(int64_t value);
+
+public:
+    explicit LogRecord(LogEvent id);
+
+    void add(const std::string& value);
+    void add(const char* value);
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type add(T value) {
+        if (std::is_signed<T>::value) {
+            addSigned(static_cast<int64_t>(value));
+        } else {
+            addUnsigned(static_cast<uint64_t>(value));
+        }
+    }
+
+    /**
+     * @brief Hands the record to AsyncLogger
+     * @param echo Text mode: also print it on stdout
+     */
+    void submit(bool echo = true);
+};
+
+#endif // BINARY_LOG_HPP
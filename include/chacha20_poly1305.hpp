@@ -0,0 +1,143 @@
+#ifndef CHACHA20_POLY1305_HPP
+#define CHACHA20_POLY1305_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class ChaCha20
+ * @brief ChaCha20 stream cipher (RFC 8439)
+ *
+ * 256-bit key, 96-bit nonce, 32-bit block counter. The keystream is
+ * XORed into the data, so the same call encrypts and decrypts.
+ *
+ * Bulk data runs through an AVX2 kernel that computes 8 blocks (512
+ * bytes) at once, one 32-bit state word of all 8 blocks per register,
+ * or a 4-block SSE2 kernel on older CPUs; without either the portable
+ * one-block-at-a-time code is used.
+ */
+class ChaCha20 {
+public:
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t NONCE_SIZE = 12;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    /**
+     * @brief XORs the keystream starting at block `counter` into data
+     * @param in Source bytes (may equal out)
+     * @param out Destination bytes
+     * @param len Byte count; a partial last block uses its first bytes
+     */
+    static void xorStream(const uint8_t key[KEY_SIZE], uint32_t counter, const uint8_t nonce[NONCE_SIZE],
+                          const uint8_t* in, uint8_t* out, size_t len);
+
+    /**
+     * @brief Computes one 64-byte keystream block
+     */
+    static void block(const uint8_t key[KEY_SIZE], uint32_t counter, const uint8_t nonce[NONCE_SIZE],
+                      uint8_t out[BLOCK_SIZE]);
+};
+
+/**
+ * @class Poly1305
+ * @brief One-time authenticator (RFC 8439), incremental
+ *
+ * 130-bit arithmetic on three 44/44/42-bit limbs with 128-bit products;
+ * long updates use a 4-way AVX2 kernel with precomputed powers of r.
+ * The key must never be reused; the AEAD derives a fresh one per nonce.
+ */
+class Poly1305 {
+private:
+    uint64_t r[3];                  // Clamped multiplier
+    uint64_t h[3];                  // Accumulator
+    uint64_t pad[2];                // Added at the end (key[16..32])
+    uint8_t buffer[16];             // Partial block
+    size_t leftover;                // Bytes in buffer
+    uint32_t powers[4][5];          // r^4, r^3, r^2, r in 26-bit limbs (vector path)
+    bool powers_ready;
+
+    void blocks(const uint8_t* data, size_t len, uint64_t hibit);
+    void computePowers();
+
+public:
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t TAG_SIZE = 16;
+
+    explicit Poly1305(const uint8_t key[KEY_SIZE]);
+    ~Poly1305();
+
+    void update(const uint8_t* data, size_t len);
+    void finish(uint8_t tag[TAG_SIZE]);
+};
+
+/**
+ * @class ChaCha20Poly1305
+ * @brief Authenticated encryption with associated data (RFC 8439 AEAD)
+ *
+ * Per message: the Poly1305 key is keystream block 0, the data is
+ * encrypted from block 1, and the tag covers
+ *   aad | pad16 | ciphertext | pad16 | le64(aad_len) | le64(ct_len)
+ *
+ * Each (key, nonce) pair must be used for one message only; callers
+ * use a per-direction key with a message counter as the nonce.
+ */
+class ChaCha20Poly1305 {
+public:
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t NONCE_SIZE = 12;
+    static constexpr size_t TAG_SIZE = 16;
+
+    /**
+     * @class Stream
+     * @brief Incremental seal/open of one message
+     *
+     * For messages produced or consumed in pieces (file chunks read
+     * from disk or the socket): call encrypt() or decrypt() any number
+     * of times with any lengths, then finish() or verify(). Each piece
+     * is encrypted and authenticated in cache-sized passes, so data is
+     * touched while still hot in L1.
+     *
+     * Decrypted bytes must not be trusted before verify() succeeds.
+     */
+    class Stream {
+    private:
+        uint8_t key[KEY_SIZE];
+        uint8_t nonce[NONCE_SIZE];
+        uint32_t counter;               // Next keystream block
+        uint8_t keystream[ChaCha20::BLOCK_SIZE];
+        size_t keystream_used;          // Bytes of keystream consumed (64 = none left)
+        Poly1305 mac;
+        uint64_t aad_len;
+        uint64_t data_len;
+
+        void crypt(const uint8_t* in, uint8_t* out, size_t len);
+        void computeTag(uint8_t tag[TAG_SIZE]);
+
+    public:
+        Stream(const uint8_t key[KEY_SIZE], const uint8_t nonce[NONCE_SIZE],
+               const uint8_t* aad, size_t aad_len);
+        ~Stream();
+
+        void encrypt(const uint8_t* in, uint8_t* out, size_t len);
+        void decrypt(const uint8_t* in, uint8_t* out, size_t len);
+        void finish(uint8_t tag[TAG_SIZE]);
+        bool verify(const uint8_t tag[TAG_SIZE]);
+    };
+
+    /**
+     * @brief Encrypts len bytes and produces the tag (in may equal out)
+     */
+    static void seal(const uint8_t key[KEY_SIZE], const uint8_t nonce[NONCE_SIZE],
+                     const uint8_t* aad, size_t aad_len,
+                     const uint8_t* in, size_t len, uint8_t* out, uint8_t tag[TAG_SIZE]);
+
+    /**
+     * @brief Verifies the tag and decrypts (in may equal out)
+     * @return false if the message was forged or corrupted; out is then zeroed
+     */
+    static bool open(const uint8_t key[KEY_SIZE], const uint8_t nonce[NONCE_SIZE],
+                     const uint8_t* aad, size_t aad_len,
+                     const uint8_t* in, size_t len, const uint8_t tag[TAG_SIZE], uint8_t* out);
+};
+
+#endif // CHACHA20_POLY1305_HPP
@@ -0,0 +1,29 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class Checksum
+ * @brief Whole-file CRC32 for chunked transfers
+ *
+ * Same polynomial and conventions as zlib's crc32() (start from 0, feed
+ * the previous result back in), so END frames stay compatible with
+ * peers that still checksum through zlib.
+ *
+ * On CPUs with PCLMULQDQ the data is folded 64 bytes per step with
+ * carry-less multiplies (Intel's "Fast CRC Computation Using PCLMULQDQ"
+ * method) and finished with a Barrett reduction; zlib's table code
+ * handles short inputs and tails.
+ */
+class Checksum {
+public:
+    /**
+     * @brief Extends a CRC32 over len more bytes
+     * @param crc Previous result, or 0 for a new checksum
+     */
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len);
+};
+
+#endif // CHECKSUM_HPP
@@ -8,6 +8,9 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <condition_variable>
+#include <map>
+#include <vector>
+#include "end_to_end.hpp"
 
 /**
  * @class ChatClient
@@ -35,9 +38,16 @@ private:
     std::string username;               // This client's username
     bool connected;                     // Connection state flag
     std::thread* receiver_thread;       // Thread for receiving messages
-    bool file_ready;
+    bool file_ready;                    // Set when a delta signature reply has arrived
     std::mutex file_mutex;
     std::condition_variable file_cv;
+    std::string delta_reply;            // Signature blob from /delta_sig, or "none"
+    EndToEnd e2e;                       // Keys for end-to-end private messages
+    bool e2e_enabled;                   // Key published; @user messages go end-to-end
+    std::map<std::string, std::vector<std::string>> e2e_pending;   // Waiting for a /pubkey reply
+    std::mutex e2e_mutex;               // Protects e2e_pending and key lookups
+    bool trace_enabled;                 // CHAT_TRACE=1: chat carries an id and send time
+    uint64_t next_trace;
     
     /**
      * @brief Establishes TCP connection to the server
@@ -51,6 +61,16 @@ private:
      */
     bool connectToServer();
     
+    /**
+     * @brief Sends the username and sets up the encrypted session
+     * 
+     * Unless CHAT_SESSION_CRYPTO=0, an X25519 key offer rides along with
+     * the username; if the server answers with its own key, all further
+     * traffic on the socket is sealed with ChaCha20-Poly1305. Any other
+     * answer (an error) is left for the receiver thread to print.
+     */
+    void login();
+    
     /**
      * @brief Continuously receives and displays messages from server
      * 
@@ -63,6 +83,7 @@ private:
      * Message types handled:
      * - "/file_offer" -> Prompts user to accept/reject file
      * - "/file_data" -> Receives and saves incoming file
+     * - "/e2e_from", "/pubkey" -> End-to-end private messages and keys
      * - "[FILE]" -> File transfer status updates
      * - "ERROR:" -> Error messages
      * - Plain text -> Regular chat messages
@@ -78,6 +99,75 @@ private:
      */
     void handleFileOffer(const std::string& metadata);
     
+    /**
+     * @brief Builds the local path for an incoming file
+     * @param sender Username of the sender
+     * @param original_filename Filename as sent by the sender
+     * @return Users/<username>/from_<sender>_<timestamp><ext>
+     * 
+     * Creates the Users/<username> directory if needed
+     */
+    std::string prepareDownloadPath(const std::string& sender, const std::string& original_filename);
+    
+    /**
+     * @brief Remembers where a received file was saved
+     * @param original_filename Filename as sent by the sender
+     * @param saved_path Local path the file was written to
+     * 
+     * Appends to Users/<username>/.received_index so later delta
+     * transfers of the same file can find their basis.
+     */
+    void recordReceivedFile(const std::string& original_filename, const std::string& saved_path);
+    
+    /**
+     * @brief Finds the most recent local copy of a received file
+     * @param original_filename Filename as sent by the sender
+     * @return Local path, or empty string if no copy exists
+     */
+    std::string findReceivedFile(const std::string& original_filename);
+    
+    /**
+     * @brief Answers a /delta_offer with block signatures of the local copy
+     * @param sender Username of the sender
+     * @param original_filename Filename being updated
+     */
+    void sendDeltaSignatures(const std::string& sender, const std::string& original_filename);
+    
+    /**
+     * @brief Reads a /delta_sig reply and hands it to the input thread
+     * @param first_chunk Data already received (header line plus blob prefix)
+     */
+    void receiveDeltaReply(const std::string& first_chunk);
+    
+    /**
+     * @brief Sends an @user message end-to-end encrypted
+     * @param target Recipient username
+     * @param text Message text
+     * 
+     * Without the recipient's key yet, the message is queued and the key
+     * is requested with "/pubkey <target>"; the reply flushes the queue.
+     */
+    void sendEndToEnd(const std::string& target, const std::string& text);
+    
+    /**
+     * @brief Handles a "/pubkey <user> [hex [stale]]" reply
+     * @param message Reply from the server
+     */
+    void handlePublicKeyReply(const std::string& message);
+    
+    /**
+     * @brief Opens and prints an "/e2e_from <sender> <body>" message
+     * @param message Message from the server
+     */
+    void showEndToEnd(const std::string& message);
+    
+    /**
+     * @brief Acknowledges a traced "/t <id> <text>" message
+     * @param message Decrypted message from the server
+     * @return The message without its trace header
+     */
+    std::string acknowledgeTrace(const std::string& message);
+    
     /**
      * @brief Sends a message to the server
      * @param message Message string to send
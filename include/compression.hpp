@@ -0,0 +1,68 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class ChunkCodec
+ * @brief Per-chunk transparent compression for file transfers
+ *
+ * Text logs and CSVs compress 5-10x, but images, archives and video
+ * are already compressed and would only waste CPU. Each chunk is
+ * therefore classified before compressing:
+ *
+ * 1. Entropy sampling: a strided sample of the chunk is histogrammed
+ *    and its Shannon entropy computed (bits per byte, 0..8). Chunks
+ *    above ENTROPY_THRESHOLD are sent raw without touching zlib.
+ * 2. Ratio check: if deflate does not save at least MIN_SAVINGS, the
+ *    chunk is sent raw anyway.
+ *
+ * The result is flagged per chunk, so a mixed file (e.g. a tar of
+ * text and JPEGs) compresses only where it pays off.
+ *
+ * Compression uses zlib at a fast level; decompression is cheap and
+ * runs inline on the receiving thread.
+ */
+class ChunkCodec {
+public:
+    static constexpr double ENTROPY_THRESHOLD = 7.2;    // bits/byte above which we skip
+    static constexpr double MIN_SAVINGS = 0.05;         // Require >= 5% smaller output
+    static constexpr size_t SAMPLE_SIZE = 4096;         // Bytes examined per chunk
+    static constexpr int COMPRESSION_LEVEL = 1;         // zlib level (speed over ratio)
+
+    /**
+     * @brief Estimates the entropy of a buffer from a strided sample
+     * @param data Buffer to examine
+     * @param len Buffer length
+     * @return Estimated Shannon entropy in bits per byte (0.0 - 8.0)
+     */
+    static double sampleEntropy(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Compresses a chunk if it is worth it
+     * @param data Raw chunk
+     * @param len Raw length
+     * @param out Receives the compressed bytes when compression pays off
+     * @return true if `out` holds a compressed chunk; false means send raw
+     */
+    static bool compressChunk(const uint8_t* data, size_t len, std::vector<uint8_t>& out);
+
+    /**
+     * @brief Decompresses a chunk produced by compressChunk
+     * @param data Compressed bytes
+     * @param len Compressed length
+     * @param out Destination buffer
+     * @param raw_len Exact expected decompressed length
+     * @return true if the chunk decompressed to exactly raw_len bytes
+     */
+    static bool decompressChunk(const uint8_t* data, size_t len, uint8_t* out, size_t raw_len);
+
+    /**
+     * @brief Upper bound on the compressed size of a chunk
+     */
+    static size_t maxCompressedSize(size_t raw_len);
+};
+
+#endif // COMPRESSION_HPP
@@ -0,0 +1,134 @@
+#ifndef CONNECTION_MONITOR_HPP
+#define CONNECTION_MONITOR_HPP
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+
+/**
+ * @struct TransportStats
+ * @brief One transport sample of a connection
+ *
+ * TCP figures come from TCP_INFO, so they cover everything on the
+ * socket (TLS and record overhead, file data), not just chat.
+ */
+struct TransportStats {
+    int64_t sampled_ns = 0;             // Monotonic time of the sample, 0 = none yet
+    uint32_t rtt_us = 0;                // Smoothed round trip
+    uint32_t rtt_var_us = 0;
+    uint32_t cwnd = 0;                  // Congestion window, segments
+    uint32_t unacked = 0;               // Segments in flight
+    uint32_t retransmits = 0;           // Segments retransmitted, connection lifetime
+    uint32_t segments_out = 0;
+    uint64_t rwnd_limited_us = 0;       // Time the peer's receive window held us back
+    uint64_t bytes_sent = 0;            // Acknowledged by the peer
+    uint64_t bytes_received = 0;
+    uint32_t send_queue = 0;            // Bytes in the kernel send buffer (unsent + unacked)
+    uint32_t chat_queued = 0;           // Chat messages waiting behind a file transfer
+    uint64_t rate = 0;                  // Bytes per second both ways, over the last interval
+    uint8_t flags = 0;                  // ConnectionMonitor::Flag bits
+};
+
+/**
+ * @struct ConnectionRecord
+ * @brief Transport state of one session, shared by its ClientInfo and the monitor
+ *
+ * The monitor holds its own reference, so sampling never needs the
+ * server's client registry lock (which a send to a stalled client can
+ * hold for a long time: exactly when a sample matters most).
+ */
+struct ConnectionRecord {
+    const int socket;
+    const std::string username;
+    std::atomic<uint8_t> flags{0};      // stats.flags, readable without the mutex
+    std::mutex mutex;                   // Protects the fields below
+    TransportStats stats;
+    bool tracked = false;
+
+    ConnectionRecord(int fd, const std::string& name) : socket(fd), username(name) {}
+};
+
+/**
+ * @class ConnectionMonitor
+ * @brief Samples each connection's transport and flags the unhealthy ones
+ *
+ * A thread samples every tracked connection each CHAT_CONN_SAMPLE_MS
+ * (default 1000, 0 = off): one getsockopt(TCP_INFO) and one SIOCOUTQ
+ * ioctl per connection. /conninfo (admins) shows the last sample.
+ *
+ * Flags, recomputed on every sample:
+ *   SLOW    the peer reads too slowly: CHAT_SLOW_QUEUE_KB (default 256)
+ *           or more stuck in the send buffer, or the peer's receive
+ *           window limited sending for over half the interval. This is
+ *           the flag a slow-consumer policy acts on (isSlowConsumer()).
+ *   LAGGING round trip at or above CHAT_SLOW_RTT_MS (default 300)
+ *   LOSSY   over 2% of the interval's segments retransmitted, or in
+ *           loss recovery after a retransmission timeout
+ *   HEAVY   at or above CHAT_HEAVY_KBPS (default 1024) both ways
+ * Changes are logged (CONNECTION_FLAGGED / CONNECTION_RECOVERED) and
+ * counted in the chat_flagged_connections gauge.
+ */
+class ConnectionMonitor {
+public:
+    enum Flag : uint8_t {
+        SLOW = 1,
+        LAGGING = 2,
+        LOSSY = 4,
+        HEAVY = 8,
+    };
+
+    static void configureFromEnvironment();
+
+    /**
+     * @brief Sampling interval in milliseconds, 0 when disabled
+     */
+    static int intervalMs();
+
+    /**
+     * @brief Starts the sampling thread (if the interval is not 0)
+     */
+    static void start();
+
+    static void stop();
+
+    /**
+     * @brief Adds a logged-in session to the sampled set
+     */
+    static void track(const std::shared_ptr<ConnectionRecord>& record);
+
+    /**
+     * @brief Removes a session; its flags no longer count as flagged
+     */
+    static void untrack(const std::shared_ptr<ConnectionRecord>& record);
+
+    static bool isSlowConsumer(const ConnectionRecord& record) {
+        return record.flags.load(std::memory_order_relaxed) & SLOW;
+    }
+
+    /**
+     * @brief Takes a new sample of a socket and recomputes its flags
+     * @param stats Previous sample (for per-interval rates), replaced
+     * @param chat_queued Chat waiting behind a transfer for this socket
+     * @return false if the socket has no TCP_INFO (stats unchanged)
+     */
+    static bool sample(int socket, size_t chat_queued, TransportStats& stats);
+
+    /**
+     * @brief "slow,lossy", or "-" for none
+     */
+    static std::string describeFlags(uint8_t flags);
+
+    /**
+     * @brief Column headings for describe() rows
+     */
+    static std::string header();
+
+    /**
+     * @brief One /conninfo row
+     */
+    static std::string describe(ConnectionRecord& record);
+};
+
+#endif // CONNECTION_MONITOR_HPP
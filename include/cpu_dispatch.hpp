@@ -0,0 +1,188 @@
+#ifndef CPU_DISPATCH_HPP
+#define CPU_DISPATCH_HPP
+
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+/**
+ * @brief Instruction set levels, each implying the ones below it
+ *
+ * SSE42 additionally requires PCLMULQDQ and SSSE3 (every CPU with
+ * PCLMULQDQ has both), AVX512 means F + BW + VL.
+ */
+enum class SimdLevel : int {
+    SCALAR = 0,
+    SSE2 = 1,
+    SSE42 = 2,
+    AVX2 = 3,
+    AVX512 = 4,
+};
+
+/**
+ * @brief One implementation of a kernel and the level it needs
+ */
+template <typename Fn>
+struct KernelVariant {
+    SimdLevel level;
+    const char* name;
+    Fn fn;
+};
+
+/**
+ * @class CpuDispatch
+ * @brief Picks the best implementation of each hot kernel once per process
+ *
+ * Every vectorised kernel keeps a table of variants, scalar first:
+ *
+ *   const KernelVariant<XorKernel> XOR_VARIANTS[] = {
+ *       {SimdLevel::SCALAR, "scalar", xorScalar},
+ *       {SimdLevel::AVX2, "avx2", xorAvx2},
+ *   };
+ *   static const XorKernel kernel = CpuDispatch::select("encryption.xor", XOR_VARIANTS).fn;
+ *
+ * select() returns the highest variant the CPU supports (CPUID, with OS
+ * support for the wider registers) and caches nothing itself; callers
+ * keep the result in a function-local static, so selection happens on
+ * first use and costs one indirect call afterwards.
+ *
+ * CHAT_SIMD_LEVEL=scalar|sse2|sse4.2|avx2|avx512 caps the level, to
+ * reproduce what an older machine runs. It can only lower the level.
+ *
+ * Kernels also register a self-test comparing each variant with the
+ * scalar one on random inputs of many lengths and alignments;
+ * `server --selftest` / `client --selftest` runs them all. Kernels may
+ * register a benchmark the same way; `server --bench` (part of
+ * `make bench`) reports each variant's throughput.
+ */
+class CpuDispatch {
+public:
+    typedef bool (*SelfTest)();
+    typedef void (*Benchmark)();
+
+    /**
+     * @brief Highest level this CPU and OS support
+     */
+    static SimdLevel detected();
+
+    /**
+     * @brief Level kernels are selected for (detected, capped by CHAT_SIMD_LEVEL)
+     */
+    static SimdLevel active();
+
+    static const char* levelName(SimdLevel level);
+
+    /**
+     * @brief Parses "scalar", "sse2", "sse4.2", "avx2" or "avx512"
+     */
+    static bool parseLevel(const std::string& text, SimdLevel& level);
+
+    /**
+     * @brief Best variant for the active level
+     * @param kernel Name recorded for summary()
+     */
+    template <typename Fn, size_t N>
+    static const KernelVariant<Fn>& select(const char* kernel, const KernelVariant<Fn> (&variants)[N]) {
+        size_t best = 0;
+        for (size_t i = 1; i < N; i++) {
+            if (variants[i].level <= active() && variants[i].level >= variants[best].level) {
+                best = i;
+            }
+        }
+        recordSelection(kernel, variants[best].name);
+        return variants[best];
+    }
+
+    /**
+     * @brief Kernels selected so far, e.g. "encryption.xor=avx2 crc32=pclmul"
+     */
+    static std::string summary();
+
+    /**
+     * @brief Adds a kernel's self-test (call from a namespace-scope initializer)
+     */
+    static bool registerSelfTest(const char* kernel, SelfTest test);
+
+    /**
+     * @brief Runs every registered self-test and prints one line per variant
+     * @return true if every variant the CPU supports matched the scalar one
+     */
+    static bool runSelfTests();
+
+    /**
+     * @brief Adds a kernel's benchmark (call from a namespace-scope initializer)
+     */
+    static bool registerBenchmark(const char* kernel, Benchmark benchmark);
+
+    /**
+     * @brief Runs every registered benchmark, one line per variant
+     */
+    static void runBenchmarks();
+
+    /**
+     * @brief Benchmark helper: MB/s of op() handling `bytes` per call
+     *
+     * Best of three runs of at least 50 ms each. Calls are timed in
+     * batches that double up to 64, so slow ops (a legacy baseline on
+     * 1 MB) still finish after a few calls.
+     */
+    template <typename Op>
+    static double throughput(size_t bytes, Op op) {
+        double best = 0.0;
+        for (int run = 0; run < 3; run++) {
+            size_t calls = 0;
+            size_t batch = 1;
+            auto started = std::chrono::steady_clock::now();
+            std::chrono::duration<double> elapsed(0);
+            do {
+                for (size_t i = 0; i < batch; i++) {
+                    op();
+                }
+                calls += batch;
+                batch = std::min<size_t>(batch * 2, 64);
+                elapsed = std::chrono::steady_clock::now() - started;
+            } while (elapsed.count() < 0.05);
+            best = std::max(best, calls * bytes / elapsed.count() / (1024.0 * 1024.0));
+        }
+        return best;
+    }
+
+    /**
+     * @brief Benchmark helper: reports run(variant) for each usable variant, scalar included
+     */
+    template <typename Fn, size_t N, typename Run>
+    static void benchVariants(const char* kernel, const KernelVariant<Fn> (&variants)[N], Run run) {
+        for (size_t i = 0; i < N; i++) {
+            if (variants[i].level > detected()) {
+                report(kernel, variants[i].name, "skipped (not supported by this CPU)");
+                continue;
+            }
+            report(kernel, variants[i].name, run(variants[i].fn).c_str());
+        }
+    }
+
+    /**
+     * @brief Self-test helper: runs check(scalar, variant) for each usable variant
+     */
+    template <typename Fn, size_t N, typename Check>
+    static bool testVariants(const char* kernel, const KernelVariant<Fn> (&variants)[N], Check check) {
+        bool all_ok = true;
+        for (size_t i = 1; i < N; i++) {
+            if (variants[i].level > detected()) {
+                report(kernel, variants[i].name, "skipped (not supported by this CPU)");
+                continue;
+            }
+            bool ok = check(variants[0].fn, variants[i].fn);
+            report(kernel, variants[i].name, ok ? "ok" : "MISMATCH");
+            all_ok = all_ok && ok;
+        }
+        return all_ok;
+    }
+
+private:
+    static void recordSelection(const char* kernel, const char* variant);
+    static void report(const char* kernel, const char* variant, const char* result);
+};
+
+#endif // CPU_DISPATCH_HPP
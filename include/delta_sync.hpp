@@ -0,0 +1,138 @@
+#ifndef DELTA_SYNC_HPP
+#define DELTA_SYNC_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @struct BlockSignature
+ * @brief Checksums of one fixed-size block of the receiver's existing copy
+ */
+struct BlockSignature {
+    uint32_t weak;              // Rolling (Adler-style) checksum
+    uint64_t strong;            // 64-bit hash to confirm weak matches
+};
+
+/**
+ * @struct SignatureSet
+ * @brief All block signatures of a basis file
+ */
+struct SignatureSet {
+    uint32_t block_size;
+    std::vector<BlockSignature> blocks;
+
+    SignatureSet() : block_size(0) {}
+};
+
+/**
+ * @struct DeltaOp
+ * @brief One instruction of a delta stream
+ *
+ * COPY: append `length` consecutive basis blocks starting at block `offset`
+ * LITERAL: append `length` bytes taken from the new file at byte `offset`
+ */
+struct DeltaOp {
+    enum Type : uint8_t { END = 0, COPY = 1, LITERAL = 2 };
+    Type type;
+    uint64_t offset;
+    uint64_t length;
+};
+
+/**
+ * @class DeltaSync
+ * @brief Rsync-style delta encoding for resending updated files
+ *
+ * Algorithm (the rsync algorithm, Tridgell & Mackerras):
+ * ======================================================
+ * 1. Receiver splits its existing copy (the "basis") into blocks and
+ *    sends a weak rolling checksum and a strong hash for each block.
+ * 2. Sender slides a window over its new file one byte at a time.
+ *    The weak checksum is updated in O(1) per byte; only when it hits
+ *    a known block is the strong hash computed to confirm the match.
+ * 3. Sender emits COPY instructions for matched blocks and LITERAL
+ *    data for everything else.
+ * 4. Receiver rebuilds the new file from its basis plus the literals.
+ *
+ * For a small edit to a large file almost every block matches, so the
+ * wire carries a few copy instructions instead of the whole file.
+ *
+ * Wire formats (all integers big-endian):
+ *   Signatures: "DSG1" | u32 block_size | u32 count | count x (u32 weak, u64 strong)
+ *   Delta:      "DLT1" | u32 block_size | u64 body_len | body
+ *   Body ops:   COPY    u8 1 | u32 block | u32 count
+ *               LITERAL u8 2 | u32 len | len bytes
+ *               END     u8 0 | u64 strong hash of the whole new file
+ */
+class DeltaSync {
+public:
+    static constexpr uint32_t MIN_BLOCK_SIZE = 1024;
+    static constexpr uint32_t MAX_BLOCK_SIZE = 64 * 1024;
+    static constexpr size_t SIGNATURE_HEADER_SIZE = 12;
+    static constexpr size_t SIGNATURE_ENTRY_SIZE = 12;
+    static constexpr size_t DELTA_HEADER_SIZE = 16;
+    static constexpr size_t COPY_OP_SIZE = 9;
+    static constexpr size_t LITERAL_OP_HEADER_SIZE = 5;
+    static constexpr size_t END_OP_SIZE = 9;
+    static constexpr uint64_t MAX_LITERAL_RUN = 1024 * 1024;  // Split long literals
+
+    /**
+     * @brief Picks a block size for a basis file (about sqrt(size), clamped)
+     */
+    static uint32_t chooseBlockSize(uint64_t file_size);
+
+    /**
+     * @brief Computes the rolling checksum of a block
+     */
+    static uint32_t weakChecksum(const uint8_t* data, size_t len);
+
+    /**
+     * @brief Slides a weak checksum one byte forward
+     * @param weak Checksum of data[i .. i+len)
+     * @param out Byte leaving the window (data[i])
+     * @param in Byte entering the window (data[i+len])
+     * @param len Window length
+     * @return Checksum of data[i+1 .. i+len+1)
+     */
+    static uint32_t rollChecksum(uint32_t weak, uint8_t out, uint8_t in, size_t len);
+
+    /**
+     * @brief 64-bit hash used to confirm block matches and verify output
+     */
+    static uint64_t strongHash(const uint8_t* data, size_t len, uint64_t seed = 0);
+
+    /**
+     * @brief Computes signatures of a basis file
+     * @param path Path of the basis file (missing file -> empty set)
+     * @return Signature set; empty when there is no usable basis
+     */
+    static SignatureSet computeSignatures(const std::string& path);
+
+    /**
+     * @brief Serializes signatures into the "DSG1" wire format
+     */
+    static std::string serializeSignatures(const SignatureSet& sigs);
+
+    /**
+     * @brief Parses a "DSG1" blob
+     * @return false if the blob is malformed
+     */
+    static bool parseSignatures(const std::string& blob, SignatureSet& sigs);
+
+    /**
+     * @brief Computes the delta that turns the basis into `data`
+     * @param data New file contents
+     * @param size Size of the new file
+     * @param sigs Signatures of the receiver's basis
+     * @return Instruction list (without the END op)
+     */
+    static std::vector<DeltaOp> computeDelta(const uint8_t* data, size_t size, const SignatureSet& sigs);
+
+    /**
+     * @brief Size of the encoded delta body, including the END op
+     */
+    static uint64_t encodedBodySize(const std::vector<DeltaOp>& ops);
+};
+
+#endif // DELTA_SYNC_HPP
@@ -3,6 +3,9 @@
 
 #include <string>
 #include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "text_codec.hpp"
 
 /**
  * @class Encryption
@@ -55,7 +58,7 @@
  * 4. Shows understanding beyond basic networking
  */
 class Encryption {
-private:
+public:
     /**
      * Default encryption key
      * In production, this would be:
@@ -65,7 +68,6 @@ private:
      */
     static constexpr const char* DEFAULT_KEY = "NetworkChat2025!SecureKey#";
     
-public:
     /**
      * @brief Encrypts a message using XOR cipher
      * @param plaintext The message to encrypt
@@ -78,18 +80,10 @@ public:
      * 3. Return encrypted bytes
      * 
      * Note: Output may contain non-printable characters
+     * Copies once, then runs encryptInPlace() on the copy.
      */
-    static std::string encrypt(const std::string& plaintext, const std::string& key = DEFAULT_KEY) {
-        std::string encrypted = plaintext;
-        size_t key_len = key.length();
-        
-        // XOR each character with corresponding key character
-        for (size_t i = 0; i < encrypted.length(); i++) {
-            encrypted[i] = plaintext[i] ^ key[i % key_len];
-        }
-        
-        return encrypted;
-    }
+    static std::string encrypt(const std::string& plaintext, const std::string& key);
+    static std::string encrypt(const std::string& plaintext);
     
     /**
      * @brief Decrypts a message using XOR cipher
@@ -100,9 +94,36 @@ public:
      * Due to XOR properties: decrypt = encrypt
      * XOR is its own inverse operation
      */
-    static std::string decrypt(const std::string& ciphertext, const std::string& key = DEFAULT_KEY) {
-        // XOR cipher is symmetric - decrypt is same as encrypt
-        return encrypt(ciphertext, key);
+    static std::string decrypt(const std::string& ciphertext, const std::string& key);
+    static std::string decrypt(const std::string& ciphertext);
+    
+    /**
+     * @brief Encrypts a buffer in place (no allocation)
+     * @param data Bytes to transform
+     * @param len Number of bytes
+     * @param offset Position of data[0] in the keystream, so a stream can
+     *               be encrypted in pieces; byte i uses key[(offset + i) % key_len]
+     * @param key Encryption key (defaults to DEFAULT_KEY)
+     * 
+     * The key is pre-expanded into a keystream block whose length is a
+     * multiple of both the key length and the vector width, so the inner
+     * loop is a plain load/XOR/store with no per-byte modulo. Uses AVX2
+     * when the CPU has it, SSE2 otherwise, and a scalar loop elsewhere.
+     * 
+     * The key-less overloads (here and for encrypt/decrypt) use the
+     * default key without building a std::string per call.
+     */
+    static void encryptInPlace(uint8_t* data, size_t len, uint64_t offset, const std::string& key);
+    static void encryptInPlace(uint8_t* data, size_t len, uint64_t offset = 0);
+    
+    /**
+     * @brief Decrypts a buffer in place (same operation as encryptInPlace)
+     */
+    static void decryptInPlace(uint8_t* data, size_t len, uint64_t offset, const std::string& key) {
+        encryptInPlace(data, len, offset, key);
+    }
+    static void decryptInPlace(uint8_t* data, size_t len, uint64_t offset = 0) {
+        encryptInPlace(data, len, offset);
     }
     
     /**
@@ -123,37 +144,27 @@ public:
     /**
      * @brief Converts encrypted bytes to hex for safe transmission
      * @param data Binary data
-     * @return Hex-encoded string
+     * @return Hex-encoded string (uppercase)
      * 
      * Useful if encrypted data contains null bytes or control characters
      * that might interfere with string transmission
      */
     static std::string toHex(const std::string& data) {
-        std::string hex;
-        const char hex_chars[] = "0123456789ABCDEF";
-        
-        for (unsigned char c : data) {
-            hex += hex_chars[c >> 4];
-            hex += hex_chars[c & 0x0F];
-        }
-        
+        std::string hex(TextCodec::hexEncodedSize(data.size()), '\0');
+        TextCodec::hexEncode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), &hex[0], true);
         return hex;
     }
     
     /**
      * @brief Converts hex string back to binary data
-     * @param hex Hex-encoded string
-     * @return Original binary data
+     * @param hex Hex-encoded string (either case)
+     * @return Original binary data, or "" if hex is not valid hex
      */
     static std::string fromHex(const std::string& hex) {
-        std::string data;
-        
-        for (size_t i = 0; i < hex.length(); i += 2) {
-            std::string byte_str = hex.substr(i, 2);
-            char byte = static_cast<char>(std::stoi(byte_str, nullptr, 16));
-            data += byte;
+        std::string data(hex.size() / 2, '\0');
+        if (!TextCodec::hexDecode(hex.data(), hex.size(), reinterpret_cast<uint8_t*>(&data[0]))) {
+            return "";
         }
-        
         return data;
     }
 };
@@ -0,0 +1,112 @@
+#ifndef END_TO_END_HPP
+#define END_TO_END_HPP
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include "key_exchange.hpp"
+#include "chacha20_poly1305.hpp"
+
+/**
+ * @class EndToEnd
+ * @brief Private messages sealed between clients; the server only routes
+ *
+ * Each client makes an X25519 key pair at login and publishes the public
+ * half with "/pubkey <64 hex>". A sender looks up the recipient's key
+ * ("/pubkey bob" -> "/pubkey bob <hex>") and sends
+ *
+ *   /e2e <recipient> <key id> <base64 body>
+ *   body = sender_pub (32) | le64 counter | ciphertext | 16-byte tag
+ *
+ * The key id is the first 16 hex digits of the recipient key the body
+ * was sealed for, so the server can spot a stale key without reading the
+ * body. The server rewrites only the header ("/e2e_from <sender> <body>")
+ * and forwards the body bytes untouched - no decryption, re-encryption
+ * or re-encoding on its side.
+ *
+ * Per sender -> recipient direction the key is
+ *   HKDF-SHA256(salt "chat-e2e-v1", X25519 shared secret,
+ *               info = sender_pub | recipient_pub, 32 bytes)
+ * with the counter as nonce and "sender>recipient" as associated data,
+ * so the server can neither read, forge, replay nor re-route a message.
+ * One send counter covers all peers for the life of the key pair, so no
+ * (key, nonce) pair repeats even if a peer's key is swapped and back.
+ * Like the session handshake the key directory is unauthenticated: a
+ * malicious server could hand out its own keys.
+ *
+ * Thread-safe: the input thread seals while the receiver thread opens
+ * and learns keys.
+ */
+class EndToEnd {
+public:
+    static constexpr size_t KEY_ID_SIZE = 16;           // Hex digits of the recipient key
+    static constexpr size_t MAX_MESSAGE = 2048;         // Plaintext bytes per message
+    static constexpr size_t BODY_OVERHEAD = X25519::KEY_SIZE + 8 + ChaCha20Poly1305::TAG_SIZE;
+
+private:
+    /**
+     * @brief Keys for one peer's current public key
+     */
+    struct Peer {
+        std::string key_hex;
+        uint8_t pub[X25519::KEY_SIZE];
+        uint8_t tx_key[ChaCha20Poly1305::KEY_SIZE];    // Us -> peer
+        uint8_t rx_key[ChaCha20Poly1305::KEY_SIZE];    // Peer -> us
+    };
+
+    uint8_t priv[X25519::KEY_SIZE];
+    uint8_t pub[X25519::KEY_SIZE];
+    std::string pub_hex;
+    std::map<std::string, Peer> peers;
+    std::map<std::string, uint64_t> rx_next;           // Lowest counter still accepted, per sender key hex
+    uint64_t tx_counter = 0;                            // Shared by every peer, never restarts
+    std::mutex peers_mutex;
+
+    bool derive(const uint8_t peer_pub[X25519::KEY_SIZE], bool sending, uint8_t key[ChaCha20Poly1305::KEY_SIZE]);
+    bool bindPeer(Peer& peer, const uint8_t peer_pub[X25519::KEY_SIZE]);
+
+public:
+    EndToEnd();
+    ~EndToEnd();
+
+    /**
+     * @brief False when CHAT_E2E=0 (private messages go through the server)
+     */
+    static bool enabled();
+
+    /**
+     * @brief Generates this client's key pair
+     */
+    bool init();
+
+    const std::string& publicKeyHex() const { return pub_hex; }
+
+    /**
+     * @brief Stores a peer's published key (replaces the entry if it changed)
+     * @return false if hex is not a usable key
+     */
+    bool setPeerKey(const std::string& user, const std::string& hex);
+
+    bool hasPeerKey(const std::string& user);
+
+    /**
+     * @brief Builds the "/e2e <to> <key id> <body>" command for text
+     * @return false without a key for `to` or if text exceeds MAX_MESSAGE
+     */
+    bool seal(const std::string& from, const std::string& to, const std::string& text, std::string& command);
+
+    /**
+     * @brief Opens the body of an "/e2e_from" message
+     * @return false if the body is malformed, forged or replayed
+     */
+    bool open(const std::string& from, const std::string& to, const std::string& body, std::string& text);
+
+    /**
+     * @brief Checks the shape of a "/pubkey <hex>" argument
+     */
+    static bool isKeyHex(const std::string& hex);
+};
+
+#endif // END_TO_END_HPP
@@ -2,6 +2,22 @@
 #define FILE_TRANSFER_HPP
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "delta_sync.hpp"
+
+class TransferFlow;
+
+/**
+ * @struct BatchEntry
+ * @brief One file of a batched (directory or glob) transfer
+ */
+struct BatchEntry {
+    std::string path;           // Local path on the sender
+    std::string name;           // Relative name written on the receiver (uses '/')
+    long size;                  // Size in bytes when the batch was collected
+};
 
 /**
  * @class FileTransferHandler
@@ -26,7 +42,8 @@
  *    c. Progress updates sent to both parties
  * 
  * Security Features:
- * - File size limit (10MB) to prevent abuse
+ * - File size limit (10MB) to prevent abuse; in delta mode it bounds
+ *   the delta stream, so a large file with a small change still goes
  * - Filename validation to prevent directory traversal
  * - Transfer confirmation required from recipient
  * 
@@ -38,9 +55,24 @@
 class FileTransferHandler {
 private:
     static constexpr size_t CHUNK_SIZE = 8192;  // 8KB chunks for streaming
-    static constexpr long MAX_FILE_SIZE = 10 * 1024 * 1024;  // 10MB limit
     
 public:
+    static constexpr long MAX_FILE_SIZE = 10 * 1024 * 1024;      // 10MB per relayed file or delta stream
+    static constexpr long MAX_DELTA_FILE_SIZE = 16L * 1024 * 1024 * 1024;  // 16GB target in delta mode
+    static constexpr long MAX_BATCH_SIZE = 100L * 1024 * 1024;   // 100MB per batch stream
+    static constexpr int MAX_BATCH_ENTRIES = 10000;              // Files per batch
+    static constexpr size_t BATCH_ENTRY_HEADER_SIZE = 11;        // u8 type | u16 name_len | u64 size
+    
+    // Chunked transfer framing: u8 flags | u32 raw_len | u32 wire_len, then wire_len bytes
+    static constexpr size_t CHUNKED_BLOCK_SIZE = 128 * 1024;     // Raw bytes per chunk
+    static constexpr size_t CHUNK_HEADER_SIZE = 9;
+    static constexpr uint8_t CHUNK_FLAG_COMPRESSED = 0x01;       // Payload is deflated
+    static constexpr uint8_t CHUNK_FLAG_ENCRYPTED = 0x02;        // Payload is encrypted (after compression)
+    static constexpr uint8_t CHUNK_FLAG_CHECKSUM = 0x04;         // END frame: raw_len holds the file's CRC32
+    static constexpr uint8_t CHUNK_FLAG_CHAT = 0x40;             // Server-inserted chat message
+    static constexpr uint8_t CHUNK_FLAG_END = 0x80;              // Last frame, no payload
+    
+
     /**
      * @brief Receives file data from sender client and forwards to recipient
      * @param sender_socket Socket of the client sending the file
@@ -49,6 +81,7 @@ public:
      * @param recipient_username Name of recipient (for progress messages)
      * @param filename Name of the file being transferred
      * @param file_size Total size of the file in bytes
+     * @param flow Bandwidth shaping for the relay (nullptr = unshaped)
      * @return true if transfer successful, false on error
      * 
      * This is the core of the improved file transfer:
@@ -60,7 +93,8 @@ public:
     static bool streamFileData(int sender_socket, int recipient_socket,
                               const std::string& sender_username,
                               const std::string& recipient_username,
-                              const std::string& filename, long file_size);
+                              const std::string& filename, long file_size,
+                              TransferFlow* flow = nullptr);
     
     /**
      * @brief Client-side: Sends local file to server
@@ -69,8 +103,8 @@ public:
      * @param file_size Size of the file (pre-calculated)
      * @return true if sent successfully, false on error
      * 
-     * Reads local file and streams it to server in chunks
-     * Used by sender client after file offer is accepted
+     * Streams the file to the server with sendfile() (raw bytes, no
+     * user-space copy). Used for the raw fallback of delta mode.
      */
     static bool sendFileToServer(int server_socket, const std::string& filename, long file_size);
     
@@ -89,6 +123,171 @@ public:
     static bool receiveFileFromServer(int server_socket, const std::string& sender,
                                      const std::string& filename, long file_size);
     
+    /**
+     * @brief Server-side: Receives an upload into a spool file
+     * @param sender_socket Socket of the client sending the file
+     * @param spool_path Path of the spool file to create
+     * @param file_size Total size of the file in bytes
+     * @param chunked true if the upload uses chunked framing
+     * @return true if the full payload was written to disk
+     * 
+     * Used when the recipient is offline. Chunked uploads are stored
+     * framed, exactly as they will be sent to the recipient. Streams through a single
+     * CHUNK_SIZE buffer, so memory use does not depend on file size.
+     */
+    static bool spoolFileData(int sender_socket, const std::string& spool_path, long file_size,
+                              bool chunked = false);
+    
+    /**
+     * @brief Server-side: Streams a spooled file to a recipient
+     * @param recipient_socket Socket of the client receiving the file
+     * @param spool_path Path of the spooled payload
+     * @param file_size Size of the payload in bytes
+     * @param flow Bandwidth shaping for the delivery (nullptr = unshaped)
+     * @param chunked true if the payload holds chunk frames
+     * @return true if the whole file was sent
+     * 
+     * Chunked payloads are replayed frame by frame, so an interleaving
+     * flow inserts chat frames only between them.
+     */
+    static bool sendSpooledFile(int recipient_socket, const std::string& spool_path, long file_size,
+                                TransferFlow* flow = nullptr, bool chunked = false);
+    
+    /**
+     * @brief Server-side: Reads and drops an upload that cannot be accepted
+     * @param sender_socket Socket of the client sending the file
+     * @param file_size Number of bytes to discard
+     * 
+     * The sender streams file data right after /sendfile regardless of
+     * the server's answer; draining keeps those bytes from being parsed
+     * as chat messages.
+     */
+    static void discardFileData(int sender_socket, long file_size);
+    
+    /**
+     * @brief Client-side: Sends a local file as compressed-where-useful chunks
+     * @param server_socket Socket connection to server
+     * @param filename Path to local file to send
+     * @param file_size Size of the file (pre-calculated)
+     * @return true if sent successfully, false on error
+     * 
+     * Runs as a read -> hash -> compress/encrypt -> send pipeline with
+     * one thread per stage (see UploadPipeline), so disk, CPU and socket
+     * work overlap. Each frame carries CHUNK_FLAG_COMPRESSED when deflate
+     * paid off; the END frame carries the file's CRC32.
+     */
+    static bool sendFileChunked(int server_socket, const std::string& filename, long file_size);
+    
+    /**
+     * @brief Server-side: Relays a chunked stream to a socket or file
+     * @param sender_socket Socket of the client sending the file
+     * @param out_fd Destination (recipient socket or spool file; -1 drains)
+     * @param out_is_socket true to write with send(), false for write()
+     * @param file_size Announced raw size (bounds the stream)
+     * @param flow Bandwidth shaping; also inserts chat frames between chunks
+     * @return true if the stream ended with a valid END frame
+     *         and every frame was written
+     * 
+     * Frames are forwarded as-is; the server never decompresses. After
+     * a write error on a file the rest of the stream is drained.
+     */
+    static bool relayChunkedStream(int sender_socket, int out_fd, bool out_is_socket, long file_size,
+                                   TransferFlow* flow = nullptr);
+    
+    /**
+     * @brief Client-side: Receives a chunked stream and saves it locally
+     * @param server_socket Socket connection to server
+     * @param sender Username of the sender (for display)
+     * @param filename Output path
+     * @param file_size Expected raw file size in bytes
+     * @param on_chat Called with chat messages interleaved into the stream
+     * @return true if the file was received and decompressed completely
+     */
+    static bool receiveChunkedFile(int server_socket, const std::string& sender,
+                                  const std::string& filename, long file_size,
+                                  const std::function<void(const std::string&)>& on_chat = nullptr);
+    
+    /**
+     * @brief Client-side: Sends an rsync-style delta of a local file
+     * @param server_socket Socket connection to server
+     * @param filepath Path to the new version of the file
+     * @param sigs Block signatures of the recipient's existing copy
+     * @return true if the delta stream was sent completely
+     * 
+     * Streams a "DLT1" header followed by COPY/LITERAL instructions.
+     * Literal bytes are sent straight from a read-only mapping of the file.
+     * A delta over MAX_FILE_SIZE is not sent: the header carries body
+     * length 0, which the server reads as a cancelled transfer.
+     */
+    static bool sendDeltaToServer(int server_socket, const std::string& filepath, const SignatureSet& sigs);
+    
+    /**
+     * @brief Server-side: Reads and validates the header of a delta stream
+     * @param sender_socket Socket of the client sending the delta
+     * @param file_size Size of the new file (bounds the body length)
+     * @param header Receives the raw 16-byte header for forwarding
+     * @param body_len Receives the length of the delta body
+     * @return true if the header is well-formed and the body is at most
+     *         MAX_FILE_SIZE (false, with nothing to drain, for length 0)
+     */
+    static bool receiveDeltaHeader(int sender_socket, long file_size, std::string& header, long& body_len);
+    
+    /**
+     * @brief Client-side: Rebuilds a file from a delta stream
+     * @param server_socket Socket connection to server
+     * @param sender Username of the sender (for display)
+     * @param basis_path Existing copy the delta refers to
+     * @param filename Output path for the rebuilt file
+     * @param file_size Expected size of the rebuilt file
+     * @return true if the file was rebuilt and its hash verified
+     */
+    static bool receiveDeltaFromServer(int server_socket, const std::string& sender,
+                                      const std::string& basis_path,
+                                      const std::string& filename, long file_size);
+    
+    /**
+     * @brief Client-side: Expands a directory or glob into batch entries
+     * @param spec Directory path or glob pattern (e.g. "logs", "*.csv")
+     * @param entries Receives every regular file found, recursively
+     * @param label Receives a short name for the batch (used in the save path)
+     * @return true if at least one file was found and limits are respected
+     */
+    static bool collectBatch(const std::string& spec, std::vector<BatchEntry>& entries, std::string& label);
+    
+    /**
+     * @brief Total bytes of the batch stream for the given entries
+     */
+    static long batchStreamSize(const std::vector<BatchEntry>& entries);
+    
+    /**
+     * @brief Client-side: Streams every batch entry as one framed transfer
+     * @param server_socket Socket connection to server
+     * @param entries Files to send (from collectBatch)
+     * @return true if the whole stream was sent
+     * 
+     * Stream format (big-endian):
+     *   per entry: u8 1 | u16 name_len | u64 size | name | data
+     *   end:       u8 0
+     * Small files are packed into one staging buffer so thousands of
+     * them cost a handful of send() calls; large files go out via sendfile().
+     */
+    static bool sendBatchToServer(int server_socket, const std::vector<BatchEntry>& entries);
+    
+    /**
+     * @brief Client-side: Receives a batch stream and writes each entry
+     * @param server_socket Socket connection to server
+     * @param sender Username of the sender (for display)
+     * @param dest_dir Directory the entries are written under
+     * @param entry_count Number of entries announced by the sender
+     * @param total_size Total length of the batch stream
+     * @return true if every entry was written
+     * 
+     * Entry names are validated: absolute paths and ".." components are
+     * rejected so a batch can never write outside dest_dir.
+     */
+    static bool receiveBatchFromServer(int server_socket, const std::string& sender,
+                                      const std::string& dest_dir, int entry_count, long total_size);
+    
     /**
      * @brief Validates if a file is safe to transfer
      * @param filepath Path to the file
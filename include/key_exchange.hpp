@@ -0,0 +1,90 @@
+#ifndef KEY_EXCHANGE_HPP
+#define KEY_EXCHANGE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class Sha256
+ * @brief SHA-256 (FIPS 180-4), incremental
+ */
+class Sha256 {
+private:
+    uint32_t state[8];
+    uint64_t total;                 // Bytes absorbed
+    uint8_t buffer[64];             // Partial block
+    size_t buffered;
+
+    void compress(const uint8_t block[64]);
+
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    Sha256();
+
+    void update(const uint8_t* data, size_t len);
+    void finish(uint8_t digest[DIGEST_SIZE]);
+
+    static void hash(const uint8_t* data, size_t len, uint8_t digest[DIGEST_SIZE]);
+};
+
+/**
+ * @class X25519
+ * @brief Elliptic-curve Diffie-Hellman on Curve25519 (RFC 7748)
+ *
+ * Field elements are five 51-bit limbs with 128-bit products; the
+ * Montgomery ladder runs in constant time (conditional swaps, no
+ * secret-dependent branches or indices).
+ */
+class X25519 {
+public:
+    static constexpr size_t KEY_SIZE = 32;
+
+    /**
+     * @brief out = scalar * u (scalar is clamped, u's top bit ignored)
+     */
+    static void scalarMult(uint8_t out[KEY_SIZE], const uint8_t scalar[KEY_SIZE], const uint8_t u[KEY_SIZE]);
+
+    /**
+     * @brief Public key for a private key (scalar * base point 9)
+     */
+    static void publicKey(uint8_t pub[KEY_SIZE], const uint8_t priv[KEY_SIZE]);
+
+    /**
+     * @brief Shared secret with a peer's public key
+     * @return false if the result is all zero (peer sent a low-order point)
+     */
+    static bool sharedSecret(uint8_t shared[KEY_SIZE], const uint8_t priv[KEY_SIZE], const uint8_t peer[KEY_SIZE]);
+};
+
+/**
+ * @class KeyExchange
+ * @brief Randomness and key derivation around X25519
+ */
+class KeyExchange {
+public:
+    /**
+     * @brief Fills buf from the kernel CSPRNG (getrandom)
+     */
+    static bool randomBytes(uint8_t* buf, size_t len);
+
+    /**
+     * @brief Generates a private key and its public key
+     */
+    static bool generateKeyPair(uint8_t priv[X25519::KEY_SIZE], uint8_t pub[X25519::KEY_SIZE]);
+
+    /**
+     * @brief HMAC-SHA256 (RFC 2104)
+     */
+    static void hmacSha256(const uint8_t* key, size_t key_len, const uint8_t* data, size_t len,
+                           uint8_t mac[Sha256::DIGEST_SIZE]);
+
+    /**
+     * @brief HKDF-SHA256 extract + expand (RFC 5869), out_len <= 255 * 32
+     */
+    static void hkdf(const uint8_t* salt, size_t salt_len, const uint8_t* ikm, size_t ikm_len,
+                     const uint8_t* info, size_t info_len, uint8_t* out, size_t out_len);
+};
+
+#endif // KEY_EXCHANGE_HPP
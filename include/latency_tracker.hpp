@@ -0,0 +1,124 @@
+#ifndef LATENCY_TRACKER_HPP
+#define LATENCY_TRACKER_HPP
+
+#include <string>
+#include <cstdint>
+
+/**
+ * @class LatencyTracker
+ * @brief Delivery latency of traced chat messages, per hop and per room
+ *
+ * A client started with CHAT_TRACE=1 sends chat as
+ *   "/t <trace id> <monotonic send ns> <text>"
+ * The server strips the header, routes the text as usual and forwards
+ * it to each recipient as "/t <server id> <text>". Recipients strip it,
+ * show the text and answer "/ack <server id> <monotonic receive ns>".
+ * Untraced messages are untouched, so old clients only ever see the
+ * header on messages from a traced sender.
+ *
+ * Hops, into the Metrics histograms:
+ *   recv -> route    read off the socket until the route is known
+ *   route -> enqueue routing until one recipient's send starts
+ *   enqueue -> write that send (to the socket, or to the frame queue
+ *                    of a recipient receiving a file)
+ *   end to end       sender's send until the recipient has the text
+ *
+ * End to end uses the two client timestamps when both clocks are
+ * clearly the server's CLOCK_MONOTONIC (clients on the server host).
+ * Otherwise client clocks are unrelated, and it is estimated from the
+ * server's view: ack arrival - receive, plus half the sender's and
+ * minus half the recipient's smoothed TCP round trip.
+ *
+ * End-to-end latency is also kept per room ("lobby", room name, or
+ * "private") for p50/p99/p99.9 in /latency and on the metrics endpoint.
+ *
+ * Work happens only for traced messages; for the rest every hook is a
+ * thread-local pointer test.
+ */
+class LatencyTracker {
+public:
+    static constexpr int64_t PENDING_TIMEOUT_NS = 10000000000LL;   // Unacked traces are dropped
+    static constexpr int64_t SAME_CLOCK_WINDOW_NS = 1000000000LL;  // Client stamps this close are ours
+    static constexpr size_t MAX_PENDING = 4096;
+    static constexpr size_t MAX_ROOMS = 256;                       // Further rooms report as "other"
+
+    /**
+     * @brief One message on its handler thread, from recv to routed
+     *
+     * If traced, route() and delivered() on this thread apply to it while
+     * it is alive; otherwise it does nothing.
+     */
+    class Scope {
+    public:
+        Scope(bool traced, int sender_socket, int64_t sent_ns, int64_t received_ns);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        friend class LatencyTracker;
+        int sender_socket;
+        int64_t sent_ns;                // Sender's clock
+        int64_t received_ns;            // Server clock, off the socket
+        int64_t routed_ns = 0;
+        uint64_t id = 0;                // Set by route()
+    };
+
+    static int64_t now();
+
+    /**
+     * @brief Strips a "/t <trace> <ns> " header
+     * @return false (message untouched) if there is none
+     */
+    static bool parseTraced(std::string& message, int64_t& sent_ns);
+
+    /**
+     * @brief Route decided: starts waiting for acks
+     * @return Header to put before the recipients' text, "" if not traced
+     */
+    static std::string route(const std::string& room) {
+        return current ? startRoute(room) : std::string();
+    }
+
+    /**
+     * @brief One recipient's send is starting; its ack is awaited from now
+     * @return Start time for delivered() (0 if not traced)
+     */
+    static int64_t startDelivery(int recipient_socket) {
+        return current ? awaitAck(recipient_socket) : 0;
+    }
+
+    /**
+     * @brief That send, started at enqueued_ns, has returned
+     */
+    static void delivered(int64_t enqueued_ns) {
+        if (current) {
+            finishDelivery(enqueued_ns);
+        }
+    }
+
+    /**
+     * @brief Handles "<id> <ns>" from a recipient's "/ack"
+     */
+    static void acknowledge(const std::string& arguments, int recipient_socket, int64_t arrived_ns);
+
+    /**
+     * @brief Hop and per-room percentiles for /latency
+     */
+    static std::string describe();
+
+    /**
+     * @brief Per-room quantiles in the Prometheus text format
+     */
+    static void appendPrometheus(std::string& out);
+
+private:
+    static thread_local Scope* current;
+
+    static std::string startRoute(const std::string& room);
+    static int64_t awaitAck(int recipient_socket);
+    static void finishDelivery(int64_t enqueued_ns);
+};
+
+#endif // LATENCY_TRACKER_HPP
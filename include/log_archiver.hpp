@@ -0,0 +1,61 @@
+#ifndef LOG_ARCHIVER_HPP
+#define LOG_ARCHIVER_HPP
+
+#include <string>
+#include <cstddef>
+
+/**
+ * @class LogArchiver
+ * @brief Compresses and prunes rotated log segments in the background
+ *
+ * AsyncLogger's writer rotates the active log (server_log.txt or
+ * server_log.bin) once it reaches CHAT_LOG_ROTATE_KB (default 65536) or
+ * is CHAT_LOG_ROTATE_SECONDS old (default 0 = no time limit). Rotating
+ * is a rename() and an open() between two batches; queued lines simply
+ * land in the new file, so nothing waits and nothing is dropped.
+ *
+ * The rotated segment is named after the moment it was closed,
+ *
+ *   server_log.20261017-031601-123.txt
+ *
+ * so names sort in time order, and handed to this class. Its thread
+ * runs at idle CPU and I/O priority, gzips the segment (".gz", then the
+ * original is removed) and keeps the newest CHAT_LOG_KEEP segments
+ * (default 10, 0 = all). CHAT_LOG_COMPRESS=0 skips compression.
+ *
+ * Segments left behind by a crash or an exit during compression are
+ * picked up on the next start. Binary segments each begin with their own
+ * header, so "./log_decode server_log.*.bin.gz server_log.bin" reads the
+ * whole history in order.
+ */
+class LogArchiver {
+public:
+    static constexpr size_t DEFAULT_KEEP = 10;
+    static constexpr int COMPRESSION_LEVEL = 6;         // Off the hot path: ratio over speed
+
+    /**
+     * @brief Starts the archiver thread for the log at active_path
+     *
+     * Also queues any rotated segments still uncompressed.
+     */
+    static void start(const std::string& active_path);
+
+    /**
+     * @brief Unused name for the segment being closed now
+     */
+    static std::string rotatedName(const std::string& active_path);
+
+    /**
+     * @brief Queues a rotated segment for compression and pruning
+     *
+     * Never blocks on the archiver's work.
+     */
+    static void archive(const std::string& segment);
+
+    /**
+     * @brief Stops the thread; an unfinished segment is redone next start
+     */
+    static void stop();
+};
+
+#endif // LOG_ARCHIVER_HPP
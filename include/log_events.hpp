@@ -0,0 +1,73 @@
+#ifndef LOG_EVENTS_HPP
+#define LOG_EVENTS_HPP
+
+#include <cstdint>
+
+/**
+ * Severity, most to least important; a category set to OFF logs nothing
+ */
+enum class LogLevel : uint8_t { OFF, ERROR, WARN, INFO, DEBUG };
+
+enum class LogCategory : uint8_t { SERVER, CONNECTION, CHAT, TRANSFER, COUNT };
+
+/**
+ * Catalog of log events: X(ID, category, level, format)
+ *
+ * Placeholders "{field}" take the event's arguments in order; the field
+ * names become JSON keys in log_decode. "{field:size}" renders an
+ * integer as a file size ("1.5 MB"); "{field:content}" marks message
+ * text, which is logged as "<N bytes>" when content logging is off.
+ *
+ * Binary segments carry a copy of the catalog, so old logs decode with
+ * the formats they were written with. Add new events at the end.
+ */
+#define CHAT_LOG_EVENTS(X)                                                                          \
+    X(TEXT,                  SERVER,     INFO,  "{text}")                                            \
+    X(SERVER_STARTED,        SERVER,     INFO,  "Server started on port {port}")                     \
+    X(SERVER_STOPPED,        SERVER,     INFO,  "Server stopped")                                    \
+    X(SERVER_STOPPING,       SERVER,     INFO,  "Server stopping ({signal})")                        \
+    X(CONNECTION_NEW,        CONNECTION, INFO,  "New connection from {ip}")                          \
+    X(CONNECTION_CLOSED,     CONNECTION, INFO,  "Connection closed for {user}")                      \
+    X(TLS_FAILED,            CONNECTION, WARN,  "TLS handshake failed from {ip}")                    \
+    X(TLS_ACCEPTED,          CONNECTION, INFO,  "TLS from {ip}: {cipher}")                           \
+    X(USERNAME_INVALID,      CONNECTION, WARN,  "Rejected invalid username from {ip}")               \
+    X(USERNAME_DUPLICATE,    CONNECTION, WARN,  "Duplicate username attempt: {user}")                \
+    X(KEY_EXCHANGE_REJECTED, CONNECTION, WARN,  "Rejected key exchange from {user}")                 \
+    X(KEY_EXCHANGE_FAILED,   CONNECTION, WARN,  "Key exchange failed for {user}")                    \
+    X(USER_AUTHENTICATED,    CONNECTION, INFO,  "User authenticated: {user}{session}")               \
+    X(USER_REGISTERED,       CONNECTION, INFO,  "Registered user: {user} (Total: {total})")          \
+    X(USER_DEREGISTERED,     CONNECTION, INFO,  "Deregistered user: {user} (Remaining: {remaining})") \
+    X(CHAT_MESSAGE,          CHAT,       INFO,  "[{user}] {message:content}")                        \
+    X(COMMAND_REPLY,         CHAT,       INFO,  "[{user}] {reply:content}")                          \
+    X(BROADCAST,             CHAT,       DEBUG, "Broadcast: {message:content}")                      \
+    X(PRIVATE_MESSAGE,       CHAT,       INFO,  "Private message: {from} -> {to}")                   \
+    X(PRIVATE_INVALID,       CHAT,       WARN,  "Failed private message to invalid user: {to}")      \
+    X(E2E_MESSAGE,           CHAT,       INFO,  "E2E message: {from} -> {to} ({bytes} bytes)")       \
+    X(E2E_UNDELIVERED,       CHAT,       WARN,  "Undelivered E2E message: {from} -> {to}")           \
+    X(FILE_DONE,             TRANSFER,   INFO,  "File transfer completed: {from} -> {to} ({file})")  \
+    X(FILE_FAILED,           TRANSFER,   WARN,  "File transfer failed: {from} -> {to}")              \
+    X(DELTA_TIMEOUT,         TRANSFER,   WARN,  "Delta signatures timed out: {from} -> {to}")        \
+    X(DELTA_DONE,            TRANSFER,   INFO,  "Delta transfer completed: {from} -> {to} ({file}, {sent}/{size} bytes)") \
+    X(DELTA_FAILED,          TRANSFER,   WARN,  "Delta transfer failed: {from} -> {to}")             \
+    X(TRANSFER_FINISHED,     TRANSFER,   INFO,  "Transfer finished: {transfer}, {bytes:size} at {rate:size}/s") \
+    X(SPOOL_STORED,          TRANSFER,   INFO,  "File spooled: {from} -> {to} ({file})")             \
+    X(SPOOL_FAILED,          TRANSFER,   WARN,  "File spool failed: {from} -> {to}")                 \
+    X(SPOOL_REJECTED,        TRANSFER,   WARN,  "File spool rejected: {from} -> {to}: {reason}")     \
+    X(SPOOL_DELIVERED,       TRANSFER,   INFO,  "Spool delivered: {from} -> {to} ({file})")          \
+    X(SPOOL_DELIVERY_FAILED, TRANSFER,   WARN,  "Spool delivery failed: {from} -> {to} ({file})")    \
+    X(SPOOL_EXPIRED,         TRANSFER,   INFO,  "Spool: expired {file} for {user}")                  \
+    X(LOG_DROPPED,           SERVER,     WARN,  "Logger: dropped {count} events (buffer full)")      \
+    X(LOG_SUPPRESSED,        SERVER,     WARN,  "Logger: suppressed {count} {event} events (rate limit)") \
+    X(LOG_SETTINGS,          SERVER,     INFO,  "Log settings changed by {user}: {settings}")         \
+    X(CONNECTION_FLAGGED,    CONNECTION, WARN,  "Connection of {user} flagged {flags} (rtt {rtt_us} us, send queue {queue:size})") \
+    X(CONNECTION_RECOVERED,  CONNECTION, INFO,  "Connection of {user} no longer flagged")            \
+    X(TRACE_SAMPLING,        SERVER,     INFO,  "Trace sampling set to {rate} by {user}")
+
+enum class LogEvent : uint16_t {
+#define CHAT_LOG_EVENT_ID(id, category, level, format) id,
+    CHAT_LOG_EVENTS(CHAT_LOG_EVENT_ID)
+#undef CHAT_LOG_EVENT_ID
+    COUNT
+};
+
+#endif // LOG_EVENTS_HPP
@@ -0,0 +1,62 @@
+#ifndef LOG_POLICY_HPP
+#define LOG_POLICY_HPP
+
+#include <string>
+#include <cstdint>
+#include "log_events.hpp"
+
+/**
+ * @class LogPolicy
+ * @brief Which events get logged, how often, and with how much content
+ *
+ * Every event has a category and a level (log_events.hpp). An event is
+ * logged when its level is at or above its category's threshold, so
+ * "chat=warn" keeps undelivered messages but drops the per-message
+ * lines. By default every category logs INFO and up (BROADCAST, which
+ * repeats each chat line, is DEBUG).
+ *
+ * Rate limit: with rate=N, each CHAT event type logs at most N times per
+ * second; the rest are counted and reported as one LOG_SUPPRESSED line
+ * when that event is next logged.
+ *
+ * Content: content=off logs message text ("{field:content}" fields) as
+ * "<N bytes>" instead, keeping who/when/how much.
+ *
+ * Checks are a few relaxed atomic loads, made before anything is
+ * formatted, and every setting can change while the server runs.
+ *
+ * Settings are space- or comma-separated words:
+ *   <level>             all categories (off, error, warn, info, debug)
+ *   <category>=<level>  one of server, connection, chat, transfer
+ *   rate=<N>            per-second limit for chat events (0 = none)
+ *   content=on|off
+ * Read at startup from CHAT_LOG_LEVEL, CHAT_LOG_RATE and
+ * CHAT_LOG_CONTENT; changed at runtime by admins with "/log <settings>".
+ */
+class LogPolicy {
+public:
+    /**
+     * @brief Level and rate check for one event about to be logged
+     */
+    static bool admit(LogEvent id);
+
+    /**
+     * @brief Bit i set: argument i is message content to be redacted now
+     */
+    static uint32_t redactedFields(LogEvent id);
+
+    /**
+     * @brief Applies settings (see class comment)
+     * @param error Set to the offending word on failure; nothing changes then
+     */
+    static bool configure(const std::string& settings, std::string& error);
+
+    static void configureFromEnvironment();
+
+    /**
+     * @brief Current settings, in the form configure() accepts
+     */
+    static std::string describe();
+};
+
+#endif // LOG_POLICY_HPP
@@ -0,0 +1,176 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Catalog of metrics: X(ID, "name", "help")
+ *
+ * Names follow Prometheus conventions. Durations are recorded in
+ * nanoseconds (histograms ending in "_seconds" are scaled on export).
+ * Gauges are up/down counters: the value is the sum of every change.
+ */
+#define CHAT_METRIC_COUNTERS(X)                                                              \
+    X(CONNECTIONS,        "chat_connections_total",        "Clients that completed login")   \
+    X(MESSAGES_IN,        "chat_messages_received_total",  "Chat lines and commands received") \
+    X(BYTES_IN,           "chat_received_bytes_total",     "Bytes of chat lines and commands received") \
+    X(MESSAGES_OUT,       "chat_messages_sent_total",      "Chat messages delivered to recipients") \
+    X(BYTES_OUT,          "chat_sent_bytes_total",         "Bytes of chat delivered to recipients") \
+    X(BROADCASTS,         "chat_broadcasts_total",         "Lobby and room broadcasts")      \
+    X(TRANSFERS,          "chat_transfers_total",          "Relayed file transfers finished") \
+    X(TRANSFER_BYTES,     "chat_transfer_bytes_total",     "Bytes of relayed file data") \
+    X(DELIVERIES_UNACKED, "chat_delivery_unacked_total",   "Traced deliveries never acknowledged")
+
+#define CHAT_METRIC_GAUGES(X)                                                                \
+    X(ACTIVE_CONNECTIONS, "chat_active_connections",       "Logged-in clients")              \
+    X(ACTIVE_TRANSFERS,   "chat_active_transfers",         "Relayed transfers in progress")  \
+    X(CHAT_QUEUED,        "chat_queued_messages",          "Chat messages waiting behind a transfer for a frame boundary") \
+    X(LOG_QUEUED_BYTES,   "chat_log_queued_bytes",         "Log bytes waiting for the writer thread") \
+    X(FLAGGED_CONNECTIONS, "chat_flagged_connections",     "Connections flagged slow, lagging, lossy or heavy")
+
+#define CHAT_METRIC_HISTOGRAMS(X)                                                            \
+    X(MESSAGE_SIZE,       "chat_message_size_bytes",       "Size of received chat lines and commands") \
+    X(FANOUT_WIDTH,       "chat_fanout_recipients",        "Recipients per broadcast")       \
+    X(BROADCAST_TIME,     "chat_broadcast_duration_seconds", "Time to encrypt and send one broadcast") \
+    X(TRANSFER_RATE,      "chat_transfer_rate_bytes_per_second", "Average rate of each finished transfer") \
+    X(DELIVERY_ROUTE,     "chat_delivery_route_seconds",   "Traced messages: received until routed") \
+    X(DELIVERY_ENQUEUE,   "chat_delivery_enqueue_seconds", "Traced messages: routed until a recipient's send starts") \
+    X(DELIVERY_WRITE,     "chat_delivery_write_seconds",   "Traced messages: one recipient's send") \
+    X(DELIVERY_LATENCY,   "chat_delivery_latency_seconds", "Traced messages: sender to recipient")
+
+#define CHAT_METRIC_ID(id, name, help) id,
+enum class Counter : uint8_t { CHAT_METRIC_COUNTERS(CHAT_METRIC_ID) COUNT };
+enum class Gauge : uint8_t { CHAT_METRIC_GAUGES(CHAT_METRIC_ID) COUNT };
+enum class Histogram : uint8_t { CHAT_METRIC_HISTOGRAMS(CHAT_METRIC_ID) COUNT };
+#undef CHAT_METRIC_ID
+
+/**
+ * @class Metrics
+ * @brief In-process counters, gauges and latency histograms
+ *
+ * Every thread updates its own shard, so an update is a plain load and
+ * store on a cache line no other thread writes: no lock, no atomic
+ * read-modify-write, a few nanoseconds. snapshot() sums all shards
+ * under the registry mutex, which updates only take when a thread
+ * makes its first update or exits (its totals are then folded into
+ * the registry).
+ *
+ * Histograms are log-linear, as in HDR histograms: values below
+ * SUB_BUCKETS are exact, above that each power of two is split into
+ * SUB_BUCKETS buckets, so any percentile is within 12.5% of the true
+ * value. Values of 2^MAX_EXPONENT and more share the last bucket.
+ */
+class Metrics {
+public:
+    static constexpr unsigned SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BITS;
+    static constexpr unsigned MAX_EXPONENT = 44;        // 2^44 ns is about 5 hours
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUB_BUCKETS;
+
+    static constexpr size_t COUNTERS = static_cast<size_t>(Counter::COUNT);
+    static constexpr size_t GAUGES = static_cast<size_t>(Gauge::COUNT);
+    static constexpr size_t HISTOGRAMS = static_cast<size_t>(Histogram::COUNT);
+
+    struct HistogramData {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        std::vector<uint64_t> buckets = std::vector<uint64_t>(BUCKETS);
+
+        /**
+         * @brief Upper bound of the bucket holding quantile q (0..1)
+         */
+        uint64_t percentile(double q) const;
+    };
+
+    struct Snapshot {
+        uint64_t counters[COUNTERS] = {};
+        int64_t gauges[GAUGES] = {};
+        HistogramData histograms[HISTOGRAMS];
+    };
+
+    static void count(Counter id, uint64_t n = 1) {
+        bump(shard().counters[static_cast<size_t>(id)], n);
+    }
+
+    static void adjust(Gauge id, int64_t delta) {
+        bump(shard().gauges[static_cast<size_t>(id)], static_cast<uint64_t>(delta));
+    }
+
+    static void record(Histogram id, uint64_t value) {
+        Cells& cells = shard().histograms[static_cast<size_t>(id)];
+        bump(cells.buckets[bucketIndex(value)], 1);
+        bump(cells.count, 1);
+        bump(cells.sum, value);
+    }
+
+    /**
+     * @brief Totals across all threads, past and present
+     */
+    static Snapshot snapshot();
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+        if (exponent > MAX_EXPONENT) {
+            return BUCKETS - 1;
+        }
+        return (exponent - SUB_BITS + 1) * SUB_BUCKETS + ((value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+    }
+
+    /**
+     * @brief Largest value that lands in bucket i
+     */
+    static uint64_t bucketUpper(size_t i);
+
+    static const char* name(Counter id);
+    static const char* name(Gauge id);
+    static const char* name(Histogram id);
+    static const char* help(Counter id);
+    static const char* help(Gauge id);
+    static const char* help(Histogram id);
+
+    /**
+     * @brief Export scale for a histogram (1e-9 for "_seconds", else 1)
+     */
+    static double scale(Histogram id);
+
+private:
+    struct Cells {
+        std::atomic<uint64_t> buckets[BUCKETS];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+    };
+
+    /**
+     * One thread's values; written only by that thread
+     */
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counters[COUNTERS];
+        std::atomic<uint64_t> gauges[GAUGES];       // Two's complement deltas
+        Cells histograms[HISTOGRAMS];
+    };
+
+    static thread_local Shard* local_shard;
+
+    static void bump(std::atomic<uint64_t>& cell, uint64_t n) {
+        cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static Shard& shard() {
+        Shard* s = local_shard;
+        return s ? *s : registerShard();
+    }
+
+    static Shard& registerShard();
+    static void retireShard(Shard* s);
+
+    friend struct ShardOwner;
+};
+
+#endif // METRICS_HPP
@@ -0,0 +1,49 @@
+#ifndef METRICS_EXPORTER_HPP
+#define METRICS_EXPORTER_HPP
+
+#include <string>
+
+/**
+ * @class MetricsExporter
+ * @brief Makes the Metrics registry readable from outside the process
+ *
+ * Two ways in:
+ *
+ * - CHAT_METRICS_PORT=<port> serves the Prometheus text format at
+ *   http://127.0.0.1:<port>/metrics. The listener is bound to loopback
+ *   only and runs its own epoll loop on one thread, so a slow or stuck
+ *   scraper never touches a client thread. /trace on the same port
+ *   returns the sampled message spans (Tracer) as Chrome trace JSON.
+ * - "/stats" (users in CHAT_ADMINS) replies with summary().
+ *
+ * Both build a Metrics::snapshot(), which only takes the registry
+ * mutex; threads handling messages never wait for it.
+ */
+class MetricsExporter {
+public:
+    static constexpr size_t MAX_REQUEST = 8192;         // Bytes of request header accepted
+    static constexpr int REQUEST_TIMEOUT_SECONDS = 5;   // Idle scrape connections are closed
+
+    /**
+     * @brief Starts the HTTP endpoint if CHAT_METRICS_PORT is set
+     * @return false if the port is set but cannot be used
+     */
+    static bool startFromEnvironment();
+
+    /**
+     * @brief Port being served, 0 if none
+     */
+    static int port();
+
+    /**
+     * @brief All metrics in the Prometheus text exposition format
+     */
+    static std::string prometheusText();
+
+    /**
+     * @brief A few human-readable lines for /stats
+     */
+    static std::string summary();
+};
+
+#endif // METRICS_EXPORTER_HPP
@@ -0,0 +1,166 @@
+#ifndef SECURE_CHANNEL_HPP
+#define SECURE_CHANNEL_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+#include "key_exchange.hpp"
+#include "chacha20_poly1305.hpp"
+
+/**
+ * @class SecureChannel
+ * @brief Per-connection ChaCha20-Poly1305 record layer over TCP sockets
+ *
+ * At login the client appends an X25519 public key to its username
+ * ("alice KEX1:<64 hex>"); the server answers with its own ("KEX1:<hex>")
+ * and both derive two session keys with HKDF-SHA256:
+ *
+ *   okm = HKDF(salt "chat-kex-v1", ikm = shared secret,
+ *              info = client_pub | server_pub, 64 bytes)
+ *   client -> server key = okm[0..32], server -> client key = okm[32..64]
+ *
+ * From then on every send() on that socket becomes one or more records
+ *
+ *   u32 length (big endian) | ciphertext | 16-byte tag
+ *
+ * sealed with the direction's key, the 4-byte length as associated data
+ * and a 64-bit record counter as nonce, so records cannot be forged,
+ * reordered, replayed or truncated mid-record. recv() returns data from
+ * one record at a time, which keeps the one-send-one-message framing the
+ * chat protocol relies on. Sockets without a session (clients that did
+ * not offer a key, or CHAT_SESSION_CRYPTO=0) pass straight through,
+ * except TLS connections without kernel offload, which go to
+ * TlsTransport's SSL_read/SSL_write.
+ *
+ * The exchange is unauthenticated: it defeats passive eavesdropping and
+ * tampering on the wire, not an active man in the middle. The server
+ * still sees plaintext (spooled files are stored as received).
+ *
+ * The first header byte is the record type (lengths never exceed 24
+ * bits). Besides data records there are two group record types, used to
+ * encrypt a broadcast once for a whole room instead of once per member:
+ *
+ *   group key:  ordinary sealed record whose plaintext is
+ *               u32 key id | u32 retired key id | 32-byte key
+ *   group data: u8 type | u24 length | u32 key id | u64 sequence |
+ *               ciphertext | tag, sealed with the group key
+ *
+ * The server builds one group data record per broadcast and writes the
+ * same bytes to every member socket. recv() installs group keys silently
+ * and returns group data like any other record. A group key only ever
+ * travels inside a session, and a fresh one (with a new id) replaces it
+ * whenever the room's membership changes.
+ *
+ * All functions are thread-safe; sends on one socket are serialized so
+ * records from different threads never interleave.
+ */
+class SecureChannel {
+public:
+    static constexpr size_t HEADER_SIZE = 4;
+    static constexpr size_t TAG_SIZE = ChaCha20Poly1305::TAG_SIZE;
+    static constexpr size_t MAX_RECORD = 64 * 1024;     // Plaintext bytes per record
+    static constexpr const char* OFFER_PREFIX = "KEX1:";
+    static constexpr size_t OFFER_SIZE = 5 + 2 * X25519::KEY_SIZE;
+    static constexpr size_t GROUP_HEADER_SIZE = 16;
+    static constexpr size_t MAX_GROUP_KEYS = 256;       // Installed keys per session
+
+    /**
+     * @brief A room's current broadcast key (server side)
+     */
+    struct GroupKey {
+        uint32_t id = 0;                // 0 = no key yet
+        uint8_t key[ChaCha20Poly1305::KEY_SIZE];
+        uint64_t sequence = 0;          // Next record number (nonce)
+
+        ~GroupKey();
+    };
+
+    /**
+     * @brief One side's ephemeral key pair and the text announcing it
+     */
+    struct KeyShare {
+        uint8_t priv[X25519::KEY_SIZE];
+        uint8_t pub[X25519::KEY_SIZE];
+        std::string offer;              // "KEX1:<hex pub>"
+
+        ~KeyShare();
+    };
+
+    /**
+     * @brief False when CHAT_SESSION_CRYPTO=0 (offer nothing, talk plaintext)
+     */
+    static bool enabled();
+
+    /**
+     * @brief Generates a fresh key pair
+     */
+    static bool createKeyShare(KeyShare& share);
+
+    /**
+     * @brief Parses "KEX1:<64 hex digits>" into a public key
+     */
+    static bool parseOffer(const std::string& text, uint8_t pub[X25519::KEY_SIZE]);
+
+    /**
+     * @brief Derives the session keys and switches the socket to records
+     * @param is_client Which side of the exchange this is (picks tx/rx keys)
+     * @return false if the peer's key is unusable (low-order point)
+     */
+    static bool establish(int socket, const KeyShare& own, const uint8_t peer_pub[X25519::KEY_SIZE],
+                          bool is_client);
+
+    /**
+     * @brief Forgets the socket's session; call before close()
+     */
+    static void detach(int socket);
+
+    static bool isSecure(int socket);
+
+    /**
+     * @brief send() replacement: seals and writes all len bytes
+     * @return len, or -1 on error (partial writes are not reported)
+     */
+    static ssize_t send(int socket, const void* data, size_t len, int flags);
+
+    /**
+     * @brief recv() replacement: returns bytes of at most one record
+     * @return Bytes received, 0 on orderly close, -1 on error or forgery (errno EBADMSG)
+     */
+    static ssize_t recv(int socket, void* buf, size_t len, int flags);
+
+    /**
+     * @brief sendfile() replacement; reads and seals when the socket is secured
+     */
+    static ssize_t sendFile(int socket, int in_fd, off_t* offset, size_t count);
+
+    /**
+     * @brief Replaces group with a fresh random key under a new id
+     */
+    static bool rotateGroupKey(GroupKey& group);
+
+    /**
+     * @brief Installs group's key on the peer, dropping retired_id (0 = none)
+     * @return false if the socket has no session or the send failed
+     */
+    static bool sendGroupKey(int socket, const GroupKey& group, uint32_t retired_id);
+
+    /**
+     * @brief Encrypts len bytes once into a group data record
+     * @param record Receives the complete record, ready for sendRecord()
+     * @return false if len is 0 or above MAX_RECORD
+     */
+    static bool sealGroupRecord(GroupKey& group, const void* data, size_t len, std::string& record);
+
+    /**
+     * @brief Writes a pre-built record to a secured socket
+     */
+    static bool sendRecord(int socket, const std::string& record);
+
+    /**
+     * @brief True if decrypted bytes are waiting (poll() would not see them)
+     */
+    static bool hasBuffered(int socket);
+};
+
+#endif // SECURE_CHANNEL_HPP
@@ -3,10 +3,18 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 #include <mutex>
+#include <memory>
+#include <condition_variable>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include "spool.hpp"
+#include "secure_channel.hpp"
+#include "utils.hpp"
+#include "connection_monitor.hpp"
 
 /**
  * @struct ClientInfo
@@ -19,12 +27,29 @@ struct ClientInfo {
     int socket_fd;              // File descriptor for the client's socket connection
     std::string username;       // Unique identifier for the client
     sockaddr_in address;        // Network address information for the client
+    std::string e2e_key;        // Published end-to-end public key (hex), empty if none
+    std::shared_ptr<ConnectionRecord> transport;    // Sampled by ConnectionMonitor (null until login)
     
     // Constructor for easy initialization
     ClientInfo(int fd = -1, const std::string& name = "", sockaddr_in addr = {})
         : socket_fd(fd), username(name), address(addr) {}
 };
 
+/**
+ * @struct Room
+ * @brief A broadcast audience sharing one group key
+ * 
+ * Broadcasts to a room are encrypted once with the room's key and the
+ * same record is written to every member. The key is replaced before
+ * the first broadcast after any join or leave, so departed members
+ * cannot read later messages and new members cannot read earlier ones.
+ */
+struct Room {
+    std::set<std::string> members;      // Usernames (unused for the lobby: everyone is in it)
+    SecureChannel::GroupKey key;        // Current key, id 0 until the first broadcast
+    bool rekey = true;                  // Membership changed since the key was issued
+};
+
 /**
  * @class ChatServer
  * @brief Multi-threaded TCP server for managing chat communications
@@ -58,6 +83,18 @@ private:
      */
     std::map<std::string, ClientInfo> clients;
     std::mutex clients_mutex;                       // Protects concurrent access to clients map
+    Room lobby;                                     // Public chat: every connected client (under clients_mutex)
+    std::map<std::string, Room> rooms;              // Named rooms joined with /join (under clients_mutex)
+    FileSpool spool;                                // Store-and-forward queue for offline recipients
+    
+    /**
+     * Block signatures posted by delta-transfer recipients
+     * Maps "sender>recipient" -> serialized signature blob
+     * Filled on the recipient's handler thread, consumed on the sender's
+     */
+    std::map<std::string, std::string> delta_signatures;
+    std::mutex delta_mutex;                         // Protects delta_signatures
+    std::condition_variable delta_cv;               // Signals a newly posted signature blob
     
     /**
      * @brief Handles all communication for a single client connection
@@ -81,7 +118,10 @@ private:
      * Message types handled:
      * - "/list" -> Returns list of active users
      * - "@username msg" -> Routes private message
+     * - "/pubkey hex|user" -> Publishes or looks up an end-to-end key
+     * - "/join room", "/leave room", "#room msg" -> Room membership and chat
      * - "/sendfile user filename size" -> Initiates file transfer
+     * - "/sendbatch user label count size" -> Initiates a batched transfer
      * - Plain text -> Broadcasts to all users
      */
     void processMessage(const std::string& message, const std::string& sender_username, int sender_socket);
@@ -95,6 +135,51 @@ private:
      */
     void broadcast(const std::string& message, const std::string& sender);
     
+    /**
+     * @brief Sends one message to a room, encrypting it once
+     * @param room Room whose key is used (rotated first if membership changed)
+     * @param members Everyone in the room; new keys go to all of them
+     * @param message Wire-ready message
+     * @param sender Username the message is not echoed to
+     * 
+     * Caller holds clients_mutex. Members without a secured session get
+     * message as is.
+     */
+    void fanOut(Room& room, const std::vector<const ClientInfo*>& members, const std::string& message,
+                const std::string& sender);
+    
+    /**
+     * @brief Handles /join, /leave and "#room message"
+     * @param message Command or room message
+     * @param sender_username Username of the sender
+     * @param sender_socket Socket for replies
+     */
+    void handleRoomCommand(const std::string& message, const std::string& sender_username, int sender_socket);
+    
+    /**
+     * @brief Handles "/log [settings]" from CHAT_ADMINS users
+     * @param settings LogPolicy settings; empty to show the current ones
+     * @param sender_username Username of the sender
+     * @param sender_socket Socket for the reply
+     */
+    void handleLogCommand(const std::string& settings, const std::string& sender_username, int sender_socket);
+    
+    /**
+     * @brief Handles "/conninfo [user]" from CHAT_ADMINS users
+     * @param target One user, or empty for every connection
+     * @param sender_username Username of the sender
+     * @param sender_socket Socket for the reply
+     */
+    void handleConnInfo(const std::string& target, const std::string& sender_username, int sender_socket);
+    
+    /**
+     * @brief Handles "/trace [N|off|dump]" from CHAT_ADMINS users
+     * @param argument Sampling rate, "off", "dump", or empty for the status
+     * @param sender_username Username of the sender
+     * @param sender_socket Socket for the reply
+     */
+    void handleTraceCommand(const std::string& argument, const std::string& sender_username, int sender_socket);
+    
     /**
      * @brief Sends a private message between two users
      * @param target Username of the recipient
@@ -106,6 +191,28 @@ private:
      */
     void sendPrivateMessage(const std::string& target, const std::string& message, const std::string& sender);
     
+    /**
+     * @brief Publishes or looks up an end-to-end public key
+     * @param argument 64 hex digits to publish, or a username to look up
+     * @param sender_username Username of the requester
+     * @param sender_socket Socket for the "/pubkey <user> <hex>" reply
+     * 
+     * A lookup of a user without a key gets "/pubkey <user>" with no key
+     */
+    void handlePublicKey(const std::string& argument, const std::string& sender_username, int sender_socket);
+    
+    /**
+     * @brief Routes an "/e2e <target> <key id> <body>" message
+     * @param message Raw message as received (not decrypted or trimmed)
+     * @param sender Username of the sender
+     * @param sender_socket Socket for error replies
+     * 
+     * Only the header is parsed; the body goes out as "/e2e_from <sender>
+     * <body>" byte for byte. If the key id does not match the target's
+     * current key the sender gets "/pubkey <target> <hex> stale" instead.
+     */
+    void forwardEndToEnd(const std::string& message, const std::string& sender, int sender_socket);
+    
     /**
      * @brief Manages the file transfer protocol between two clients
      * @param sender_socket Socket of the user sending the file
@@ -113,6 +220,8 @@ private:
      * @param recipient_username Username of the recipient
      * @param filename Original filename (with extension)
      * @param file_size Size of the file in bytes
+     * @param batch_entries Number of files in a batch stream (0 = single file)
+     * @param chunked Sender streams compressed chunk frames instead of raw bytes
      * 
      * File Transfer Protocol:
      * 1. Server notifies recipient about incoming file (with filename)
@@ -125,7 +234,68 @@ private:
      */
     void handleFileTransfer(int sender_socket, const std::string& sender_username,
                           const std::string& recipient_username, 
-                          const std::string& filename, long file_size);
+                          const std::string& filename, long file_size,
+                          int batch_entries = 0, bool chunked = false);
+    
+    /**
+     * @brief Manages an rsync-style delta transfer between two clients
+     * @param sender_socket Socket of the user sending the file
+     * @param sender_username Username of the sender
+     * @param recipient_username Username of the recipient
+     * @param filename Original filename (with extension)
+     * @param file_size Size of the new file in bytes
+     * 
+     * Delta Protocol:
+     * 1. Server asks the recipient for signatures (/delta_offer)
+     * 2. Recipient posts block signatures of its existing copy (/delta_sig)
+     * 3. Server forwards the signatures to the sender
+     * 4. Sender streams a delta; server relays it after /delta_data
+     * 
+     * Falls back to a regular transfer ("/delta_sig none") when the
+     * recipient is offline or does not answer in time.
+     */
+    void handleDeltaTransfer(int sender_socket, const std::string& sender_username,
+                             const std::string& recipient_username,
+                             const std::string& filename, long file_size);
+    
+    /**
+     * @brief Reads a signature blob posted by a delta recipient
+     * @param client_socket Socket of the recipient
+     * @param recipient_username Username of the recipient
+     * @param first_chunk Data already received (header line plus blob prefix)
+     */
+    void receiveDeltaSignatures(int client_socket, const std::string& recipient_username,
+                                const std::string& first_chunk);
+    
+    /**
+     * @brief Accepts a file for an offline recipient into the spool
+     * @param sender_socket Socket of the user sending the file
+     * @param sender_username Username of the sender
+     * @param recipient_username Username of the (offline) recipient
+     * @param filename Original filename (with extension)
+     * @param file_size Size of the file in bytes
+     * @param batch_entries Number of files in a batch stream (0 = single file)
+     * @param chunked Upload is a chunk-frame stream (stored verbatim)
+     * 
+     * Streams the upload to disk if the recipient's spool quota allows it,
+     * otherwise drains the upload and reports the reason to the sender.
+     */
+    void spoolFileTransfer(int sender_socket, const std::string& sender_username,
+                           const std::string& recipient_username,
+                           const std::string& filename, long file_size,
+                           int batch_entries = 0, bool chunked = false);
+    
+    /**
+     * @brief Pushes files spooled while a user was offline
+     * @param client_socket Socket of the user who just logged in
+     * @param username Username of the user who just logged in
+     * 
+     * Uses the same offer / file_data sequence as a live transfer, on a
+     * thread of its own. Entries are removed only after they were sent
+     * completely, so a dropped connection leaves them queued for the
+     * next login.
+     */
+    void deliverSpooledFiles(int client_socket, const std::string& username);
     
     /**
      * @brief Generates a comma-separated list of active usernames
@@ -167,11 +337,14 @@ private:
     
     /**
      * @brief Logs server events with timestamp
-     * @param event Event description to log
+     * @param id Event from log_events.hpp, followed by its arguments
      * 
      * Logs to both console and file for debugging and auditing
      */
-    void logEvent(const std::string& event);
+    template <typename... Args>
+    void logEvent(LogEvent id, const Args&... args) {
+        Utils::logEvent(id, args...);
+    }
     
 public:
     /**
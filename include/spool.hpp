@@ -0,0 +1,153 @@
+#ifndef SPOOL_HPP
+#define SPOOL_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <ctime>
+
+/**
+ * @struct SpoolEntry
+ * @brief One file waiting on disk for an offline recipient
+ */
+struct SpoolEntry {
+    std::string id;             // Unique entry id (<epoch>_<sequence>)
+    std::string recipient;      // User the file is addressed to
+    std::string sender;         // User who uploaded the file
+    std::string filename;       // Original filename (with extension)
+    long size;                  // Payload size in bytes
+    int entries;                // Files in a batch stream (0 = single file)
+    bool chunked;               // Payload is a stored chunk-frame stream
+    time_t created;             // When the upload was accepted
+    std::string data_path;      // Path of the spooled payload on disk
+
+    SpoolEntry() : size(0), entries(0), chunked(false), created(0) {}
+};
+
+/**
+ * @class FileSpool
+ * @brief Disk-backed store-and-forward queue for file transfers
+ *
+ * When a /sendfile targets a user who is not online, the server streams
+ * the upload into this spool instead of rejecting it. The file is pushed
+ * to the recipient the next time they log in.
+ *
+ * On-disk layout:
+ *   spool/<recipient>/<id>.part   Upload in progress (never delivered)
+ *   spool/<recipient>/<id>.dat    Completed payload
+ *   spool/<recipient>/<id>.meta   Sender, filename, size, batch entries, framing, creation time
+ *
+ * Disk usage is bounded by:
+ * - Per-user quota on total spooled bytes (including in-flight uploads)
+ * - Per-user limit on number of queued files
+ * - The same two limits across the whole spool: recipients need no
+ *   account, so cycling through names must not get past the per-user ones
+ * - Expiry: entries older than the expiry age are pruned, and so are
+ *   payloads without a .meta (left by a crash) once their mtime is that old
+ *
+ * Thread-safe: all bookkeeping is protected by spool_mutex. The payload
+ * itself is streamed by FileTransferHandler outside the lock.
+ */
+class FileSpool {
+private:
+    std::string root;                           // Spool root directory
+    long user_quota;                            // Max spooled bytes per recipient
+    int max_files;                              // Max queued files per recipient
+    long total_quota;                           // Max spooled bytes, all recipients
+    int total_files;                            // Max queued files, all recipients
+    long expiry_seconds;                        // Age after which entries are pruned
+    unsigned long sequence;                     // Counter for unique entry ids
+    std::map<std::string, long> reserved;       // Bytes of in-flight uploads per recipient
+    std::set<std::string> uploading;            // .part paths of in-flight uploads
+    std::mutex spool_mutex;                     // Protects all of the above
+
+    /**
+     * @brief Lists completed entries for a recipient (caller holds the lock)
+     */
+    std::vector<SpoolEntry> listEntriesLocked(const std::string& recipient);
+
+    /**
+     * @brief Deletes the payload and metadata of an entry (caller holds the lock)
+     */
+    void removeEntryLocked(const SpoolEntry& entry);
+
+    /**
+     * @brief Deletes stale .part/.dat files without a .meta (caller holds the lock)
+     * @return Number of files deleted
+     */
+    int pruneOrphansLocked(const std::string& recipient, time_t cutoff);
+
+    /**
+     * @brief Bytes and files queued or uploading, all recipients (caller holds the lock)
+     */
+    void usageLocked(long& bytes, int& files);
+
+    std::string userDir(const std::string& recipient) const;
+
+public:
+    static constexpr long DEFAULT_USER_QUOTA = 50L * 1024 * 1024;   // 50MB per user
+    static constexpr int DEFAULT_MAX_FILES = 20;                    // 20 files per user
+    static constexpr long DEFAULT_EXPIRY = 7L * 24 * 60 * 60;       // 7 days
+    static constexpr long DEFAULT_TOTAL_QUOTA = 1024L * 1024 * 1024; // 1GB in all
+    static constexpr int DEFAULT_TOTAL_FILES = 500;                 // 500 files in all
+
+    /**
+     * @brief Constructs a spool rooted at the given directory
+     * @param root_dir Directory holding per-user spool folders
+     * @param quota Max spooled bytes per recipient
+     * @param files Max queued files per recipient
+     * @param expiry Seconds before an undelivered entry is pruned
+     * @param all_quota Max spooled bytes across all recipients
+     * @param all_files Max queued files across all recipients
+     */
+    explicit FileSpool(const std::string& root_dir = "spool",
+                       long quota = DEFAULT_USER_QUOTA,
+                       int files = DEFAULT_MAX_FILES,
+                       long expiry = DEFAULT_EXPIRY,
+                       long all_quota = DEFAULT_TOTAL_QUOTA,
+                       int all_files = DEFAULT_TOTAL_FILES);
+
+    /**
+     * @brief Reserves space for an incoming upload
+     * @param entry Filled with recipient/sender/filename/size on input;
+     *              id and data_path (the .part file) are set on success
+     * @param error Reason for refusal (quota, file count, spool full, disk error)
+     * @return true if the upload may be streamed to entry.data_path
+     *
+     * Expired entries are pruned before the quota check so stale files
+     * never block new ones.
+     */
+    bool reserve(SpoolEntry& entry, std::string& error);
+
+    /**
+     * @brief Finalizes (or abandons) a reserved upload
+     * @param entry Entry returned by reserve()
+     * @param success true if the full payload was written
+     * @return true if the entry is now queued for delivery
+     *
+     * On success the .part file is renamed to .dat and the .meta file is
+     * written, making the entry visible to pending(). On failure the
+     * partial payload is deleted. Either way the reservation is released.
+     */
+    bool commit(SpoolEntry& entry, bool success);
+
+    /**
+     * @brief Returns queued entries for a recipient, oldest first
+     */
+    std::vector<SpoolEntry> pending(const std::string& recipient);
+
+    /**
+     * @brief Removes an entry after successful delivery
+     */
+    void remove(const SpoolEntry& entry);
+
+    /**
+     * @brief Deletes every entry older than the expiry age, and orphaned payloads as old
+     * @return Number of entries pruned
+     */
+    int pruneExpired();
+};
+
+#endif // SPOOL_HPP
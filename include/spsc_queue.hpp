@@ -0,0 +1,150 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @class SpscQueue
+ * @brief Bounded lock-free ring for exactly one producer and one consumer
+ *
+ * Connects two pipeline stages running on different threads. The
+ * producer only writes `tail`, the consumer only writes `head`, so no
+ * lock or CAS is needed: each side publishes its index with a release
+ * store and reads the other's with an acquire load. The indices live on
+ * separate cache lines so the two threads do not false-share.
+ *
+ * Capacity is rounded up to a power of two; one slot stays empty to
+ * tell "full" from "empty". Items are moved out on pop, so a slot holds
+ * no memory once consumed (matters for T = std::string).
+ *
+ * push()/pop() block when the ring is full/empty: they spin briefly,
+ * then yield, then sleep, so a stalled stage costs little CPU. Both
+ * give up once `abort` becomes true, letting a failing stage unblock
+ * the rest of the pipeline.
+ */
+template <typename T>
+class SpscQueue {
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::vector<T> slots;
+    size_t mask;
+    alignas(CACHE_LINE) std::atomic<size_t> head;   // Next slot to read (consumer)
+    alignas(CACHE_LINE) std::atomic<size_t> tail;   // Next slot to write (producer)
+
+    /**
+     * @brief Backoff for blocked push/pop: spin, then yield, then sleep
+     * On a single CPU the other side cannot run while we spin, so yield at once.
+     */
+    static void backoff(unsigned& attempts) {
+        static const bool multicore = std::thread::hardware_concurrency() > 1;
+        if (++attempts < 64 && multicore) {
+            return;
+        }
+        if (attempts < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+public:
+    explicit SpscQueue(size_t capacity) : head(0), tail(0) {
+        size_t size = 2;
+        while (size < capacity + 1) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     * @brief Adds an item if there is room (producer only)
+     */
+    bool tryPush(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) & mask;
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Moves an item in if there is room (producer only)
+     * item is left untouched when the ring is full.
+     */
+    bool tryPush(T&& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) & mask;
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[t] = std::move(item);
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Items queued; exact only when called from the producer or consumer
+     * (the other side may move it concurrently)
+     */
+    size_t size() const {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & mask;
+    }
+
+    size_t capacity() const { return mask; }
+
+    /**
+     * @brief Removes an item if one is available (consumer only)
+     */
+    bool tryPop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots[h]);
+        head.store((h + 1) & mask, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Blocking push; returns false if aborted first
+     */
+    bool push(const T& item, const std::atomic<bool>& abort) {
+        unsigned attempts = 0;
+        while (!tryPush(item)) {
+            if (abort.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            backoff(attempts);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Blocking pop; returns false if aborted first
+     */
+    bool pop(T& item, const std::atomic<bool>& abort) {
+        unsigned attempts = 0;
+        while (!tryPop(item)) {
+            if (abort.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            backoff(attempts);
+        }
+        return true;
+    }
+};
+
+#endif // SPSC_QUEUE_HPP
@@ -0,0 +1,145 @@
+#ifndef TEXT_CODEC_HPP
+#define TEXT_CODEC_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @class TextCodec
+ * @brief Hex and base64 (RFC 4648) encoding into caller-provided buffers
+ *
+ * Binary data (ciphertext, keys) has to travel inside text messages, so
+ * these run on every encrypted payload. All functions work on raw
+ * buffers with no allocation; sizes are given by the *Size() helpers.
+ *
+ * Decoding is strict: anything outside the alphabet (including
+ * whitespace), an odd number of hex digits, base64 input that is not a
+ * whole number of quads, '=' anywhere but the end, or non-zero unused
+ * bits before the padding is rejected. Every encoded form therefore has
+ * exactly one decoding and vice versa.
+ *
+ * The bulk of each buffer runs through SSSE3 or AVX2 kernels picked by
+ * CpuDispatch (hex.encode, hex.decode, base64.encode, base64.decode);
+ * tails and the final base64 quad use the scalar code.
+ *
+ * For data that arrives in pieces, HexDecoder, Base64Encoder and
+ * Base64Decoder carry partial units between calls. Hex encoding needs no
+ * state: hexEncode() can be called piece by piece.
+ */
+class TextCodec {
+public:
+    static size_t hexEncodedSize(size_t len) { return 2 * len; }
+    static size_t base64EncodedSize(size_t len) { return (len + 2) / 3 * 4; }
+
+    /**
+     * @brief Upper bound of base64Decode() output for len input chars
+     */
+    static size_t base64DecodedMaxSize(size_t len) { return len / 4 * 3; }
+
+    /**
+     * @brief Writes 2 * len hex digits (no terminator)
+     * @param upper "0-9A-F" instead of "0-9a-f"
+     */
+    static void hexEncode(const uint8_t* in, size_t len, char* out, bool upper = false);
+
+    /**
+     * @brief Decodes len hex digits (either case) into len / 2 bytes
+     * @return false if len is odd or a character is not a hex digit
+     */
+    static bool hexDecode(const char* in, size_t len, uint8_t* out);
+
+    /**
+     * @brief Writes base64EncodedSize(len) chars, padded with '='
+     * @return Characters written
+     */
+    static size_t base64Encode(const uint8_t* in, size_t len, char* out);
+
+    /**
+     * @brief Decodes padded base64
+     * @param out At least base64DecodedMaxSize(len) bytes
+     * @param out_len Bytes written
+     * @return false on malformed input (out then holds garbage)
+     */
+    static bool base64Decode(const char* in, size_t len, uint8_t* out, size_t& out_len);
+
+    /**
+     * @class HexDecoder
+     * @brief Hex decoding of input split at arbitrary points
+     */
+    class HexDecoder {
+    private:
+        char pending;           // First digit of an incomplete pair
+        bool has_pending;
+        bool failed;
+
+    public:
+        HexDecoder() : pending(0), has_pending(false), failed(false) {}
+
+        /**
+         * @param out At least (len + 1) / 2 bytes
+         * @return Bytes written; 0 if this or an earlier call hit bad input
+         */
+        size_t update(const char* in, size_t len, uint8_t* out);
+
+        /**
+         * @brief True if all input was valid and no digit is left over
+         */
+        bool finish() const { return !failed && !has_pending; }
+    };
+
+    /**
+     * @class Base64Encoder
+     * @brief Base64 encoding of input split at arbitrary points
+     */
+    class Base64Encoder {
+    private:
+        uint8_t carry[2];       // Bytes not yet forming a 3-byte group
+        size_t carry_len;
+
+    public:
+        Base64Encoder() : carry(), carry_len(0) {}
+
+        /**
+         * @param out At least base64EncodedSize(len + 2) chars
+         * @return Characters written
+         */
+        size_t update(const uint8_t* in, size_t len, char* out);
+
+        /**
+         * @brief Writes the last, padded quad (if any)
+         * @param out At least 4 chars
+         * @return Characters written (0 or 4)
+         */
+        size_t finish(char* out);
+    };
+
+    /**
+     * @class Base64Decoder
+     * @brief Base64 decoding of input split at arbitrary points
+     *
+     * Padding ends the stream: any input after a quad with '=' fails.
+     */
+    class Base64Decoder {
+    private:
+        char carry[4];          // Chars not yet forming a quad
+        size_t carry_len;
+        bool padded;
+        bool failed;
+
+    public:
+        Base64Decoder() : carry(), carry_len(0), padded(false), failed(false) {}
+
+        /**
+         * @param out At least (len + 3) / 4 * 3 bytes
+         * @return Bytes written; 0 if this or an earlier call hit bad input
+         */
+        size_t update(const char* in, size_t len, uint8_t* out);
+
+        /**
+         * @brief True if all input was valid and ended on a quad boundary
+         */
+        bool finish() const { return !failed && carry_len == 0; }
+    };
+};
+
+#endif // TEXT_CODEC_HPP
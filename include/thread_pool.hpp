@@ -0,0 +1,108 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <algorithm>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed-size pool of worker threads for CPU-bound jobs
+ *
+ * Used to take CPU work (chunk compression) off the thread that owns
+ * a socket, so the socket keeps draining while workers crunch ahead.
+ *
+ * Usage:
+ *   ThreadPool pool(4);
+ *   std::future<int> f = pool.submit([] { return 42; });
+ *   int v = f.get();
+ *
+ * Jobs run in submission order across the workers; results come back
+ * through std::future so callers can consume them in order.
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;           // Worker threads
+    std::queue<std::function<void()>> jobs;     // Pending jobs
+    std::mutex queue_mutex;                     // Protects jobs and stopping
+    std::condition_variable queue_cv;           // Signals new jobs / shutdown
+    bool stopping;                              // Set by the destructor
+
+public:
+    /**
+     * @brief Starts the worker threads
+     * @param threads Number of workers (0 = one per hardware thread)
+     */
+    explicit ThreadPool(size_t threads = 0) : stopping(false) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this] {
+                for (;;) {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(queue_mutex);
+                        queue_cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                        if (stopping && jobs.empty()) {
+                            return;
+                        }
+                        job = std::move(jobs.front());
+                        jobs.pop();
+                    }
+                    job();
+                }
+            });
+        }
+    }
+
+    /**
+     * @brief Finishes queued jobs and joins the workers
+     */
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        queue_cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Queues a job
+     * @param fn Callable with no arguments
+     * @return Future for the job's result
+     */
+    template <typename F>
+    auto submit(F fn) -> std::future<decltype(fn())> {
+        using Result = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            jobs.emplace([task] { (*task)(); });
+        }
+        queue_cv.notify_one();
+        return result;
+    }
+
+    /**
+     * @brief Number of worker threads
+     */
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,114 @@
+#ifndef TLS_TRANSPORT_HPP
+#define TLS_TRANSPORT_HPP
+
+#include <string>
+#include <cstddef>
+#include <sys/types.h>
+
+/**
+ * @class TlsTransport
+ * @brief Optional TLS on client connections, offloaded to kernel TLS
+ *
+ * Built only with `make TLS=1` (links the system OpenSSL); otherwise
+ * every function reports TLS as unavailable.
+ *
+ * The handshake runs in OpenSSL with SSL_OP_ENABLE_KTLS. When the kernel
+ * "tls" ULP accepts both directions, the socket itself encrypts and
+ * decrypts: plain send()/recv()/sendfile() keep working on it and the
+ * SSL object is only kept for shutdown. A client upload still leaves
+ * through sendfile(). The server relay is not zero-copy with or without
+ * offload: it recv()s each slice into a user-space buffer and send()s
+ * it on; kTLS only moves the encryption into the kernel. To make full offload possible the version is capped at
+ * TLS 1.2 with AES-GCM suites while the ULP is loaded (OpenSSL 3.0
+ * offloads only TLS 1.3 transmit).
+ *
+ * Without kTLS (module missing, CHAT_KTLS=0, unsupported suite) the
+ * connection falls back to SSL_read()/SSL_write() through
+ * SecureChannel's send()/recv()/sendFile(), which dispatch here. In that
+ * mode the socket is non-blocking and each direction waits in poll()
+ * outside a per-connection lock, so the client's reader and writer
+ * threads do not block each other.
+ *
+ * Server: CHAT_TLS_CERT and CHAT_TLS_KEY (PEM) enable TLS; connections
+ * are told apart by their first byte (0x16 = handshake), so plaintext
+ * clients keep working. Client: CHAT_TLS=1, with CHAT_TLS_CA naming a
+ * certificate to verify the server against (e.g. the self-signed one
+ * from `make tls-cert`); without it the server is not verified.
+ *
+ * TLS connections skip SecureChannel's own key exchange.
+ */
+class TlsTransport {
+public:
+    /**
+     * @brief True if built with TLS=1
+     */
+    static bool available();
+
+    /**
+     * @brief True if the kernel TLS ULP is loaded
+     */
+    static bool kernelOffloadAvailable();
+
+    /**
+     * @brief Loads CHAT_TLS_CERT / CHAT_TLS_KEY if set
+     * @return false if they are set but unusable
+     */
+    static bool initServer();
+
+    /**
+     * @brief True once initServer() loaded a certificate
+     */
+    static bool serverEnabled();
+
+    /**
+     * @brief Peeks at the first byte for a TLS handshake record
+     */
+    static bool looksLikeHandshake(int socket);
+
+    /**
+     * @brief Server-side handshake on an accepted socket
+     */
+    static bool accept(int socket);
+
+    /**
+     * @brief Client-side handshake (reads CHAT_TLS_CA)
+     * @param host Server address, checked against the certificate
+     */
+    static bool connect(int socket, const std::string& host);
+
+    /**
+     * @brief True if CHAT_TLS=1 asks the client to use TLS
+     */
+    static bool clientRequested();
+
+    static bool isTls(int socket);
+
+    /**
+     * @brief True if the connection uses SSL_read/SSL_write (no full offload)
+     */
+    static bool isUserspace(int socket);
+
+    /**
+     * @brief True while any connection is in userspace mode (cheap check)
+     */
+    static bool anyUserspace();
+
+    /**
+     * @brief "TLSv1.2 ECDHE-RSA-AES128-GCM-SHA256, kernel offload" and the like
+     */
+    static std::string describe(int socket);
+
+    /**
+     * @brief Userspace-mode I/O; same contracts as SecureChannel's
+     */
+    static ssize_t send(int socket, const void* data, size_t len, int flags);
+    static ssize_t recv(int socket, void* buf, size_t len, int flags);
+    static bool hasBuffered(int socket);
+
+    /**
+     * @brief Sends close_notify and frees the connection; call before close()
+     */
+    static void detach(int socket);
+};
+
+#endif // TLS_TRANSPORT_HPP
@@ -0,0 +1,136 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @class Tracer
+ * @brief Sampled per-message spans, dumped as Chrome trace_event JSON
+ *
+ * One message in every CHAT_TRACE_SAMPLE (default 0 = off) read by each
+ * handler thread is traced: every Span opened on that thread while the
+ * message is handled (recv, trim, decrypt, processMessage, broadcast,
+ * per-recipient send, ...) is recorded with its thread id into that
+ * thread's ring buffer, which keeps the last RING_EVENTS spans.
+ *
+ * dumpJson() renders all rings in the trace_event format that
+ * chrome://tracing and Perfetto open. Admins use "/trace dump" (writes
+ * trace-<time>.json) and "/trace <N>" to change the rate at runtime;
+ * the metrics endpoint serves the same JSON at /trace.
+ *
+ * When sampling is off a Message costs one relaxed load and a branch,
+ * and a Span one thread-local flag test, always false, so predicted.
+ * Span names must be string literals: only the pointer is stored.
+ */
+class Tracer {
+public:
+    static constexpr size_t RING_EVENTS = 4096;         // Per thread
+    static constexpr size_t MAX_FINISHED_RINGS = 64;    // Rings of exited threads kept for dumps
+
+    /**
+     * @brief One message on the calling thread; sampled or not
+     */
+    class Message {
+    public:
+        Message() {
+            uint32_t every = sample_every.load(std::memory_order_relaxed);
+            if (__builtin_expect(every != 0, 0)) {
+                begin(every);
+            }
+        }
+
+        ~Message() {
+            if (__builtin_expect(started != 0, 0)) {
+                end();
+            }
+        }
+
+        Message(const Message&) = delete;
+        Message& operator=(const Message&) = delete;
+
+        bool sampled() const {
+            return started != 0;
+        }
+
+        /**
+         * @brief Starts the message's own span now (e.g. once input is readable)
+         */
+        void restart();
+
+    private:
+        int64_t started = 0;
+
+        void begin(uint32_t every);
+        void end();
+    };
+
+    /**
+     * @brief Times a scope if the current message is sampled
+     */
+    class Span {
+    public:
+        explicit Span(const char* span_name) {
+            if (__builtin_expect(active, 0)) {
+                name = span_name;
+                started = now();
+            }
+        }
+
+        ~Span() {
+            if (__builtin_expect(started != 0, 0)) {
+                record(name, started, now());
+            }
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* name = nullptr;
+        int64_t started = 0;
+    };
+
+    static void configureFromEnvironment();
+
+    /**
+     * @brief Trace one message in every `every` per thread (0 = off)
+     */
+    static void setSampling(uint32_t every);
+
+    static uint32_t sampling() {
+        return sample_every.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Label for this thread in dumps ("client alice")
+     */
+    static void nameThread(const std::string& name);
+
+    /**
+     * @brief Spans currently held in all rings
+     */
+    static size_t bufferedSpans();
+
+    /**
+     * @brief Every buffered span as {"traceEvents": [...]}
+     */
+    static std::string dumpJson();
+
+    /**
+     * @brief Writes dumpJson() to trace-<YYYYmmdd-HHMMSS>.json
+     * @param path Set to the file written
+     */
+    static bool dumpToFile(std::string& path);
+
+    static int64_t now();
+
+private:
+    static std::atomic<uint32_t> sample_every;
+    static thread_local bool active;                    // Current message is sampled
+
+    static void record(const char* name, int64_t start_ns, int64_t end_ns);
+};
+
+#endif // TRACER_HPP
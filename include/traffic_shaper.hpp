@@ -0,0 +1,239 @@
+#ifndef TRAFFIC_SHAPER_HPP
+#define TRAFFIC_SHAPER_HPP
+
+#include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class TokenBucket
+ * @brief Classic token bucket limiting a byte rate
+ *
+ * Tokens (bytes) accumulate at `rate` per second up to `burst`. Callers
+ * reserve tokens up front and may drive the bucket into debt; the
+ * returned delay is how long they must wait before sending. Letting
+ * the bucket go negative keeps whole chunks intact (no partial sends)
+ * while the long-run rate still converges to `rate`.
+ *
+ * A rate of 0 means unlimited. Thread-safe.
+ */
+class TokenBucket {
+private:
+    double rate;                                        // Bytes per second (0 = unlimited)
+    double burst;                                       // Max accumulated tokens
+    double tokens;                                      // Current balance (may be negative)
+    std::chrono::steady_clock::time_point last_refill;  // Time of last refill
+    std::mutex bucket_mutex;                            // Protects all of the above
+
+public:
+    /**
+     * @brief Constructs a bucket
+     * @param rate_bps Sustained rate in bytes per second (0 = unlimited)
+     * @param burst_bytes Bucket depth (0 = 100ms worth of rate, at least 256KB)
+     */
+    explicit TokenBucket(double rate_bps = 0, double burst_bytes = 0);
+
+    /**
+     * @brief Changes the rate and depth (the balance is kept)
+     */
+    void setRate(double rate_bps, double burst_bytes = 0);
+
+    /**
+     * @brief Takes tokens for a send
+     * @param bytes Bytes about to be sent
+     * @return Seconds the caller must wait before sending (0 = send now)
+     */
+    double reserve(size_t bytes);
+
+    bool unlimited() const { return rate <= 0; }
+};
+
+/**
+ * @class TransferFlow
+ * @brief Shaping state for one relayed transfer
+ *
+ * Created by the server for the duration of a relay. Every slice of
+ * bulk data passes through throttle(), which:
+ *
+ * 1. Charges the per-transfer and per-user (uploader) buckets, waits for
+ *    the slower of them, and waits for the TransferScheduler to grant
+ *    the slice its fair share of the global rate.
+ * 2. Keeps the recipient's kernel send queue shallow (BULK_QUEUE_LIMIT),
+ *    so anything sent on the socket after a slice waits behind at most
+ *    that much bulk data instead of a full socket buffer.
+ * 3. Interleaving flows only: writes queued chat messages as chat frames
+ *    while waiting, so chat for the recipient goes out ahead of the next
+ *    bulk slice rather than after the whole file. awaitInput() does the
+ *    same while the relay is blocked on the sender.
+ *
+ * Every flow on a socket holds the recipient's chat in its queue; a
+ * raw stream has no frames to carry it, so it goes out as plain
+ * messages once the flow ends and the body is complete.
+ *
+ * Optionally caps the recipient socket with SO_MAX_PACING_RATE for the
+ * lifetime of the flow, so the kernel spreads bulk packets out instead
+ * of bursting them into the NIC queue.
+ */
+class TransferFlow {
+private:
+    std::string username;                       // User charged for the bandwidth
+    int out_socket;                             // Recipient socket (-1 = not a socket)
+    bool interleave;                            // Chat may be framed into this stream
+    bool pacing_set;                            // SO_MAX_PACING_RATE applied
+    TokenBucket transfer_bucket;                // Per-transfer limit
+    std::shared_ptr<TokenBucket> user_bucket;   // Shared by all flows of the user
+
+    std::deque<std::string> chat_queue;         // Chat waiting for a frame boundary
+    std::mutex chat_mutex;                      // Protects chat_queue
+    std::condition_variable chat_cv;            // Signals queued chat
+    bool chat_failed;                           // A chat frame write failed
+    int wake_fd;                                // eventfd signalled on queued chat (-1 if none)
+    uint64_t schedule_id;                       // TransferScheduler flow id
+    bool granted;                               // Scheduler granted the pending slice
+
+    friend class TransferScheduler;
+
+    /**
+     * @brief Called by the scheduler when the pending slice may be sent
+     */
+    void grant();
+
+    /**
+     * @brief Writes queued chat messages as chat frames
+     * @return false if the socket write failed
+     */
+    bool flushChat();
+
+public:
+    static constexpr size_t BULK_QUEUE_LIMIT = 64 * 1024;  // Unsent bytes allowed ahead of chat
+
+    /**
+     * @brief Starts shaping a transfer
+     * @param user Uploader whose per-user bucket is charged
+     * @param socket Recipient socket (-1 when writing to disk)
+     * @param interleave_chat true if the stream is chunk-framed and chat
+     *        for this socket may be sent as chat frames between chunks;
+     *        otherwise it is held until the flow ends
+     * @param description Shown by /transfers ("alice -> bob report.pdf")
+     * @param total_bytes Announced size, for /transfers
+     */
+    TransferFlow(const std::string& user, int socket, bool interleave_chat,
+                 const std::string& description = "", long total_bytes = 0);
+
+    /**
+     * @brief Stops shaping; chat still queued is sent as plain messages
+     */
+    ~TransferFlow();
+
+    TransferFlow(const TransferFlow&) = delete;
+    TransferFlow& operator=(const TransferFlow&) = delete;
+
+    /**
+     * @brief Waits until `bytes` of bulk data may be sent
+     * @return false if the recipient socket failed while sending chat
+     */
+    bool throttle(size_t bytes);
+    
+    /**
+     * @brief Waits until the sender socket is readable, sending chat meanwhile
+     * @param fd Socket the relay is about to read from
+     * @return false if the recipient socket failed while sending chat
+     */
+    bool awaitInput(int fd);
+
+    /**
+     * @brief Queues a chat message for the next frame boundary
+     */
+    void enqueueChat(const std::string& message);
+
+    /**
+     * @brief Chat messages waiting for a frame boundary
+     */
+    size_t queuedChat();
+};
+
+/**
+ * @class TrafficShaper
+ * @brief Process-wide shaping configuration and chat routing
+ *
+ * Rates are read once at startup from the environment (bytes/second,
+ * optional K/M/G suffix; unset or 0 = unlimited):
+ *   CHAT_RATE_GLOBAL    All relayed file data combined
+ *   CHAT_RATE_USER      All transfers uploaded by one user
+ *   CHAT_RATE_TRANSFER  A single transfer
+ *   CHAT_PACING_RATE    SO_MAX_PACING_RATE on recipient sockets
+ *   CHAT_USER_WEIGHTS   Scheduler weights, e.g. "alice=4,bob=2"
+ *
+ * Chat sends go through sendChat(): if the destination socket is in the
+ * middle of a transfer, the message is handed to that flow instead of
+ * being written into the middle of the data stream.
+ */
+class TrafficShaper {
+private:
+    static double transfer_rate;
+    static double user_rate;
+    static double pacing_rate;
+    static TokenBucket global_bucket;
+    static std::map<std::string, std::weak_ptr<TokenBucket>> user_buckets;
+    static std::map<int, TransferFlow*> flows;          // Recipient socket -> active flow
+    static std::mutex shaper_mutex;                     // Protects the two maps
+
+    friend class TransferFlow;
+
+    static std::shared_ptr<TokenBucket> userBucket(const std::string& username);
+    static void registerFlow(int socket, TransferFlow* flow);
+    static void unregisterFlow(int socket);
+
+public:
+    /**
+     * @brief Sets all limits (bytes/second, 0 = unlimited)
+     */
+    static void configure(double global_bps, double user_bps, double transfer_bps, double pacing_bps);
+
+    /**
+     * @brief Reads the CHAT_RATE_* / CHAT_PACING_RATE environment variables
+     */
+    static void configureFromEnvironment();
+
+    /**
+     * @brief Parses "2M", "512K", "1000000" into bytes (0 on error)
+     */
+    static double parseRate(const std::string& text);
+
+    static double transferRate() { return transfer_rate; }
+    static double pacingRate() { return pacing_rate; }
+    static TokenBucket& globalBucket() { return global_bucket; }
+
+    /**
+     * @brief Sends a chat message, interleaving it into an active transfer
+     * @param socket Destination client socket
+     * @param message Wire-ready (already encrypted) message
+     * @return true if the message was queued or sent
+     */
+    static bool sendChat(int socket, const std::string& message);
+
+    /**
+     * @brief Sends one recipient's copy of a room broadcast
+     * @param socket Destination client socket
+     * @param message Wire-ready message (plaintext sessions, active flows)
+     * @param record The broadcast's shared group record (secured sessions)
+     * @return true if the message was queued or sent
+     *
+     * An active flow gets message, since a record cannot go into the
+     * middle of its data stream; the flow seals it as part of the stream.
+     */
+    static bool sendGroupChat(int socket, const std::string& message, const std::string& record);
+
+    /**
+     * @brief Chat messages queued for a socket behind an active transfer
+     */
+    static size_t queuedChat(int socket);
+};
+
+#endif // TRAFFIC_SHAPER_HPP
@@ -0,0 +1,122 @@
+#ifndef TRANSFER_SCHEDULER_HPP
+#define TRANSFER_SCHEDULER_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+class TransferFlow;
+
+/**
+ * @class TransferScheduler
+ * @brief Deficit round robin over concurrent relayed transfers
+ *
+ * Without a scheduler every relay thread grabs global bandwidth as fast
+ * as its sender uploads, so the fastest uploader wins. With a global
+ * rate configured (CHAT_RATE_GLOBAL), each slice of every transfer must
+ * instead be granted by this scheduler, which hands out the global
+ * bucket with deficit round robin (DRR):
+ *
+ *   for each flow, round robin:
+ *       if it has no slice waiting:  deficit = 0, skip
+ *       deficit += QUANTUM * share
+ *       if slice <= deficit:         deficit -= slice, grant it
+ *
+ * Shares are hierarchical: a user's weight (default 1, raised for
+ * priority users via CHAT_USER_WEIGHTS="alice=4,bob=2") is split evenly
+ * across that user's concurrent transfers. So two users get equal
+ * bandwidth regardless of how many files each sends at once, and a
+ * weight-4 user gets four times a weight-1 user.
+ *
+ * Grants are paced by the global token bucket on a dedicated scheduler
+ * thread; flows wait for their grant inside TransferFlow::throttle()
+ * (where chat still gets flushed). Without a global rate nothing is
+ * scarce, so slices are not arbitrated, but per-transfer statistics
+ * are still kept for /transfers.
+ */
+class TransferScheduler {
+private:
+    struct Flow {
+        TransferFlow* flow;                             // Relay waiting for grants
+        std::string user;                               // Uploader (fairness group)
+        std::string description;                        // "alice -> bob report.pdf"
+        long total_bytes;                               // Announced transfer size
+        long sent_bytes;                                // Bytes relayed so far
+        size_t pending;                                 // Slice awaiting a grant (0 = none)
+        double deficit;                                 // DRR deficit counter
+        std::chrono::steady_clock::time_point last_grant;  // When the last slice was granted
+        std::chrono::steady_clock::time_point started;  // For the achieved rate
+    };
+
+    static std::map<uint64_t, Flow> flows;              // Active flows by id
+    static std::vector<uint64_t> round;                 // Round-robin order
+    static size_t cursor;                               // Next position in round
+    static std::map<std::string, double> user_weights;  // Priority users
+    static uint64_t next_id;
+    static bool thread_started;
+    static std::mutex scheduler_mutex;                  // Protects all of the above
+    static std::condition_variable scheduler_cv;        // Signals a new pending slice
+
+    /**
+     * @brief Scheduler thread: grants pending slices in DRR order
+     */
+    static void run();
+
+    /**
+     * @brief Share of a flow: user weight / concurrent flows of the user (lock held)
+     */
+    static double shareLocked(const Flow& flow);
+
+public:
+    static constexpr size_t QUANTUM = 16 * 1024;        // Bytes added per round at share 1.0
+    static constexpr int GRACE_MS = 20;                 // How long a just-served flow counts as backlogged
+
+    /**
+     * @brief Sets a user's weight (relative priority, default 1.0)
+     */
+    static void setUserWeight(const std::string& user, double weight);
+
+    /**
+     * @brief Parses "alice=4,bob=2" into user weights
+     */
+    static void configureWeights(const std::string& spec);
+
+    /**
+     * @brief Adds a transfer to the rotation
+     * @return Flow id used for the other calls
+     */
+    static uint64_t registerFlow(TransferFlow* flow, const std::string& user,
+                                 const std::string& description, long total_bytes);
+
+    /**
+     * @brief Removes a transfer and logs its achieved rate
+     */
+    static void unregisterFlow(uint64_t id);
+
+    /**
+     * @brief True if slices must be granted (a global rate is configured)
+     */
+    static bool arbitrating();
+
+    /**
+     * @brief Queues a slice for a grant; the grant arrives via TransferFlow::grant()
+     */
+    static void request(uint64_t id, size_t bytes);
+
+    /**
+     * @brief Counts relayed bytes for the statistics
+     */
+    static void recordSent(uint64_t id, size_t bytes);
+
+    /**
+     * @brief Human-readable table of active transfers and achieved rates
+     */
+    static std::string describe();
+};
+
+#endif // TRANSFER_SCHEDULER_HPP
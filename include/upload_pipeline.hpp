@@ -0,0 +1,81 @@
+#ifndef UPLOAD_PIPELINE_HPP
+#define UPLOAD_PIPELINE_HPP
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @struct PipelineChunk
+ * @brief One block of a file travelling through the upload pipeline
+ *
+ * Chunks are allocated once per upload and recycled from the send
+ * stage back to the read stage, so the steady state allocates nothing.
+ */
+struct PipelineChunk {
+    std::vector<uint8_t> raw;       // File bytes (capacity = block size)
+    std::vector<uint8_t> packed;    // Compressed bytes, if compression paid off
+    size_t raw_len;                 // Valid bytes in raw
+    uint8_t flags;                  // CHUNK_FLAG_* for the frame header
+
+    PipelineChunk() : raw_len(0), flags(0) {}
+
+    const uint8_t* payload() const { return packed.empty() ? raw.data() : packed.data(); }
+    size_t payloadSize() const { return packed.empty() ? raw_len : packed.size(); }
+};
+
+/**
+ * @class UploadPipeline
+ * @brief Chunked upload split into concurrent stages
+ *
+ * A single-threaded upload alternates read, CPU work and send, so each
+ * resource idles while the others work. Here every stage has its own
+ * thread and the stages are connected by bounded SPSC rings:
+ *
+ *   [read] --ring--> [hash] --ring--> [encode] --ring--> [send]
+ *     ^                                                     |
+ *     +------------------- free chunks ---------------------+
+ *
+ * - read:   read() into recycled chunks; posix_fadvise(SEQUENTIAL) plus
+ *           WILLNEED a few MB ahead so the disk is never idle
+ * - hash:   running CRC32 of the raw file, sent in the END frame
+ * - encode: compression (fanned out to a ThreadPool, consumed in order)
+ *           and XOR encryption when enabled
+ * - send:   the calling thread writes frames to the socket
+ *
+ * The number of chunks bounds memory (CHUNKS x block size) and lets
+ * each stage run ahead of the next by a few chunks; the upload then
+ * proceeds at the speed of the slowest stage. Any stage failing sets
+ * a shared abort flag that unblocks all the others.
+ *
+ * On a single-CPU host the stages cannot overlap and the handoffs only
+ * cost context switches, so run() then performs the same stages inline,
+ * one chunk at a time; the wire format is identical.
+ */
+class UploadPipeline {
+public:
+    static constexpr size_t CHUNKS = 16;                        // Buffers in circulation
+    static constexpr long READAHEAD = 4L * 1024 * 1024;         // WILLNEED window
+
+    struct Result {
+        long raw_bytes;             // File bytes sent
+        long wire_bytes;            // Frame bytes sent, headers included
+        uint32_t crc;               // CRC32 of the raw file
+    };
+
+    /**
+     * @brief Streams a file as chunk frames
+     * @param socket Destination socket
+     * @param fd Open file, positioned at the start
+     * @param file_size Bytes to send (the announced size)
+     * @param result Filled with byte counts and the checksum
+     * @param progress Called on the send thread with raw bytes sent so far
+     * @return true if the whole file and the END trailer were sent (the
+     *         trailer goes out even when the file comes up short)
+     */
+    static bool run(int socket, int fd, long file_size, Result& result,
+                    const std::function<void(long)>& progress = nullptr);
+};
+
+#endif // UPLOAD_PIPELINE_HPP
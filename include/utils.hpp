@@ -7,6 +7,7 @@
 #include <sstream>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include "binary_log.hpp"
 
 /**
  * @class Utils
@@ -23,14 +24,35 @@
  */
 class Utils {
 public:
+    static constexpr size_t MAX_USERNAME_LENGTH = 20;
+
     /**
      * @brief Logs an event with timestamp to console and file
      * @param event Event description to log
      * 
      * Format: [YYYY-MM-DD HH:MM:SS.mmm] event message
-     * Logs to both stdout and "server_log.txt" for persistence
+     * Logs to both stdout and "server_log.txt" for persistence.
+     * Asynchronous: written by AsyncLogger's background thread
      */
     static void logEvent(const std::string& event);
+
+    /**
+     * @brief Logs a catalogued event (see log_events.hpp)
+     * @param args One per placeholder in the event's format
+     *
+     * Text mode renders the format; CHAT_LOG_FORMAT=binary stores the
+     * arguments unformatted for log_decode. Events LogPolicy filters out
+     * return before anything is formatted.
+     */
+    template <typename... Args>
+    static void logEvent(LogEvent id, const Args&... args) {
+        if (!LogPolicy::admit(id)) {
+            return;
+        }
+        LogRecord record(id);
+        (record.add(args), ...);
+        record.submit();
+    }
     
     /**
      * @brief Appends an event to the log file
@@ -60,6 +82,15 @@ public:
      */
     static std::string trim(const std::string& str);
     
+    /**
+     * @brief Checks a username: 1-20 characters of a-z, A-Z, 0-9, '_', '-'
+     * @param username Name to check
+     * @return true if the name is allowed
+     */
+    static bool isValidUsername(const std::string& username);
+    
+    static constexpr size_t TIMESTAMP_LENGTH = 23;     // "YYYY-MM-DD HH:MM:SS.mmm"
+
     /**
      * @brief Gets current timestamp with millisecond precision
      * @return Formatted timestamp string
@@ -68,6 +99,16 @@ public:
      * Used for accurate event logging
      */
     static std::string getCurrentTimestamp();
+
+    /**
+     * @brief Writes the current timestamp without allocating
+     * @param out At least TIMESTAMP_LENGTH chars (no terminator written)
+     * @return TIMESTAMP_LENGTH
+     *
+     * Thread-safe; the date and time part is cached per thread and
+     * reformatted only when the second changes.
+     */
+    static size_t formatTimestamp(char* out);
     
     /**
      * @brief Checks if a file exists on the filesystem
@@ -97,6 +138,12 @@ public:
      */
     static std::string formatFileSize(long size);
     
+    /**
+     * @brief Formats a duration in nanoseconds
+     * @return "850 ns", "12.3 us", "4.1 ms" or "1.20 s"
+     */
+    static std::string formatDuration(uint64_t ns);
+    
     /**
      * @brief Converts sockaddr_in to IP address string
      * @param addr Socket address structure
@@ -105,6 +152,27 @@ public:
      * Uses inet_ntop() for safe conversion
      */
     static std::string getIPString(struct sockaddr_in addr);
+    
+    /**
+     * @brief Sends an entire buffer, retrying on partial writes
+     * @param socket Socket file descriptor
+     * @param data Buffer to send
+     * @param len Number of bytes to send
+     * @return true if every byte was sent
+     * 
+     * send() may write fewer bytes than asked for; binary protocols
+     * (delta streams, signature blobs) need the whole buffer on the wire.
+     */
+    static bool sendAll(int socket, const void* data, size_t len);
+    
+    /**
+     * @brief Receives exactly len bytes
+     * @param socket Socket file descriptor
+     * @param data Destination buffer
+     * @param len Number of bytes to receive
+     * @return true if len bytes were received, false on error or disconnect
+     */
+    static bool recvAll(int socket, void* data, size_t len);
 };
 
 #endif // UTILS_HPP
\ No newline at end of file
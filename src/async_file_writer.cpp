@@ -0,0 +1,205 @@
+#include "../include/async_file_writer.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * ASYNC FILE WRITER IMPLEMENTATION
+ * ================================
+ *
+ * Handoff protocol: `pending` is the only shared state. The receiver
+ * may set it only while it is nullptr (writer idle); the writer clears
+ * it when the buffer is on disk. The receiver never touches a buffer
+ * while it is pending, and the writer never touches the fill buffer,
+ * so the data itself needs no lock.
+ *
+ * Every handed-off buffer but the last is exactly BUFFER_SIZE, so all
+ * of them start at aligned offsets and only the tail can break the
+ * O_DIRECT alignment rules.
+ */
+
+AsyncFileWriter::AsyncFileWriter()
+    : fd(-1), direct(false), fill_index(0), fill_len(0), written(0),
+      pending(nullptr), pending_len(0), pending_offset(0), stopping(false) {
+    buffers[0] = nullptr;
+    buffers[1] = nullptr;
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    if (fd >= 0) {
+        close();
+    }
+    free(buffers[0]);
+    free(buffers[1]);
+}
+
+bool AsyncFileWriter::open(const std::string& path, long expected_size) {
+    for (int i = 0; i < 2; i++) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, ALIGNMENT, BUFFER_SIZE) != 0) {
+            failure = "out of memory";
+            return false;
+        }
+        buffers[i] = static_cast<uint8_t*>(memory);
+    }
+
+    const char* direct_io = std::getenv("CHAT_DIRECT_IO");
+    direct = direct_io && std::strcmp(direct_io, "1") == 0;
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | (direct ? O_DIRECT : 0), 0644);
+    if (fd < 0 && direct && errno == EINVAL) {
+        direct = false;  // Filesystem (e.g. tmpfs) does not support O_DIRECT
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+        failure = std::strerror(errno);
+        return false;
+    }
+
+    // Reserve the blocks now; only running out of space is fatal
+    if (expected_size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, expected_size) != 0 && errno == ENOSPC) {
+        failure = std::strerror(errno);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    writer_thread = std::thread(&AsyncFileWriter::writerLoop, this);
+    return true;
+}
+
+bool AsyncFileWriter::writeAt(const uint8_t* data, size_t len, long offset) {
+    if (direct && (len % ALIGNMENT != 0 || offset % ALIGNMENT != 0)) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        direct = false;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, data + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL && direct) {
+            // Refused at write time (some filesystems accept the open)
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+
+    if (!direct) {
+        // Start writeback now instead of letting dirty pages accumulate
+        sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WRITE);
+    }
+    return true;
+}
+
+void AsyncFileWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    for (;;) {
+        writer_cv.wait(lock, [this] { return pending != nullptr || stopping; });
+        if (!pending) {
+            return;
+        }
+
+        const uint8_t* data = pending;
+        size_t len = pending_len;
+        long offset = pending_offset;
+        bool failed = !failure.empty();
+        lock.unlock();
+
+        int err = 0;
+        if (!failed && !writeAt(data, len, offset)) {
+            err = errno ? errno : EIO;
+        }
+
+        lock.lock();
+        if (err && failure.empty()) {
+            failure = std::strerror(err);
+        }
+        pending = nullptr;
+        writer_cv.notify_all();
+    }
+}
+
+bool AsyncFileWriter::flushFill() {
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    writer_cv.wait(lock, [this] { return pending == nullptr; });
+    if (!failure.empty()) {
+        return false;
+    }
+
+    pending = buffers[fill_index];
+    pending_len = fill_len;
+    pending_offset = written;
+    written += fill_len;
+    writer_cv.notify_all();
+
+    fill_index ^= 1;
+    fill_len = 0;
+    return true;
+}
+
+uint8_t* AsyncFileWriter::buffer(size_t& room) {
+    room = BUFFER_SIZE - fill_len;
+    return buffers[fill_index] + fill_len;
+}
+
+bool AsyncFileWriter::commit(size_t len) {
+    fill_len += len;
+    if (fill_len == BUFFER_SIZE) {
+        return flushFill();
+    }
+    return true;
+}
+
+bool AsyncFileWriter::write(const void* data, size_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        size_t room;
+        uint8_t* dest = buffer(room);
+        size_t n = len < room ? len : room;
+        std::memcpy(dest, bytes, n);
+        if (!commit(n)) {
+            return false;
+        }
+        bytes += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool AsyncFileWriter::close() {
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = fill_len == 0 || flushFill();
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        stopping = true;
+    }
+    writer_cv.notify_all();
+    if (writer_thread.joinable()) {
+        writer_thread.join();
+    }
+
+    // Release preallocated blocks past the data (short or failed transfers)
+    if (ftruncate(fd, written) != 0 && failure.empty()) {
+        failure = std::strerror(errno);
+    }
+    if (::close(fd) != 0 && failure.empty()) {
+        failure = std::strerror(errno);
+    }
+    fd = -1;
+    return ok && failure.empty();
+}
+
+std::string AsyncFileWriter::error() {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    return failure;
+}
@@ -0,0 +1,435 @@
+#include "../include/async_logger.hpp"
+#include "../include/spsc_queue.hpp"
+#include "../include/utils.hpp"
+#include "../include/binary_log.hpp"
+#include "../include/log_archiver.hpp"
+#include "../include/metrics.hpp"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * ASYNC LOGGER IMPLEMENTATION
+ * ===========================
+ *
+ * Each logging thread owns one ring; it registers it (the only lock a
+ * producer ever takes) on its first line and marks it retired when it
+ * exits. The writer drains every ring in one pass, drops retired rings
+ * once they are empty, and sorts the batch by the global sequence
+ * number taken when each line was queued.
+ *
+ * Idle handshake: a producer reserves its bytes in `queued_bytes`, pushes,
+ * then reads `idle`; the writer sets `idle`, then reads `queued_bytes`.
+ * With sequentially consistent ordering at least one of them sees the
+ * other, so either the writer keeps going or the producer wakes it - no
+ * line waits for a timeout.
+ *
+ * Rotation happens on the writer thread between two batches: rename the
+ * file, open a fresh one, carry on. Producers never notice; lines queued
+ * meanwhile go into the new file.
+ */
+
+namespace {
+
+const std::chrono::milliseconds BUSY_PAUSE(1);      // Let a burst gather into one batch
+const std::chrono::milliseconds IDLE_WAIT(1000);    // Only to report drops while idle
+const size_t DEFAULT_BUFFER_KB = 4096;
+const size_t DEFAULT_ROTATE_KB = 64 * 1024;
+
+enum State { NOT_STARTED, RUNNING, SHUT_DOWN };
+
+struct Entry {
+    uint64_t sequence;
+    bool echo;
+    std::string text;                   // Includes the trailing '\n'
+};
+
+struct Ring {
+    SpscQueue<Entry> queue;
+    std::atomic<bool> retired;          // Owner thread exited; no more pushes
+
+    Ring() : queue(AsyncLogger::RING_ENTRIES), retired(false) {}
+};
+
+/**
+ * Thread-local owner of a ring; retires it when the thread exits
+ */
+struct RingHandle {
+    std::shared_ptr<Ring> ring;
+
+    ~RingHandle() {
+        if (ring) {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+struct Shared {
+    std::once_flag started;
+    std::atomic<int> state{NOT_STARTED};
+    int fd = -1;
+    size_t budget = DEFAULT_BUFFER_KB * 1024;
+    bool block_on_overflow = false;
+    bool binary = false;
+    const char* path = nullptr;         // LOG_FILE or BINARY_LOG_FILE
+
+    // Rotation; only the writer thread touches these after start()
+    size_t rotate_bytes = DEFAULT_ROTATE_KB * 1024;     // 0 = no size limit
+    long rotate_seconds = 0;                            // 0 = no age limit
+    size_t file_bytes = 0;              // Events in the current file
+    std::chrono::steady_clock::time_point file_opened;
+
+    std::mutex rings_mutex;             // Registration vs. draining
+    std::vector<std::shared_ptr<Ring>> rings;
+
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<size_t> queued_bytes{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> idle{false};
+
+    std::thread writer;
+    std::mutex wake_mutex;              // Protects the fields below
+    std::condition_variable wake_cv;
+    std::condition_variable cycle_cv;
+    bool wake = false;
+    bool stopping = false;
+    unsigned flushing = 0;              // Threads waiting in flush()
+    uint64_t cycles = 0;                // Completed drain passes
+
+    std::mutex direct_mutex;            // Synchronous writes after shutdown
+};
+
+/**
+ * Never destroyed: detached threads may still log during exit
+ */
+Shared& shared() {
+    static Shared* instance = new Shared;
+    return *instance;
+}
+
+thread_local RingHandle local_ring;
+
+void writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;                     // Nowhere left to report it
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+void wakeWriter(Shared& s) {
+    std::lock_guard<std::mutex> lock(s.wake_mutex);
+    s.wake = true;
+    s.wake_cv.notify_one();
+}
+
+/**
+ * Moves everything queued into batch; drops finished threads' rings
+ */
+void drain(Shared& s, std::vector<Entry>& batch) {
+    std::lock_guard<std::mutex> lock(s.rings_mutex);
+    Entry entry;
+    size_t bytes = 0;
+    for (auto it = s.rings.begin(); it != s.rings.end();) {
+        bool retired = (*it)->retired.load(std::memory_order_acquire);
+        while ((*it)->queue.tryPop(entry)) {
+            bytes += entry.text.size();
+            batch.push_back(std::move(entry));
+        }
+        it = retired ? s.rings.erase(it) : it + 1;
+    }
+    if (bytes > 0) {
+        s.queued_bytes.fetch_sub(bytes);
+        Metrics::adjust(Gauge::LOG_QUEUED_BYTES, -static_cast<int64_t>(bytes));
+    }
+}
+
+/**
+ * Opens the log file; a binary segment starts with its header
+ */
+int openLogFile(Shared& s) {
+    int fd = ::open(s.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    s.file_bytes = 0;
+    s.file_opened = std::chrono::steady_clock::now();
+    if (fd < 0) {
+        return fd;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        s.file_bytes = static_cast<size_t>(st.st_size);
+    }
+    if (s.binary) {
+        std::string header = BinaryLog::segmentHeader();
+        writeAll(fd, header.data(), header.size());
+    }
+    return fd;
+}
+
+bool rotationDue(const Shared& s) {
+    if (s.fd < 0 || s.file_bytes == 0) {
+        return false;
+    }
+    if (s.rotate_bytes > 0 && s.file_bytes >= s.rotate_bytes) {
+        return true;
+    }
+    return s.rotate_seconds > 0 &&
+           std::chrono::steady_clock::now() - s.file_opened >= std::chrono::seconds(s.rotate_seconds);
+}
+
+/**
+ * Closes the current file under a time-stamped name and hands it to
+ * LogArchiver; on failure logging continues in the old file
+ */
+void rotate(Shared& s) {
+    std::string segment = LogArchiver::rotatedName(s.path);
+    if (::rename(s.path, segment.c_str()) != 0) {
+        s.file_opened = std::chrono::steady_clock::now();    // Retry later, not every batch
+        return;
+    }
+    int fd = openLogFile(s);
+    if (fd < 0) {
+        ::rename(segment.c_str(), s.path);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(s.direct_mutex);
+        ::close(s.fd);
+        s.fd = fd;
+    }
+    LogArchiver::archive(segment);
+}
+
+void writerLoop() {
+    Shared& s = shared();
+    std::vector<Entry> batch;
+    std::string file_out;
+    std::string echo_out;
+    uint64_t reported = 0;
+
+    for (;;) {
+        bool stop;
+        {
+            std::lock_guard<std::mutex> lock(s.wake_mutex);
+            stop = s.stopping;
+            s.wake = false;
+        }
+
+        batch.clear();
+        drain(s, batch);
+        if (!batch.empty()) {
+            std::sort(batch.begin(), batch.end(), [](const Entry& a, const Entry& b) {
+                return a.sequence < b.sequence;
+            });
+            file_out.clear();
+            echo_out.clear();
+            for (const Entry& entry : batch) {
+                file_out += entry.text;
+                if (entry.echo) {
+                    echo_out += entry.text;
+                }
+            }
+            if (s.fd >= 0) {
+                writeAll(s.fd, file_out.data(), file_out.size());
+                s.file_bytes += file_out.size();
+            }
+            writeAll(STDOUT_FILENO, echo_out.data(), echo_out.size());
+        }
+        if (!stop && rotationDue(s)) {
+            rotate(s);
+        }
+        // Queued like any other event; written on the next pass
+        uint64_t dropped = s.dropped.load(std::memory_order_relaxed);
+        if (dropped != reported) {
+            Utils::logEvent(LogEvent::LOG_DROPPED, dropped - reported);
+            reported = dropped;
+        }
+
+        std::unique_lock<std::mutex> lock(s.wake_mutex);
+        s.cycles++;
+        s.cycle_cv.notify_all();
+        if (stop) {
+            return;
+        }
+        auto woken = [&s]() { return s.wake || s.stopping || s.flushing > 0; };
+        if (!batch.empty()) {
+            s.wake_cv.wait_for(lock, BUSY_PAUSE, woken);
+            continue;
+        }
+        s.idle.store(true);
+        if (s.queued_bytes.load() == 0) {
+            s.wake_cv.wait_for(lock, IDLE_WAIT, woken);
+        }
+        s.idle.store(false, std::memory_order_relaxed);
+    }
+}
+
+void shutdownAtExit() {
+    AsyncLogger::shutdown();
+}
+
+void start() {
+    Shared& s = shared();
+    if (const char* kb = std::getenv("CHAT_LOG_BUFFER_KB")) {
+        long value = std::atol(kb);
+        if (value > 0) {
+            s.budget = static_cast<size_t>(value) * 1024;
+        }
+    }
+    if (const char* policy = std::getenv("CHAT_LOG_OVERFLOW")) {
+        s.block_on_overflow = std::strcmp(policy, "block") == 0;
+    }
+    if (const char* format = std::getenv("CHAT_LOG_FORMAT")) {
+        s.binary = std::strcmp(format, "binary") == 0;
+    }
+    if (const char* kb = std::getenv("CHAT_LOG_ROTATE_KB")) {
+        long value = std::atol(kb);
+        s.rotate_bytes = value > 0 ? static_cast<size_t>(value) * 1024 : 0;
+    }
+    if (const char* seconds = std::getenv("CHAT_LOG_ROTATE_SECONDS")) {
+        s.rotate_seconds = std::max(0L, std::atol(seconds));
+    }
+    s.path = s.binary ? AsyncLogger::BINARY_LOG_FILE : AsyncLogger::LOG_FILE;
+    // Without a log file lines still go to stdout
+    s.fd = openLogFile(s);
+    if (s.rotate_bytes > 0 || s.rotate_seconds > 0) {
+        LogArchiver::start(s.path);
+    }
+
+    s.writer = std::thread(writerLoop);
+    s.state.store(RUNNING, std::memory_order_release);
+    std::atexit(shutdownAtExit);
+}
+
+void writeDirect(Shared& s, const std::string& line, bool echo) {
+    std::lock_guard<std::mutex> lock(s.direct_mutex);
+    if (s.fd >= 0) {
+        writeAll(s.fd, line.data(), line.size());
+    }
+    if (echo) {
+        writeAll(STDOUT_FILENO, line.data(), line.size());
+    }
+}
+
+/**
+ * Claims room for len bytes; a line larger than the budget still fits
+ * into an empty buffer
+ */
+bool reserve(Shared& s, size_t len) {
+    size_t before = s.queued_bytes.fetch_add(len);
+    if (before != 0 && before + len > s.budget) {
+        s.queued_bytes.fetch_sub(len);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+void AsyncLogger::write(std::string line, bool echo) {
+    line.push_back('\n');
+    enqueue(std::move(line), echo);
+}
+
+void AsyncLogger::writeRecord(std::string record) {
+    enqueue(std::move(record), false);
+}
+
+bool AsyncLogger::binary() {
+    Shared& s = shared();
+    std::call_once(s.started, start);
+    return s.binary;
+}
+
+void AsyncLogger::enqueue(std::string line, bool echo) {
+    Shared& s = shared();
+    std::call_once(s.started, start);
+    if (s.state.load(std::memory_order_acquire) != RUNNING) {
+        writeDirect(s, line, echo);
+        return;
+    }
+
+    if (!local_ring.ring) {
+        local_ring.ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(s.rings_mutex);
+        s.rings.push_back(local_ring.ring);
+    }
+
+    Entry entry{0, echo, std::move(line)};
+    size_t len = entry.text.size();
+    for (;;) {
+        if (reserve(s, len)) {
+            entry.sequence = s.sequence.fetch_add(1, std::memory_order_relaxed);
+            if (local_ring.ring->queue.tryPush(std::move(entry))) {
+                Metrics::adjust(Gauge::LOG_QUEUED_BYTES, static_cast<int64_t>(len));
+                break;
+            }
+            s.queued_bytes.fetch_sub(len);
+        }
+        if (!s.block_on_overflow) {
+            s.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (s.state.load(std::memory_order_acquire) != RUNNING) {
+            writeDirect(s, entry.text, echo);
+            return;
+        }
+        wakeWriter(s);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    // Half a ring left: cut the writer's pause short before lines drop
+    if (s.idle.load() || local_ring.ring->queue.size() > RING_ENTRIES / 2) {
+        wakeWriter(s);
+    }
+}
+
+void AsyncLogger::flush() {
+    Shared& s = shared();
+    if (s.state.load(std::memory_order_acquire) != RUNNING) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(s.wake_mutex);
+    // The pass in progress may have missed our lines; the one after cannot
+    uint64_t target = s.cycles + 2;
+    s.flushing++;
+    s.wake_cv.notify_one();
+    s.cycle_cv.wait(lock, [&s, target]() { return s.cycles >= target || s.stopping; });
+    s.flushing--;
+}
+
+void AsyncLogger::shutdown() {
+    Shared& s = shared();
+    int expected = RUNNING;
+    if (!s.state.compare_exchange_strong(expected, SHUT_DOWN)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(s.wake_mutex);
+        s.stopping = true;
+        s.wake_cv.notify_one();
+        s.cycle_cv.notify_all();
+    }
+    // The writer's last pass drains whatever was queued before the switch
+    if (s.writer.joinable()) {
+        s.writer.join();
+    }
+    LogArchiver::stop();
+}
+
+uint64_t AsyncLogger::dropped() {
+    return shared().dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,107 @@
+#include "../include/binary_log.hpp"
+#include <cstring>
+#include <time.h>
+
+/**
+ * BINARY LOG IMPLEMENTATION
+ * =========================
+ *
+ * The format shared by writer and decoder: the event table, segment
+ * headers, varints and placeholder parsing. Depends on nothing else in
+ * the tree, so log_decode links it on its own; records are built in
+ * log_record.cpp.
+ */
+
+namespace {
+
+struct EventInfo {
+    const char* name;
+    const char* format;
+};
+
+const EventInfo EVENTS[] = {
+#define CHAT_LOG_EVENT_INFO(id, category, level, format) {#id, format},
+    CHAT_LOG_EVENTS(CHAT_LOG_EVENT_INFO)
+#undef CHAT_LOG_EVENT_INFO
+};
+
+uint64_t clockNanos(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+}  // namespace
+
+const char* BinaryLog::eventName(LogEvent id) {
+    size_t index = static_cast<size_t>(id);
+    return index < static_cast<size_t>(LogEvent::COUNT) ? EVENTS[index].name : "UNKNOWN";
+}
+
+const char* BinaryLog::eventFormat(LogEvent id) {
+    size_t index = static_cast<size_t>(id);
+    return index < static_cast<size_t>(LogEvent::COUNT) ? EVENTS[index].format : "";
+}
+
+void BinaryLog::putLe(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+uint64_t BinaryLog::monotonicNanos() {
+    return clockNanos(CLOCK_MONOTONIC);
+}
+
+void BinaryLog::putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+std::string BinaryLog::segmentHeader() {
+    std::string out(2, '\0');
+    putLe(out, SEGMENT_HEADER, 2);
+    out.append(MAGIC, 8);
+    putLe(out, clockNanos(CLOCK_REALTIME), 8);
+    putLe(out, monotonicNanos(), 8);
+    putLe(out, static_cast<uint64_t>(LogEvent::COUNT), 2);
+    for (const EventInfo& event : EVENTS) {
+        size_t name_len = std::strlen(event.name);
+        size_t format_len = std::strlen(event.format);
+        putLe(out, name_len, 1);
+        out.append(event.name, name_len);
+        putLe(out, format_len, 2);
+        out.append(event.format, format_len);
+    }
+    size_t length = out.size() - 2;
+    out[0] = static_cast<char>(length);
+    out[1] = static_cast<char>(length >> 8);
+    return out;
+}
+
+bool BinaryLog::nextField(const char*& pos, std::string& out, std::string* name, FieldKind& kind) {
+    const char* open = std::strchr(pos, '{');
+    const char* close = open ? std::strchr(open, '}') : nullptr;
+    if (!close) {
+        out.append(pos);
+        pos += std::strlen(pos);
+        return false;
+    }
+    out.append(pos, open - pos);
+    const char* colon = static_cast<const char*>(std::memchr(open, ':', close - open));
+    kind = !colon ? FieldKind::PLAIN :
+           std::strncmp(colon, ":size}", 6) == 0 ? FieldKind::SIZE :
+           std::strncmp(colon, ":content}", 9) == 0 ? FieldKind::CONTENT : FieldKind::PLAIN;
+    if (name) {
+        name->assign(open + 1, (colon ? colon : close) - open - 1);
+    }
+    pos = close + 1;
+    return true;
+}
+
+std::string BinaryLog::redacted(uint64_t bytes) {
+    return "<" + std::to_string(bytes) + " bytes>";
+}
@@ -0,0 +1,935 @@
+#include "../include/chacha20_poly1305.hpp"
+#include "../include/cpu_dispatch.hpp"
+#include <cstring>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHACHA_X86 1
+#endif
+
+/**
+ * CHACHA20-POLY1305 IMPLEMENTATION
+ * ================================
+ *
+ * ChaCha20 bulk path: the AVX2 kernel keeps the 16-word state of 8
+ * consecutive blocks "transposed" - register i holds word i of all 8
+ * blocks - so every quarter-round step is one vector instruction for 8
+ * blocks. Rotations by 16 and 8 are byte shuffles; by 12 and 7 are
+ * shift pairs. After the rounds an 8x8 transpose per half turns the
+ * registers back into 8 contiguous 64-byte blocks for the XOR.
+ *
+ * Poly1305 is the 64-bit "donna" formulation: h and r in 44/44/42-bit
+ * limbs, products in unsigned __int128, reduction by 2^130 = 5 (mod p).
+ * Inputs of 256 bytes or more go through a 4-lane AVX2 kernel instead:
+ * lane j accumulates blocks j, j+4, ... multiplied by r^4 per step,
+ * in 26-bit limbs so 32x32-bit vector multiplies suffice; the lanes are
+ * weighted by r^4..r^1 on the last step and summed back into h.
+ *
+ * Kernels are picked through CpuDispatch (AVX2, a 4-block SSE2 ChaCha20,
+ * or scalar); the self-tests at the end check each against scalar.
+ */
+
+namespace {
+
+inline uint32_t load32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void store32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+inline uint64_t load64(const uint8_t* p) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+#else
+    return static_cast<uint64_t>(load32(p)) | (static_cast<uint64_t>(load32(p + 4)) << 32);
+#endif
+}
+
+inline void store64(uint8_t* p, uint64_t v) {
+    store32(p, static_cast<uint32_t>(v));
+    store32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+inline uint32_t rotl(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+/**
+ * Initial state: constants | key | counter | nonce
+ */
+void initState(uint32_t state[16], const uint8_t key[32], uint32_t counter, const uint8_t nonce[12]) {
+    state[0] = 0x61707865;  // "expand 32-byte k"
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) {
+        state[4 + i] = load32(key + 4 * i);
+    }
+    state[12] = counter;
+    state[13] = load32(nonce);
+    state[14] = load32(nonce + 4);
+    state[15] = load32(nonce + 8);
+}
+
+#define CHACHA_QR(a, b, c, d)                 \
+    a += b; d ^= a; d = rotl(d, 16);          \
+    c += d; b ^= c; b = rotl(b, 12);          \
+    a += b; d ^= a; d = rotl(d, 8);           \
+    c += d; b ^= c; b = rotl(b, 7);
+
+/**
+ * One block with the portable code
+ */
+void blockScalar(const uint32_t state[16], uint8_t out[64]) {
+    uint32_t x[16];
+    std::memcpy(x, state, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        CHACHA_QR(x[0], x[4], x[8], x[12]);
+        CHACHA_QR(x[1], x[5], x[9], x[13]);
+        CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CHACHA_QR(x[2], x[7], x[8], x[13]);
+        CHACHA_QR(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++) {
+        store32(out + 4 * i, x[i] + state[i]);
+    }
+}
+
+/**
+ * Bulk kernel signature: XORs whole groups of blocks (8 for AVX2, 4 for
+ * SSE2, 1 for scalar), advances state[12] past them
+ * @return Bytes processed
+ */
+typedef size_t (*BulkKernel)(uint32_t state[16], const uint8_t* in, uint8_t* out, size_t len);
+
+size_t bulkScalar(uint32_t state[16], const uint8_t* in, uint8_t* out, size_t len) {
+    uint8_t ks[64];
+    size_t done = 0;
+    for (; done + 64 <= len; done += 64) {
+        blockScalar(state, ks);
+        state[12]++;
+        for (size_t i = 0; i < 64; i++) {
+            out[done + i] = in[done + i] ^ ks[i];
+        }
+    }
+    return done;
+}
+
+#ifdef CHACHA_X86
+/**
+ * SSE2: 4 blocks per pass, one state word of all 4 blocks per register.
+ * No byte shuffle before SSSE3, so rotate by 16 swaps 16-bit halves and
+ * the other rotations are shift pairs.
+ */
+#define CHACHA_ROTL4(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define CHACHA_QR4(a, b, c, d)                                                                    \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a);                                             \
+    d = _mm_shufflehi_epi16(_mm_shufflelo_epi16(d, 0xB1), 0xB1);                                  \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL4(b, 12);                    \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_ROTL4(d, 8);                     \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL4(b, 7);
+
+__attribute__((target("sse2")))
+size_t bulkSse2(uint32_t state[16], const uint8_t* in, uint8_t* out, size_t len) {
+    if (len < 256) {
+        return 0;
+    }
+    __m128i base[16];
+    for (int i = 0; i < 16; i++) {
+        base[i] = _mm_set1_epi32(static_cast<int>(state[i]));
+    }
+    base[12] = _mm_add_epi32(base[12], _mm_set_epi32(3, 2, 1, 0));
+    const __m128i four = _mm_set1_epi32(4);
+    size_t done = 0;
+
+    for (; done + 256 <= len; done += 256) {
+        __m128i x0 = base[0], x1 = base[1], x2 = base[2], x3 = base[3];
+        __m128i x4 = base[4], x5 = base[5], x6 = base[6], x7 = base[7];
+        __m128i x8 = base[8], x9 = base[9], x10 = base[10], x11 = base[11];
+        __m128i x12 = base[12], x13 = base[13], x14 = base[14], x15 = base[15];
+
+        for (int round = 0; round < 10; round++) {
+            CHACHA_QR4(x0, x4, x8, x12);
+            CHACHA_QR4(x1, x5, x9, x13);
+            CHACHA_QR4(x2, x6, x10, x14);
+            CHACHA_QR4(x3, x7, x11, x15);
+            CHACHA_QR4(x0, x5, x10, x15);
+            CHACHA_QR4(x1, x6, x11, x12);
+            CHACHA_QR4(x2, x7, x8, x13);
+            CHACHA_QR4(x3, x4, x9, x14);
+        }
+
+        __m128i x[16] = {x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15};
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm_add_epi32(x[i], base[i]);
+        }
+
+        // Words 4g..4g+3 of the 4 blocks -> 16 bytes at offset 16g of each block
+        for (int g = 0; g < 4; g++) {
+            __m128i* v = x + 4 * g;
+            __m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+            __m128i t1 = _mm_unpacklo_epi32(v[2], v[3]);
+            __m128i t2 = _mm_unpackhi_epi32(v[0], v[1]);
+            __m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+            __m128i rows[4] = {
+                _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+                _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3),
+            };
+            for (int b = 0; b < 4; b++) {
+                const __m128i* src = reinterpret_cast<const __m128i*>(in + done + 64 * b + 16 * g);
+                __m128i* dst = reinterpret_cast<__m128i*>(out + done + 64 * b + 16 * g);
+                _mm_storeu_si128(dst, _mm_xor_si128(_mm_loadu_si128(src), rows[b]));
+            }
+        }
+        base[12] = _mm_add_epi32(base[12], four);
+        state[12] += 4;
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+inline __m256i rotl16(__m256i v) {
+    const __m256i mask = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                         13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+    return _mm256_shuffle_epi8(v, mask);
+}
+
+__attribute__((target("avx2")))
+inline __m256i rotl8(__m256i v) {
+    const __m256i mask = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                         14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+    return _mm256_shuffle_epi8(v, mask);
+}
+
+#define CHACHA_QR8(a, b, c, d)                                                                    \
+    a = _mm256_add_epi32(a, b); d = rotl16(_mm256_xor_si256(d, a));                              \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c);                                       \
+    b = _mm256_or_si256(_mm256_slli_epi32(b, 12), _mm256_srli_epi32(b, 20));                      \
+    a = _mm256_add_epi32(a, b); d = rotl8(_mm256_xor_si256(d, a));                               \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c);                                       \
+    b = _mm256_or_si256(_mm256_slli_epi32(b, 7), _mm256_srli_epi32(b, 25));
+
+/**
+ * 8x8 transpose of 32-bit words: row i of the result is column i of the input
+ * Result rows come out in the order 0,4,1,5,2,6,3,7 (see the stores below).
+ */
+__attribute__((target("avx2")))
+inline void transpose8(__m256i v[8]) {
+    __m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    v[0] = _mm256_permute2x128_si256(u0, u4, 0x20);  // block 0
+    v[4] = _mm256_permute2x128_si256(u0, u4, 0x31);  // block 4
+    v[1] = _mm256_permute2x128_si256(u1, u5, 0x20);  // block 1
+    v[5] = _mm256_permute2x128_si256(u1, u5, 0x31);  // block 5
+    v[2] = _mm256_permute2x128_si256(u2, u6, 0x20);  // block 2
+    v[6] = _mm256_permute2x128_si256(u2, u6, 0x31);  // block 6
+    v[3] = _mm256_permute2x128_si256(u3, u7, 0x20);  // block 3
+    v[7] = _mm256_permute2x128_si256(u3, u7, 0x31);  // block 7
+}
+
+__attribute__((target("avx2")))
+size_t bulkAvx2(uint32_t state[16], const uint8_t* in, uint8_t* out, size_t len) {
+    if (len < 512) {
+        return 0;
+    }
+    __m256i base[16];
+    for (int i = 0; i < 16; i++) {
+        base[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+    }
+    base[12] = _mm256_add_epi32(base[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    const __m256i eight = _mm256_set1_epi32(8);
+    size_t done = 0;
+
+    for (; done + 512 <= len; done += 512) {
+        __m256i x0 = base[0], x1 = base[1], x2 = base[2], x3 = base[3];
+        __m256i x4 = base[4], x5 = base[5], x6 = base[6], x7 = base[7];
+        __m256i x8 = base[8], x9 = base[9], x10 = base[10], x11 = base[11];
+        __m256i x12 = base[12], x13 = base[13], x14 = base[14], x15 = base[15];
+
+        for (int round = 0; round < 10; round++) {
+            CHACHA_QR8(x0, x4, x8, x12);
+            CHACHA_QR8(x1, x5, x9, x13);
+            CHACHA_QR8(x2, x6, x10, x14);
+            CHACHA_QR8(x3, x7, x11, x15);
+            CHACHA_QR8(x0, x5, x10, x15);
+            CHACHA_QR8(x1, x6, x11, x12);
+            CHACHA_QR8(x2, x7, x8, x13);
+            CHACHA_QR8(x3, x4, x9, x14);
+        }
+
+        __m256i x[16] = {x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15};
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm256_add_epi32(x[i], base[i]);
+        }
+
+        // x[0..7] -> first 32 bytes of each block, x[8..15] -> second 32 bytes
+        transpose8(x);
+        transpose8(x + 8);
+        for (int b = 0; b < 8; b++) {
+            const __m256i* src = reinterpret_cast<const __m256i*>(in + done + 64 * b);
+            __m256i* dst = reinterpret_cast<__m256i*>(out + done + 64 * b);
+            _mm256_storeu_si256(dst, _mm256_xor_si256(_mm256_loadu_si256(src), x[b]));
+            _mm256_storeu_si256(dst + 1, _mm256_xor_si256(_mm256_loadu_si256(src + 1), x[8 + b]));
+        }
+        base[12] = _mm256_add_epi32(base[12], eight);
+        state[12] += 8;
+    }
+    return done;
+}
+#endif
+
+const KernelVariant<BulkKernel> BULK_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", bulkScalar},
+#ifdef CHACHA_X86
+    {SimdLevel::SSE2, "sse2", bulkSse2},
+    {SimdLevel::AVX2, "avx2", bulkAvx2},
+#endif
+};
+
+/**
+ * XOR keystream into data from an initialized state (advances state[12])
+ */
+void xorWithKernel(BulkKernel bulk, uint32_t state[16], const uint8_t* in, uint8_t* out, size_t len) {
+    size_t done = bulk(state, in, out, len);
+    uint8_t ks[64];
+    while (done < len) {
+        blockScalar(state, ks);
+        state[12]++;
+        size_t n = len - done < 64 ? len - done : 64;
+        for (size_t i = 0; i < n; i++) {
+            out[done + i] = in[done + i] ^ ks[i];
+        }
+        done += n;
+    }
+}
+
+void xorWithState(uint32_t state[16], const uint8_t* in, uint8_t* out, size_t len) {
+    static const BulkKernel bulk = CpuDispatch::select("chacha20", BULK_VARIANTS).fn;
+    xorWithKernel(bulk, state, in, out, len);
+}
+
+/**
+ * Best-effort wipe the compiler may not elide
+ */
+void wipe(void* p, size_t len) {
+    volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+    while (len--) {
+        *v++ = 0;
+    }
+}
+
+const uint8_t ZERO_PAD[16] = {0};
+
+}  // namespace
+
+/* ===================== ChaCha20 ===================== */
+
+void ChaCha20::xorStream(const uint8_t key[KEY_SIZE], uint32_t counter, const uint8_t nonce[NONCE_SIZE],
+                         const uint8_t* in, uint8_t* out, size_t len) {
+    uint32_t state[16];
+    initState(state, key, counter, nonce);
+    xorWithState(state, in, out, len);
+    wipe(state, sizeof(state));
+}
+
+void ChaCha20::block(const uint8_t key[KEY_SIZE], uint32_t counter, const uint8_t nonce[NONCE_SIZE],
+                     uint8_t out[BLOCK_SIZE]) {
+    uint32_t state[16];
+    initState(state, key, counter, nonce);
+    blockScalar(state, out);
+    wipe(state, sizeof(state));
+}
+
+/* ===================== Poly1305 ===================== */
+
+namespace {
+
+typedef unsigned __int128 u128;
+const uint64_t MASK44 = 0xfffffffffffULL;
+const uint64_t MASK42 = 0x3ffffffffffULL;
+const uint64_t MASK26 = 0x3ffffffULL;
+
+/**
+ * out = a * b mod 2^130 - 5, all in 44/44/42-bit limbs, fully carried
+ */
+void mul130(uint64_t out[3], const uint64_t a[3], const uint64_t b[3]) {
+    const uint64_t s1 = b[1] * 20, s2 = b[2] * 20;  // 2^132 = 4 * 5 mod p
+    u128 d0 = (u128)a[0] * b[0] + (u128)a[1] * s2 + (u128)a[2] * s1;
+    u128 d1 = (u128)a[0] * b[1] + (u128)a[1] * b[0] + (u128)a[2] * s2;
+    u128 d2 = (u128)a[0] * b[2] + (u128)a[1] * b[1] + (u128)a[2] * b[0];
+
+    uint64_t c = static_cast<uint64_t>(d0 >> 44);
+    uint64_t h0 = static_cast<uint64_t>(d0) & MASK44;
+    d1 += c;
+    c = static_cast<uint64_t>(d1 >> 44);
+    uint64_t h1 = static_cast<uint64_t>(d1) & MASK44;
+    d2 += c;
+    c = static_cast<uint64_t>(d2 >> 42);
+    uint64_t h2 = static_cast<uint64_t>(d2) & MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c; c = h1 >> 44; h1 &= MASK44;
+    h2 += c;
+    out[0] = h0;
+    out[1] = h1;
+    out[2] = h2;
+}
+
+/**
+ * 44/44/42-bit limbs (carried) -> five 26-bit limbs
+ */
+void to26(const uint64_t h[3], uint32_t l[5]) {
+    l[0] = static_cast<uint32_t>(h[0] & MASK26);
+    l[1] = static_cast<uint32_t>(((h[0] >> 26) | (h[1] << 18)) & MASK26);
+    l[2] = static_cast<uint32_t>((h[1] >> 8) & MASK26);
+    l[3] = static_cast<uint32_t>(((h[1] >> 34) | (h[2] << 10)) & MASK26);
+    l[4] = static_cast<uint32_t>(h[2] >> 16);
+}
+
+/**
+ * r^4, r^3, r^2, r in 26-bit limbs for the vector kernels
+ */
+void powersOf(const uint64_t r[3], uint32_t powers[4][5]) {
+    uint64_t r2[3], r3[3], r4[3];
+    mul130(r2, r, r);
+    mul130(r3, r2, r);
+    mul130(r4, r3, r);
+    to26(r4, powers[0]);
+    to26(r3, powers[1]);
+    to26(r2, powers[2]);
+    to26(r, powers[3]);
+}
+
+/**
+ * 26-bit limbs -> 44/44/42-bit limbs
+ */
+void from26(const uint32_t l[5], uint64_t h[3]) {
+    h[0] = (l[0] | (static_cast<uint64_t>(l[1]) << 26)) & MASK44;
+    h[1] = ((l[1] >> 18) | (static_cast<uint64_t>(l[2]) << 8) | (static_cast<uint64_t>(l[3]) << 34)) & MASK44;
+    h[2] = (l[3] >> 10) | (static_cast<uint64_t>(l[4]) << 16);
+}
+
+/**
+ * h = (h + block) * r for each 16-byte block (the donna inner loop)
+ */
+void polyBlocks(uint64_t h[3], const uint64_t r[3], const uint8_t* data, size_t len, uint64_t hibit) {
+    const uint64_t r0 = r[0], r1 = r[1], r2 = r[2];
+    const uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+
+    while (len >= 16) {
+        uint64_t t0 = load64(data);
+        uint64_t t1 = load64(data + 8);
+        h0 += t0 & MASK44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+        h2 += ((t1 >> 24) & MASK42) | hibit;
+
+        u128 d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        u128 d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        u128 d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+
+        uint64_t c = static_cast<uint64_t>(d0 >> 44);
+        h0 = static_cast<uint64_t>(d0) & MASK44;
+        d1 += c;
+        c = static_cast<uint64_t>(d1 >> 44);
+        h1 = static_cast<uint64_t>(d1) & MASK44;
+        d2 += c;
+        c = static_cast<uint64_t>(d2 >> 42);
+        h2 = static_cast<uint64_t>(d2) & MASK42;
+        h0 += c * 5;
+        c = h0 >> 44;
+        h0 &= MASK44;
+        h1 += c;
+
+        data += 16;
+        len -= 16;
+    }
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+}
+
+/**
+ * Fully reduces h mod 2^130 - 5 (constant time)
+ */
+void reduce130(uint64_t h[3]) {
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+    uint64_t c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c; c = h1 >> 44; h1 &= MASK44;
+    h2 += c; c = h2 >> 42; h2 &= MASK42;
+    h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+    h1 += c;
+
+    // g = h + -p = h - (2^130 - 5); select g if h >= p
+    uint64_t g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+    uint64_t g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+    uint64_t g2 = h2 + c - (1ULL << 42);
+
+    uint64_t select = (g2 >> 63) - 1;  // all ones if no borrow
+    g0 &= select;
+    g1 &= select;
+    g2 &= select;
+    select = ~select;
+    h[0] = (h0 & select) | g0;
+    h[1] = (h1 & select) | g1;
+    h[2] = (h2 & select) | g2;
+}
+
+/**
+ * Vector kernel signature: absorbs whole 64-byte groups into h
+ * @return Bytes processed (a multiple of 64)
+ */
+typedef size_t (*PolyKernel)(uint64_t h[3], const uint32_t powers[4][5], const uint8_t* data, size_t len);
+
+#ifdef CHACHA_X86
+/**
+ * AVX2 Poly1305: four interleaved accumulators
+ * -------------------------------------------
+ * Lane j absorbs blocks j, j+4, j+8, ... and is multiplied by r^4 per
+ * step; on the last step lanes are multiplied by r^4, r^3, r^2, r so
+ * that their sum equals the sequential result. Limbs are 26 bits in
+ * 64-bit lanes, so _mm256_mul_epu32 products and sums fit in 64 bits.
+ */
+__attribute__((target("avx2")))
+size_t polyAvx2(uint64_t h[3], const uint32_t powers[4][5], const uint8_t* data, size_t len) {
+    const size_t groups = len / 64;
+    const __m256i m26 = _mm256_set1_epi64x(MASK26);
+    const __m256i hibit = _mm256_set1_epi64x(1 << 24);  // 2^128 in limb 4
+
+    __m256i R[5], S[5], RL[5], SL[5];
+    for (int k = 0; k < 5; k++) {
+        R[k] = _mm256_set1_epi64x(powers[0][k]);
+        S[k] = _mm256_set1_epi64x(powers[0][k] * 5ULL);
+        RL[k] = _mm256_set_epi64x(powers[3][k], powers[2][k], powers[1][k], powers[0][k]);
+        SL[k] = _mm256_set_epi64x(powers[3][k] * 5ULL, powers[2][k] * 5ULL, powers[1][k] * 5ULL, powers[0][k] * 5ULL);
+    }
+
+    // The running h enters through lane 0
+    uint64_t carried[3] = {h[0], h[1], h[2]};
+    uint64_t c = carried[0] >> 44; carried[0] &= MASK44; carried[1] += c;
+    c = carried[1] >> 44; carried[1] &= MASK44; carried[2] += c;
+    uint32_t start[5];
+    to26(carried, start);
+    __m256i H0 = _mm256_set_epi64x(0, 0, 0, start[0]);
+    __m256i H1 = _mm256_set_epi64x(0, 0, 0, start[1]);
+    __m256i H2 = _mm256_set_epi64x(0, 0, 0, start[2]);
+    __m256i H3 = _mm256_set_epi64x(0, 0, 0, start[3]);
+    __m256i H4 = _mm256_set_epi64x(0, 0, 0, start[4]);
+
+    for (size_t g = 0; g < groups; g++) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 64 * g));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 64 * g + 32));
+        __m256i t0 = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), 0xD8);  // low halves of blocks 0-3
+        __m256i t1 = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), 0xD8);  // high halves
+
+        H0 = _mm256_add_epi64(H0, _mm256_and_si256(t0, m26));
+        H1 = _mm256_add_epi64(H1, _mm256_and_si256(_mm256_srli_epi64(t0, 26), m26));
+        H2 = _mm256_add_epi64(H2, _mm256_and_si256(
+                 _mm256_or_si256(_mm256_srli_epi64(t0, 52), _mm256_slli_epi64(t1, 12)), m26));
+        H3 = _mm256_add_epi64(H3, _mm256_and_si256(_mm256_srli_epi64(t1, 14), m26));
+        H4 = _mm256_add_epi64(H4, _mm256_or_si256(_mm256_srli_epi64(t1, 40), hibit));
+
+        const __m256i* r = g + 1 < groups ? R : RL;
+        const __m256i* s = g + 1 < groups ? S : SL;
+        __m256i d0 = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epu32(H0, r[0]), _mm256_mul_epu32(H1, s[4])),
+            _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(H2, s[3]), _mm256_mul_epu32(H3, s[2])),
+                             _mm256_mul_epu32(H4, s[1])));
+        __m256i d1 = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epu32(H0, r[1]), _mm256_mul_epu32(H1, r[0])),
+            _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(H2, s[4]), _mm256_mul_epu32(H3, s[3])),
+                             _mm256_mul_epu32(H4, s[2])));
+        __m256i d2 = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epu32(H0, r[2]), _mm256_mul_epu32(H1, r[1])),
+            _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(H2, r[0]), _mm256_mul_epu32(H3, s[4])),
+                             _mm256_mul_epu32(H4, s[3])));
+        __m256i d3 = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epu32(H0, r[3]), _mm256_mul_epu32(H1, r[2])),
+            _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(H2, r[1]), _mm256_mul_epu32(H3, r[0])),
+                             _mm256_mul_epu32(H4, s[4])));
+        __m256i d4 = _mm256_add_epi64(
+            _mm256_add_epi64(_mm256_mul_epu32(H0, r[4]), _mm256_mul_epu32(H1, r[3])),
+            _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(H2, r[2]), _mm256_mul_epu32(H3, r[1])),
+                             _mm256_mul_epu32(H4, r[0])));
+
+        // Partial carry: limbs end up just above 26 bits, enough for the next round
+        __m256i k;
+        k = _mm256_srli_epi64(d3, 26); d3 = _mm256_and_si256(d3, m26); d4 = _mm256_add_epi64(d4, k);
+        k = _mm256_srli_epi64(d0, 26); d0 = _mm256_and_si256(d0, m26); d1 = _mm256_add_epi64(d1, k);
+        k = _mm256_srli_epi64(d4, 26); d4 = _mm256_and_si256(d4, m26);
+        d0 = _mm256_add_epi64(d0, _mm256_add_epi64(k, _mm256_slli_epi64(k, 2)));  // k * 5
+        k = _mm256_srli_epi64(d1, 26); d1 = _mm256_and_si256(d1, m26); d2 = _mm256_add_epi64(d2, k);
+        k = _mm256_srli_epi64(d2, 26); d2 = _mm256_and_si256(d2, m26); d3 = _mm256_add_epi64(d3, k);
+        k = _mm256_srli_epi64(d0, 26); d0 = _mm256_and_si256(d0, m26); d1 = _mm256_add_epi64(d1, k);
+        k = _mm256_srli_epi64(d3, 26); d3 = _mm256_and_si256(d3, m26); d4 = _mm256_add_epi64(d4, k);
+        H0 = d0; H1 = d1; H2 = d2; H3 = d3; H4 = d4;
+    }
+
+    // Sum the lanes and return to 44/44/42-bit limbs
+    uint64_t l[5];
+    const __m256i* limbs[5] = {&H0, &H1, &H2, &H3, &H4};
+    for (int i = 0; i < 5; i++) {
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), *limbs[i]);
+        l[i] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    c = l[0] >> 26; l[0] &= MASK26; l[1] += c;
+    c = l[1] >> 26; l[1] &= MASK26; l[2] += c;
+    c = l[2] >> 26; l[2] &= MASK26; l[3] += c;
+    c = l[3] >> 26; l[3] &= MASK26; l[4] += c;
+    c = l[4] >> 26; l[4] &= MASK26; l[0] += c * 5;
+    c = l[0] >> 26; l[0] &= MASK26; l[1] += c;
+
+    uint64_t h0 = l[0] + (l[1] << 26);
+    uint64_t h1 = (h0 >> 44) + (l[2] << 8) + (l[3] << 34);
+    h0 &= MASK44;
+    uint64_t h2 = (h1 >> 44) + (l[4] << 16);
+    h1 &= MASK44;
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+    return groups * 64;
+}
+#endif
+
+size_t polyScalar(uint64_t h[3], const uint32_t powers[4][5], const uint8_t* data, size_t len) {
+    uint64_t r[3];
+    from26(powers[3], r);
+    size_t whole = len & ~static_cast<size_t>(63);
+    polyBlocks(h, r, data, whole, 1ULL << 40);
+    return whole;
+}
+
+const KernelVariant<PolyKernel> POLY_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", polyScalar},
+#ifdef CHACHA_X86
+    {SimdLevel::AVX2, "avx2", polyAvx2},
+#endif
+};
+
+constexpr size_t POLY_VECTOR_MIN = 256;   // Below this the r^2..r^4 setup costs more than it saves
+
+}  // namespace
+
+Poly1305::Poly1305(const uint8_t key[KEY_SIZE]) : leftover(0), powers_ready(false) {
+    uint64_t t0 = load64(key);
+    uint64_t t1 = load64(key + 8);
+
+    // Clamp r and split into 44/44/42-bit limbs
+    r[0] = t0 & 0xffc0fffffffULL;
+    r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+    h[0] = h[1] = h[2] = 0;
+    pad[0] = load64(key + 16);
+    pad[1] = load64(key + 24);
+}
+
+Poly1305::~Poly1305() {
+    wipe(r, sizeof(r));
+    wipe(pad, sizeof(pad));
+    wipe(powers, sizeof(powers));
+}
+
+void Poly1305::computePowers() {
+    powersOf(r, powers);
+    powers_ready = true;
+}
+
+void Poly1305::blocks(const uint8_t* data, size_t len, uint64_t hibit) {
+    polyBlocks(h, r, data, len, hibit);
+}
+
+void Poly1305::update(const uint8_t* data, size_t len) {
+    const uint64_t full_block = 1ULL << 40;  // The 2^128 bit, in limb 2
+
+    if (leftover) {
+        size_t want = 16 - leftover;
+        if (want > len) want = len;
+        std::memcpy(buffer + leftover, data, want);
+        leftover += want;
+        data += want;
+        len -= want;
+        if (leftover < 16) {
+            return;
+        }
+        blocks(buffer, 16, full_block);
+        leftover = 0;
+    }
+
+    if (len >= POLY_VECTOR_MIN) {
+        static const PolyKernel poly_kernel = CpuDispatch::select("poly1305", POLY_VARIANTS).fn;
+        if (!powers_ready) {
+            computePowers();
+        }
+        size_t done = poly_kernel(h, powers, data, len & ~static_cast<size_t>(63));
+        data += done;
+        len -= done;
+    }
+
+    size_t whole = len & ~static_cast<size_t>(15);
+    if (whole) {
+        blocks(data, whole, full_block);
+        data += whole;
+        len -= whole;
+    }
+
+    if (len) {
+        std::memcpy(buffer, data, len);
+        leftover = len;
+    }
+}
+
+void Poly1305::finish(uint8_t tag[TAG_SIZE]) {
+    // Last partial block: append 1, zero pad, no 2^128 bit
+    if (leftover) {
+        buffer[leftover] = 1;
+        std::memset(buffer + leftover + 1, 0, 16 - leftover - 1);
+        blocks(buffer, 16, 0);
+    }
+
+    reduce130(h);
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2], c;
+
+    // h + pad mod 2^128
+    uint64_t t0 = pad[0], t1 = pad[1];
+    h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+    h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+
+    store64(tag, h0 | (h1 << 44));
+    store64(tag + 8, (h1 >> 20) | (h2 << 24));
+
+    wipe(h, sizeof(h));
+    wipe(buffer, sizeof(buffer));
+}
+
+/* ===================== AEAD ===================== */
+
+namespace {
+
+/**
+ * Poly1305 key for a message: first 32 bytes of keystream block 0
+ */
+struct OneTimeKey {
+    uint8_t bytes[64];
+    OneTimeKey(const uint8_t key[32], const uint8_t nonce[12]) {
+        ChaCha20::block(key, 0, nonce, bytes);
+    }
+    ~OneTimeKey() {
+        wipe(bytes, sizeof(bytes));
+    }
+};
+
+constexpr size_t PASS = 4096;   // Encrypt/MAC interleave granularity
+
+}  // namespace
+
+ChaCha20Poly1305::Stream::Stream(const uint8_t k[KEY_SIZE], const uint8_t n[NONCE_SIZE],
+                                 const uint8_t* aad, size_t aad_bytes)
+    : counter(1), keystream_used(ChaCha20::BLOCK_SIZE), mac(OneTimeKey(k, n).bytes),
+      aad_len(aad_bytes), data_len(0) {
+    std::memcpy(key, k, KEY_SIZE);
+    std::memcpy(nonce, n, NONCE_SIZE);
+    if (aad_bytes) {
+        mac.update(aad, aad_bytes);
+        mac.update(ZERO_PAD, (16 - aad_bytes % 16) % 16);
+    }
+}
+
+ChaCha20Poly1305::Stream::~Stream() {
+    wipe(key, sizeof(key));
+    wipe(keystream, sizeof(keystream));
+}
+
+void ChaCha20Poly1305::Stream::crypt(const uint8_t* in, uint8_t* out, size_t len) {
+    // Finish a block left over from the previous call
+    while (len && keystream_used < ChaCha20::BLOCK_SIZE) {
+        *out++ = *in++ ^ keystream[keystream_used++];
+        len--;
+    }
+
+    size_t whole = len & ~(ChaCha20::BLOCK_SIZE - 1);
+    if (whole) {
+        uint32_t state[16];
+        initState(state, key, counter, nonce);
+        xorWithState(state, in, out, whole);
+        counter = state[12];
+        wipe(state, sizeof(state));
+        in += whole;
+        out += whole;
+        len -= whole;
+    }
+
+    if (len) {
+        ChaCha20::block(key, counter++, nonce, keystream);
+        for (keystream_used = 0; keystream_used < len; keystream_used++) {
+            out[keystream_used] = in[keystream_used] ^ keystream[keystream_used];
+        }
+    }
+}
+
+void ChaCha20Poly1305::Stream::encrypt(const uint8_t* in, uint8_t* out, size_t len) {
+    while (len) {
+        size_t n = len < PASS ? len : PASS;
+        crypt(in, out, n);
+        mac.update(out, n);
+        in += n;
+        out += n;
+        len -= n;
+        data_len += n;
+    }
+}
+
+void ChaCha20Poly1305::Stream::decrypt(const uint8_t* in, uint8_t* out, size_t len) {
+    while (len) {
+        size_t n = len < PASS ? len : PASS;
+        mac.update(in, n);  // Before crypt: in may equal out
+        crypt(in, out, n);
+        in += n;
+        out += n;
+        len -= n;
+        data_len += n;
+    }
+}
+
+void ChaCha20Poly1305::Stream::computeTag(uint8_t tag[TAG_SIZE]) {
+    uint8_t lengths[16];
+    mac.update(ZERO_PAD, (16 - data_len % 16) % 16);
+    store64(lengths, aad_len);
+    store64(lengths + 8, data_len);
+    mac.update(lengths, sizeof(lengths));
+    mac.finish(tag);
+}
+
+void ChaCha20Poly1305::Stream::finish(uint8_t tag[TAG_SIZE]) {
+    computeTag(tag);
+}
+
+bool ChaCha20Poly1305::Stream::verify(const uint8_t tag[TAG_SIZE]) {
+    uint8_t expected[TAG_SIZE];
+    computeTag(expected);
+    uint8_t diff = 0;
+    for (size_t i = 0; i < TAG_SIZE; i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    return diff == 0;
+}
+
+void ChaCha20Poly1305::seal(const uint8_t key[KEY_SIZE], const uint8_t nonce[NONCE_SIZE],
+                            const uint8_t* aad, size_t aad_len,
+                            const uint8_t* in, size_t len, uint8_t* out, uint8_t tag[TAG_SIZE]) {
+    Stream stream(key, nonce, aad, aad_len);
+    stream.encrypt(in, out, len);
+    stream.finish(tag);
+}
+
+bool ChaCha20Poly1305::open(const uint8_t key[KEY_SIZE], const uint8_t nonce[NONCE_SIZE],
+                            const uint8_t* aad, size_t aad_len,
+                            const uint8_t* in, size_t len, const uint8_t tag[TAG_SIZE], uint8_t* out) {
+    Stream stream(key, nonce, aad, aad_len);
+    stream.decrypt(in, out, len);
+    if (!stream.verify(tag)) {
+        wipe(out, len);
+        return false;
+    }
+    return true;
+}
+
+/* ===================== Self-tests ===================== */
+
+namespace {
+
+/**
+ * Every bulk variant (finished by the scalar tail) must give the scalar
+ * output and block counter for all lengths around the group sizes, with
+ * source and destination misaligned independently
+ */
+bool testChaCha20() {
+    return CpuDispatch::testVariants("chacha20", BULK_VARIANTS, [](BulkKernel scalar, BulkKernel variant) {
+        std::mt19937 rng(8439);
+        std::vector<uint8_t> in(5200), expected(in.size()), actual(in.size());
+        for (uint8_t& byte : in) byte = static_cast<uint8_t>(rng());
+
+        for (size_t len = 0; len <= 5120; len += len < 1100 ? 1 : 61) {
+            size_t in_off = rng() % 32, out_off = rng() % 32;
+            uint32_t expected_state[16], actual_state[16];
+            for (int i = 0; i < 16; i++) {
+                expected_state[i] = actual_state[i] = static_cast<uint32_t>(rng());
+            }
+            xorWithKernel(scalar, expected_state, in.data() + in_off, expected.data() + out_off, len);
+            xorWithKernel(variant, actual_state, in.data() + in_off, actual.data() + out_off, len);
+            if (std::memcmp(expected.data() + out_off, actual.data() + out_off, len) != 0 ||
+                expected_state[12] != actual_state[12]) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * Vector variants may leave h only partially reduced, so results are
+ * compared mod 2^130 - 5
+ */
+bool testPoly1305() {
+    return CpuDispatch::testVariants("poly1305", POLY_VARIANTS, [](PolyKernel scalar, PolyKernel variant) {
+        std::mt19937_64 rng(1305);
+        std::vector<uint8_t> data(4200);
+        for (uint8_t& byte : data) byte = static_cast<uint8_t>(rng());
+
+        for (size_t len = 64; len <= 4096; len += 64) {
+            uint64_t r[3] = {rng() & 0xffc0fffffffULL, rng() & 0xfffffc0ffffULL, rng() & 0x00ffffffc0fULL};
+            uint32_t powers[4][5];
+            powersOf(r, powers);
+            uint64_t expected[3] = {rng() & MASK44, rng() & MASK44, rng() & MASK42};
+            uint64_t actual[3] = {expected[0], expected[1], expected[2]};
+            const uint8_t* start = data.data() + rng() % 64;
+
+            if (scalar(expected, powers, start, len) != variant(actual, powers, start, len)) {
+                return false;
+            }
+            reduce130(expected);
+            reduce130(actual);
+            if (std::memcmp(expected, actual, sizeof(expected)) != 0) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+const bool chacha20_registered = CpuDispatch::registerSelfTest("chacha20", testChaCha20);
+const bool poly1305_registered = CpuDispatch::registerSelfTest("poly1305", testPoly1305);
+
+}  // namespace
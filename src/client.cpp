@@ -2,6 +2,11 @@
 #include "../include/utils.hpp"
 #include "../include/file_transfer.hpp"
 #include "../include/encryption.hpp"
+#include "../include/secure_channel.hpp"
+#include "../include/end_to_end.hpp"
+#include "../include/tls_transport.hpp"
+#include "../include/cpu_dispatch.hpp"
+#include "../include/binary_log.hpp"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -12,6 +17,8 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <cstring> 
+#include <mutex>
+#include <chrono>
 
 /**
  * CLIENT IMPLEMENTATION
@@ -25,7 +32,10 @@
 // Constructor
 ChatClient::ChatClient(const std::string& ip, int port) 
     : client_socket(-1), server_ip(ip), server_port(port), 
-      connected(false), receiver_thread(nullptr) {
+      connected(false), receiver_thread(nullptr), file_ready(false), e2e_enabled(false),
+      trace_enabled(false), next_trace(1) {
+    const char* trace = std::getenv("CHAT_TRACE");
+    trace_enabled = trace && std::strcmp(trace, "1") == 0;
 }
 
 // Destructor
@@ -66,8 +76,25 @@ bool ChatClient::connectToServer() {
         return false;
     }
     
+    // CHAT_TLS=1: handshake before anything else is said
+    if (TlsTransport::clientRequested()) {
+        if (!TlsTransport::available()) {
+            std::cerr << "CHAT_TLS=1 but this client was built without TLS (make TLS=1)" << std::endl;
+            close(client_socket);
+            return false;
+        }
+        if (!TlsTransport::connect(client_socket, server_ip)) {
+            std::cerr << "TLS handshake with server failed" << std::endl;
+            close(client_socket);
+            return false;
+        }
+    }
+    
     connected = true;
     std::cout << "✓ Connected to server at " << server_ip << ":" << server_port << std::endl;
+    if (TlsTransport::isTls(client_socket)) {
+        std::cout << "✓ TLS: " << TlsTransport::describe(client_socket) << std::endl;
+    }
     if (Encryption::isEnabled()) {
         std::cout << "✓ Encryption: ENABLED" << std::endl;
     }
@@ -100,7 +127,7 @@ void ChatClient::receiveMessages() {
     char buffer[8192];
     
     while (connected) {
-        ssize_t bytes_read = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+        ssize_t bytes_read = SecureChannel::recv(client_socket, buffer, sizeof(buffer) - 1, 0);
         
         if (bytes_read <= 0) {
             if (connected) {
@@ -112,10 +139,18 @@ void ChatClient::receiveMessages() {
         buffer[bytes_read] = '\0';
         std::string encrypted_message(buffer, bytes_read);
         
+        // Delta signature replies carry a binary blob after their header line
+        if (encrypted_message.compare(0, 10, "/delta_sig") == 0) {
+            receiveDeltaReply(encrypted_message);
+            continue;
+        }
+        
         // Decrypt message if encryption is enabled
         std::string message = encrypted_message;
         if (Encryption::isEnabled() && encrypted_message.length() > 0) {
-            if (encrypted_message.find("/file_data") == std::string::npos) {
+            if (encrypted_message.find("/file_data") == std::string::npos &&
+                encrypted_message.find("/delta") != 0 &&
+                encrypted_message.find("/e2e_from") != 0) {
                 try {
                     message = Encryption::decrypt(encrypted_message);
                 } catch (...) {
@@ -124,8 +159,16 @@ void ChatClient::receiveMessages() {
             }
         }
         
+        message = acknowledgeTrace(message);
+        
         // Handle special messages
-        if (message.find("/file_offer") == 0) {
+        if (message.compare(0, 10, "/e2e_from ") == 0) {
+            showEndToEnd(message);
+        }
+        else if (message.compare(0, 8, "/pubkey ") == 0) {
+            handlePublicKeyReply(message);
+        }
+        else if (message.find("/file_offer") == 0) {
             // File transfer offer - auto-accept
             std::cout << "\n" << message.substr(12) << std::endl;
             std::cout << "[FILE] Accepting automatically..." << std::endl;
@@ -134,42 +177,92 @@ void ChatClient::receiveMessages() {
         else if (message.find("/file_data") == 0) {
             // Receiving file data - NOW WITH FILENAME
             std::vector<std::string> parts = Utils::split(message, ' ');
-            if (parts.size() >= 4) {  // /file_data sender filename size
+            if (parts.size() >= 4) {  // /file_data sender filename size [chunked]
                 std::string sender = parts[1];
                 std::string original_filename = parts[2];  // Get original filename
                 long file_size = std::stol(parts[3]);
+                bool chunked = parts.size() >= 5 && parts[4] == "chunked";
                 
-                // DEFINE user_dir FIRST
-                std::string user_dir = "Users/" + username;
+                std::string filename = prepareDownloadPath(sender, original_filename);
                 
-                // CREATE USER DIRECTORY
-                if (mkdir("Users", 0755) == -1 && errno != EEXIST) {
-                    std::cerr << "[ERROR] Failed to create Users directory: " << strerror(errno) << std::endl;
+                std::cout << "[FILE] Receiving '" << original_filename << "' (" << formatFileSize(file_size) 
+                         << ") from " << sender << "..." << std::endl;
+                
+                // Chat that arrives mid-transfer is framed into the stream
+                auto show_chat = [this](const std::string& chat) {
+                    if (chat.compare(0, 10, "/e2e_from ") == 0) {
+                        showEndToEnd(chat);
+                        return;
+                    }
+                    std::string text = chat;
+                    if (Encryption::isEnabled()) {
+                        try {
+                            text = Encryption::decrypt(chat);
+                        } catch (...) {
+                        }
+                    }
+                    std::cout << acknowledgeTrace(text) << std::endl;
+                };
+                bool received = chunked
+                    ? FileTransferHandler::receiveChunkedFile(client_socket, sender, filename, file_size, show_chat)
+                    : FileTransferHandler::receiveFileFromServer(client_socket, sender, filename, file_size);
+                if (received) {
+                    std::cout << "[FILE] ✓ File saved to: " << filename << std::endl;
+                    recordReceivedFile(original_filename, filename);
+                } else {
+                    std::cerr << "[FILE] ✗ File reception failed" << std::endl;
                 }
-
-                if (mkdir(user_dir.c_str(), 0755) == -1 && errno != EEXIST) {
-                    std::cerr << "[ERROR] Failed to create " << user_dir << ": " << strerror(errno) << std::endl;
+            }
+        }
+        else if (message.find("/batch_data") == 0) {
+            // Batch stream follows: /batch_data sender label entry_count stream_size
+            std::vector<std::string> parts = Utils::split(message, ' ');
+            if (parts.size() >= 5) {
+                std::string sender = parts[1];
+                std::string label = parts[2];
+                int entry_count = std::atoi(parts[3].c_str());
+                long stream_size = std::atol(parts[4].c_str());
+                
+                // Entries go under Users/<me>/from_<sender>_<timestamp>_<label>/
+                std::string dest_dir = prepareDownloadPath(sender, "") + "_" + label;
+                if (mkdir(dest_dir.c_str(), 0755) == -1 && errno != EEXIST) {
+                    std::cerr << "[ERROR] Failed to create " << dest_dir << ": " << strerror(errno) << std::endl;
                 }
-
-                std::cout << "[DEBUG] Created directory: " << user_dir << std::endl;
                 
-                // EXTRACT FILE EXTENSION
-                std::string extension = "";
-                size_t dot_pos = original_filename.find_last_of('.');
-                if (dot_pos != std::string::npos) {
-                    extension = original_filename.substr(dot_pos);  // Includes the dot
+                std::cout << "[FILE] Receiving " << entry_count << " files (" << formatFileSize(stream_size)
+                         << ") from " << sender << "..." << std::endl;
+                
+                if (FileTransferHandler::receiveBatchFromServer(client_socket, sender, dest_dir, entry_count, stream_size)) {
+                    std::cout << "[FILE] ✓ Files saved to: " << dest_dir << std::endl;
+                } else {
+                    std::cerr << "[FILE] ✗ Some files could not be received" << std::endl;
                 }
+            }
+        }
+        else if (message.find("/delta_offer") == 0) {
+            // Sender wants to send an updated file: /delta_offer sender filename size
+            std::vector<std::string> parts = Utils::split(message, ' ');
+            if (parts.size() >= 4) {
+                sendDeltaSignatures(parts[1], parts[2]);
+            }
+        }
+        else if (message.find("/delta_data") == 0) {
+            // Delta stream follows: /delta_data sender filename size
+            std::vector<std::string> parts = Utils::split(message, ' ');
+            if (parts.size() >= 4) {
+                std::string sender = parts[1];
+                std::string original_filename = parts[2];
+                long file_size = std::stol(parts[3]);
                 
-                // SAVE FILE TO USER DIRECTORY with timestamp AND EXTENSION
-                time_t now = time(0);
-                std::string timestamp = std::to_string(now);
-                std::string filename = user_dir + "/from_" + sender + "_" + timestamp + extension;
+                std::string basis = findReceivedFile(original_filename);
+                std::string filename = prepareDownloadPath(sender, original_filename);
                 
-                std::cout << "[FILE] Receiving '" << original_filename << "' (" << formatFileSize(file_size) 
+                std::cout << "[FILE] Receiving update of '" << original_filename << "' (" << formatFileSize(file_size)
                          << ") from " << sender << "..." << std::endl;
                 
-                if (FileTransferHandler::receiveFileFromServer(client_socket, sender, filename, file_size)) {
+                if (FileTransferHandler::receiveDeltaFromServer(client_socket, sender, basis, filename, file_size)) {
                     std::cout << "[FILE] ✓ File saved to: " << filename << std::endl;
+                    recordReceivedFile(original_filename, filename);
                 } else {
                     std::cerr << "[FILE] ✗ File reception failed" << std::endl;
                 }
@@ -192,6 +285,119 @@ void ChatClient::receiveMessages() {
     }
 }
 
+/**
+ * Build the save path for an incoming file
+ * Keeps the original extension: Users/<me>/from_<sender>_<timestamp><ext>
+ */
+std::string ChatClient::prepareDownloadPath(const std::string& sender, const std::string& original_filename) {
+    // DEFINE user_dir FIRST
+    std::string user_dir = "Users/" + username;
+    
+    // CREATE USER DIRECTORY
+    if (mkdir("Users", 0755) == -1 && errno != EEXIST) {
+        std::cerr << "[ERROR] Failed to create Users directory: " << strerror(errno) << std::endl;
+    }
+
+    if (mkdir(user_dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        std::cerr << "[ERROR] Failed to create " << user_dir << ": " << strerror(errno) << std::endl;
+    }
+
+    std::cout << "[DEBUG] Created directory: " << user_dir << std::endl;
+    
+    // EXTRACT FILE EXTENSION
+    std::string extension = "";
+    size_t dot_pos = original_filename.find_last_of('.');
+    if (dot_pos != std::string::npos) {
+        extension = original_filename.substr(dot_pos);  // Includes the dot
+    }
+    
+    // SAVE FILE TO USER DIRECTORY with timestamp AND EXTENSION
+    time_t now = time(0);
+    std::string timestamp = std::to_string(now);
+    return user_dir + "/from_" + sender + "_" + timestamp + extension;
+}
+
+/**
+ * Record a received file in the per-user index
+ * Format: one "<original filename>\t<saved path>" line per file
+ */
+void ChatClient::recordReceivedFile(const std::string& original_filename, const std::string& saved_path) {
+    std::ofstream index("Users/" + username + "/.received_index", std::ios::app);
+    if (index.is_open()) {
+        index << original_filename << '\t' << saved_path << '\n';
+    }
+}
+
+/**
+ * Look up the latest saved copy of a file (the delta basis)
+ */
+std::string ChatClient::findReceivedFile(const std::string& original_filename) {
+    std::ifstream index("Users/" + username + "/.received_index");
+    std::string line, latest;
+    
+    while (std::getline(index, line)) {
+        size_t tab = line.find('\t');
+        if (tab != std::string::npos && line.compare(0, tab, original_filename) == 0 && tab == original_filename.size()) {
+            std::string path = line.substr(tab + 1);
+            if (Utils::fileExists(path)) {
+                latest = path;
+            }
+        }
+    }
+    return latest;
+}
+
+/**
+ * Answer a delta offer
+ * --------------------
+ * Sends signatures of our latest copy; an empty set (no copy yet)
+ * makes the sender fall back to literal data for the whole file.
+ */
+void ChatClient::sendDeltaSignatures(const std::string& sender, const std::string& original_filename) {
+    std::string basis = findReceivedFile(original_filename);
+    SignatureSet sigs = DeltaSync::computeSignatures(basis);
+    std::string blob = DeltaSync::serializeSignatures(sigs);
+    
+    if (basis.empty()) {
+        std::cout << "[DELTA] No local copy of '" << original_filename << "' - requesting full file" << std::endl;
+    } else {
+        std::cout << "[DELTA] Sending " << sigs.blocks.size() << " block signatures of " << basis << std::endl;
+    }
+    
+    std::string msg = "/delta_sig " + sender + " " + std::to_string(blob.size()) + "\n" + blob;
+    Utils::sendAll(client_socket, msg.data(), msg.size());
+}
+
+/**
+ * Receive the server's /delta_sig reply
+ * Format: "/delta_sig <length>\n<blob>" or "/delta_sig none"
+ */
+void ChatClient::receiveDeltaReply(const std::string& first_chunk) {
+    std::string reply = "none";
+    size_t newline = first_chunk.find('\n');
+    
+    if (newline != std::string::npos) {
+        long length = std::atol(first_chunk.c_str() + 11);
+        if (length > 0) {
+            reply = first_chunk.substr(newline + 1, length);
+            size_t have = reply.size();
+            if (have < static_cast<size_t>(length)) {
+                reply.resize(length);
+                if (!Utils::recvAll(client_socket, &reply[have], length - have)) {
+                    reply = "none";
+                }
+            }
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(file_mutex);
+        delta_reply = std::move(reply);
+        file_ready = true;
+    }
+    file_cv.notify_all();
+}
+
 /**
  * Handle file transfer offer
  */
@@ -222,15 +428,149 @@ void ChatClient::sendMessage(const std::string& message) {
         if (Encryption::isEnabled() && 
             message.find("/file") != 0 &&
             message.find("/sendfile") != 0 &&
+            message.find("/sendbatch") != 0 &&
+            message.find("/e2e") != 0 &&
             message.find("/accept") != 0 &&
             message.find("/reject") != 0) {
             to_send = Encryption::encrypt(message);
         }
         
-        send(client_socket, to_send.c_str(), to_send.length(), 0);
+        SecureChannel::send(client_socket, to_send.c_str(), to_send.length(), 0);
     }
 }
 
+/**
+ * Strip a traced message's "/t <id> " header and acknowledge it
+ */
+std::string ChatClient::acknowledgeTrace(const std::string& message) {
+    if (message.compare(0, 3, "/t ") != 0) {
+        return message;
+    }
+    size_t space = message.find(' ', 3);
+    if (space == std::string::npos) {
+        return message;
+    }
+    uint64_t received = BinaryLog::monotonicNanos();
+    sendMessage("/ack " + message.substr(3, space - 3) + " " + std::to_string(received));
+    return message.substr(space + 1);
+}
+
+/**
+ * Seal and send an end-to-end private message, or queue it for the key
+ */
+void ChatClient::sendEndToEnd(const std::string& target, const std::string& text) {
+    if (text.size() > EndToEnd::MAX_MESSAGE) {
+        std::cerr << "✗ Private message too long (max " << EndToEnd::MAX_MESSAGE << " bytes)" << std::endl;
+        return;
+    }
+    
+    std::string command;
+    {
+        std::lock_guard<std::mutex> lock(e2e_mutex);
+        if (!e2e.seal(username, target, text, command)) {
+            std::vector<std::string>& queue = e2e_pending[target];
+            queue.push_back(text);
+            if (queue.size() > 1) {
+                return;     // Key already requested
+            }
+        }
+    }
+    
+    if (command.empty()) {
+        sendMessage("/pubkey " + target);
+        return;
+    }
+    sendMessage(command);
+    std::cout << "[E2E] You -> " << target << ": " << text << std::endl;
+}
+
+/**
+ * Learn a peer's key and send what was waiting for it
+ */
+void ChatClient::handlePublicKeyReply(const std::string& message) {
+    std::vector<std::string> parts = Utils::split(message, ' ');
+    if (parts.size() < 2) {
+        return;
+    }
+    const std::string& target = parts[1];
+    
+    std::vector<std::string> queue;
+    bool have_key = false;
+    {
+        std::lock_guard<std::mutex> lock(e2e_mutex);
+        have_key = parts.size() >= 3 && e2e.setPeerKey(target, parts[2]);
+        auto it = e2e_pending.find(target);
+        if (it != e2e_pending.end()) {
+            queue.swap(it->second);
+            e2e_pending.erase(it);
+        }
+    }
+    
+    if (parts.size() >= 4 && parts[3] == "stale") {
+        std::cerr << "✗ " << target << " logged in again; last private message not delivered, please resend" << std::endl;
+    }
+    if (!have_key) {
+        std::cerr << "✗ " << target << " is offline or has no end-to-end key";
+        if (!queue.empty()) {
+            std::cerr << "; " << queue.size() << " private message(s) not sent";
+        }
+        std::cerr << std::endl;
+        return;
+    }
+    for (const std::string& text : queue) {
+        sendEndToEnd(target, text);
+    }
+}
+
+/**
+ * Open and print a forwarded end-to-end message
+ */
+void ChatClient::showEndToEnd(const std::string& message) {
+    size_t sender_end = message.find(' ', 10);
+    if (sender_end == std::string::npos) {
+        return;
+    }
+    std::string sender = message.substr(10, sender_end - 10);
+    std::string text;
+    if (!e2e.open(sender, username, message.substr(sender_end + 1), text)) {
+        std::cerr << "✗ Could not decrypt private message from " << sender << std::endl;
+        return;
+    }
+    std::cout << "[E2E] " << sender << " -> You: " << text << std::endl;
+}
+
+/**
+ * Log in, offering a session key
+ */
+void ChatClient::login() {
+    SecureChannel::KeyShare share;
+    bool offered = SecureChannel::enabled() && !TlsTransport::isTls(client_socket) &&
+                   SecureChannel::createKeyShare(share);
+    
+    std::string hello = offered ? username + " " + share.offer : username;
+    SecureChannel::send(client_socket, hello.c_str(), hello.length(), 0);
+    if (!offered) {
+        return;
+    }
+    
+    // The reply is either exactly the server's offer or a plaintext error
+    char prefix[5];
+    ssize_t n = recv(client_socket, prefix, sizeof(prefix), MSG_PEEK | MSG_WAITALL);
+    if (n != sizeof(prefix) || std::memcmp(prefix, SecureChannel::OFFER_PREFIX, sizeof(prefix)) != 0) {
+        return;
+    }
+    
+    std::string reply(SecureChannel::OFFER_SIZE, '\0');
+    uint8_t server_pub[X25519::KEY_SIZE];
+    if (!Utils::recvAll(client_socket, &reply[0], reply.size()) ||
+        !SecureChannel::parseOffer(reply, server_pub) ||
+        !SecureChannel::establish(client_socket, share, server_pub, true)) {
+        std::cerr << "✗ Key exchange with server failed" << std::endl;
+        return;
+    }
+    std::cout << "✓ Session encryption: ChaCha20-Poly1305 (X25519 key exchange)" << std::endl;
+}
+
 /**
  * Main client execution
  */
@@ -249,9 +589,15 @@ void ChatClient::start() {
     }
     
     // Send username for authentication
-    send(client_socket, username.c_str(), username.length(), 0);
+    login();
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     
+    // Publish a key so private messages can bypass the server's view
+    if (EndToEnd::enabled() && e2e.init()) {
+        sendMessage("/pubkey " + e2e.publicKeyHex());
+        e2e_enabled = true;
+    }
+    
     // Start receiver thread
     receiver_thread = new std::thread(&ChatClient::receiveMessages, this);
     
@@ -259,8 +605,18 @@ void ChatClient::start() {
     std::cout << "\n========================================" << std::endl;
     std::cout << "Commands:" << std::endl;
     std::cout << "  /list              - Show active users" << std::endl;
-    std::cout << "  @username message  - Private message" << std::endl;
+    std::cout << "  /transfers         - Show active file transfers" << std::endl;
+    std::cout << "  @username message  - Private message" << (e2e_enabled ? " (end-to-end encrypted)" : "") << std::endl;
+    std::cout << "  /join room, /leave room - Enter or leave a room" << std::endl;
+    std::cout << "  #room message      - Message everyone in a room" << std::endl;
     std::cout << "  /sendfile user file - Send file" << std::endl;
+    std::cout << "  /sendfile user file delta - Send only changes" << std::endl;
+    std::cout << "  /sendfile user dir|glob - Send many files at once" << std::endl;
+    std::cout << "  /log [settings]    - Logging settings (admins)" << std::endl;
+    std::cout << "  /stats             - Server statistics (admins)" << std::endl;
+    std::cout << "  /latency           - Message delivery latency (admins)" << std::endl;
+    std::cout << "  /conninfo [user]   - Connection statistics (admins)" << std::endl;
+    std::cout << "  /trace [N|off|dump] - Sampled message tracing (admins)" << std::endl;
     std::cout << "  /quit              - Exit chat" << std::endl;
     std::cout << "========================================\n" << std::endl;
     
@@ -280,12 +636,41 @@ void ChatClient::start() {
         if (input.find("/sendfile") == 0) {
             std::vector<std::string> parts = Utils::split(input, ' ');
             if (parts.size() < 3) {
-                std::cerr << "Usage: /sendfile <username> <filepath>" << std::endl;
+                std::cerr << "Usage: /sendfile <username> <filepath> [delta]" << std::endl;
                 continue;
             }
             
             std::string target_user = parts[1];
             std::string filepath = parts[2];
+            bool delta_mode = parts.size() >= 4 && parts[3] == "delta";
+            
+            // Directory or glob: send every file as one batch stream
+            struct stat path_info;
+            bool is_directory = stat(filepath.c_str(), &path_info) == 0 && S_ISDIR(path_info.st_mode);
+            if (is_directory || filepath.find_first_of("*?[") != std::string::npos) {
+                std::vector<BatchEntry> entries;
+                std::string label;
+                if (!FileTransferHandler::collectBatch(filepath, entries, label)) {
+                    continue;
+                }
+                long stream_size = FileTransferHandler::batchStreamSize(entries);
+                
+                std::string request = "/sendbatch " + target_user + " " + label + " " +
+                                      std::to_string(entries.size()) + " " + std::to_string(stream_size);
+                sendMessage(request);
+                
+                std::cout << "[FILE] Waiting for " << target_user << " to accept " << entries.size()
+                         << " files (" << formatFileSize(stream_size) << ")..." << std::endl;
+                std::this_thread::sleep_for(std::chrono::seconds(3));
+                
+                std::cout << "[FILE] Sending files..." << std::endl;
+                if (FileTransferHandler::sendBatchToServer(client_socket, entries)) {
+                    std::cout << "[FILE] ✓ Files sent successfully" << std::endl;
+                } else {
+                    std::cerr << "[FILE] ✗ File transfer failed" << std::endl;
+                }
+                continue;
+            }
             
             // Validate file
             if (!Utils::fileExists(filepath)) {
@@ -293,9 +678,11 @@ void ChatClient::start() {
                 continue;
             }
             
+            // Delta mode only sends the changes; the delta itself must fit MAX_FILE_SIZE
             long file_size = Utils::getFileSize(filepath);
-            if (file_size <= 0 || file_size > 10 * 1024 * 1024) {
-                std::cerr << "Error: Invalid file size (max 10MB)" << std::endl;
+            long max_size = delta_mode ? FileTransferHandler::MAX_DELTA_FILE_SIZE : FileTransferHandler::MAX_FILE_SIZE;
+            if (file_size <= 0 || file_size > max_size) {
+                std::cerr << "Error: Invalid file size (max " << formatFileSize(max_size) << ")" << std::endl;
                 continue;
             }
             
@@ -308,16 +695,55 @@ void ChatClient::start() {
             
             // Send file transfer request WITH FILENAME
             std::string request = "/sendfile " + target_user + " " + filename + " " + std::to_string(file_size);
+            if (delta_mode) {
+                request += " delta";
+                std::lock_guard<std::mutex> lock(file_mutex);
+                file_ready = false;
+            } else {
+                request += " chunked";
+            }
             sendMessage(request);
             
-            std::cout << "[FILE] Waiting for " << target_user << " to accept..." << std::endl;
-            
-            // Wait for server to process (server is synchronous now)
-            std::this_thread::sleep_for(std::chrono::seconds(3));
+            if (delta_mode) {
+                // Wait for the recipient's block signatures (server times out after 30s)
+                std::cout << "[FILE] Waiting for " << target_user << "'s block signatures..." << std::endl;
+                std::string reply;
+                {
+                    std::unique_lock<std::mutex> lock(file_mutex);
+                    file_cv.wait_for(lock, std::chrono::seconds(35), [this] { return file_ready; });
+                    reply = file_ready ? std::move(delta_reply) : "none";
+                    file_ready = false;
+                }
+                
+                SignatureSet sigs;
+                if (reply != "none" && DeltaSync::parseSignatures(reply, sigs)) {
+                    std::cout << "[FILE] Sending delta..." << std::endl;
+                    if (FileTransferHandler::sendDeltaToServer(client_socket, filepath, sigs)) {
+                        std::cout << "[FILE] ✓ File sent successfully" << std::endl;
+                    } else {
+                        std::cerr << "[FILE] ✗ File transfer failed" << std::endl;
+                    }
+                    continue;
+                }
+                if (file_size > FileTransferHandler::MAX_FILE_SIZE) {
+                    std::cerr << "[FILE] ✗ Delta not available and the file is over "
+                              << formatFileSize(FileTransferHandler::MAX_FILE_SIZE) << std::endl;
+                    continue;
+                }
+                std::cout << "[FILE] Delta not available - sending full file" << std::endl;
+            } else {
+                std::cout << "[FILE] Waiting for " << target_user << " to accept..." << std::endl;
+                
+                // Wait for server to process (server is synchronous now)
+                std::this_thread::sleep_for(std::chrono::seconds(3));
+            }
             
-            // Send file data
+            // Send file data (delta fallback stays raw: the server expects a plain stream)
             std::cout << "[FILE] Sending file..." << std::endl;
-            if (FileTransferHandler::sendFileToServer(client_socket, filepath, file_size)) {
+            bool sent = delta_mode
+                ? FileTransferHandler::sendFileToServer(client_socket, filepath, file_size)
+                : FileTransferHandler::sendFileChunked(client_socket, filepath, file_size);
+            if (sent) {
                 std::cout << "[FILE] ✓ File sent successfully" << std::endl;
             } else {
                 std::cerr << "[FILE] ✗ File transfer failed" << std::endl;
@@ -326,6 +752,21 @@ void ChatClient::start() {
             continue;
         }
         
+        // Private messages are sealed here; the server only sees the recipient
+        if (e2e_enabled && input[0] == '@') {
+            size_t space = input.find(' ');
+            if (space != std::string::npos && space > 1) {
+                sendEndToEnd(input.substr(1, space - 1), input.substr(space + 1));
+                continue;
+            }
+        }
+        
+        // Traced chat carries an id and our send time for latency measurement
+        if (trace_enabled && input[0] != '/') {
+            input = "/t " + std::to_string(next_trace++) + " " +
+                    std::to_string(BinaryLog::monotonicNanos()) + " " + input;
+        }
+        
         // Send regular message
         sendMessage(input);
     }
@@ -340,6 +781,7 @@ void ChatClient::disconnect() {
     connected = false;
     
     if (client_socket >= 0) {
+        SecureChannel::detach(client_socket);
         close(client_socket);
         client_socket = -1;
     }
@@ -356,7 +798,17 @@ void ChatClient::disconnect() {
 /**
  * MAIN FUNCTION
  */
-int main() {
+int main(int argc, char* argv[]) {
+    // --selftest: check every SIMD kernel variant against scalar and exit
+    if (argc > 1 && std::string(argv[1]) == "--selftest") {
+        return CpuDispatch::runSelfTests() ? 0 : 1;
+    }
+    // --bench: throughput of every SIMD kernel variant
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        CpuDispatch::runBenchmarks();
+        return 0;
+    }
+    
     std::cout << "========================================" << std::endl;
     std::cout << "   Network Chat Client - Enhanced" << std::endl;
     std::cout << "   Features: Encrypted, File Transfer" << std::endl;
@@ -0,0 +1,65 @@
+#include "../include/compression.hpp"
+#include <cmath>
+#include <zlib.h>
+
+/**
+ * CHUNK COMPRESSION IMPLEMENTATION
+ * ================================
+ *
+ * Entropy sampling cost: SAMPLE_SIZE histogram updates plus 256 log2
+ * calls per chunk, independent of chunk size. For a 128KB chunk that is
+ * a few microseconds, versus ~1ms to deflate it, so incompressible media
+ * passes through at close to memcpy speed.
+ */
+
+double ChunkCodec::sampleEntropy(const uint8_t* data, size_t len) {
+    if (len == 0) {
+        return 0.0;
+    }
+
+    // Stride through the chunk so the sample covers all of it
+    size_t samples = len < SAMPLE_SIZE ? len : SAMPLE_SIZE;
+    size_t stride = len / samples;
+
+    uint32_t histogram[256] = {0};
+    for (size_t i = 0; i < samples; i++) {
+        histogram[data[i * stride]]++;
+    }
+
+    double entropy = 0.0;
+    for (uint32_t count : histogram) {
+        if (count > 0) {
+            double p = static_cast<double>(count) / samples;
+            entropy -= p * std::log2(p);
+        }
+    }
+    return entropy;
+}
+
+size_t ChunkCodec::maxCompressedSize(size_t raw_len) {
+    return compressBound(static_cast<uLong>(raw_len));
+}
+
+bool ChunkCodec::compressChunk(const uint8_t* data, size_t len, std::vector<uint8_t>& out) {
+    if (len == 0 || sampleEntropy(data, len) > ENTROPY_THRESHOLD) {
+        return false;
+    }
+
+    out.resize(maxCompressedSize(len));
+    uLongf out_len = static_cast<uLongf>(out.size());
+    if (compress2(out.data(), &out_len, data, static_cast<uLong>(len), COMPRESSION_LEVEL) != Z_OK) {
+        return false;
+    }
+
+    if (out_len >= len * (1.0 - MIN_SAVINGS)) {
+        return false;
+    }
+    out.resize(out_len);
+    return true;
+}
+
+bool ChunkCodec::decompressChunk(const uint8_t* data, size_t len, uint8_t* out, size_t raw_len) {
+    uLongf out_len = static_cast<uLongf>(raw_len);
+    int rc = uncompress(out, &out_len, data, static_cast<uLong>(len));
+    return rc == Z_OK && out_len == raw_len;
+}
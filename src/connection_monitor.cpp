@@ -0,0 +1,279 @@
+#include "../include/connection_monitor.hpp"
+#include "../include/binary_log.hpp"
+#include "../include/utils.hpp"
+#include "../include/metrics.hpp"
+#include "../include/traffic_shaper.hpp"
+#include <vector>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <linux/sockios.h>
+
+/**
+ * CONNECTION MONITOR IMPLEMENTATION
+ * =================================
+ *
+ * TCP_INFO is read with the kernel's own struct (linux/tcp.h), which
+ * has the byte counters and rwnd-limited time the glibc copy lacks.
+ * Older kernels fill a shorter prefix; the rest stays zero.
+ *
+ * The thread copies the tracked list under its own mutex, then samples
+ * each record under that record's mutex. A record untracked meanwhile
+ * is skipped, so the flagged gauge only counts live sessions.
+ */
+
+namespace {
+
+int interval_ms = 1000;
+uint32_t slow_queue_bytes = 256 * 1024;
+uint32_t slow_rtt_us = 300 * 1000;
+uint64_t heavy_bytes_per_second = 1024 * 1024;
+
+const uint32_t LOSSY_MIN_SEGMENTS = 20;     // Too few segments say nothing about loss
+
+struct Shared {
+    std::mutex mutex;                   // Protects the fields below
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<ConnectionRecord>> records;
+    std::thread worker;
+    bool running = false;
+};
+
+Shared& shared() {
+    static Shared* instance = new Shared;
+    return *instance;
+}
+
+long environmentNumber(const char* name, long fallback) {
+    const char* value = std::getenv(name);
+    return value && *value ? std::atol(value) : fallback;
+}
+
+/**
+ * Samples one record; logs and counts flag changes
+ */
+void sampleRecord(ConnectionRecord& record) {
+    uint8_t before;
+    uint8_t after;
+    TransportStats stats;
+    {
+        std::lock_guard<std::mutex> lock(record.mutex);
+        if (!record.tracked) {
+            return;
+        }
+        stats = record.stats;
+        before = stats.flags;
+        if (!ConnectionMonitor::sample(record.socket, TrafficShaper::queuedChat(record.socket), stats)) {
+            return;
+        }
+        after = stats.flags;
+        record.stats = stats;
+        record.flags.store(after, std::memory_order_relaxed);
+        if ((before != 0) != (after != 0)) {
+            Metrics::adjust(Gauge::FLAGGED_CONNECTIONS, after != 0 ? 1 : -1);
+        }
+    }
+
+    if (after == before) {
+        return;
+    }
+    if (after != 0) {
+        Utils::logEvent(LogEvent::CONNECTION_FLAGGED, record.username, ConnectionMonitor::describeFlags(after),
+                        stats.rtt_us, stats.send_queue);
+    } else {
+        Utils::logEvent(LogEvent::CONNECTION_RECOVERED, record.username);
+    }
+}
+
+void workerLoop() {
+    Shared& s = shared();
+    auto interval = std::chrono::milliseconds(interval_ms);
+    std::vector<std::shared_ptr<ConnectionRecord>> records;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            if (s.cv.wait_for(lock, interval, [&s]() { return !s.running; })) {
+                return;
+            }
+            records = s.records;
+        }
+        for (const auto& record : records) {
+            sampleRecord(*record);
+        }
+        records.clear();
+    }
+}
+
+}  // namespace
+
+void ConnectionMonitor::configureFromEnvironment() {
+    interval_ms = static_cast<int>(environmentNumber("CHAT_CONN_SAMPLE_MS", interval_ms));
+    if (interval_ms < 0) {
+        interval_ms = 0;
+    }
+    slow_queue_bytes = static_cast<uint32_t>(environmentNumber("CHAT_SLOW_QUEUE_KB", slow_queue_bytes / 1024)) * 1024;
+    slow_rtt_us = static_cast<uint32_t>(environmentNumber("CHAT_SLOW_RTT_MS", slow_rtt_us / 1000)) * 1000;
+    heavy_bytes_per_second = static_cast<uint64_t>(
+        environmentNumber("CHAT_HEAVY_KBPS", static_cast<long>(heavy_bytes_per_second / 1024))) * 1024;
+}
+
+int ConnectionMonitor::intervalMs() {
+    return interval_ms;
+}
+
+void ConnectionMonitor::start() {
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.running || interval_ms == 0) {
+        return;
+    }
+    s.running = true;
+    s.worker = std::thread(workerLoop);
+}
+
+void ConnectionMonitor::stop() {
+    Shared& s = shared();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.running) {
+            return;
+        }
+        s.running = false;
+        s.cv.notify_one();
+    }
+    if (s.worker.joinable()) {
+        s.worker.join();
+    }
+}
+
+void ConnectionMonitor::track(const std::shared_ptr<ConnectionRecord>& record) {
+    {
+        std::lock_guard<std::mutex> lock(record->mutex);
+        record->tracked = true;
+    }
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.records.push_back(record);
+}
+
+void ConnectionMonitor::untrack(const std::shared_ptr<ConnectionRecord>& record) {
+    {
+        std::lock_guard<std::mutex> lock(record->mutex);
+        if (record->tracked && record->stats.flags != 0) {
+            Metrics::adjust(Gauge::FLAGGED_CONNECTIONS, -1);
+        }
+        record->tracked = false;
+    }
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.records.erase(std::remove(s.records.begin(), s.records.end(), record), s.records.end());
+}
+
+bool ConnectionMonitor::sample(int socket, size_t chat_queued, TransportStats& stats) {
+    struct tcp_info info;
+    memset(&info, 0, sizeof(info));
+    socklen_t length = sizeof(info);
+    if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+        return false;
+    }
+    int queued = 0;
+    if (ioctl(socket, SIOCOUTQ, &queued) != 0) {
+        queued = 0;
+    }
+
+    TransportStats next;
+    next.sampled_ns = static_cast<int64_t>(BinaryLog::monotonicNanos());
+    next.rtt_us = info.tcpi_rtt;
+    next.rtt_var_us = info.tcpi_rttvar;
+    next.cwnd = info.tcpi_snd_cwnd;
+    next.unacked = info.tcpi_unacked;
+    next.retransmits = info.tcpi_total_retrans;
+    next.segments_out = info.tcpi_segs_out;
+    next.rwnd_limited_us = info.tcpi_rwnd_limited;
+    next.bytes_sent = info.tcpi_bytes_acked;
+    next.bytes_received = info.tcpi_bytes_received;
+    next.send_queue = static_cast<uint32_t>(queued > 0 ? queued : 0);
+    next.chat_queued = static_cast<uint32_t>(chat_queued);
+
+    // Rates need a previous sample; the first one only sets the baseline
+    if (stats.sampled_ns > 0 && next.sampled_ns > stats.sampled_ns) {
+        int64_t elapsed_us = (next.sampled_ns - stats.sampled_ns) / 1000;
+        uint64_t bytes = (next.bytes_sent - stats.bytes_sent) + (next.bytes_received - stats.bytes_received);
+        next.rate = elapsed_us > 0 ? bytes * 1000000 / static_cast<uint64_t>(elapsed_us) : 0;
+
+        uint32_t segments = next.segments_out - stats.segments_out;
+        uint32_t retransmitted = next.retransmits - stats.retransmits;
+        if ((segments >= LOSSY_MIN_SEGMENTS && retransmitted * 50 > segments) ||
+            info.tcpi_ca_state == TCP_CA_Loss) {
+            next.flags |= LOSSY;
+        }
+        if (next.rwnd_limited_us - stats.rwnd_limited_us > static_cast<uint64_t>(elapsed_us / 2)) {
+            next.flags |= SLOW;
+        }
+        if (next.rate >= heavy_bytes_per_second) {
+            next.flags |= HEAVY;
+        }
+    }
+    if (next.send_queue >= slow_queue_bytes) {
+        next.flags |= SLOW;
+    }
+    if (next.rtt_us >= slow_rtt_us) {
+        next.flags |= LAGGING;
+    }
+
+    stats = next;
+    return true;
+}
+
+std::string ConnectionMonitor::describeFlags(uint8_t flags) {
+    static const char* const NAMES[] = {"slow", "lagging", "lossy", "heavy"};
+    std::string out;
+    for (int bit = 0; bit < 4; bit++) {
+        if (flags & (1 << bit)) {
+            out += out.empty() ? "" : ",";
+            out += NAMES[bit];
+        }
+    }
+    return out.empty() ? "-" : out;
+}
+
+std::string ConnectionMonitor::header() {
+    char line[160];
+    snprintf(line, sizeof(line), "%-20s %9s %9s %6s %7s %7s %9s %5s %9s %9s %10s  %s",
+             "user", "rtt", "rttvar", "cwnd", "unacked", "retrans", "sendq", "chatq",
+             "sent", "recvd", "rate", "flags");
+    return line;
+}
+
+std::string ConnectionMonitor::describe(ConnectionRecord& record) {
+    TransportStats stats;
+    {
+        std::lock_guard<std::mutex> lock(record.mutex);
+        stats = record.stats;
+    }
+    const std::string& username = record.username;
+    if (stats.sampled_ns == 0) {
+        return username + " (not sampled yet)";
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "%-20s %9s %9s %6u %7u %7u %9s %5u %9s %9s %8s/s  %s",
+             username.c_str(),
+             Utils::formatDuration(uint64_t(stats.rtt_us) * 1000).c_str(),
+             Utils::formatDuration(uint64_t(stats.rtt_var_us) * 1000).c_str(),
+             stats.cwnd, stats.unacked, stats.retransmits,
+             Utils::formatFileSize(static_cast<long>(stats.send_queue)).c_str(),
+             stats.chat_queued,
+             Utils::formatFileSize(static_cast<long>(stats.bytes_sent)).c_str(),
+             Utils::formatFileSize(static_cast<long>(stats.bytes_received)).c_str(),
+             Utils::formatFileSize(static_cast<long>(stats.rate)).c_str(),
+             describeFlags(stats.flags).c_str());
+    return line;
+}
@@ -0,0 +1,178 @@
+#include "../include/cpu_dispatch.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdlib>
+
+/**
+ * CPU DISPATCH IMPLEMENTATION
+ * ===========================
+ *
+ * Detection uses GCC's __builtin_cpu_supports, which reads CPUID once
+ * and also checks XGETBV, so AVX/AVX-512 count only when the OS saves
+ * the wide registers.
+ */
+
+namespace {
+
+struct SelfTestEntry {
+    const char* kernel;
+    CpuDispatch::SelfTest test;
+};
+
+std::vector<SelfTestEntry>& selfTests() {
+    static std::vector<SelfTestEntry> tests;   // Function-local: safe from static init order
+    return tests;
+}
+
+struct BenchmarkEntry {
+    const char* kernel;
+    CpuDispatch::Benchmark benchmark;
+};
+
+std::vector<BenchmarkEntry>& benchmarks() {
+    static std::vector<BenchmarkEntry> registered;
+    return registered;
+}
+
+std::mutex selection_mutex;
+std::map<std::string, std::string>& selections() {
+    static std::map<std::string, std::string> chosen;
+    return chosen;
+}
+
+SimdLevel detectLevel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse2")) {
+        return SimdLevel::SCALAR;
+    }
+    if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("ssse3") ||
+        !__builtin_cpu_supports("pclmul")) {
+        return SimdLevel::SSE2;
+    }
+    if (!__builtin_cpu_supports("avx2")) {
+        return SimdLevel::SSE42;
+    }
+    if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw") ||
+        !__builtin_cpu_supports("avx512vl")) {
+        return SimdLevel::AVX2;
+    }
+    return SimdLevel::AVX512;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+SimdLevel activeLevel() {
+    SimdLevel level = CpuDispatch::detected();
+    const char* forced = std::getenv("CHAT_SIMD_LEVEL");
+    if (!forced || !*forced) {
+        return level;
+    }
+
+    SimdLevel requested;
+    if (!CpuDispatch::parseLevel(forced, requested)) {
+        std::cerr << "Warning: Ignoring unknown CHAT_SIMD_LEVEL '" << forced << "'" << std::endl;
+        return level;
+    }
+    if (requested > level) {
+        std::cerr << "Warning: CHAT_SIMD_LEVEL=" << forced << " is not supported here, using "
+                  << CpuDispatch::levelName(level) << std::endl;
+        return level;
+    }
+    return requested;
+}
+
+}  // namespace
+
+SimdLevel CpuDispatch::detected() {
+    static const SimdLevel level = detectLevel();
+    return level;
+}
+
+SimdLevel CpuDispatch::active() {
+    static const SimdLevel level = activeLevel();
+    return level;
+}
+
+const char* CpuDispatch::levelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SCALAR: return "scalar";
+        case SimdLevel::SSE2: return "sse2";
+        case SimdLevel::SSE42: return "sse4.2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+bool CpuDispatch::parseLevel(const std::string& text, SimdLevel& level) {
+    static const SimdLevel levels[] = {
+        SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512,
+    };
+    for (SimdLevel candidate : levels) {
+        if (text == levelName(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    if (text == "sse42") {
+        level = SimdLevel::SSE42;
+        return true;
+    }
+    return false;
+}
+
+void CpuDispatch::recordSelection(const char* kernel, const char* variant) {
+    std::lock_guard<std::mutex> lock(selection_mutex);
+    selections()[kernel] = variant;
+}
+
+std::string CpuDispatch::summary() {
+    std::lock_guard<std::mutex> lock(selection_mutex);
+    std::string text;
+    for (const auto& entry : selections()) {
+        if (!text.empty()) text += " ";
+        text += entry.first + "=" + entry.second;
+    }
+    return text;
+}
+
+bool CpuDispatch::registerSelfTest(const char* kernel, SelfTest test) {
+    selfTests().push_back({kernel, test});
+    return true;
+}
+
+void CpuDispatch::report(const char* kernel, const char* variant, const char* result) {
+    std::cout << "  " << std::left << std::setw(20) << kernel << std::setw(10) << variant << result << std::endl;
+}
+
+bool CpuDispatch::runSelfTests() {
+    std::cout << "SIMD self-test: CPU supports " << levelName(detected())
+              << ", kernels run at " << levelName(active()) << std::endl;
+
+    bool all_ok = true;
+    for (const SelfTestEntry& entry : selfTests()) {
+        if (!entry.test()) {
+            all_ok = false;
+        }
+    }
+    std::cout << (all_ok ? "All variants match the scalar kernels" : "FAILED: some variants differ") << std::endl;
+    return all_ok;
+}
+
+bool CpuDispatch::registerBenchmark(const char* kernel, Benchmark benchmark) {
+    benchmarks().push_back({kernel, benchmark});
+    return true;
+}
+
+void CpuDispatch::runBenchmarks() {
+    std::cout << "SIMD benchmarks: CPU supports " << levelName(detected())
+              << ", kernels run at " << levelName(active()) << std::endl;
+    for (const BenchmarkEntry& entry : benchmarks()) {
+        entry.benchmark();
+    }
+}
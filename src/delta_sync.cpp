@@ -0,0 +1,385 @@
+#include "../include/delta_sync.hpp"
+#include "../include/cpu_dispatch.hpp"
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <random>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DELTA_X86 1
+#endif
+
+/**
+ * DELTA SYNC IMPLEMENTATION
+ * =========================
+ *
+ * Weak checksum: rsync's rolling checksum
+ *   a = sum(x[i])                 mod 2^16
+ *   b = sum((len - i) * x[i])     mod 2^16
+ *   weak = a | (b << 16)
+ * Sliding the window one byte only needs the byte leaving and the byte
+ * entering, which is what makes the byte-by-byte search affordable.
+ * Whole blocks (signatures, restarts after a match) are summed by
+ * SSE2/AVX2 kernels picked through CpuDispatch.
+ *
+ * Strong hash: a 64-bit multiply/xor-shift hash over 8-byte words.
+ * It only needs to be collision-resistant against accidental matches;
+ * the END op carries a whole-file hash as a final safety net.
+ */
+
+namespace {
+
+inline void putU32(std::string& out, uint32_t v) {
+    char b[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+    out.append(b, 4);
+}
+
+inline void putU64(std::string& out, uint64_t v) {
+    putU32(out, static_cast<uint32_t>(v >> 32));
+    putU32(out, static_cast<uint32_t>(v));
+}
+
+inline uint32_t getU32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline uint64_t getU64(const unsigned char* p) {
+    return (uint64_t(getU32(p)) << 32) | getU32(p + 4);
+}
+
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+typedef uint32_t (*WeakKernel)(const uint8_t* data, size_t len);
+
+uint32_t weakScalar(const uint8_t* data, size_t len) {
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a += data[i];
+        b += static_cast<uint32_t>(len - i) * data[i];
+    }
+    return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+/**
+ * Combines per-vector sums into the checksum
+ * ------------------------------------------
+ * A vector kernel walks n chunks of `width` bytes and reduces to
+ *   sum    = sum of all bytes
+ *   tri    = sum over chunks k of (n - 1 - k) * chunk_sum[k]
+ *   inner  = sum of j * x[k * width + j] (j = offset within the chunk)
+ * Since byte k * width + j has weight len - k * width - j,
+ *   b = len * sum - width * ((n - 1) * sum - tri) - inner
+ * mod 2^32; the last len % width bytes are added one at a time.
+ */
+uint32_t finishWeak(const uint8_t* data, size_t len, size_t width, size_t n,
+                    uint32_t sum, uint32_t tri, uint32_t inner) {
+    uint32_t a = sum;
+    uint32_t b = static_cast<uint32_t>(len) * sum -
+                 static_cast<uint32_t>(width) * (static_cast<uint32_t>(n - 1) * sum - tri) - inner;
+    for (size_t i = n * width; i < len; i++) {
+        a += data[i];
+        b += static_cast<uint32_t>(len - i) * data[i];
+    }
+    return (a & 0xffff) | ((b & 0xffff) << 16);
+}
+
+#ifdef DELTA_X86
+__attribute__((target("sse2")))
+uint32_t hsum32(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+/**
+ * SSE2: 16-byte chunks; sums via SAD, position weights via 16-bit madd
+ */
+__attribute__((target("sse2")))
+uint32_t weakSse2(const uint8_t* data, size_t len) {
+    const size_t n = len / 16;
+    if (n == 0) {
+        return weakScalar(data, len);
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w_lo = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i w_hi = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i sum = zero, tri = zero, inner = zero;
+
+    for (size_t k = 0; k < n; k++) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * k));
+        tri = _mm_add_epi32(tri, sum);
+        sum = _mm_add_epi32(sum, _mm_sad_epu8(x, zero));
+        inner = _mm_add_epi32(inner, _mm_madd_epi16(_mm_unpacklo_epi8(x, zero), w_lo));
+        inner = _mm_add_epi32(inner, _mm_madd_epi16(_mm_unpackhi_epi8(x, zero), w_hi));
+    }
+    return finishWeak(data, len, 16, n, hsum32(sum), hsum32(tri), hsum32(inner));
+}
+
+__attribute__((target("avx2")))
+__m128i foldAvx2(__m256i v) {
+    return _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+/**
+ * AVX2: 32-byte chunks; maddubs multiplies bytes by their offsets
+ * (at most 2 * 255 * 31, fits int16), madd widens to 32 bits
+ */
+__attribute__((target("avx2")))
+uint32_t weakAvx2(const uint8_t* data, size_t len) {
+    const size_t n = len / 32;
+    if (n == 0) {
+        return weakSse2(data, len);
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                             16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    __m256i sum = zero, tri = zero, inner = zero;
+
+    for (size_t k = 0; k < n; k++) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32 * k));
+        tri = _mm256_add_epi32(tri, sum);
+        sum = _mm256_add_epi32(sum, _mm256_sad_epu8(x, zero));
+        inner = _mm256_add_epi32(inner, _mm256_madd_epi16(_mm256_maddubs_epi16(x, weights), ones));
+    }
+    return finishWeak(data, len, 32, n, hsum32(foldAvx2(sum)), hsum32(foldAvx2(tri)), hsum32(foldAvx2(inner)));
+}
+#endif
+
+const KernelVariant<WeakKernel> WEAK_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", weakScalar},
+#ifdef DELTA_X86
+    {SimdLevel::SSE2, "sse2", weakSse2},
+    {SimdLevel::AVX2, "avx2", weakAvx2},
+#endif
+};
+
+/**
+ * Every length up to past two chunks, then block sizes up to the
+ * maximum, on random and all-0xff data (the largest per-lane sums)
+ */
+bool testWeak() {
+    return CpuDispatch::testVariants("delta.weak", WEAK_VARIANTS, [](WeakKernel scalar, WeakKernel variant) {
+        std::mt19937 rng(1996);
+        std::vector<uint8_t> random(DeltaSync::MAX_BLOCK_SIZE + 64), saturated(random.size(), 0xff);
+        for (uint8_t& byte : random) byte = static_cast<uint8_t>(rng());
+
+        for (const std::vector<uint8_t>* buffer : {&random, &saturated}) {
+            for (size_t len = 0; len <= DeltaSync::MAX_BLOCK_SIZE; len += len < 200 ? 1 : 1021) {
+                const uint8_t* start = buffer->data() + rng() % 64;
+                if (scalar(start, len) != variant(start, len)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    });
+}
+
+const bool weak_registered = CpuDispatch::registerSelfTest("delta.weak", testWeak);
+
+}  // namespace
+
+uint32_t DeltaSync::chooseBlockSize(uint64_t file_size) {
+    uint64_t block = static_cast<uint64_t>(std::sqrt(static_cast<double>(file_size)));
+    block = (block + 1023) & ~uint64_t(1023);  // Round up to 1KB
+    if (block < MIN_BLOCK_SIZE) block = MIN_BLOCK_SIZE;
+    if (block > MAX_BLOCK_SIZE) block = MAX_BLOCK_SIZE;
+    return static_cast<uint32_t>(block);
+}
+
+uint32_t DeltaSync::weakChecksum(const uint8_t* data, size_t len) {
+    static const WeakKernel kernel = CpuDispatch::select("delta.weak", WEAK_VARIANTS).fn;
+    return kernel(data, len);
+}
+
+uint32_t DeltaSync::rollChecksum(uint32_t weak, uint8_t out, uint8_t in, size_t len) {
+    uint32_t a = weak & 0xffff;
+    uint32_t b = weak >> 16;
+    a = (a - out + in) & 0xffff;
+    b = (b - static_cast<uint32_t>(len) * out + a) & 0xffff;
+    return a | (b << 16);
+}
+
+uint64_t DeltaSync::strongHash(const uint8_t* data, size_t len, uint64_t seed) {
+    uint64_t h = seed ^ (0x9e3779b97f4a7c15ULL * (len + 1));
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = mix64(h ^ w) + 0x9e3779b97f4a7c15ULL;
+    }
+    uint64_t tail = 0;
+    for (size_t j = 0; i + j < len; j++) {
+        tail |= uint64_t(data[i + j]) << (8 * j);
+    }
+    return mix64(h ^ tail);
+}
+
+/**
+ * Compute signatures of the receiver's basis file
+ * -----------------------------------------------
+ * Only full blocks are signed; the sender sends any tail as literal data.
+ */
+SignatureSet DeltaSync::computeSignatures(const std::string& path) {
+    SignatureSet sigs;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return sigs;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return sigs;
+    }
+
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    sigs.block_size = chooseBlockSize(size);
+
+    std::vector<uint8_t> block(sigs.block_size);
+    for (uint64_t off = 0; off + sigs.block_size <= size; off += sigs.block_size) {
+        ssize_t n = pread(fd, block.data(), sigs.block_size, static_cast<off_t>(off));
+        if (n != static_cast<ssize_t>(sigs.block_size)) {
+            break;
+        }
+        BlockSignature sig;
+        sig.weak = weakChecksum(block.data(), sigs.block_size);
+        sig.strong = strongHash(block.data(), sigs.block_size);
+        sigs.blocks.push_back(sig);
+    }
+
+    close(fd);
+    return sigs;
+}
+
+std::string DeltaSync::serializeSignatures(const SignatureSet& sigs) {
+    std::string out;
+    out.reserve(SIGNATURE_HEADER_SIZE + sigs.blocks.size() * SIGNATURE_ENTRY_SIZE);
+    out.append("DSG1", 4);
+    putU32(out, sigs.block_size);
+    putU32(out, static_cast<uint32_t>(sigs.blocks.size()));
+    for (const auto& sig : sigs.blocks) {
+        putU32(out, sig.weak);
+        putU64(out, sig.strong);
+    }
+    return out;
+}
+
+bool DeltaSync::parseSignatures(const std::string& blob, SignatureSet& sigs) {
+    if (blob.size() < SIGNATURE_HEADER_SIZE || blob.compare(0, 4, "DSG1") != 0) {
+        return false;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(blob.data());
+    sigs.block_size = getU32(p + 4);
+    uint32_t count = getU32(p + 8);
+
+    if (blob.size() != SIGNATURE_HEADER_SIZE + uint64_t(count) * SIGNATURE_ENTRY_SIZE) {
+        return false;
+    }
+    if (count > 0 && (sigs.block_size < MIN_BLOCK_SIZE || sigs.block_size > MAX_BLOCK_SIZE)) {
+        return false;
+    }
+
+    sigs.blocks.resize(count);
+    p += SIGNATURE_HEADER_SIZE;
+    for (uint32_t i = 0; i < count; i++, p += SIGNATURE_ENTRY_SIZE) {
+        sigs.blocks[i].weak = getU32(p);
+        sigs.blocks[i].strong = getU64(p + 4);
+    }
+    return true;
+}
+
+/**
+ * Compute the delta
+ * -----------------
+ * Rolling search over the new file. Adjacent matched blocks are merged
+ * into a single COPY so a mostly-unchanged file encodes to a handful
+ * of instructions.
+ */
+std::vector<DeltaOp> DeltaSync::computeDelta(const uint8_t* data, size_t size, const SignatureSet& sigs) {
+    std::vector<DeltaOp> ops;
+    const size_t block = sigs.block_size;
+
+    auto emitLiteral = [&](uint64_t from, uint64_t to) {
+        while (from < to) {
+            uint64_t len = std::min<uint64_t>(to - from, MAX_LITERAL_RUN);
+            ops.push_back({DeltaOp::LITERAL, from, len});
+            from += len;
+        }
+    };
+
+    auto emitCopy = [&](uint64_t index) {
+        if (!ops.empty() && ops.back().type == DeltaOp::COPY &&
+            ops.back().offset + ops.back().length == index) {
+            ops.back().length++;
+        } else {
+            ops.push_back({DeltaOp::COPY, index, 1});
+        }
+    };
+
+    if (block == 0 || sigs.blocks.empty() || size < block) {
+        emitLiteral(0, size);
+        return ops;
+    }
+
+    // weak checksum -> candidate block indices
+    std::unordered_multimap<uint32_t, uint32_t> table;
+    table.reserve(sigs.blocks.size());
+    for (uint32_t i = 0; i < sigs.blocks.size(); i++) {
+        table.emplace(sigs.blocks[i].weak, i);
+    }
+
+    size_t pos = 0;
+    size_t literal_start = 0;
+    uint32_t weak = weakChecksum(data, block);
+
+    while (pos + block <= size) {
+        bool matched = false;
+        auto range = table.equal_range(weak);
+        if (range.first != range.second) {
+            uint64_t strong = strongHash(data + pos, block);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (sigs.blocks[it->second].strong == strong) {
+                    emitLiteral(literal_start, pos);
+                    emitCopy(it->second);
+                    pos += block;
+                    literal_start = pos;
+                    if (pos + block <= size) {
+                        weak = weakChecksum(data + pos, block);
+                    }
+                    matched = true;
+                    break;
+                }
+            }
+        }
+        if (matched) continue;
+
+        if (pos + block >= size) break;
+        weak = rollChecksum(weak, data[pos], data[pos + block], block);
+        pos++;
+    }
+
+    emitLiteral(literal_start, size);
+    return ops;
+}
+
+uint64_t DeltaSync::encodedBodySize(const std::vector<DeltaOp>& ops) {
+    uint64_t total = END_OP_SIZE;
+    for (const auto& op : ops) {
+        total += (op.type == DeltaOp::COPY) ? COPY_OP_SIZE : LITERAL_OP_HEADER_SIZE + op.length;
+    }
+    return total;
+}
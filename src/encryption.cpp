@@ -0,0 +1,363 @@
+#include "../include/encryption.hpp"
+#include "../include/cpu_dispatch.hpp"
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <vector>
+#include <random>
+#include <numeric>
+#include <cstring>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ENCRYPTION_X86 1
+#endif
+
+/**
+ * XOR CIPHER IMPLEMENTATION
+ * =========================
+ *
+ * The old loop did `key[i % key_len]` per byte: a division per byte and
+ * no vectorization, plus a string copy per call (two for decrypt).
+ *
+ * Here the key is expanded once into a keystream block with
+ *   block[i] = key[i % key_len],   period = lcm(key_len, 128)
+ * plus 128 bytes of slack. Because the period is a multiple of the key
+ * length, any position p in the stream maps to block[p % period], and
+ * a 128-byte step from any position < period stays inside the block.
+ * The kernels therefore do unaligned loads of data and keystream, XOR
+ * and store, and wrap the keystream position once per 128 bytes.
+ *
+ * Cost per byte is a fraction of a cycle, far below a recv()/send()
+ * of the same bytes, so enabling encryption is not measurable.
+ */
+
+namespace {
+
+constexpr size_t STEP = 128;    // Bytes per unrolled iteration (4 x AVX2)
+
+struct Keystream {
+    std::string key;
+    size_t period;
+    std::vector<uint8_t> block;  // period + STEP bytes
+
+    explicit Keystream(const std::string& k) : key(k), period(0) {
+        if (key.empty()) {
+            return;
+        }
+        period = std::lcm(key.size(), STEP);
+        block.resize(period + STEP);
+        for (size_t i = 0; i < block.size(); i++) {
+            block[i] = static_cast<uint8_t>(key[i % key.size()]);
+        }
+    }
+};
+
+const Keystream& defaultKeystream() {
+    static const Keystream stream(Encryption::DEFAULT_KEY);
+    return stream;
+}
+
+/**
+ * Keystream for a key
+ * The default key is expanded once per process; other keys are cached
+ * per thread, so repeated calls with the same key expand it once.
+ */
+const Keystream& keystreamFor(const std::string& key) {
+    const Keystream& default_stream = defaultKeystream();
+    if (key == default_stream.key) {
+        return default_stream;
+    }
+    thread_local Keystream custom("");
+    if (custom.key != key) {
+        custom = Keystream(key);
+    }
+    return custom;
+}
+
+typedef size_t (*XorKernel)(uint8_t* data, size_t len, const uint8_t* ks, size_t& pos, size_t period);
+
+/**
+ * Scalar kernel: 8 bytes at a time, memcpy keeps the loads unaligned-safe
+ */
+size_t xorScalar(uint8_t* data, size_t len, const uint8_t* ks, size_t& pos, size_t period) {
+    size_t i = 0;
+    for (; i + STEP <= len; i += STEP) {
+        for (size_t j = 0; j < STEP; j += 8) {
+            uint64_t d, k;
+            std::memcpy(&d, data + i + j, 8);
+            std::memcpy(&k, ks + pos + j, 8);
+            d ^= k;
+            std::memcpy(data + i + j, &d, 8);
+        }
+        pos += STEP;
+        if (pos >= period) pos -= period;
+    }
+    for (; i + 8 <= len; i += 8) {
+        uint64_t d, k;
+        std::memcpy(&d, data + i, 8);
+        std::memcpy(&k, ks + pos, 8);
+        d ^= k;
+        std::memcpy(data + i, &d, 8);
+        pos += 8;
+        if (pos >= period) pos -= period;
+    }
+    return i;
+}
+
+#ifdef ENCRYPTION_X86
+/**
+ * SSE2 kernel: two halves of 4 x 16 bytes per step
+ */
+__attribute__((target("sse2")))
+size_t xorSse2(uint8_t* data, size_t len, const uint8_t* ks, size_t& pos, size_t period) {
+    size_t i = 0;
+    for (; i + STEP <= len; i += STEP) {
+        for (size_t j = 0; j < STEP; j += 64) {
+            __m128i* d = reinterpret_cast<__m128i*>(data + i + j);
+            const __m128i* k = reinterpret_cast<const __m128i*>(ks + pos + j);
+            __m128i d0 = _mm_loadu_si128(d + 0), d1 = _mm_loadu_si128(d + 1);
+            __m128i d2 = _mm_loadu_si128(d + 2), d3 = _mm_loadu_si128(d + 3);
+            _mm_storeu_si128(d + 0, _mm_xor_si128(d0, _mm_loadu_si128(k + 0)));
+            _mm_storeu_si128(d + 1, _mm_xor_si128(d1, _mm_loadu_si128(k + 1)));
+            _mm_storeu_si128(d + 2, _mm_xor_si128(d2, _mm_loadu_si128(k + 2)));
+            _mm_storeu_si128(d + 3, _mm_xor_si128(d3, _mm_loadu_si128(k + 3)));
+        }
+        pos += STEP;
+        if (pos >= period) pos -= period;
+    }
+    for (; i + 16 <= len; i += 16) {
+        __m128i* d = reinterpret_cast<__m128i*>(data + i);
+        _mm_storeu_si128(d, _mm_xor_si128(_mm_loadu_si128(d),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(ks + pos))));
+        pos += 16;
+        if (pos >= period) pos -= period;
+    }
+    return i;
+}
+
+/**
+ * AVX2 kernel: 4 x 32 bytes per step
+ */
+__attribute__((target("avx2")))
+size_t xorAvx2(uint8_t* data, size_t len, const uint8_t* ks, size_t& pos, size_t period) {
+    size_t i = 0;
+    for (; i + STEP <= len; i += STEP) {
+        __m256i* d = reinterpret_cast<__m256i*>(data + i);
+        const __m256i* k = reinterpret_cast<const __m256i*>(ks + pos);
+        __m256i d0 = _mm256_loadu_si256(d + 0), d1 = _mm256_loadu_si256(d + 1);
+        __m256i d2 = _mm256_loadu_si256(d + 2), d3 = _mm256_loadu_si256(d + 3);
+        _mm256_storeu_si256(d + 0, _mm256_xor_si256(d0, _mm256_loadu_si256(k + 0)));
+        _mm256_storeu_si256(d + 1, _mm256_xor_si256(d1, _mm256_loadu_si256(k + 1)));
+        _mm256_storeu_si256(d + 2, _mm256_xor_si256(d2, _mm256_loadu_si256(k + 2)));
+        _mm256_storeu_si256(d + 3, _mm256_xor_si256(d3, _mm256_loadu_si256(k + 3)));
+        pos += STEP;
+        if (pos >= period) pos -= period;
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i* d = reinterpret_cast<__m256i*>(data + i);
+        _mm256_storeu_si256(d, _mm256_xor_si256(_mm256_loadu_si256(d),
+                                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ks + pos))));
+        pos += 32;
+        if (pos >= period) pos -= period;
+    }
+    return i;
+}
+
+/**
+ * AVX-512 kernel: 2 x 64 bytes per step
+ */
+__attribute__((target("avx512f")))
+size_t xorAvx512(uint8_t* data, size_t len, const uint8_t* ks, size_t& pos, size_t period) {
+    size_t i = 0;
+    for (; i + STEP <= len; i += STEP) {
+        __m512i d0 = _mm512_loadu_si512(data + i);
+        __m512i d1 = _mm512_loadu_si512(data + i + 64);
+        _mm512_storeu_si512(data + i, _mm512_xor_si512(d0, _mm512_loadu_si512(ks + pos)));
+        _mm512_storeu_si512(data + i + 64, _mm512_xor_si512(d1, _mm512_loadu_si512(ks + pos + 64)));
+        pos += STEP;
+        if (pos >= period) pos -= period;
+    }
+    for (; i + 64 <= len; i += 64) {
+        _mm512_storeu_si512(data + i, _mm512_xor_si512(_mm512_loadu_si512(data + i),
+                                                       _mm512_loadu_si512(ks + pos)));
+        pos += 64;
+        if (pos >= period) pos -= period;
+    }
+    return i;
+}
+#endif
+
+const KernelVariant<XorKernel> XOR_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", xorScalar},
+#ifdef ENCRYPTION_X86
+    {SimdLevel::SSE2, "sse2", xorSse2},
+    {SimdLevel::AVX2, "avx2", xorAvx2},
+    {SimdLevel::AVX512, "avx512", xorAvx512},
+#endif
+};
+
+/**
+ * Runs a kernel, then the last few bytes one at a time
+ */
+void xorWithKernel(XorKernel kernel, uint8_t* data, size_t len, uint64_t offset, const Keystream& stream) {
+    if (stream.period == 0 || len == 0) {
+        return;
+    }
+
+    size_t pos = static_cast<size_t>(offset % stream.period);
+    size_t done = kernel(data, len, stream.block.data(), pos, stream.period);
+    for (; done < len; done++) {
+        data[done] ^= stream.block[pos];
+        if (++pos == stream.period) pos = 0;
+    }
+}
+
+void xorStream(uint8_t* data, size_t len, uint64_t offset, const Keystream& stream) {
+    static const XorKernel kernel = CpuDispatch::select("encryption.xor", XOR_VARIANTS).fn;
+    xorWithKernel(kernel, data, len, offset, stream);
+}
+
+/**
+ * Keys of every length up to past STEP, random offsets, lengths and
+ * misalignment; each variant must leave the same bytes as scalar
+ */
+bool testXor() {
+    return CpuDispatch::testVariants("encryption.xor", XOR_VARIANTS, [](XorKernel scalar, XorKernel variant) {
+        std::mt19937 rng(2025);
+        std::vector<uint8_t> expected(3000), actual(expected.size());
+        for (size_t key_len = 1; key_len <= 140; key_len++) {
+            std::string key(key_len, '\0');
+            for (char& c : key) c = static_cast<char>(rng());
+            Keystream stream(key);
+            for (int round = 0; round < 8; round++) {
+                size_t len = rng() % 2900, start = rng() % 64;
+                uint64_t offset = rng();
+                for (size_t i = 0; i < len; i++) {
+                    expected[start + i] = actual[start + i] = static_cast<uint8_t>(rng());
+                }
+                xorWithKernel(scalar, expected.data() + start, len, offset, stream);
+                xorWithKernel(variant, actual.data() + start, len, offset, stream);
+                if (std::memcmp(expected.data() + start, actual.data() + start, len) != 0) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * In-place throughput of each variant on message- and chunk-sized
+ * buffers, then the string API (copy included) at the active level
+ */
+void benchXor() {
+    static const size_t SIZES[] = {64, 1024, 128 * 1024};
+    const Keystream& stream = defaultKeystream();
+    std::vector<uint8_t> buffer(SIZES[2], 0x5a);
+    auto rates = [&](const std::function<void(size_t)>& op) {
+        char line[128];
+        int used = 0;
+        for (size_t size : SIZES) {
+            double rate = CpuDispatch::throughput(size, [&]() { op(size); });
+            used += snprintf(line + used, sizeof(line) - used, "%8zu B %8.0f MB/s", size, rate);
+        }
+        return std::string(line);
+    };
+
+    CpuDispatch::benchVariants("encryption.xor", XOR_VARIANTS, [&](XorKernel kernel) {
+        return rates([&](size_t size) { xorWithKernel(kernel, buffer.data(), size, 7, stream); });
+    });
+    std::string message(SIZES[2], 'x');
+    std::cout << "  " << std::left << std::setw(20) << "encryption.xor" << std::setw(10) << "encrypt()"
+              << rates([&](size_t size) {
+                     message.resize(size, 'x');
+                     message = Encryption::encrypt(message);
+                 }) << std::endl;
+}
+
+/**
+ * toHex/fromHex as they were before TextCodec: a string append per
+ * digit, and a substr plus std::stoi per byte. Kept as the baseline
+ * for benchHex.
+ */
+std::string legacyToHex(const std::string& data) {
+    std::string hex;
+    const char hex_chars[] = "0123456789ABCDEF";
+    for (unsigned char c : data) {
+        hex += hex_chars[c >> 4];
+        hex += hex_chars[c & 0x0F];
+    }
+    return hex;
+}
+
+std::string legacyFromHex(const std::string& hex) {
+    std::string data;
+    for (size_t i = 0; i < hex.length(); i += 2) {
+        std::string byte_str = hex.substr(i, 2);
+        data += static_cast<char>(std::stoi(byte_str, nullptr, 16));
+    }
+    return data;
+}
+
+/**
+ * The string API against the legacy loops on 1 KB and 1 MB, allocation
+ * and copies included. Rates are MB/s of binary data.
+ */
+void benchHex() {
+    static const size_t SIZES[] = {1024, 1024 * 1024};
+    std::mt19937 rng(3);
+    std::string data(SIZES[1], '\0');
+    for (char& c : data) c = static_cast<char>(rng());
+    std::string hex = Encryption::toHex(data);
+    auto rates = [&](const char* kernel, const char* name, const std::function<std::string(size_t)>& op) {
+        char line[128];
+        int used = 0;
+        for (size_t size : SIZES) {
+            double rate = CpuDispatch::throughput(size, [&]() { op(size); });
+            used += snprintf(line + used, sizeof(line) - used, "%8zu B %8.0f MB/s", size, rate);
+        }
+        std::cout << "  " << std::left << std::setw(20) << kernel << std::setw(10) << name
+                  << line << std::endl;
+    };
+
+    rates("encryption.toHex", "old", [&](size_t size) { return legacyToHex(data.substr(0, size)); });
+    rates("encryption.toHex", "toHex()", [&](size_t size) { return Encryption::toHex(data.substr(0, size)); });
+    rates("encryption.fromHex", "old", [&](size_t size) { return legacyFromHex(hex.substr(0, 2 * size)); });
+    rates("encryption.fromHex", "fromHex()", [&](size_t size) { return Encryption::fromHex(hex.substr(0, 2 * size)); });
+}
+
+const bool xor_registered = CpuDispatch::registerSelfTest("encryption.xor", testXor);
+const bool xor_bench_registered = CpuDispatch::registerBenchmark("encryption.xor", benchXor);
+const bool hex_bench_registered = CpuDispatch::registerBenchmark("encryption.hex", benchHex);
+
+}  // namespace
+
+void Encryption::encryptInPlace(uint8_t* data, size_t len, uint64_t offset, const std::string& key) {
+    xorStream(data, len, offset, keystreamFor(key));
+}
+
+void Encryption::encryptInPlace(uint8_t* data, size_t len, uint64_t offset) {
+    xorStream(data, len, offset, defaultKeystream());
+}
+
+std::string Encryption::encrypt(const std::string& plaintext, const std::string& key) {
+    std::string encrypted = plaintext;
+    encryptInPlace(reinterpret_cast<uint8_t*>(&encrypted[0]), encrypted.size(), 0, key);
+    return encrypted;
+}
+
+std::string Encryption::encrypt(const std::string& plaintext) {
+    std::string encrypted = plaintext;
+    encryptInPlace(reinterpret_cast<uint8_t*>(&encrypted[0]), encrypted.size());
+    return encrypted;
+}
+
+std::string Encryption::decrypt(const std::string& ciphertext, const std::string& key) {
+    // XOR cipher is symmetric - decrypt is same as encrypt
+    return encrypt(ciphertext, key);
+}
+
+std::string Encryption::decrypt(const std::string& ciphertext) {
+    return encrypt(ciphertext);
+}
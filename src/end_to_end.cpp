@@ -0,0 +1,219 @@
+#include "../include/end_to_end.hpp"
+#include "../include/text_codec.hpp"
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+/**
+ * END-TO-END MESSAGE IMPLEMENTATION
+ * =================================
+ *
+ * Keys are derived once per peer key (one X25519 operation and two HKDF
+ * runs) and cached; a message then costs one AEAD pass and one base64
+ * pass on each client. The body is sealed in place inside the buffer it
+ * is encoded from, and opened in place inside the buffer it is decoded
+ * into, so each side makes no copies beyond the encoding itself.
+ *
+ * A peer's entry is replaced whenever a different public key shows up -
+ * from a /pubkey reply or inside a body that opens under it - which is
+ * what happens when that user logs in again. Counters are not part of
+ * the entry: sending uses one counter for all peers, and the receive
+ * window is kept per sender key, so going back to an earlier key neither
+ * reuses a nonce nor lets old messages be replayed.
+ */
+
+namespace {
+
+const char* const KDF_SALT = "chat-e2e-v1";
+
+void wipe(void* data, size_t len) {
+    volatile uint8_t* p = static_cast<volatile uint8_t*>(data);
+    for (size_t i = 0; i < len; i++) p[i] = 0;
+}
+
+void wipeKeys(uint8_t* tx_key, uint8_t* rx_key) {
+    wipe(tx_key, ChaCha20Poly1305::KEY_SIZE);
+    wipe(rx_key, ChaCha20Poly1305::KEY_SIZE);
+}
+
+void makeNonce(uint64_t counter, uint8_t nonce[ChaCha20Poly1305::NONCE_SIZE]) {
+    std::memset(nonce, 0, ChaCha20Poly1305::NONCE_SIZE);
+    for (int i = 0; i < 8; i++) {
+        nonce[4 + i] = static_cast<uint8_t>(counter >> (8 * i));
+    }
+}
+
+}  // namespace
+
+EndToEnd::EndToEnd() : priv(), pub() {}
+
+EndToEnd::~EndToEnd() {
+    wipe(priv, sizeof(priv));
+    for (auto& pair : peers) {
+        wipeKeys(pair.second.tx_key, pair.second.rx_key);
+    }
+}
+
+bool EndToEnd::enabled() {
+    const char* value = std::getenv("CHAT_E2E");
+    return !value || std::strcmp(value, "0") != 0;
+}
+
+bool EndToEnd::init() {
+    if (!KeyExchange::generateKeyPair(priv, pub)) {
+        return false;
+    }
+    pub_hex.assign(2 * X25519::KEY_SIZE, '\0');
+    TextCodec::hexEncode(pub, X25519::KEY_SIZE, &pub_hex[0]);
+    return true;
+}
+
+bool EndToEnd::isKeyHex(const std::string& hex) {
+    uint8_t key[X25519::KEY_SIZE];
+    return hex.size() == 2 * X25519::KEY_SIZE && TextCodec::hexDecode(hex.data(), hex.size(), key);
+}
+
+/**
+ * Direction key: info is sender_pub | recipient_pub
+ */
+bool EndToEnd::derive(const uint8_t peer_pub[X25519::KEY_SIZE], bool sending,
+                      uint8_t key[ChaCha20Poly1305::KEY_SIZE]) {
+    uint8_t shared[X25519::KEY_SIZE];
+    if (!X25519::sharedSecret(shared, priv, peer_pub)) {
+        return false;
+    }
+
+    uint8_t info[2 * X25519::KEY_SIZE];
+    std::memcpy(info, sending ? pub : peer_pub, X25519::KEY_SIZE);
+    std::memcpy(info + X25519::KEY_SIZE, sending ? peer_pub : pub, X25519::KEY_SIZE);
+    KeyExchange::hkdf(reinterpret_cast<const uint8_t*>(KDF_SALT), std::strlen(KDF_SALT),
+                      shared, sizeof(shared), info, sizeof(info), key, ChaCha20Poly1305::KEY_SIZE);
+    wipe(shared, sizeof(shared));
+    return true;
+}
+
+/**
+ * Point a peer entry at a (new) public key
+ */
+bool EndToEnd::bindPeer(Peer& peer, const uint8_t peer_pub[X25519::KEY_SIZE]) {
+    if (!derive(peer_pub, true, peer.tx_key) || !derive(peer_pub, false, peer.rx_key)) {
+        return false;
+    }
+    std::memcpy(peer.pub, peer_pub, X25519::KEY_SIZE);
+    peer.key_hex.assign(2 * X25519::KEY_SIZE, '\0');
+    TextCodec::hexEncode(peer_pub, X25519::KEY_SIZE, &peer.key_hex[0]);
+    return true;
+}
+
+bool EndToEnd::setPeerKey(const std::string& user, const std::string& hex) {
+    uint8_t peer_pub[X25519::KEY_SIZE];
+    if (hex.size() != 2 * X25519::KEY_SIZE || !TextCodec::hexDecode(hex.data(), hex.size(), peer_pub)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    auto it = peers.find(user);
+    if (it != peers.end() && it->second.key_hex == hex) {
+        return true;
+    }
+    Peer peer;
+    bool bound = bindPeer(peer, peer_pub);
+    if (bound) {
+        peers[user] = peer;
+    }
+    wipeKeys(peer.tx_key, peer.rx_key);
+    return bound;
+}
+
+bool EndToEnd::hasPeerKey(const std::string& user) {
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    return peers.find(user) != peers.end();
+}
+
+bool EndToEnd::seal(const std::string& from, const std::string& to, const std::string& text,
+                    std::string& command) {
+    if (text.size() > MAX_MESSAGE) {
+        return false;
+    }
+
+    std::vector<uint8_t> body(BODY_OVERHEAD + text.size());
+    uint8_t* counter_bytes = body.data() + X25519::KEY_SIZE;
+    uint8_t* ciphertext = counter_bytes + 8;
+    uint8_t* tag = ciphertext + text.size();
+    std::string key_id;
+    {
+        std::lock_guard<std::mutex> lock(peers_mutex);
+        auto it = peers.find(to);
+        if (it == peers.end()) {
+            return false;
+        }
+        Peer& peer = it->second;
+        uint64_t counter = tx_counter++;
+        uint8_t nonce[ChaCha20Poly1305::NONCE_SIZE];
+        makeNonce(counter, nonce);
+        std::memcpy(counter_bytes, nonce + 4, 8);
+        std::memcpy(body.data(), pub, X25519::KEY_SIZE);
+
+        std::string aad = from + ">" + to;
+        ChaCha20Poly1305::seal(peer.tx_key, nonce, reinterpret_cast<const uint8_t*>(aad.data()), aad.size(),
+                               reinterpret_cast<const uint8_t*>(text.data()), text.size(), ciphertext, tag);
+        key_id = peer.key_hex.substr(0, KEY_ID_SIZE);
+    }
+
+    std::string header = "/e2e " + to + " " + key_id + " ";
+    command.assign(header.size() + TextCodec::base64EncodedSize(body.size()), '\0');
+    command.replace(0, header.size(), header);
+    TextCodec::base64Encode(body.data(), body.size(), &command[header.size()]);
+    return true;
+}
+
+bool EndToEnd::open(const std::string& from, const std::string& to, const std::string& body_text,
+                    std::string& text) {
+    std::vector<uint8_t> body(TextCodec::base64DecodedMaxSize(body_text.size()));
+    size_t body_len = 0;
+    if (!TextCodec::base64Decode(body_text.data(), body_text.size(), body.data(), body_len) ||
+        body_len < BODY_OVERHEAD || body_len - BODY_OVERHEAD > MAX_MESSAGE) {
+        return false;
+    }
+    const uint8_t* sender_pub = body.data();
+    const uint8_t* counter_bytes = sender_pub + X25519::KEY_SIZE;
+    uint8_t* ciphertext = const_cast<uint8_t*>(counter_bytes) + 8;
+    size_t len = body_len - BODY_OVERHEAD;
+    const uint8_t* tag = ciphertext + len;
+
+    uint64_t counter = 0;
+    for (int i = 7; i >= 0; i--) {
+        counter = (counter << 8) | counter_bytes[i];
+    }
+    uint8_t nonce[ChaCha20Poly1305::NONCE_SIZE];
+    makeNonce(counter, nonce);
+    std::string aad = from + ">" + to;
+
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    auto it = peers.find(from);
+    bool known = it != peers.end() && std::memcmp(it->second.pub, sender_pub, X25519::KEY_SIZE) == 0;
+
+    // First message from this peer, or they logged in again: the entry is
+    // only replaced once the body opens under the new key
+    Peer candidate;
+    if (!known && !bindPeer(candidate, sender_pub)) {
+        wipeKeys(candidate.tx_key, candidate.rx_key);
+        return false;
+    }
+    Peer& peer = known ? it->second : candidate;
+    uint64_t& next = rx_next[peer.key_hex];
+    bool opened = counter >= next &&
+        ChaCha20Poly1305::open(peer.rx_key, nonce, reinterpret_cast<const uint8_t*>(aad.data()), aad.size(),
+                               ciphertext, len, tag, ciphertext);
+    if (opened) {
+        next = counter + 1;
+        if (!known) {
+            peers.insert_or_assign(from, candidate);
+        }
+        text.assign(reinterpret_cast<const char*>(ciphertext), len);
+    } else if (next == 0) {
+        rx_next.erase(peer.key_hex);                    // Nothing from this key ever opened
+    }
+    wipeKeys(candidate.tx_key, candidate.rx_key);
+    return opened;
+}
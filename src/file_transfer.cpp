@@ -1,5 +1,12 @@
 #include "../include/file_transfer.hpp"
 #include "../include/utils.hpp"
+#include "../include/compression.hpp"
+#include "../include/upload_pipeline.hpp"
+#include "../include/traffic_shaper.hpp"
+#include "../include/encryption.hpp"
+#include "../include/async_file_writer.hpp"
+#include "../include/secure_channel.hpp"
+#include "../include/checksum.hpp"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -7,8 +14,16 @@
 #include <chrono>
 #include <algorithm>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <dirent.h>
+#include <glob.h>
+#include <cerrno>
 #include <sys/socket.h>
 #include <cstring>
+#include <cstdio>
 
 /**
  * FILE TRANSFER IMPLEMENTATION
@@ -39,6 +54,28 @@
  * - Non-blocking I/O would improve this further (future work)
  */
 
+namespace {
+
+inline void putU32(std::string& out, uint32_t v) {
+    char b[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+    out.append(b, 4);
+}
+
+inline void putU64(std::string& out, uint64_t v) {
+    putU32(out, static_cast<uint32_t>(v >> 32));
+    putU32(out, static_cast<uint32_t>(v));
+}
+
+inline uint32_t getU32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline uint64_t getU64(const unsigned char* p) {
+    return (uint64_t(getU32(p)) << 32) | getU32(p + 4);
+}
+
+}  // namespace
+
 /**
  * Stream file data from sender to recipient via server
  * ---------------------------------------------------
@@ -47,12 +84,15 @@
  * The server acts as a relay:
  * Sender --> Server --> Recipient
  * 
- * Data flows in real-time without server storing the file
+ * Data flows in real-time without server storing the file. Each
+ * CHUNK_SIZE slice is copied through user space (recv into buffer,
+ * then sendAll), on plaintext, session and TLS sockets alike.
  */
 bool FileTransferHandler::streamFileData(int sender_socket, int recipient_socket,
                                         const std::string& sender_username,
                                         const std::string& recipient_username,
-                                        const std::string& filename, long file_size) {
+                                        const std::string& filename, long file_size,
+                                        TransferFlow* flow) {
     std::vector<char> buffer(CHUNK_SIZE);
     long total_transferred = 0;
     long last_update = 0;
@@ -69,15 +109,15 @@ bool FileTransferHandler::streamFileData(int sender_socket, int recipient_socket
         );
         
         // Step 1: Receive chunk from sender
-        ssize_t bytes_received = recv(sender_socket, buffer.data(), bytes_to_receive, 0);
+        ssize_t bytes_received = SecureChannel::recv(sender_socket, buffer.data(), bytes_to_receive, 0);
         if (bytes_received <= 0) {
             std::cerr << "[FILE TRANSFER] Error receiving from sender" << std::endl;
             return false;
         }
         
-        // Step 2: Forward chunk to recipient
-        ssize_t bytes_sent = send(recipient_socket, buffer.data(), bytes_received, 0);
-        if (bytes_sent <= 0) {
+        // Step 2: Forward chunk to recipient (within the shaping limits)
+        if ((flow && !flow->throttle(bytes_received)) ||
+            !Utils::sendAll(recipient_socket, buffer.data(), bytes_received)) {
             std::cerr << "[FILE TRANSFER] Error sending to recipient" << std::endl;
             return false;
         }
@@ -113,26 +153,31 @@ bool FileTransferHandler::streamFileData(int sender_socket, int recipient_socket
  */
 bool FileTransferHandler::sendFileToServer(int server_socket, const std::string& filename, long file_size) {
     // Open local file for reading
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
         std::cerr << "Error: Cannot open file '" << filename << "'" << std::endl;
         return false;
     }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
     
-    std::vector<char> buffer(CHUNK_SIZE);
     long total_sent = 0;
     long last_update = 0;
+    off_t offset = 0;
     
-    // Read and send file in chunks
-    while (file.read(buffer.data(), CHUNK_SIZE) || file.gcount() > 0) {
-        ssize_t chunk_size = file.gcount();
-        
-        // Send this chunk to server
-        ssize_t bytes_sent = send(server_socket, buffer.data(), chunk_size, 0);
+    // Raw bytes need no user-space work, so let the kernel copy
+    // page cache -> socket directly (no read()/send() round trip);
+    // on an encrypted session the bytes are read and sealed instead
+    while (total_sent < file_size) {
+        size_t slice = static_cast<size_t>(std::min<long>(file_size - total_sent, 1024 * 1024));
+        ssize_t bytes_sent = SecureChannel::sendFile(server_socket, fd, &offset, slice);
+        if (bytes_sent < 0 && errno == EINTR) {
+            continue;
+        }
         if (bytes_sent <= 0) {
-            std::cerr << "Error: Failed to send data to server" << std::endl;
-            file.close();
-            return false;
+            if (bytes_sent < 0) {
+                std::cerr << "Error: Failed to send data to server" << std::endl;
+            }
+            break;  // Error, or the file shrank (reported below)
         }
         
         total_sent += bytes_sent;
@@ -143,13 +188,9 @@ bool FileTransferHandler::sendFileToServer(int server_socket, const std::string&
             std::cout << "[SENDING] " << static_cast<int>(percent) << "% uploaded" << std::endl;
             last_update = total_sent;
         }
-        
-        // Small delay to prevent overwhelming the network
-        // In production, use proper flow control instead
-        std::this_thread::sleep_for(std::chrono::microseconds(100));
     }
     
-    file.close();
+    close(fd);
     
     if (total_sent != file_size) {
         std::cerr << "Warning: Sent " << total_sent << " bytes, expected " << file_size << std::endl;
@@ -163,45 +204,36 @@ bool FileTransferHandler::sendFileToServer(int server_socket, const std::string&
 /**
  * Client-side: Receive file from server and save locally
  * ------------------------------------------------------
- * Receives file data in chunks and writes to disk
- * 
- * Saves with "received_" prefix to avoid overwriting existing files
+ * recv() lands directly in the AsyncFileWriter's fill buffer; the disk
+ * writes happen on the writer thread, so the socket keeps draining
+ * while the previous buffer is being written.
  */
 bool FileTransferHandler::receiveFileFromServer(int server_socket, const std::string& sender,
                                               const std::string& filename, long file_size) {
-    // Create output filename with prefix
-    //std::string filename = "received_" + filename;
-    std::ofstream file(filename, std::ios::binary);
-    
-    if (!file.is_open()) {
-        std::cerr << "Error: Cannot create output file: " << filename << std::endl;
+    AsyncFileWriter file;
+    if (!file.open(filename, file_size)) {
+        std::cerr << "Error: Cannot create output file: " << filename << " (" << file.error() << ")" << std::endl;
         return false;
     }
     
-    std::vector<char> buffer(CHUNK_SIZE);
     long total_received = 0;
     long last_update = 0;
     
-    // Receive file in chunks
+    // Receive straight into the writer's buffer
     while (total_received < file_size) {
-        // Calculate how much to receive
-        size_t bytes_to_receive = std::min(
-            static_cast<size_t>(file_size - total_received), 
-            static_cast<size_t>(CHUNK_SIZE)
-        );
+        size_t room;
+        uint8_t* dest = file.buffer(room);
+        size_t bytes_to_receive = std::min(static_cast<size_t>(file_size - total_received), room);
         
-        // Receive chunk from server
-        ssize_t bytes_received = recv(server_socket, buffer.data(), bytes_to_receive, 0);
+        ssize_t bytes_received = SecureChannel::recv(server_socket, dest, bytes_to_receive, 0);
         if (bytes_received <= 0) {
             std::cerr << "Error: Failed to receive data" << std::endl;
             file.close();
             return false;
         }
         
-        // Write chunk to disk
-        file.write(buffer.data(), bytes_received);
-        if (file.fail()) {
-            std::cerr << "Error: Failed to write to file" << std::endl;
+        if (!file.commit(bytes_received)) {
+            std::cerr << "Error: Failed to write to file: " << file.error() << std::endl;
             file.close();
             return false;
         }
@@ -217,11 +249,8 @@ bool FileTransferHandler::receiveFileFromServer(int server_socket, const std::st
         }
     }
     
-    file.close();
-    
-    if (total_received != file_size) {
-        std::cerr << "Warning: Received " << total_received 
-                 << " bytes, expected " << file_size << std::endl;
+    if (!file.close()) {
+        std::cerr << "Error: Failed to write to file: " << file.error() << std::endl;
         return false;
     }
     
@@ -230,6 +259,1036 @@ bool FileTransferHandler::receiveFileFromServer(int server_socket, const std::st
     return true;
 }
 
+/**
+ * Server-side: Spool an upload to disk
+ * ------------------------------------
+ * Same chunk loop as streamFileData, but the sink is a file descriptor.
+ * The payload is fsync'd before returning so a committed spool entry
+ * survives a server crash.
+ */
+bool FileTransferHandler::spoolFileData(int sender_socket, const std::string& spool_path, long file_size,
+                                        bool chunked) {
+    int fd = open(spool_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        std::cerr << "[SPOOL] Cannot create " << spool_path << ": " << strerror(errno) << std::endl;
+        if (chunked) {
+            relayChunkedStream(sender_socket, -1, false, file_size);
+        } else {
+            discardFileData(sender_socket, file_size);
+        }
+        return false;
+    }
+    if (chunked) {
+        // Store frames verbatim; delivery replays them to the recipient
+        bool ok = relayChunkedStream(sender_socket, fd, false, file_size) && fsync(fd) == 0;
+        close(fd);
+        return ok;
+    }
+    
+    std::vector<char> buffer(CHUNK_SIZE);
+    long total_received = 0;
+    bool ok = true;
+    
+    while (total_received < file_size) {
+        size_t bytes_to_receive = std::min(
+            static_cast<size_t>(file_size - total_received), 
+            static_cast<size_t>(CHUNK_SIZE)
+        );
+        
+        ssize_t bytes_received = SecureChannel::recv(sender_socket, buffer.data(), bytes_to_receive, 0);
+        if (bytes_received <= 0) {
+            std::cerr << "[SPOOL] Error receiving from sender" << std::endl;
+            close(fd);
+            return false;
+        }
+        total_received += bytes_received;
+        
+        // Keep draining the socket after a disk error so the stream stays in sync
+        ssize_t written = 0;
+        while (ok && written < bytes_received) {
+            ssize_t n = write(fd, buffer.data() + written, bytes_received - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "[SPOOL] Write failed: " << strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+            written += n;
+        }
+    }
+    
+    if (ok && fsync(fd) != 0) {
+        ok = false;
+    }
+    close(fd);
+    return ok;
+}
+
+/**
+ * Server-side: Deliver a spooled file
+ * -----------------------------------
+ * Reads the spool file chunk by chunk and sends it to the recipient
+ */
+bool FileTransferHandler::sendSpooledFile(int recipient_socket, const std::string& spool_path, long file_size,
+                                          TransferFlow* flow, bool chunked) {
+    std::ifstream file(spool_path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "[SPOOL] Cannot open " << spool_path << std::endl;
+        return false;
+    }
+    
+    if (chunked) {
+        // Frames were validated when stored; one throttle per frame keeps chat frames on boundaries
+        std::vector<char> frame(CHUNK_HEADER_SIZE + ChunkCodec::maxCompressedSize(CHUNKED_BLOCK_SIZE));
+        long total_sent = 0;
+        while (total_sent < file_size && file.read(frame.data(), CHUNK_HEADER_SIZE)) {
+            const unsigned char* header = reinterpret_cast<const unsigned char*>(frame.data());
+            size_t wire_len = (header[0] & CHUNK_FLAG_END) ? 0 : getU32(header + 5);
+            if (CHUNK_HEADER_SIZE + wire_len > frame.size() ||
+                !file.read(frame.data() + CHUNK_HEADER_SIZE, static_cast<std::streamsize>(wire_len))) {
+                std::cerr << "[SPOOL] Corrupt spool file " << spool_path << std::endl;
+                return false;
+            }
+            if ((flow && !flow->throttle(CHUNK_HEADER_SIZE + wire_len)) ||
+                !Utils::sendAll(recipient_socket, frame.data(), CHUNK_HEADER_SIZE + wire_len)) {
+                std::cerr << "[SPOOL] Error sending to recipient" << std::endl;
+                return false;
+            }
+            total_sent += static_cast<long>(CHUNK_HEADER_SIZE + wire_len);
+        }
+        return total_sent == file_size;
+    }
+    
+    std::vector<char> buffer(CHUNK_SIZE);
+    long total_sent = 0;
+    
+    while (total_sent < file_size && (file.read(buffer.data(), CHUNK_SIZE) || file.gcount() > 0)) {
+        ssize_t chunk_size = file.gcount();
+        ssize_t offset = 0;
+        
+        if (flow && !flow->throttle(chunk_size)) {
+            std::cerr << "[SPOOL] Error sending to recipient" << std::endl;
+            return false;
+        }
+        while (offset < chunk_size) {
+            ssize_t bytes_sent = SecureChannel::send(recipient_socket, buffer.data() + offset, chunk_size - offset, 0);
+            if (bytes_sent <= 0) {
+                std::cerr << "[SPOOL] Error sending to recipient" << std::endl;
+                return false;
+            }
+            offset += bytes_sent;
+        }
+        total_sent += chunk_size;
+    }
+    
+    return total_sent == file_size;
+}
+
+/**
+ * Server-side: Drain a rejected upload
+ */
+void FileTransferHandler::discardFileData(int sender_socket, long file_size) {
+    std::vector<char> buffer(CHUNK_SIZE);
+    long total_received = 0;
+    
+    while (total_received < file_size) {
+        size_t bytes_to_receive = std::min(
+            static_cast<size_t>(file_size - total_received), 
+            static_cast<size_t>(CHUNK_SIZE)
+        );
+        ssize_t bytes_received = SecureChannel::recv(sender_socket, buffer.data(), bytes_to_receive, 0);
+        if (bytes_received <= 0) {
+            return;
+        }
+        total_received += bytes_received;
+    }
+}
+
+namespace {
+
+/**
+ * Recursively add regular files under dir to entries
+ * Entry names are prefix + relative path
+ */
+bool walkDirectory(const std::string& dir, const std::string& prefix, std::vector<BatchEntry>& entries) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+    
+    std::vector<std::string> names;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        std::string name = ent->d_name;
+        if (name != "." && name != "..") {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    
+    for (const auto& name : names) {
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) continue;  // Symlinks are skipped, not followed
+        
+        if (S_ISDIR(st.st_mode)) {
+            walkDirectory(path, prefix + name + "/", entries);
+        } else if (S_ISREG(st.st_mode)) {
+            entries.push_back({path, prefix + name, static_cast<long>(st.st_size)});
+        }
+    }
+    return true;
+}
+
+/**
+ * Reduce a path component to [A-Za-z0-9._-] so it is safe in a filename
+ */
+std::string sanitizeLabel(const std::string& label) {
+    std::string out;
+    for (char c : label) {
+        out += (isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_' || c == '-') ? c : '_';
+    }
+    return (out.empty() || out == "." || out == "..") ? "files" : out;
+}
+
+/**
+ * Check a batch entry name: relative, no empty/"."/".." components
+ */
+bool isSafeEntryName(const std::string& name) {
+    if (name.empty() || name[0] == '/') {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t slash = name.find('/', start);
+        if (slash == std::string::npos) slash = name.size();
+        std::string part = name.substr(start, slash - start);
+        if (part.empty() || part == "." || part == "..") {
+            return false;
+        }
+        start = slash + 1;
+    }
+    return true;
+}
+
+}  // namespace
+
+/**
+ * Write a whole buffer to a socket (send) or a file (write)
+ * A negative fd discards the data (used to drain rejected uploads)
+ */
+static bool writeFully(int fd, bool is_socket, const void* data, size_t len) {
+    if (fd < 0) {
+        return true;
+    }
+    if (is_socket) {
+        return Utils::sendAll(fd, data, len);
+    }
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * Client-side: Send a chunked, selectively compressed file
+ * --------------------------------------------------------
+ * Read, checksum, compress/encrypt and send run as concurrent pipeline
+ * stages (see UploadPipeline); this function only owns the file and
+ * reports progress.
+ */
+bool FileTransferHandler::sendFileChunked(int server_socket, const std::string& filename, long file_size) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open file '" << filename << "'" << std::endl;
+        return false;
+    }
+    
+    long last_update = 0;
+    UploadPipeline::Result result;
+    bool ok = UploadPipeline::run(server_socket, fd, file_size, result, [&](long total_sent) {
+        if (total_sent - last_update > file_size * 0.05) {
+            std::cout << "[SENDING] " << static_cast<int>(total_sent * 100.0 / file_size) << "% uploaded" << std::endl;
+            last_update = total_sent;
+        }
+    });
+    close(fd);
+    
+    if (!ok) {
+        if (result.raw_bytes != file_size) {
+            std::cerr << "Warning: Sent " << result.raw_bytes << " bytes, expected " << file_size << std::endl;
+        }
+        std::cerr << "Error: Failed to send data to server" << std::endl;
+        return false;
+    }
+    
+    std::cout << "[SENDING] ✓ Upload complete: " << formatFileSize(result.raw_bytes) << " ("
+              << formatFileSize(result.wire_bytes) << " on the wire, "
+              << static_cast<int>(100.0 - result.wire_bytes * 100.0 / std::max(1L, result.raw_bytes)) << "% saved)" << std::endl;
+    return true;
+}
+
+/**
+ * Server-side: Relay chunk frames
+ * -------------------------------
+ * Each header is validated before its payload is forwarded: raw and
+ * wire lengths must fit a chunk, uncompressed frames must have equal
+ * lengths, and the raw total may not exceed the announced file size.
+ * A failed file write switches to draining, so the sender's remaining
+ * frames are still consumed and never read as chat.
+ */
+bool FileTransferHandler::relayChunkedStream(int sender_socket, int out_fd, bool out_is_socket, long file_size,
+                                             TransferFlow* flow) {
+    const size_t max_wire = ChunkCodec::maxCompressedSize(CHUNKED_BLOCK_SIZE);
+    std::vector<char> buffer(max_wire);
+    long raw_total = 0;
+    long last_update = 0;
+    bool sink_failed = false;
+    
+    for (;;) {
+        // Chat for the recipient keeps flowing while the sender is slow
+        if (flow && !flow->awaitInput(sender_socket)) {
+            std::cerr << "[FILE TRANSFER] Error sending to recipient" << std::endl;
+            return false;
+        }
+        
+        unsigned char header[CHUNK_HEADER_SIZE];
+        if (!Utils::recvAll(sender_socket, header, sizeof(header))) {
+            std::cerr << "[FILE TRANSFER] Error receiving from sender" << std::endl;
+            return false;
+        }
+        
+        uint8_t flags = header[0];
+        uint32_t raw_len = getU32(header + 1);
+        uint32_t wire_len = getU32(header + 5);
+        
+        if (flags & CHUNK_FLAG_END) {
+            if (!writeFully(out_fd, out_is_socket, header, sizeof(header))) {
+                return false;
+            }
+            std::cout << "[FILE TRANSFER] Complete: " << formatFileSize(raw_total) << " transferred" << std::endl;
+            return !sink_failed && raw_total == file_size;
+        }
+        
+        bool compressed = flags & CHUNK_FLAG_COMPRESSED;
+        if ((flags & ~(CHUNK_FLAG_COMPRESSED | CHUNK_FLAG_ENCRYPTED)) || raw_len == 0 || raw_len > CHUNKED_BLOCK_SIZE || wire_len > max_wire ||
+            (!compressed && wire_len != raw_len) || raw_total + static_cast<long>(raw_len) > file_size) {
+            std::cerr << "[FILE TRANSFER] Malformed chunk header" << std::endl;
+            return false;
+        }
+        
+        if (!Utils::recvAll(sender_socket, buffer.data(), wire_len)) {
+            std::cerr << "[FILE TRANSFER] Error receiving from sender" << std::endl;
+            return false;
+        }
+        // Waits for tokens and queue room; pending chat frames go out first
+        if (flow && !flow->throttle(CHUNK_HEADER_SIZE + wire_len)) {
+            std::cerr << "[FILE TRANSFER] Error sending to recipient" << std::endl;
+            return false;
+        }
+        if (!writeFully(out_fd, out_is_socket, header, sizeof(header)) ||
+            !writeFully(out_fd, out_is_socket, buffer.data(), wire_len)) {
+            if (out_is_socket) {
+                std::cerr << "[FILE TRANSFER] Error sending to recipient" << std::endl;
+                return false;
+            }
+            std::cerr << "[FILE TRANSFER] Write failed: " << strerror(errno) << std::endl;
+            sink_failed = true;
+            out_fd = -1;
+        }
+        raw_total += raw_len;
+        
+        if (raw_total - last_update > file_size * 0.05) {
+            std::cout << "[FILE TRANSFER] " << static_cast<int>(raw_total * 100.0 / file_size) << "% complete" << std::endl;
+            last_update = raw_total;
+        }
+    }
+}
+
+/**
+ * Client-side: Receive a chunked file
+ * -----------------------------------
+ * Uncompressed frames are handed to the writer straight from the receive
+ * buffer; compressed frames are inflated into a second buffer first.
+ * Disk writes run on the AsyncFileWriter thread, so chat frames keep
+ * being displayed while earlier chunks are written.
+ */
+bool FileTransferHandler::receiveChunkedFile(int server_socket, const std::string& sender,
+                                           const std::string& filename, long file_size,
+                                           const std::function<void(const std::string&)>& on_chat) {
+    AsyncFileWriter file;
+    bool ok = file.open(filename, file_size);
+    if (!ok) {
+        std::cerr << "Error: Cannot create output file: " << filename << " (" << file.error() << ")" << std::endl;
+    }
+    
+    std::vector<uint8_t> wire(ChunkCodec::maxCompressedSize(CHUNKED_BLOCK_SIZE));
+    std::vector<uint8_t> raw(CHUNKED_BLOCK_SIZE);
+    long total_received = 0;
+    long wire_bytes = 0;
+    long last_update = 0;
+    uint32_t crc = 0;
+    
+    for (;;) {
+        unsigned char header[CHUNK_HEADER_SIZE];
+        if (!Utils::recvAll(server_socket, header, sizeof(header))) {
+            std::cerr << "Error: Failed to receive data" << std::endl;
+            return false;
+        }
+        wire_bytes += CHUNK_HEADER_SIZE;
+        
+        uint8_t flags = header[0];
+        uint32_t raw_len = getU32(header + 1);
+        uint32_t wire_len = getU32(header + 5);
+        if (flags & CHUNK_FLAG_END) {
+            // Trailer checksum covers the whole decoded file
+            if ((flags & CHUNK_FLAG_CHECKSUM) && ok && crc != raw_len) {
+                std::cerr << "Error: Checksum mismatch - file corrupted in transit" << std::endl;
+                ok = false;
+            }
+            break;
+        }
+        
+        bool compressed = flags & CHUNK_FLAG_COMPRESSED;
+        if (raw_len > raw.size() || wire_len > wire.size() || (!compressed && wire_len != raw_len)) {
+            std::cerr << "Error: Malformed chunk header" << std::endl;
+            return false;
+        }
+        if (!Utils::recvAll(server_socket, wire.data(), wire_len)) {
+            std::cerr << "Error: Failed to receive data" << std::endl;
+            return false;
+        }
+        
+        // Chat the server slipped in between chunks
+        if (flags & CHUNK_FLAG_CHAT) {
+            if (on_chat) {
+                on_chat(std::string(reinterpret_cast<const char*>(wire.data()), wire_len));
+            }
+            continue;
+        }
+        wire_bytes += wire_len;
+        
+        // Undo the sender's stages in reverse: decrypt, then inflate
+        if (flags & CHUNK_FLAG_ENCRYPTED) {
+            Encryption::decryptInPlace(wire.data(), wire_len);
+        }
+        
+        const uint8_t* data = wire.data();
+        if (compressed) {
+            if (!ChunkCodec::decompressChunk(wire.data(), wire_len, raw.data(), raw_len)) {
+                std::cerr << "Error: Corrupt compressed chunk" << std::endl;
+                ok = false;
+            }
+            data = raw.data();
+        }
+        
+        if (ok) {
+            crc = Checksum::crc32(crc, data, raw_len);
+            if (!file.write(data, raw_len)) {
+                std::cerr << "Error: Failed to write to file: " << file.error() << std::endl;
+                ok = false;
+            }
+        }
+        total_received += raw_len;
+        
+        if (total_received - last_update > file_size * 0.05) {
+            std::cout << "[RECEIVING] " << static_cast<int>(total_received * 100.0 / file_size)
+                     << "% downloaded from " << sender << std::endl;
+            last_update = total_received;
+        }
+    }
+    if (ok && !file.close()) {
+        std::cerr << "Error: Failed to write to file: " << file.error() << std::endl;
+        ok = false;
+    }
+    
+    if (!ok || total_received != file_size) {
+        std::cerr << "Warning: Received " << total_received << " bytes, expected " << file_size << std::endl;
+        std::remove(filename.c_str());
+        return false;
+    }
+    
+    std::cout << "[RECEIVING] ✓ Download complete: " << filename << " (" << formatFileSize(total_received)
+              << ", " << formatFileSize(wire_bytes) << " on the wire)" << std::endl;
+    return true;
+}
+
+/**
+ * Client-side: Send a delta
+ * -------------------------
+ * The new file is memory-mapped so the rolling search and the literal
+ * sends work on the same pages without an intermediate copy. Small
+ * instructions are batched into one send.
+ */
+bool FileTransferHandler::sendDeltaToServer(int server_socket, const std::string& filepath, const SignatureSet& sigs) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open file '" << filepath << "'" << std::endl;
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << "Error: Cannot map file '" << filepath << "'" << std::endl;
+        return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    const uint8_t* data = static_cast<const uint8_t*>(map);
+    
+    std::vector<DeltaOp> ops = DeltaSync::computeDelta(data, size, sigs);
+    uint64_t body_len = DeltaSync::encodedBodySize(ops);
+    
+    std::string out;
+    out.append("DLT1", 4);
+    putU32(out, sigs.block_size);
+    
+    // The relay only takes deltas up to MAX_FILE_SIZE; length 0 cancels
+    if (body_len > static_cast<uint64_t>(MAX_FILE_SIZE)) {
+        munmap(map, size);
+        putU64(out, 0);
+        std::cerr << "Error: The delta is " << formatFileSize(static_cast<long>(body_len)) << " (max "
+                  << formatFileSize(MAX_FILE_SIZE) << ")" << std::endl;
+        Utils::sendAll(server_socket, out.data(), out.size());
+        return false;
+    }
+    putU64(out, body_len);
+    
+    bool ok = true;
+    uint64_t copied_blocks = 0;
+    uint64_t literal_bytes = 0;
+    
+    for (const auto& op : ops) {
+        if (op.type == DeltaOp::COPY) {
+            out.push_back(static_cast<char>(DeltaOp::COPY));
+            putU32(out, static_cast<uint32_t>(op.offset));
+            putU32(out, static_cast<uint32_t>(op.length));
+            copied_blocks += op.length;
+        } else {
+            out.push_back(static_cast<char>(DeltaOp::LITERAL));
+            putU32(out, static_cast<uint32_t>(op.length));
+            if (op.length < CHUNK_SIZE) {
+                out.append(reinterpret_cast<const char*>(data + op.offset), op.length);
+            } else {
+                ok = Utils::sendAll(server_socket, out.data(), out.size()) &&
+                     Utils::sendAll(server_socket, data + op.offset, op.length);
+                out.clear();
+            }
+            literal_bytes += op.length;
+        }
+        
+        if (ok && out.size() >= CHUNK_SIZE) {
+            ok = Utils::sendAll(server_socket, out.data(), out.size());
+            out.clear();
+        }
+        if (!ok) break;
+    }
+    
+    if (ok) {
+        out.push_back(static_cast<char>(DeltaOp::END));
+        putU64(out, DeltaSync::strongHash(data, size));
+        ok = Utils::sendAll(server_socket, out.data(), out.size());
+    }
+    munmap(map, size);
+    
+    if (!ok) {
+        std::cerr << "Error: Failed to send delta to server" << std::endl;
+        return false;
+    }
+    
+    uint64_t wire = DeltaSync::DELTA_HEADER_SIZE + body_len;
+    std::cout << "[DELTA] Sent " << formatFileSize(static_cast<long>(wire)) << " for a "
+              << formatFileSize(static_cast<long>(size)) << " file ("
+              << copied_blocks << " blocks reused, "
+              << formatFileSize(static_cast<long>(literal_bytes)) << " literal)" << std::endl;
+    return true;
+}
+
+/**
+ * Server-side: Validate a delta header
+ * ------------------------------------
+ * Bounds the block size and body length so a malformed stream cannot
+ * pin the relay or the receiver. Worst case is an all-literal delta:
+ * the file plus one 5-byte header per literal run and the END op. The
+ * body, not the file, is what the relay carries, so MAX_FILE_SIZE
+ * applies to it.
+ */
+bool FileTransferHandler::receiveDeltaHeader(int sender_socket, long file_size, std::string& header, long& body_len) {
+    unsigned char raw[DeltaSync::DELTA_HEADER_SIZE];
+    if (!Utils::recvAll(sender_socket, raw, sizeof(raw))) {
+        return false;
+    }
+    if (memcmp(raw, "DLT1", 4) != 0) {
+        std::cerr << "[FILE TRANSFER] Malformed delta header" << std::endl;
+        return false;
+    }
+    
+    // 0 means the recipient had no basis file and the body is all literal
+    uint32_t block_size = getU32(raw + 4);
+    if (block_size != 0 && (block_size < DeltaSync::MIN_BLOCK_SIZE || block_size > DeltaSync::MAX_BLOCK_SIZE)) {
+        std::cerr << "[FILE TRANSFER] Delta block size out of range" << std::endl;
+        return false;
+    }
+    
+    uint64_t len = getU64(raw + 8);
+    if (len == 0) {
+        std::cerr << "[FILE TRANSFER] Delta cancelled by sender" << std::endl;
+        return false;
+    }
+    if (len > static_cast<uint64_t>(MAX_FILE_SIZE)) {
+        std::cerr << "[FILE TRANSFER] Delta body over " << formatFileSize(MAX_FILE_SIZE) << std::endl;
+        return false;
+    }
+    uint64_t max_len = static_cast<uint64_t>(file_size) +
+                       (static_cast<uint64_t>(file_size) / DeltaSync::MAX_LITERAL_RUN + 1) * DeltaSync::LITERAL_OP_HEADER_SIZE +
+                       (static_cast<uint64_t>(file_size) / DeltaSync::MIN_BLOCK_SIZE + 1) * DeltaSync::COPY_OP_SIZE +
+                       DeltaSync::END_OP_SIZE;
+    if (len > max_len) {
+        std::cerr << "[FILE TRANSFER] Delta body length out of range" << std::endl;
+        return false;
+    }
+    
+    header.assign(reinterpret_cast<const char*>(raw), sizeof(raw));
+    body_len = static_cast<long>(len);
+    return true;
+}
+
+/**
+ * Client-side: Apply a delta
+ * --------------------------
+ * Instructions are applied as they arrive; COPY reads blocks from the
+ * basis with pread, LITERAL data is streamed straight into the output.
+ * The rebuilt file is checked against the sender's whole-file hash.
+ */
+bool FileTransferHandler::receiveDeltaFromServer(int server_socket, const std::string& sender,
+                                               const std::string& basis_path,
+                                               const std::string& filename, long file_size) {
+    unsigned char header[DeltaSync::DELTA_HEADER_SIZE];
+    if (!Utils::recvAll(server_socket, header, sizeof(header)) || memcmp(header, "DLT1", 4) != 0) {
+        std::cerr << "Error: Malformed delta stream" << std::endl;
+        return false;
+    }
+    uint32_t block_size = getU32(header + 4);
+    uint64_t body_len = getU64(header + 8);
+    uint64_t consumed = 0;
+    
+    int basis_fd = basis_path.empty() ? -1 : open(basis_path.c_str(), O_RDONLY);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot create output file: " << filename << std::endl;
+    }
+    
+    bool valid_block = block_size == 0 ||
+                       (block_size >= DeltaSync::MIN_BLOCK_SIZE && block_size <= DeltaSync::MAX_BLOCK_SIZE);
+    std::vector<char> buffer(std::max<size_t>(CHUNK_SIZE, valid_block ? block_size : 0));
+    uint64_t expected_hash = 0;
+    long total_written = 0;
+    bool ok = file.is_open();
+    bool ended = false;
+    
+    // Nothing in the body can be applied without a sane block size
+    if (!valid_block) {
+        std::cerr << "Error: Delta block size out of range" << std::endl;
+        ok = false;
+        while (consumed < body_len) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(body_len - consumed, buffer.size()));
+            if (!Utils::recvAll(server_socket, buffer.data(), n)) break;
+            consumed += n;
+        }
+    }
+    
+    // Keep consuming the body even after a local error so the stream stays in sync
+    while (consumed < body_len) {
+        unsigned char op[DeltaSync::END_OP_SIZE];
+        if (!Utils::recvAll(server_socket, op, 1)) {
+            ok = false;
+            break;
+        }
+        consumed += 1;
+        
+        if (op[0] == DeltaOp::END) {
+            if (!Utils::recvAll(server_socket, op + 1, 8)) { ok = false; break; }
+            consumed += 8;
+            expected_hash = getU64(op + 1);
+            ended = true;
+            break;
+        }
+        else if (op[0] == DeltaOp::COPY) {
+            if (!Utils::recvAll(server_socket, op + 1, 8)) { ok = false; break; }
+            consumed += 8;
+            uint64_t block = getU32(op + 1);
+            uint64_t count = getU32(op + 5);
+            if (ok && (block_size == 0 ||
+                       count * block_size > static_cast<uint64_t>(std::max<long>(file_size - total_written, 0)))) {
+                std::cerr << "Error: Delta COPY outside the basis or past the end of the file" << std::endl;
+                ok = false;
+            }
+            
+            for (uint64_t i = 0; ok && i < count; i++) {
+                off_t offset = static_cast<off_t>((block + i) * block_size);
+                if (basis_fd < 0 || pread(basis_fd, buffer.data(), block_size, offset) != static_cast<ssize_t>(block_size)) {
+                    std::cerr << "Error: Delta refers to missing basis data" << std::endl;
+                    ok = false;
+                    break;
+                }
+                file.write(buffer.data(), block_size);
+                total_written += block_size;
+            }
+        }
+        else if (op[0] == DeltaOp::LITERAL) {
+            if (!Utils::recvAll(server_socket, op + 1, 4)) { ok = false; break; }
+            consumed += 4;
+            uint64_t remaining = getU32(op + 1);
+            
+            while (remaining > 0) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+                if (!Utils::recvAll(server_socket, buffer.data(), n)) {
+                    ok = false;
+                    remaining = 0;
+                    consumed = body_len;
+                    break;
+                }
+                if (ok) {
+                    file.write(buffer.data(), n);
+                    total_written += n;
+                }
+                remaining -= n;
+                consumed += n;
+            }
+        }
+        else {
+            std::cerr << "Error: Unknown delta instruction" << std::endl;
+            ok = false;
+            // Drain the rest of the body to resynchronize
+            while (consumed < body_len) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(body_len - consumed, buffer.size()));
+                if (!Utils::recvAll(server_socket, buffer.data(), n)) break;
+                consumed += n;
+            }
+        }
+        
+        if (file.is_open() && file.fail()) {
+            ok = false;
+        }
+    }
+    
+    if (basis_fd >= 0) {
+        close(basis_fd);
+    }
+    file.close();
+    
+    if (ok && (!ended || total_written != file_size)) {
+        std::cerr << "Warning: Rebuilt " << total_written << " bytes, expected " << file_size << std::endl;
+        ok = false;
+    }
+    
+    // Verify the rebuilt file against the sender's hash
+    if (ok) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        void* map = (fd >= 0 && file_size > 0) ? mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        if (fd >= 0) close(fd);
+        if (map == MAP_FAILED || DeltaSync::strongHash(static_cast<const uint8_t*>(map), file_size) != expected_hash) {
+            std::cerr << "Error: Rebuilt file does not match sender's copy" << std::endl;
+            ok = false;
+        }
+        if (map != MAP_FAILED) munmap(map, file_size);
+    }
+    
+    if (!ok) {
+        std::remove(filename.c_str());
+        return false;
+    }
+    
+    std::cout << "[RECEIVING] ✓ Delta applied: " << filename << " (" << formatFileSize(total_written)
+              << " from " << sender << ", " << formatFileSize(static_cast<long>(body_len + sizeof(header)))
+              << " on the wire)" << std::endl;
+    return true;
+}
+
+/**
+ * Client-side: Expand a batch spec
+ * --------------------------------
+ * Directory: every regular file below it, named by its path inside the directory
+ * Glob:      every match (directories are walked), named relative to
+ *            the pattern's fixed leading directory
+ */
+bool FileTransferHandler::collectBatch(const std::string& spec, std::vector<BatchEntry>& entries, std::string& label) {
+    std::string trimmed = spec;
+    while (trimmed.size() > 1 && trimmed.back() == '/') {
+        trimmed.pop_back();
+    }
+    
+    size_t wildcard = trimmed.find_first_of("*?[");
+    if (wildcard == std::string::npos) {
+        // Plain directory
+        size_t slash = trimmed.find_last_of('/');
+        std::string base = (slash == std::string::npos) ? trimmed : trimmed.substr(slash + 1);
+        label = sanitizeLabel(base);
+        if (!walkDirectory(trimmed, "", entries)) {
+            std::cerr << "Error: Cannot read directory '" << spec << "'" << std::endl;
+            return false;
+        }
+    } else {
+        // Glob: names are relative to the directory before the first wildcard
+        size_t slash = trimmed.find_last_of('/', wildcard);
+        std::string base = (slash == std::string::npos) ? "" : trimmed.substr(0, slash + 1);
+        std::string base_dir = base.empty() ? "" : base.substr(0, base.size() - 1);
+        size_t label_slash = base_dir.find_last_of('/');
+        label = sanitizeLabel(label_slash == std::string::npos ? base_dir : base_dir.substr(label_slash + 1));
+        
+        glob_t matches;
+        if (glob(trimmed.c_str(), 0, nullptr, &matches) != 0) {
+            std::cerr << "Error: No files match '" << spec << "'" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < matches.gl_pathc; i++) {
+            std::string path = matches.gl_pathv[i];
+            std::string name = path.compare(0, base.size(), base) == 0 ? path.substr(base.size()) : path;
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0) continue;
+            
+            if (S_ISDIR(st.st_mode)) {
+                walkDirectory(path, name + "/", entries);
+            } else if (S_ISREG(st.st_mode)) {
+                entries.push_back({path, name, static_cast<long>(st.st_size)});
+            }
+        }
+        globfree(&matches);
+    }
+    
+    if (entries.empty()) {
+        std::cerr << "Error: No files found in '" << spec << "'" << std::endl;
+        return false;
+    }
+    if (static_cast<int>(entries.size()) > MAX_BATCH_ENTRIES) {
+        std::cerr << "Error: Too many files (" << entries.size() << ", max " << MAX_BATCH_ENTRIES << ")" << std::endl;
+        return false;
+    }
+    for (const auto& entry : entries) {
+        if (entry.name.size() > 0xFFFF || !isSafeEntryName(entry.name)) {
+            std::cerr << "Error: Unsupported file name '" << entry.name << "'" << std::endl;
+            return false;
+        }
+    }
+    if (batchStreamSize(entries) > MAX_BATCH_SIZE) {
+        std::cerr << "Error: Batch too large (max " << formatFileSize(MAX_BATCH_SIZE) << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+long FileTransferHandler::batchStreamSize(const std::vector<BatchEntry>& entries) {
+    long total = 1;  // End marker
+    for (const auto& entry : entries) {
+        total += BATCH_ENTRY_HEADER_SIZE + entry.name.size() + entry.size;
+    }
+    return total;
+}
+
+/**
+ * Client-side: Send a batch stream
+ * --------------------------------
+ * Files that fit in the staging buffer are read straight into it behind
+ * their header; the buffer is flushed only when full. A file that
+ * changed size since collectBatch() is truncated or zero-padded to the
+ * announced size so the stream framing stays valid.
+ */
+bool FileTransferHandler::sendBatchToServer(int server_socket, const std::vector<BatchEntry>& entries) {
+    static constexpr size_t STAGING_SIZE = 256 * 1024;
+    std::vector<char> staging(STAGING_SIZE);
+    size_t used = 0;
+    long total = batchStreamSize(entries);
+    long total_sent = 0;
+    long last_update = 0;
+    
+    auto flush = [&]() {
+        bool ok = Utils::sendAll(server_socket, staging.data(), used);
+        total_sent += used;
+        used = 0;
+        return ok;
+    };
+    
+    for (const auto& entry : entries) {
+        size_t header_len = BATCH_ENTRY_HEADER_SIZE + entry.name.size();
+        if (used + header_len > STAGING_SIZE && !flush()) {
+            return false;
+        }
+        
+        unsigned char* h = reinterpret_cast<unsigned char*>(staging.data() + used);
+        uint16_t name_len = static_cast<uint16_t>(entry.name.size());
+        uint64_t size = static_cast<uint64_t>(entry.size);
+        h[0] = 1;
+        h[1] = static_cast<unsigned char>(name_len >> 8);
+        h[2] = static_cast<unsigned char>(name_len);
+        for (int i = 0; i < 8; i++) {
+            h[3 + i] = static_cast<unsigned char>(size >> (56 - 8 * i));
+        }
+        memcpy(staging.data() + used + BATCH_ENTRY_HEADER_SIZE, entry.name.data(), entry.name.size());
+        used += header_len;
+        
+        int fd = open(entry.path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Warning: Cannot open '" << entry.path << "', sending zeros" << std::endl;
+        }
+        
+        long remaining = entry.size;
+        if (remaining <= static_cast<long>(STAGING_SIZE - used)) {
+            // Small file: read into the staging buffer behind its header
+            while (fd >= 0 && remaining > 0) {
+                ssize_t n = read(fd, staging.data() + used, remaining);
+                if (n <= 0) break;
+                used += n;
+                remaining -= n;
+            }
+        } else {
+            // Large file: flush headers, then let the kernel copy file -> socket
+            if (!flush()) {
+                if (fd >= 0) close(fd);
+                return false;
+            }
+            off_t offset = 0;
+            while (fd >= 0 && remaining > 0) {
+                ssize_t n = SecureChannel::sendFile(server_socket, fd, &offset, remaining);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                remaining -= n;
+                total_sent += n;
+            }
+        }
+        if (fd >= 0) close(fd);
+        
+        // File shrank or vanished: pad so the framing stays intact
+        while (remaining > 0) {
+            if (used == STAGING_SIZE && !flush()) return false;
+            size_t n = std::min(static_cast<size_t>(remaining), STAGING_SIZE - used);
+            memset(staging.data() + used, 0, n);
+            used += n;
+            remaining -= n;
+        }
+        
+        if (total_sent + static_cast<long>(used) - last_update > total * 0.05) {
+            long done = total_sent + used;
+            std::cout << "[SENDING] " << static_cast<int>(done * 100.0 / total) << "% uploaded" << std::endl;
+            last_update = done;
+        }
+    }
+    
+    if (used == STAGING_SIZE && !flush()) {
+        return false;
+    }
+    staging[used++] = 0;  // End marker
+    if (!flush()) {
+        std::cerr << "Error: Failed to send data to server" << std::endl;
+        return false;
+    }
+    
+    std::cout << "[SENDING] ✓ Upload complete: " << entries.size() << " files, "
+              << formatFileSize(total_sent) << std::endl;
+    return true;
+}
+
+/**
+ * Client-side: Receive a batch stream
+ * -----------------------------------
+ * Each entry is written as soon as its bytes arrive. A rejected or
+ * unwritable entry is still consumed from the socket so the following
+ * entries (and chat messages after the batch) stay in sync.
+ */
+bool FileTransferHandler::receiveBatchFromServer(int server_socket, const std::string& sender,
+                                               const std::string& dest_dir, int entry_count, long total_size) {
+    std::vector<char> buffer(64 * 1024);
+    long consumed = 0;
+    long last_update = 0;
+    int received = 0;
+    int failed = 0;
+    
+    while (consumed < total_size) {
+        unsigned char header[BATCH_ENTRY_HEADER_SIZE];
+        if (!Utils::recvAll(server_socket, header, 1)) {
+            std::cerr << "Error: Failed to receive data" << std::endl;
+            return false;
+        }
+        consumed += 1;
+        if (header[0] == 0) {
+            break;  // End marker
+        }
+        
+        if (header[0] != 1 || !Utils::recvAll(server_socket, header + 1, BATCH_ENTRY_HEADER_SIZE - 1)) {
+            std::cerr << "Error: Malformed batch stream" << std::endl;
+            return false;
+        }
+        size_t name_len = (size_t(header[1]) << 8) | header[2];
+        uint64_t size = getU64(header + 3);
+        consumed += BATCH_ENTRY_HEADER_SIZE - 1;
+        
+        std::string name(name_len, '\0');
+        if (!Utils::recvAll(server_socket, &name[0], name_len)) {
+            return false;
+        }
+        consumed += name_len;
+        if (size > static_cast<uint64_t>(total_size - consumed) || received + failed >= entry_count) {
+            std::cerr << "Error: Malformed batch stream" << std::endl;
+            return false;
+        }
+        
+        // Create parent directories under dest_dir
+        std::ofstream file;
+        if (isSafeEntryName(name)) {
+            std::string path = dest_dir + "/" + name;
+            for (size_t slash = dest_dir.size() + 1; (slash = path.find('/', slash)) != std::string::npos; slash++) {
+                mkdir(path.substr(0, slash).c_str(), 0755);
+            }
+            file.open(path, std::ios::binary);
+        }
+        if (!file.is_open()) {
+            std::cerr << "Warning: Skipping '" << name << "'" << std::endl;
+        }
+        
+        uint64_t remaining = size;
+        while (remaining > 0) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+            if (!Utils::recvAll(server_socket, buffer.data(), n)) {
+                std::cerr << "Error: Failed to receive data" << std::endl;
+                return false;
+            }
+            if (file.is_open()) {
+                file.write(buffer.data(), n);
+            }
+            remaining -= n;
+            consumed += n;
+        }
+        
+        if (file.is_open() && !file.fail()) {
+            received++;
+        } else {
+            failed++;
+        }
+        
+        if (consumed - last_update > total_size * 0.05) {
+            std::cout << "[RECEIVING] " << static_cast<int>(consumed * 100.0 / total_size)
+                     << "% downloaded from " << sender << std::endl;
+            last_update = consumed;
+        }
+    }
+    
+    std::cout << "[RECEIVING] ✓ Download complete: " << received << " files in " << dest_dir
+              << " (" << formatFileSize(consumed) << ")" << std::endl;
+    return failed == 0 && received == entry_count;
+}
+
 /**
  * Validate if a file is safe to transfer
  * --------------------------------------
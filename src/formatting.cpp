@@ -0,0 +1,68 @@
+#include "../include/utils.hpp"
+#include <cstdio>
+
+/**
+ * FORMATTING HELPERS
+ * ==================
+ *
+ * Utils' value formatters, kept apart from the rest of utils.cpp (which
+ * pulls in sockets, the logger and SIMD dispatch) so that tools such as
+ * log_decode can link them alone.
+ */
+
+/**
+ * Format file size for human-readable display
+ * -------------------------------------------
+ * Converts bytes to appropriate unit
+ * 
+ * Logic:
+ * - < 1024 bytes: Display as "X B"
+ * - < 1MB: Display as "X.Y KB"
+ * - >= 1MB: Display as "X.Y MB"
+ * 
+ * Examples:
+ *   formatFileSize(500) -> "500 B"
+ *   formatFileSize(1536) -> "1.5 KB"
+ *   formatFileSize(2097152) -> "2.0 MB"
+ * 
+ * Why one decimal place:
+ * - Good balance between precision and readability
+ * - "1.5 MB" is clearer than "1572864 B"
+ */
+std::string Utils::formatFileSize(long size) {
+    if (size < 1024) {
+        // Less than 1KB: Show bytes
+        return std::to_string(size) + " B";
+    }
+    
+    if (size < 1024 * 1024) {
+        // Less than 1MB: Show kilobytes with one decimal
+        double kb = size / 1024.0;
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.1f KB", kb);
+        return std::string(buffer);
+    }
+    
+    // 1MB or more: Show megabytes with one decimal
+    double mb = size / (1024.0 * 1024.0);
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.1f MB", mb);
+    return std::string(buffer);
+}
+
+/**
+ * Format a duration for humans
+ */
+std::string Utils::formatDuration(uint64_t ns) {
+    char buffer[32];
+    if (ns < 1000) {
+        snprintf(buffer, sizeof(buffer), "%llu ns", static_cast<unsigned long long>(ns));
+    } else if (ns < 1000000) {
+        snprintf(buffer, sizeof(buffer), "%.1f us", ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buffer, sizeof(buffer), "%.1f ms", ns / 1e6);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%.2f s", ns / 1e9);
+    }
+    return buffer;
+}
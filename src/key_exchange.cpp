@@ -0,0 +1,455 @@
+#include "../include/key_exchange.hpp"
+#include <cstring>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+/**
+ * KEY EXCHANGE IMPLEMENTATION
+ * ===========================
+ *
+ * X25519 follows the 64-bit "donna" layout: a field element mod
+ * p = 2^255 - 19 is five 51-bit limbs, a product is 25 128-bit partial
+ * products folded with 2^255 = 19 (mod p). Subtraction adds 4p first so
+ * limbs never go negative. The ladder and the inversion (z^(p-2)) are
+ * straight from RFC 7748; one key exchange costs well under a
+ * millisecond, paid once per connection.
+ */
+
+namespace {
+
+typedef unsigned __int128 u128;
+typedef uint64_t Fe[5];
+
+const uint64_t MASK51 = 0x7ffffffffffffULL;
+
+inline uint64_t load64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+inline void store64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+inline void storeBe32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+void wipe(void* p, size_t len) {
+    volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+    while (len--) {
+        *v++ = 0;
+    }
+}
+
+/* ===================== Field arithmetic ===================== */
+
+void feCopy(Fe out, const Fe a) {
+    for (int i = 0; i < 5; i++) out[i] = a[i];
+}
+
+void feAdd(Fe out, const Fe a, const Fe b) {
+    for (int i = 0; i < 5; i++) out[i] = a[i] + b[i];
+}
+
+void feSub(Fe out, const Fe a, const Fe b) {
+    // a + 4p - b: inputs may be up to ~2^53 per limb
+    out[0] = a[0] + 0x1fffffffffffb4ULL - b[0];
+    out[1] = a[1] + 0x1ffffffffffffcULL - b[1];
+    out[2] = a[2] + 0x1ffffffffffffcULL - b[2];
+    out[3] = a[3] + 0x1ffffffffffffcULL - b[3];
+    out[4] = a[4] + 0x1ffffffffffffcULL - b[4];
+}
+
+/**
+ * Carries 128-bit column sums into 51-bit limbs
+ */
+void feCarry(Fe out, u128 t0, u128 t1, u128 t2, u128 t3, u128 t4) {
+    t1 += t0 >> 51;
+    t2 += t1 >> 51;
+    t3 += t2 >> 51;
+    t4 += t3 >> 51;
+    u128 r0 = (static_cast<uint64_t>(t0) & MASK51) + (t4 >> 51) * 19;
+    uint64_t r1 = (static_cast<uint64_t>(t1) & MASK51) + static_cast<uint64_t>(r0 >> 51);
+    out[0] = static_cast<uint64_t>(r0) & MASK51;
+    out[1] = r1;
+    out[2] = static_cast<uint64_t>(t2) & MASK51;
+    out[3] = static_cast<uint64_t>(t3) & MASK51;
+    out[4] = static_cast<uint64_t>(t4) & MASK51;
+}
+
+void feMul(Fe out, const Fe a, const Fe b) {
+    const uint64_t b1 = b[1] * 19, b2 = b[2] * 19, b3 = b[3] * 19, b4 = b[4] * 19;
+    u128 t0 = (u128)a[0] * b[0] + (u128)a[1] * b4 + (u128)a[2] * b3 + (u128)a[3] * b2 + (u128)a[4] * b1;
+    u128 t1 = (u128)a[0] * b[1] + (u128)a[1] * b[0] + (u128)a[2] * b4 + (u128)a[3] * b3 + (u128)a[4] * b2;
+    u128 t2 = (u128)a[0] * b[2] + (u128)a[1] * b[1] + (u128)a[2] * b[0] + (u128)a[3] * b4 + (u128)a[4] * b3;
+    u128 t3 = (u128)a[0] * b[3] + (u128)a[1] * b[2] + (u128)a[2] * b[1] + (u128)a[3] * b[0] + (u128)a[4] * b4;
+    u128 t4 = (u128)a[0] * b[4] + (u128)a[1] * b[3] + (u128)a[2] * b[2] + (u128)a[3] * b[1] + (u128)a[4] * b[0];
+    feCarry(out, t0, t1, t2, t3, t4);
+}
+
+void feSquare(Fe out, const Fe a, int times = 1) {
+    Fe t;
+    feCopy(t, a);
+    while (times--) {
+        feMul(t, t, t);
+    }
+    feCopy(out, t);
+}
+
+void feMulSmall(Fe out, const Fe a, uint64_t k) {
+    feCarry(out, (u128)a[0] * k, (u128)a[1] * k, (u128)a[2] * k, (u128)a[3] * k, (u128)a[4] * k);
+}
+
+/**
+ * z^(p-2) = z^-1: the standard 254 squarings + 11 multiplications
+ */
+void feInvert(Fe out, const Fe z) {
+    Fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+
+    feSquare(z2, z);
+    feSquare(t, z2, 2);
+    feMul(z9, t, z);
+    feMul(z11, z9, z2);
+    feSquare(t, z11);
+    feMul(z2_5_0, t, z9);
+    feSquare(t, z2_5_0, 5);
+    feMul(z2_10_0, t, z2_5_0);
+    feSquare(t, z2_10_0, 10);
+    feMul(z2_20_0, t, z2_10_0);
+    feSquare(t, z2_20_0, 20);
+    feMul(t, t, z2_20_0);
+    feSquare(t, t, 10);
+    feMul(z2_50_0, t, z2_10_0);
+    feSquare(t, z2_50_0, 50);
+    feMul(z2_100_0, t, z2_50_0);
+    feSquare(t, z2_100_0, 100);
+    feMul(t, t, z2_100_0);
+    feSquare(t, t, 50);
+    feMul(t, t, z2_50_0);
+    feSquare(t, t, 5);
+    feMul(out, t, z11);
+}
+
+void feCswap(Fe a, Fe b, uint64_t swap) {
+    const uint64_t mask = 0 - swap;
+    for (int i = 0; i < 5; i++) {
+        uint64_t x = mask & (a[i] ^ b[i]);
+        a[i] ^= x;
+        b[i] ^= x;
+    }
+}
+
+void feFromBytes(Fe out, const uint8_t in[32]) {
+    out[0] = load64(in) & MASK51;
+    out[1] = (load64(in + 6) >> 3) & MASK51;
+    out[2] = (load64(in + 12) >> 6) & MASK51;
+    out[3] = (load64(in + 19) >> 1) & MASK51;
+    out[4] = (load64(in + 24) >> 12) & MASK51;   // Drops bit 255
+}
+
+/**
+ * Fully reduces mod p and serializes little-endian
+ */
+void feToBytes(uint8_t out[32], const Fe a) {
+    uint64_t t[5];
+    feCopy(t, a);
+
+    for (int pass = 0; pass < 2; pass++) {
+        t[1] += t[0] >> 51; t[0] &= MASK51;
+        t[2] += t[1] >> 51; t[1] &= MASK51;
+        t[3] += t[2] >> 51; t[2] &= MASK51;
+        t[4] += t[3] >> 51; t[3] &= MASK51;
+        t[0] += (t[4] >> 51) * 19; t[4] &= MASK51;
+    }
+
+    // t < 2^255 now; adding 19 overflows 2^255 exactly when t >= p
+    t[0] += 19;
+    t[1] += t[0] >> 51; t[0] &= MASK51;
+    t[2] += t[1] >> 51; t[1] &= MASK51;
+    t[3] += t[2] >> 51; t[2] &= MASK51;
+    t[4] += t[3] >> 51; t[3] &= MASK51;
+    t[0] += (t[4] >> 51) * 19; t[4] &= MASK51;
+
+    // Subtract the 19 again as + (2^255 - 19), dropping the 2^255
+    t[0] += 0x8000000000000ULL - 19;
+    t[1] += 0x8000000000000ULL - 1;
+    t[2] += 0x8000000000000ULL - 1;
+    t[3] += 0x8000000000000ULL - 1;
+    t[4] += 0x8000000000000ULL - 1;
+    t[1] += t[0] >> 51; t[0] &= MASK51;
+    t[2] += t[1] >> 51; t[1] &= MASK51;
+    t[3] += t[2] >> 51; t[2] &= MASK51;
+    t[4] += t[3] >> 51; t[3] &= MASK51;
+    t[4] &= MASK51;
+
+    store64(out, t[0] | (t[1] << 51));
+    store64(out + 8, (t[1] >> 13) | (t[2] << 38));
+    store64(out + 16, (t[2] >> 26) | (t[3] << 25));
+    store64(out + 24, (t[3] >> 39) | (t[4] << 12));
+}
+
+/* ===================== SHA-256 constants ===================== */
+
+const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+}  // namespace
+
+/* ===================== SHA-256 ===================== */
+
+Sha256::Sha256() : total(0), buffered(0) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    std::memcpy(state, initial, sizeof(state));
+}
+
+void Sha256::compress(const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (static_cast<uint32_t>(block[4 * i]) << 24) | (static_cast<uint32_t>(block[4 * i + 1]) << 16) |
+               (static_cast<uint32_t>(block[4 * i + 2]) << 8) | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void Sha256::update(const uint8_t* data, size_t len) {
+    total += len;
+    if (buffered) {
+        size_t want = BLOCK_SIZE - buffered;
+        if (want > len) want = len;
+        std::memcpy(buffer + buffered, data, want);
+        buffered += want;
+        data += want;
+        len -= want;
+        if (buffered < BLOCK_SIZE) {
+            return;
+        }
+        compress(buffer);
+        buffered = 0;
+    }
+    for (; len >= BLOCK_SIZE; data += BLOCK_SIZE, len -= BLOCK_SIZE) {
+        compress(data);
+    }
+    std::memcpy(buffer, data, len);
+    buffered = len;
+}
+
+void Sha256::finish(uint8_t digest[DIGEST_SIZE]) {
+    const uint64_t bits = total * 8;
+    uint8_t tail[BLOCK_SIZE * 2] = {0x80};
+    size_t pad = (buffered < 56 ? 56 : 120) - buffered;
+    for (int i = 0; i < 8; i++) {
+        tail[pad + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    }
+    update(tail, pad + 8);
+
+    for (int i = 0; i < 8; i++) {
+        storeBe32(digest + 4 * i, state[i]);
+    }
+    wipe(state, sizeof(state));
+    wipe(buffer, sizeof(buffer));
+}
+
+void Sha256::hash(const uint8_t* data, size_t len, uint8_t digest[DIGEST_SIZE]) {
+    Sha256 sha;
+    sha.update(data, len);
+    sha.finish(digest);
+}
+
+/* ===================== X25519 ===================== */
+
+void X25519::scalarMult(uint8_t out[KEY_SIZE], const uint8_t scalar[KEY_SIZE], const uint8_t u[KEY_SIZE]) {
+    uint8_t k[KEY_SIZE];
+    std::memcpy(k, scalar, KEY_SIZE);
+    k[0] &= 248;
+    k[31] &= 127;
+    k[31] |= 64;
+
+    Fe x1, x2 = {1}, z2 = {0}, x3, z3 = {1};
+    Fe a, aa, b, bb, e, c, d, da, cb, t;
+    feFromBytes(x1, u);
+    feCopy(x3, x1);
+
+    uint64_t swap = 0;
+    for (int pos = 254; pos >= 0; pos--) {
+        uint64_t bit = (k[pos >> 3] >> (pos & 7)) & 1;
+        swap ^= bit;
+        feCswap(x2, x3, swap);
+        feCswap(z2, z3, swap);
+        swap = bit;
+
+        feAdd(a, x2, z2);
+        feSquare(aa, a);
+        feSub(b, x2, z2);
+        feSquare(bb, b);
+        feSub(e, aa, bb);
+        feAdd(c, x3, z3);
+        feSub(d, x3, z3);
+        feMul(da, d, a);
+        feMul(cb, c, b);
+
+        feAdd(t, da, cb);
+        feSquare(x3, t);
+        feSub(t, da, cb);
+        feSquare(t, t);
+        feMul(z3, x1, t);
+
+        feMul(x2, aa, bb);
+        feMulSmall(t, e, 121665);      // a24 = (486662 - 2) / 4
+        feAdd(t, aa, t);
+        feMul(z2, e, t);
+    }
+    feCswap(x2, x3, swap);
+    feCswap(z2, z3, swap);
+
+    feInvert(t, z2);
+    feMul(x2, x2, t);
+    feToBytes(out, x2);
+    wipe(k, sizeof(k));
+}
+
+void X25519::publicKey(uint8_t pub[KEY_SIZE], const uint8_t priv[KEY_SIZE]) {
+    static const uint8_t base[KEY_SIZE] = {9};
+    scalarMult(pub, priv, base);
+}
+
+bool X25519::sharedSecret(uint8_t shared[KEY_SIZE], const uint8_t priv[KEY_SIZE], const uint8_t peer[KEY_SIZE]) {
+    scalarMult(shared, priv, peer);
+    uint8_t any = 0;
+    for (size_t i = 0; i < KEY_SIZE; i++) {
+        any |= shared[i];
+    }
+    return any != 0;
+}
+
+/* ===================== KeyExchange ===================== */
+
+bool KeyExchange::randomBytes(uint8_t* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = getrandom(buf, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            // Kernels without getrandom()
+            int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            while (len > 0) {
+                n = read(fd, buf, len);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    close(fd);
+                    return false;
+                }
+                buf += n;
+                len -= n;
+            }
+            close(fd);
+            return true;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool KeyExchange::generateKeyPair(uint8_t priv[X25519::KEY_SIZE], uint8_t pub[X25519::KEY_SIZE]) {
+    if (!randomBytes(priv, X25519::KEY_SIZE)) {
+        return false;
+    }
+    X25519::publicKey(pub, priv);
+    return true;
+}
+
+void KeyExchange::hmacSha256(const uint8_t* key, size_t key_len, const uint8_t* data, size_t len,
+                             uint8_t mac[Sha256::DIGEST_SIZE]) {
+    uint8_t block[Sha256::BLOCK_SIZE] = {0};
+    if (key_len > Sha256::BLOCK_SIZE) {
+        Sha256::hash(key, key_len, block);
+    } else {
+        std::memcpy(block, key, key_len);
+    }
+
+    uint8_t pad[Sha256::BLOCK_SIZE];
+    uint8_t inner[Sha256::DIGEST_SIZE];
+    for (size_t i = 0; i < Sha256::BLOCK_SIZE; i++) pad[i] = block[i] ^ 0x36;
+    Sha256 in;
+    in.update(pad, sizeof(pad));
+    in.update(data, len);
+    in.finish(inner);
+
+    for (size_t i = 0; i < Sha256::BLOCK_SIZE; i++) pad[i] = block[i] ^ 0x5c;
+    Sha256 out;
+    out.update(pad, sizeof(pad));
+    out.update(inner, sizeof(inner));
+    out.finish(mac);
+
+    wipe(block, sizeof(block));
+    wipe(pad, sizeof(pad));
+    wipe(inner, sizeof(inner));
+}
+
+void KeyExchange::hkdf(const uint8_t* salt, size_t salt_len, const uint8_t* ikm, size_t ikm_len,
+                       const uint8_t* info, size_t info_len, uint8_t* out, size_t out_len) {
+    uint8_t prk[Sha256::DIGEST_SIZE];
+    hmacSha256(salt, salt_len, ikm, ikm_len, prk);
+
+    // T(i) = HMAC(PRK, T(i-1) | info | i)
+    uint8_t t[Sha256::DIGEST_SIZE];
+    std::vector<uint8_t> message;
+    message.reserve(sizeof(t) + info_len + 1);
+    uint8_t counter = 1;
+    while (out_len > 0) {
+        message.insert(message.end(), info, info + info_len);
+        message.push_back(counter++);
+        hmacSha256(prk, sizeof(prk), message.data(), message.size(), t);
+        message.assign(t, t + sizeof(t));
+
+        size_t n = out_len < sizeof(t) ? out_len : sizeof(t);
+        std::memcpy(out, t, n);
+        out += n;
+        out_len -= n;
+    }
+    wipe(prk, sizeof(prk));
+    wipe(t, sizeof(t));
+}
@@ -0,0 +1,286 @@
+#include "../include/latency_tracker.hpp"
+#include "../include/metrics.hpp"
+#include "../include/binary_log.hpp"
+#include "../include/utils.hpp"
+#include <map>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/**
+ * LATENCY TRACKER IMPLEMENTATION
+ * ==============================
+ *
+ * Traces waiting for acks live in one map under a mutex, taken only for
+ * traced messages. An entry is sealed when its Scope ends (no more
+ * recipients can be added) and dropped once sealed with every ack in,
+ * or after PENDING_TIMEOUT_NS; whatever is still unacked then is
+ * counted in chat_delivery_unacked_total.
+ */
+
+namespace {
+
+struct Pending {
+    std::string room;
+    int64_t sent_ns;                    // Sender's clock
+    int64_t received_ns;
+    int64_t routed_ns;
+    int64_t sender_rtt_ns;
+    std::vector<int> awaiting;          // Recipient sockets yet to ack
+    bool sealed = false;
+};
+
+struct State {
+    std::mutex mutex;
+    std::map<uint64_t, Pending> pending;
+    std::map<std::string, Metrics::HistogramData> rooms;    // End to end, per room
+    uint64_t next_id = 1;
+    int64_t next_sweep = 0;
+};
+
+State& state() {
+    static State* instance = new State;
+    return *instance;
+}
+
+const double QUANTILES[] = {0.5, 0.99, 0.999};
+const char* const QUANTILE_LABELS[] = {"0.5", "0.99", "0.999"};
+const char* const PERCENTILE_NAMES[] = {"p50", "p99", "p99.9"};
+
+/**
+ * Smoothed round trip of a TCP socket, 0 if unknown
+ */
+int64_t smoothedRtt(int socket) {
+    struct tcp_info info;
+    socklen_t length = sizeof(info);
+    if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &length) != 0) {
+        return 0;
+    }
+    return static_cast<int64_t>(info.tcpi_rtt) * 1000;
+}
+
+void recordHop(Histogram id, int64_t from, int64_t to) {
+    Metrics::record(id, static_cast<uint64_t>(std::max<int64_t>(to - from, 0)));
+}
+
+/**
+ * Drop expired entries; caller holds the mutex
+ */
+void sweep(State& s, int64_t now) {
+    if (now < s.next_sweep) {
+        return;
+    }
+    s.next_sweep = now + 1000000000;    // At most once a second
+    for (auto it = s.pending.begin(); it != s.pending.end();) {
+        if (now - it->second.received_ns > LatencyTracker::PENDING_TIMEOUT_NS) {
+            Metrics::count(Counter::DELIVERIES_UNACKED, it->second.awaiting.size());
+            it = s.pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::string percentiles(const Metrics::HistogramData& data) {
+    std::string out;
+    for (size_t i = 0; i < 3; i++) {
+        out += std::string(i ? "  " : "") + PERCENTILE_NAMES[i] + " " +
+               Utils::formatDuration(data.percentile(QUANTILES[i]));
+    }
+    return out;
+}
+
+}  // namespace
+
+thread_local LatencyTracker::Scope* LatencyTracker::current = nullptr;
+
+LatencyTracker::Scope::Scope(bool traced, int sender_socket, int64_t sent_ns, int64_t received_ns)
+    : sender_socket(sender_socket), sent_ns(sent_ns), received_ns(received_ns) {
+    if (traced) {
+        current = this;
+    }
+}
+
+LatencyTracker::Scope::~Scope() {
+    if (current != this) {
+        return;
+    }
+    current = nullptr;
+    if (id == 0) {
+        return;
+    }
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.pending.find(id);
+    if (it != s.pending.end()) {
+        it->second.sealed = true;
+        if (it->second.awaiting.empty()) {
+            s.pending.erase(it);
+        }
+    }
+}
+
+int64_t LatencyTracker::now() {
+    return static_cast<int64_t>(BinaryLog::monotonicNanos());
+}
+
+bool LatencyTracker::parseTraced(std::string& message, int64_t& sent_ns) {
+    if (message.compare(0, 3, "/t ") != 0) {
+        return false;
+    }
+    size_t trace_end = message.find(' ', 3);
+    if (trace_end == std::string::npos || trace_end == 3) {
+        return false;
+    }
+    size_t stamp_end = message.find(' ', trace_end + 1);
+    if (stamp_end == std::string::npos) {
+        return false;
+    }
+    char* end = nullptr;
+    long long stamp = std::strtoll(message.c_str() + trace_end + 1, &end, 10);
+    if (end != message.c_str() + stamp_end) {
+        return false;
+    }
+    sent_ns = stamp;
+    message.erase(0, stamp_end + 1);
+    return true;
+}
+
+std::string LatencyTracker::startRoute(const std::string& room) {
+    Scope& scope = *current;
+    scope.routed_ns = now();
+    recordHop(Histogram::DELIVERY_ROUTE, scope.received_ns, scope.routed_ns);
+
+    Pending entry;
+    entry.sent_ns = scope.sent_ns;
+    entry.received_ns = scope.received_ns;
+    entry.routed_ns = scope.routed_ns;
+    entry.sender_rtt_ns = smoothedRtt(scope.sender_socket);
+
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    sweep(s, scope.routed_ns);
+    if (s.pending.size() >= MAX_PENDING) {
+        return std::string();           // Delivered untraced
+    }
+    entry.room = s.rooms.count(room) || s.rooms.size() < MAX_ROOMS ? room : "other";
+    scope.id = s.next_id++;
+    s.pending.emplace(scope.id, std::move(entry));
+    return "/t " + std::to_string(scope.id) + " ";
+}
+
+int64_t LatencyTracker::awaitAck(int recipient_socket) {
+    Scope& scope = *current;
+    if (scope.id != 0) {
+        // Before the send: a fast recipient may ack before it returns
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.pending.find(scope.id);
+        if (it != s.pending.end()) {
+            it->second.awaiting.push_back(recipient_socket);
+        }
+    }
+    return now();
+}
+
+void LatencyTracker::finishDelivery(int64_t enqueued_ns) {
+    Scope& scope = *current;
+    if (scope.id != 0) {
+        recordHop(Histogram::DELIVERY_ENQUEUE, scope.routed_ns, enqueued_ns);
+        recordHop(Histogram::DELIVERY_WRITE, enqueued_ns, now());
+    }
+}
+
+void LatencyTracker::acknowledge(const std::string& arguments, int recipient_socket, int64_t arrived_ns) {
+    char* end = nullptr;
+    uint64_t id = std::strtoull(arguments.c_str(), &end, 10);
+    if (end == arguments.c_str() || *end != ' ') {
+        return;
+    }
+    int64_t recipient_ns = std::strtoll(end + 1, nullptr, 10);
+    int64_t recipient_rtt = smoothedRtt(recipient_socket);
+
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.pending.find(id);
+    if (it == s.pending.end()) {
+        return;
+    }
+    Pending& p = it->second;
+    auto waiting = std::find(p.awaiting.begin(), p.awaiting.end(), recipient_socket);
+    if (waiting == p.awaiting.end()) {
+        return;                         // Not a recipient, or already acked
+    }
+    p.awaiting.erase(waiting);
+
+    // Stamps that fit inside our own timeline came from our clock
+    bool same_clock = p.sent_ns <= p.received_ns && p.received_ns - p.sent_ns < SAME_CLOCK_WINDOW_NS &&
+                      recipient_ns >= p.routed_ns && recipient_ns <= arrived_ns &&
+                      arrived_ns - recipient_ns < SAME_CLOCK_WINDOW_NS;
+    int64_t latency = same_clock
+        ? recipient_ns - p.sent_ns
+        : (arrived_ns - p.received_ns) + p.sender_rtt_ns / 2 - recipient_rtt / 2;
+    uint64_t value = static_cast<uint64_t>(std::max<int64_t>(latency, 0));
+
+    Metrics::record(Histogram::DELIVERY_LATENCY, value);
+    Metrics::HistogramData& room = s.rooms[p.room];
+    room.buckets[Metrics::bucketIndex(value)]++;
+    room.count++;
+    room.sum += value;
+
+    if (p.sealed && p.awaiting.empty()) {
+        s.pending.erase(it);
+    }
+}
+
+std::string LatencyTracker::describe() {
+    Metrics::Snapshot snapshot = Metrics::snapshot();
+    auto hop = [&snapshot](Histogram id) -> const Metrics::HistogramData& {
+        return snapshot.histograms[static_cast<size_t>(id)];
+    };
+    const Metrics::HistogramData& latency = hop(Histogram::DELIVERY_LATENCY);
+
+    std::string out = "Delivery latency (" + std::to_string(latency.count) + " traced deliveries)\n";
+    out += "  recv -> route      " + percentiles(hop(Histogram::DELIVERY_ROUTE)) + "\n";
+    out += "  route -> enqueue   " + percentiles(hop(Histogram::DELIVERY_ENQUEUE)) + "\n";
+    out += "  enqueue -> write   " + percentiles(hop(Histogram::DELIVERY_WRITE)) + "\n";
+    out += "  end to end         " + percentiles(latency);
+
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (const auto& room : s.rooms) {
+        char label[48];
+        snprintf(label, sizeof(label), "\n  %-18s ", room.first.c_str());
+        out += label + percentiles(room.second) + " (" + std::to_string(room.second.count) + ")";
+    }
+    return out;
+}
+
+void LatencyTracker::appendPrometheus(std::string& out) {
+    const char* name = "chat_room_delivery_latency_seconds";
+    out += "# HELP ";
+    out += name;
+    out += " Traced messages: sender to recipient, per room\n# TYPE ";
+    out += name;
+    out += " summary\n";
+
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    char value[32];
+    for (const auto& room : s.rooms) {
+        const Metrics::HistogramData& data = room.second;
+        std::string labels = std::string(name) + "{room=\"" + room.first + "\"";
+        for (size_t i = 0; i < 3; i++) {
+            snprintf(value, sizeof(value), "%.9g", data.percentile(QUANTILES[i]) * 1e-9);
+            out += labels + ",quantile=\"" + QUANTILE_LABELS[i] + "\"} " + value + "\n";
+        }
+        snprintf(value, sizeof(value), "%.9g", data.sum * 1e-9);
+        out += std::string(name) + "_sum{room=\"" + room.first + "\"} " + value + "\n";
+        out += std::string(name) + "_count{room=\"" + room.first + "\"} " + std::to_string(data.count) + "\n";
+    }
+}
@@ -0,0 +1,293 @@
+#include "../include/log_archiver.hpp"
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <cctype>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+
+/**
+ * LOG ARCHIVER IMPLEMENTATION
+ * ===========================
+ *
+ * One thread, fed through a small queue under a mutex; the writer only
+ * pushes a name and notifies. Compression streams the segment through
+ * zlib into "<segment>.gz.tmp" and renames it into place, so a
+ * ".gz" file is always complete. Between chunks the thread checks for
+ * stop(), which lets the server exit without waiting for a large file.
+ */
+
+namespace {
+
+const size_t CHUNK = 64 * 1024;
+
+// ioprio_set(2) has no glibc wrapper
+const int IOPRIO_WHO_PROCESS = 1;
+const int IOPRIO_CLASS_IDLE = 3;
+const int IOPRIO_CLASS_SHIFT = 13;
+
+struct Shared {
+    std::string directory;              // Where the active log lives
+    std::string stem;                   // "server_log."
+    std::string extension;              // ".txt"
+    size_t keep = LogArchiver::DEFAULT_KEEP;
+    bool compress = true;
+
+    std::thread worker;
+    std::mutex mutex;                   // Protects the fields below
+    std::condition_variable cv;
+    std::deque<std::string> pending;
+    bool running = false;
+    std::atomic<bool> stopping{false};
+};
+
+Shared& shared() {
+    static Shared* instance = new Shared;
+    return *instance;
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string joinPath(const std::string& directory, const std::string& name) {
+    return directory == "." ? name : directory + "/" + name;
+}
+
+/**
+ * Idle CPU scheduling and idle I/O class for the calling thread
+ */
+void lowerPriority() {
+    struct sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+}
+
+/**
+ * Rotated segments (compressed or not) in name, i.e. time, order
+ */
+std::vector<std::string> listSegments(const Shared& s) {
+    std::vector<std::string> names;
+    DIR* d = opendir(s.directory.c_str());
+    if (!d) {
+        return names;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        std::string name = ent->d_name;
+        // "<stem>.<YYYYMMDD-...>"; leaves the active file and anything else alone
+        if (name.size() <= s.stem.size() || name.compare(0, s.stem.size(), s.stem) != 0 ||
+            !isdigit(static_cast<unsigned char>(name[s.stem.size()]))) {
+            continue;
+        }
+        if (endsWith(name, s.extension) || endsWith(name, s.extension + ".gz")) {
+            names.push_back(name);
+        } else if (endsWith(name, s.extension + ".gz.tmp")) {
+            unlink(joinPath(s.directory, name).c_str());    // Interrupted compression
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+/**
+ * Gzip one segment; false if stopped or failed (the original is kept)
+ */
+bool compressSegment(Shared& s, const std::string& path) {
+    int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;                   // Already pruned or compressed
+    }
+    std::string temp = path + ".gz.tmp";
+    char mode[8];
+    snprintf(mode, sizeof(mode), "wb%d", LogArchiver::COMPRESSION_LEVEL);
+    gzFile out = gzopen(temp.c_str(), mode);
+    if (!out) {
+        std::cerr << "Log archiver: cannot create " << temp << std::endl;
+        close(in);
+        return false;
+    }
+
+    std::vector<char> buffer(CHUNK);
+    bool ok = true;
+    for (;;) {
+        if (s.stopping.load(std::memory_order_relaxed)) {
+            ok = false;
+            break;
+        }
+        ssize_t n = ::read(in, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        if (gzwrite(out, buffer.data(), static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    close(in);
+    ok = gzclose(out) == Z_OK && ok;
+
+    if (!ok || rename(temp.c_str(), (path + ".gz").c_str()) != 0) {
+        if (!s.stopping.load(std::memory_order_relaxed)) {
+            std::cerr << "Log archiver: failed to compress " << path << std::endl;
+        }
+        unlink(temp.c_str());
+        return false;
+    }
+    unlink(path.c_str());
+    return true;
+}
+
+/**
+ * Keep the newest `keep` segments
+ */
+void prune(const Shared& s) {
+    if (s.keep == 0) {
+        return;
+    }
+    std::vector<std::string> names = listSegments(s);
+    for (size_t i = 0; i + s.keep < names.size(); i++) {
+        unlink(joinPath(s.directory, names[i]).c_str());
+    }
+}
+
+void workerLoop() {
+    Shared& s = shared();
+    lowerPriority();
+
+    // Leftovers from the last run: compress uncompressed segments
+    if (s.compress) {
+        for (const std::string& name : listSegments(s)) {
+            if (endsWith(name, s.extension) && !s.stopping.load()) {
+                compressSegment(s, joinPath(s.directory, name));
+            }
+        }
+    }
+    prune(s);
+
+    for (;;) {
+        std::string segment;
+        {
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.cv.wait(lock, [&s]() { return !s.pending.empty() || s.stopping.load(); });
+            if (s.stopping.load()) {
+                return;
+            }
+            segment = std::move(s.pending.front());
+            s.pending.pop_front();
+        }
+        if (s.compress) {
+            compressSegment(s, segment);
+        }
+        prune(s);
+    }
+}
+
+}  // namespace
+
+void LogArchiver::start(const std::string& active_path) {
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.running) {
+        return;
+    }
+
+    size_t slash = active_path.find_last_of('/');
+    std::string name = slash == std::string::npos ? active_path : active_path.substr(slash + 1);
+    s.directory = slash == std::string::npos ? "." : active_path.substr(0, slash);
+    size_t dot = name.find_last_of('.');
+    s.stem = (dot == std::string::npos ? name : name.substr(0, dot)) + ".";
+    s.extension = dot == std::string::npos ? "" : name.substr(dot);
+
+    if (const char* keep = std::getenv("CHAT_LOG_KEEP")) {
+        long value = std::atol(keep);
+        s.keep = value > 0 ? static_cast<size_t>(value) : 0;
+    }
+    if (const char* compress = std::getenv("CHAT_LOG_COMPRESS")) {
+        s.compress = std::strcmp(compress, "0") != 0;
+    }
+
+    s.stopping.store(false);
+    s.worker = std::thread(workerLoop);
+    s.running = true;
+}
+
+std::string LogArchiver::rotatedName(const std::string& active_path) {
+    size_t slash = active_path.find_last_of('/');
+    size_t dot = active_path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = active_path.size();
+    }
+    std::string base = active_path.substr(0, dot);
+    std::string extension = active_path.substr(dot);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    time_t seconds = now.tv_sec;
+    long millis = now.tv_nsec / 1000000;
+    struct stat st;
+    for (;;) {
+        struct tm local;
+        localtime_r(&seconds, &local);
+        char stamp[32];
+        size_t len = strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+        snprintf(stamp + len, sizeof(stamp) - len, "-%03ld", millis);
+
+        std::string name = base + "." + stamp + extension;
+        if (stat(name.c_str(), &st) != 0 && stat((name + ".gz").c_str(), &st) != 0) {
+            return name;
+        }
+        // Same millisecond as the last rotation: take the next free one
+        if (++millis == 1000) {
+            millis = 0;
+            seconds++;
+        }
+    }
+}
+
+void LogArchiver::archive(const std::string& segment) {
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (!s.running) {
+        return;                         // Compressed on the next start
+    }
+    s.pending.push_back(segment);
+    s.cv.notify_one();
+}
+
+void LogArchiver::stop() {
+    Shared& s = shared();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.running) {
+            return;
+        }
+        s.running = false;
+        s.stopping.store(true);
+        s.cv.notify_one();
+    }
+    if (s.worker.joinable()) {
+        s.worker.join();
+    }
+}
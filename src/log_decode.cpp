@@ -0,0 +1,296 @@
+#include "../include/binary_log.hpp"
+#include "../include/utils.hpp"
+#include "../include/async_logger.hpp"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <ctime>
+#include <zlib.h>
+
+/**
+ * LOG DECODER
+ * ===========
+ *
+ * Turns binary log segments (CHAT_LOG_FORMAT=binary) back into the text
+ * the server would have printed, or into one JSON object per line:
+ *
+ *   ./log_decode [--json] [file ...]        (default: server_log.bin)
+ *
+ * Formats come from each segment's own catalog, so logs from older
+ * builds decode as they were written. Files are read through zlib, so
+ * gzip-compressed segments work as they are.
+ */
+
+namespace {
+
+struct Event {
+    std::string name;
+    std::string format;
+};
+
+/**
+ * One segment's catalog and clock base
+ */
+struct Segment {
+    std::vector<Event> events;
+    int64_t wall_base = 0;      // Wall-clock ns at...
+    int64_t mono_base = 0;      // ...this monotonic ns
+    bool valid = false;
+};
+
+struct Value {
+    char type;                  // 's', 'u' or 'i'
+    std::string text;
+    uint64_t number;
+};
+
+/**
+ * Bounds-checked little-endian / varint reader over one record
+ */
+class Cursor {
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+
+public:
+    bool ok = true;
+
+    Cursor(const uint8_t* data, size_t len) : pos(data), end(data + len) {}
+
+    uint64_t le(int bytes) {
+        if (end - pos < bytes) {
+            ok = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value |= static_cast<uint64_t>(pos[i]) << (8 * i);
+        }
+        pos += bytes;
+        return value;
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos == end) {
+                break;
+            }
+            uint8_t byte = *pos++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    std::string bytes(size_t len) {
+        if (static_cast<size_t>(end - pos) < len) {
+            ok = false;
+            return std::string();
+        }
+        std::string value(reinterpret_cast<const char*>(pos), len);
+        pos += len;
+        return value;
+    }
+};
+
+std::string formatTime(int64_t wall_ns) {
+    time_t seconds = static_cast<time_t>(wall_ns / 1000000000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char buffer[40];
+    size_t len = strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+    snprintf(buffer + len, sizeof(buffer) - len, ".%03d", static_cast<int>(wall_ns / 1000000 % 1000));
+    return buffer;
+}
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + "\"";
+}
+
+std::string plainValue(const Value& value, BinaryLog::FieldKind kind) {
+    if (value.type == 's') {
+        return value.text;
+    }
+    long number = value.type == 'i' ? static_cast<long>((value.number >> 1) ^ (0 - (value.number & 1)))
+                                    : static_cast<long>(value.number);
+    switch (kind) {
+        case BinaryLog::FieldKind::SIZE:
+            return Utils::formatFileSize(number);
+        case BinaryLog::FieldKind::CONTENT:
+            return BinaryLog::redacted(value.number);     // Logged with content=off
+        default:
+            return std::to_string(number);
+    }
+}
+
+std::string jsonValue(const Value& value) {
+    return value.type == 's' ? jsonString(value.text) : plainValue(value, BinaryLog::FieldKind::PLAIN);
+}
+
+bool readHeader(Cursor& in, Segment& segment) {
+    if (in.bytes(8) != BinaryLog::MAGIC) {
+        return false;
+    }
+    segment.wall_base = static_cast<int64_t>(in.le(8));
+    segment.mono_base = static_cast<int64_t>(in.le(8));
+    size_t count = in.le(2);
+    segment.events.clear();
+    for (size_t i = 0; i < count && in.ok; i++) {
+        Event event;
+        event.name = in.bytes(in.le(1));
+        event.format = in.bytes(in.le(2));
+        segment.events.push_back(event);
+    }
+    segment.valid = in.ok;
+    return in.ok;
+}
+
+void printEvent(const Segment& segment, uint16_t id, int64_t mono, const std::vector<Value>& values, bool json) {
+    std::string time = formatTime(segment.wall_base + (mono - segment.mono_base));
+    bool known = id < segment.events.size();
+    const char* format = known ? segment.events[id].format.c_str() : "";
+    std::string text;
+    std::string name;
+    BinaryLog::FieldKind kind = BinaryLog::FieldKind::PLAIN;
+    size_t used = 0;
+
+    if (json) {
+        std::string line = "{\"time\":" + jsonString(time) + ",\"event\":" +
+                           jsonString(known ? segment.events[id].name : "EVENT_" + std::to_string(id));
+        while (BinaryLog::nextField(format, text, &name, kind) && used < values.size()) {
+            line += "," + jsonString(name) + ":" + jsonValue(values[used++]);
+        }
+        for (; used < values.size(); used++) {
+            line += ",\"arg" + std::to_string(used) + "\":" + jsonValue(values[used]);
+        }
+        std::cout << line << "}\n";
+        return;
+    }
+
+    text = "[" + time + "] ";
+    while (BinaryLog::nextField(format, text, nullptr, kind)) {
+        if (used < values.size()) {
+            text += plainValue(values[used++], kind);
+        }
+    }
+    for (; used < values.size(); used++) {
+        text += " " + plainValue(values[used], BinaryLog::FieldKind::PLAIN);
+    }
+    std::cout << text << "\n";
+}
+
+/**
+ * Decode one file; returns false on a malformed or truncated record
+ */
+bool decodeFile(const char* path, bool json) {
+    gzFile file = gzopen(path, "rb");
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+
+    Segment segment;
+    std::vector<uint8_t> record;
+    std::vector<Value> values;
+    bool ok = true;
+    for (;;) {
+        uint8_t length_bytes[2];
+        int got = gzread(file, length_bytes, 2);
+        if (got == 0) {
+            break;
+        }
+        size_t length = length_bytes[0] | (length_bytes[1] << 8);
+        record.resize(length);
+        if (got != 2 || length < 2 || gzread(file, record.data(), length) != static_cast<int>(length)) {
+            std::cerr << path << ": truncated record" << std::endl;
+            ok = false;
+            break;
+        }
+
+        Cursor in(record.data(), length);
+        uint16_t id = static_cast<uint16_t>(in.le(2));
+        if (id == BinaryLog::SEGMENT_HEADER) {
+            if (!readHeader(in, segment)) {
+                std::cerr << path << ": bad segment header" << std::endl;
+                ok = false;
+                break;
+            }
+            continue;
+        }
+        if (!segment.valid) {
+            std::cerr << path << ": not a binary chat log (no segment header)" << std::endl;
+            ok = false;
+            break;
+        }
+
+        int64_t mono = static_cast<int64_t>(in.le(8));
+        size_t count = in.le(1);
+        values.clear();
+        for (size_t i = 0; i < count && in.ok; i++) {
+            Value value;
+            value.type = static_cast<char>(in.le(1));
+            value.number = 0;
+            if (value.type == 's') {
+                value.text = in.bytes(in.varint());
+            } else if (value.type == 'u' || value.type == 'i') {
+                value.number = in.varint();
+            } else {
+                in.ok = false;
+            }
+            values.push_back(value);
+        }
+        if (!in.ok) {
+            std::cerr << path << ": malformed record" << std::endl;
+            ok = false;
+            break;
+        }
+        printEvent(segment, id, mono, values, json);
+    }
+    gzclose(file);
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+            std::cout << "Usage: " << argv[0] << " [--json] [file ...]  (default: "
+                      << AsyncLogger::BINARY_LOG_FILE << ")" << std::endl;
+            return 0;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        paths.push_back(AsyncLogger::BINARY_LOG_FILE);
+    }
+
+    bool ok = true;
+    for (const char* path : paths) {
+        ok = decodeFile(path, json) && ok;
+    }
+    std::cout.flush();
+    return ok ? 0 : 1;
+}
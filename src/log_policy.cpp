@@ -0,0 +1,220 @@
+#include "../include/log_policy.hpp"
+#include "../include/binary_log.hpp"
+#include "../include/utils.hpp"
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+/**
+ * LOG POLICY IMPLEMENTATION
+ * =========================
+ *
+ * Settings are plain atomics read with relaxed loads: a change made by
+ * "/log" on one thread shows up on the others within moments, and a
+ * check never takes a lock.
+ *
+ * The rate limit keeps a one-second window per event type. Whoever
+ * first sees a new second resets the count and reports what the last
+ * window suppressed; the count is approximate when threads race on the
+ * boundary, which is fine for sampling.
+ */
+
+namespace {
+
+const size_t CATEGORIES = static_cast<size_t>(LogCategory::COUNT);
+const size_t EVENTS = static_cast<size_t>(LogEvent::COUNT);
+
+const char* const LEVEL_NAMES[] = {"off", "error", "warn", "info", "debug"};
+const char* const CATEGORY_NAMES[] = {"server", "connection", "chat", "transfer"};
+
+struct EventPolicy {
+    LogCategory category;
+    LogLevel level;
+};
+
+const EventPolicy EVENT_POLICY[] = {
+#define CHAT_LOG_EVENT_POLICY(id, category, level, format) {LogCategory::category, LogLevel::level},
+    CHAT_LOG_EVENTS(CHAT_LOG_EVENT_POLICY)
+#undef CHAT_LOG_EVENT_POLICY
+};
+
+const uint8_t DEFAULT_LEVEL = static_cast<uint8_t>(LogLevel::INFO);
+
+std::atomic<uint8_t> thresholds[CATEGORIES] = {DEFAULT_LEVEL, DEFAULT_LEVEL, DEFAULT_LEVEL, DEFAULT_LEVEL};
+std::atomic<uint32_t> rate_limit(0);
+std::atomic<bool> log_content(true);
+
+struct RateWindow {
+    std::atomic<int64_t> second{-1};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint64_t> suppressed{0};
+};
+
+RateWindow windows[EVENTS];
+
+/**
+ * Content argument positions per event, from the "{field:content}" specs
+ */
+const std::array<uint32_t, EVENTS>& contentMasks() {
+    static const std::array<uint32_t, EVENTS> masks = []() {
+        std::array<uint32_t, EVENTS> result{};
+        std::string literal;
+        for (size_t i = 0; i < EVENTS; i++) {
+            const char* pos = BinaryLog::eventFormat(static_cast<LogEvent>(i));
+            BinaryLog::FieldKind kind;
+            for (uint32_t field = 0; BinaryLog::nextField(pos, literal, nullptr, kind) && field < 32; field++) {
+                if (kind == BinaryLog::FieldKind::CONTENT) {
+                    result[i] |= 1u << field;
+                }
+            }
+        }
+        return result;
+    }();
+    return masks;
+}
+
+bool parseLevel(const std::string& word, uint8_t& level) {
+    for (size_t i = 0; i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); i++) {
+        if (word == LEVEL_NAMES[i]) {
+            level = static_cast<uint8_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool withinRate(LogEvent id, uint32_t limit) {
+    RateWindow& window = windows[static_cast<size_t>(id)];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    int64_t second = window.second.load(std::memory_order_relaxed);
+    if (second != now.tv_sec && window.second.compare_exchange_strong(second, now.tv_sec)) {
+        window.count.store(0, std::memory_order_relaxed);
+        uint64_t missed = window.suppressed.exchange(0);
+        if (missed > 0) {
+            Utils::logEvent(LogEvent::LOG_SUPPRESSED, missed, BinaryLog::eventName(id));
+        }
+    }
+    if (window.count.fetch_add(1, std::memory_order_relaxed) < limit) {
+        return true;
+    }
+    window.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+}  // namespace
+
+bool LogPolicy::admit(LogEvent id) {
+    size_t index = static_cast<size_t>(id);
+    if (index >= EVENTS) {
+        return false;
+    }
+    const EventPolicy& event = EVENT_POLICY[index];
+    if (static_cast<uint8_t>(event.level) >
+        thresholds[static_cast<size_t>(event.category)].load(std::memory_order_relaxed)) {
+        return false;
+    }
+    if (event.category != LogCategory::CHAT) {
+        return true;
+    }
+    uint32_t limit = rate_limit.load(std::memory_order_relaxed);
+    return limit == 0 || withinRate(id, limit);
+}
+
+uint32_t LogPolicy::redactedFields(LogEvent id) {
+    size_t index = static_cast<size_t>(id);
+    if (log_content.load(std::memory_order_relaxed) || index >= EVENTS) {
+        return 0;
+    }
+    return contentMasks()[index];
+}
+
+bool LogPolicy::configure(const std::string& settings, std::string& error) {
+    uint8_t levels[CATEGORIES];
+    for (size_t i = 0; i < CATEGORIES; i++) {
+        levels[i] = thresholds[i].load();
+    }
+    uint32_t rate = rate_limit.load();
+    bool content = log_content.load();
+
+    std::string words = settings;
+    for (char& c : words) {
+        if (c == ',') {
+            c = ' ';
+        }
+    }
+    for (const std::string& word : Utils::split(words, ' ')) {
+        if (word.empty()) {
+            continue;
+        }
+        size_t equals = word.find('=');
+        std::string key = equals == std::string::npos ? "level" : word.substr(0, equals);
+        std::string value = equals == std::string::npos ? word : word.substr(equals + 1);
+        uint8_t level = 0;
+        bool ok = false;
+
+        if (key == "rate") {
+            ok = !value.empty() && value.size() <= 9 && value.find_first_not_of("0123456789") == std::string::npos;
+            if (ok) {
+                rate = static_cast<uint32_t>(std::stoul(value));
+            }
+        } else if (key == "content") {
+            ok = value == "on" || value == "off";
+            content = value == "on";
+        } else if (parseLevel(value, level)) {
+            if (key == "level") {
+                std::fill(levels, levels + CATEGORIES, level);
+                ok = true;
+            }
+            for (size_t i = 0; i < CATEGORIES; i++) {
+                if (key == CATEGORY_NAMES[i]) {
+                    levels[i] = level;
+                    ok = true;
+                }
+            }
+        }
+        if (!ok) {
+            error = word;
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < CATEGORIES; i++) {
+        thresholds[i].store(levels[i]);
+    }
+    rate_limit.store(rate);
+    log_content.store(content);
+    return true;
+}
+
+void LogPolicy::configureFromEnvironment() {
+    std::string settings;
+    if (const char* level = std::getenv("CHAT_LOG_LEVEL")) {
+        settings += level;
+    }
+    if (const char* rate = std::getenv("CHAT_LOG_RATE")) {
+        settings += std::string(" rate=") + rate;
+    }
+    if (const char* content = std::getenv("CHAT_LOG_CONTENT")) {
+        settings += std::strcmp(content, "0") == 0 ? " content=off" : " content=on";
+    }
+    std::string error;
+    if (!configure(settings, error)) {
+        std::cerr << "Ignoring log settings: bad setting '" << error << "'" << std::endl;
+    }
+}
+
+std::string LogPolicy::describe() {
+    std::string out;
+    for (size_t i = 0; i < CATEGORIES; i++) {
+        out += std::string(CATEGORY_NAMES[i]) + "=" + LEVEL_NAMES[thresholds[i].load()] + " ";
+    }
+    out += "rate=" + std::to_string(rate_limit.load());
+    out += log_content.load() ? " content=on" : " content=off";
+    return out;
+}
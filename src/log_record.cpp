@@ -0,0 +1,135 @@
+#include "../include/binary_log.hpp"
+#include "../include/async_logger.hpp"
+#include "../include/log_policy.hpp"
+#include "../include/utils.hpp"
+#include <cstring>
+#include <algorithm>
+
+/**
+ * LOG RECORD IMPLEMENTATION
+ * =========================
+ *
+ * A binary record is built in one buffer: a 13-byte fixed part whose
+ * length field is patched in submit(), then the arguments. Nothing is
+ * formatted and the clock read is a vDSO call, so an event costs about
+ * as much as copying its arguments.
+ *
+ * Kept out of binary_log.cpp, which the offline decoder links on its own.
+ */
+
+namespace {
+
+const size_t ARGC_OFFSET = 2 + 2 + 8;     // After length, id and timestamp
+const size_t ARG_RESERVE = 1 + 10 + 1;    // Tag, longest varint, slack
+
+}  // namespace
+
+LogRecord::LogRecord(LogEvent id)
+    : binary(AsyncLogger::binary()), format(nullptr), kind(BinaryLog::FieldKind::PLAIN), args(0), field(0),
+      redact(LogPolicy::redactedFields(id)) {
+    if (binary) {
+        buffer.reserve(64);
+        buffer.append(2, '\0');
+        BinaryLog::putLe(buffer, static_cast<uint16_t>(id), 2);
+        BinaryLog::putLe(buffer, BinaryLog::monotonicNanos(), 8);
+        buffer.push_back('\0');
+        return;
+    }
+    buffer.reserve(64);
+    buffer.resize(1 + Utils::TIMESTAMP_LENGTH);
+    buffer[0] = '[';
+    Utils::formatTimestamp(&buffer[1]);
+    buffer += "] ";
+    format = BinaryLog::eventFormat(id);
+    if (!BinaryLog::nextField(format, buffer, nullptr, kind)) {
+        format = nullptr;
+    }
+}
+
+/**
+ * Text mode: fill the current placeholder and move to the next
+ */
+void LogRecord::addText(const std::string& text) {
+    if (format) {
+        buffer += text;
+        if (!BinaryLog::nextField(format, buffer, nullptr, kind)) {
+            format = nullptr;
+        }
+    }
+}
+
+/**
+ * Binary mode: room for a tag, a varint and a few bytes?
+ */
+bool LogRecord::hasRoom() const {
+    return args < 255 && buffer.size() + ARG_RESERVE <= BinaryLog::MAX_RECORD + 2;
+}
+
+void LogRecord::add(const std::string& value) {
+    if (field < 32 && (redact >> field & 1)) {
+        addUnsigned(value.size());
+        return;
+    }
+    field++;
+    if (!binary) {
+        addText(value);
+        return;
+    }
+    if (!hasRoom()) {
+        return;
+    }
+    size_t len = std::min(value.size(), BinaryLog::MAX_RECORD + 2 - ARG_RESERVE - buffer.size());
+    buffer.push_back('s');
+    BinaryLog::putVarint(buffer, len);
+    buffer.append(value, 0, len);
+    args++;
+}
+
+void LogRecord::add(const char* value) {
+    add(std::string(value ? value : ""));
+}
+
+void LogRecord::addUnsigned(uint64_t value) {
+    bool redacted = field < 32 && (redact >> field & 1);
+    field++;
+    if (!binary) {
+        addText(redacted ? BinaryLog::redacted(value) :
+                kind == BinaryLog::FieldKind::SIZE ? Utils::formatFileSize(static_cast<long>(value)) :
+                std::to_string(value));
+        return;
+    }
+    if (hasRoom()) {
+        buffer.push_back('u');
+        BinaryLog::putVarint(buffer, value);
+        args++;
+    }
+}
+
+void LogRecord::addSigned(int64_t value) {
+    field++;
+    if (!binary) {
+        addText(kind == BinaryLog::FieldKind::SIZE ? Utils::formatFileSize(static_cast<long>(value)) :
+                std::to_string(value));
+        return;
+    }
+    if (hasRoom()) {
+        buffer.push_back('i');
+        BinaryLog::putVarint(buffer, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+        args++;
+    }
+}
+
+void LogRecord::submit(bool echo) {
+    if (!binary) {
+        if (format) {
+            buffer += format;       // Too few arguments: rest of the format as is
+        }
+        AsyncLogger::write(std::move(buffer), echo);
+        return;
+    }
+    size_t length = buffer.size() - 2;
+    buffer[0] = static_cast<char>(length);
+    buffer[1] = static_cast<char>(length >> 8);
+    buffer[ARGC_OFFSET] = static_cast<char>(args);
+    AsyncLogger::writeRecord(std::move(buffer));
+}
@@ -0,0 +1,173 @@
+#include "../include/metrics.hpp"
+#include <mutex>
+#include <cstring>
+
+/**
+ * METRICS IMPLEMENTATION
+ * ======================
+ *
+ * Shards are heap blocks owned by the registry. A thread's first update
+ * allocates one and plants a thread_local ShardOwner whose destructor
+ * folds the shard into `retired` when the thread exits, so counts from
+ * finished client threads are kept. The hot path only sees the raw
+ * thread_local pointer, which needs no guard or constructor call.
+ */
+
+namespace {
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<void*> shards;          // Metrics::Shard*, live threads
+    Metrics::Snapshot retired;          // Totals of exited threads
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry;     // Threads may exit during static destruction
+    return *instance;
+}
+
+const char* const COUNTER_NAMES[] = {
+#define CHAT_METRIC_NAME(id, name, help) name,
+    CHAT_METRIC_COUNTERS(CHAT_METRIC_NAME)
+};
+const char* const GAUGE_NAMES[] = {CHAT_METRIC_GAUGES(CHAT_METRIC_NAME)};
+const char* const HISTOGRAM_NAMES[] = {CHAT_METRIC_HISTOGRAMS(CHAT_METRIC_NAME)};
+#undef CHAT_METRIC_NAME
+
+const char* const COUNTER_HELP[] = {
+#define CHAT_METRIC_HELP(id, name, help) help,
+    CHAT_METRIC_COUNTERS(CHAT_METRIC_HELP)
+};
+const char* const GAUGE_HELP[] = {CHAT_METRIC_GAUGES(CHAT_METRIC_HELP)};
+const char* const HISTOGRAM_HELP[] = {CHAT_METRIC_HISTOGRAMS(CHAT_METRIC_HELP)};
+#undef CHAT_METRIC_HELP
+
+bool endsWith(const char* text, const char* suffix) {
+    size_t len = std::strlen(text);
+    size_t suffix_len = std::strlen(suffix);
+    return len >= suffix_len && std::strcmp(text + len - suffix_len, suffix) == 0;
+}
+
+}  // namespace
+
+thread_local Metrics::Shard* Metrics::local_shard = nullptr;
+
+/**
+ * Retires the thread's shard at thread exit
+ */
+struct ShardOwner {
+    Metrics::Shard* shard = nullptr;
+
+    ~ShardOwner() {
+        if (shard) {
+            Metrics::retireShard(shard);
+        }
+    }
+};
+
+namespace {
+thread_local ShardOwner shard_owner;
+}
+
+template <typename Cells, typename Totals>
+static void addCells(const Cells& cells, Totals& totals) {
+    totals.count += cells.count.load(std::memory_order_relaxed);
+    totals.sum += cells.sum.load(std::memory_order_relaxed);
+    for (size_t b = 0; b < Metrics::BUCKETS; b++) {
+        totals.buckets[b] += cells.buckets[b].load(std::memory_order_relaxed);
+    }
+}
+
+Metrics::Shard& Metrics::registerShard() {
+    Shard* s = new Shard();
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.shards.push_back(s);
+    }
+    shard_owner.shard = s;
+    local_shard = s;
+    return *s;
+}
+
+void Metrics::retireShard(Shard* s) {
+    Registry& r = registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (size_t i = 0; i < COUNTERS; i++) {
+            r.retired.counters[i] += s->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < GAUGES; i++) {
+            r.retired.gauges[i] += static_cast<int64_t>(s->gauges[i].load(std::memory_order_relaxed));
+        }
+        for (size_t i = 0; i < HISTOGRAMS; i++) {
+            addCells(s->histograms[i], r.retired.histograms[i]);
+        }
+        for (size_t i = 0; i < r.shards.size(); i++) {
+            if (r.shards[i] == s) {
+                r.shards[i] = r.shards.back();
+                r.shards.pop_back();
+                break;
+            }
+        }
+    }
+    local_shard = nullptr;
+    delete s;
+}
+
+Metrics::Snapshot Metrics::snapshot() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    Snapshot totals = r.retired;
+    for (void* entry : r.shards) {
+        const Shard* s = static_cast<const Shard*>(entry);
+        for (size_t i = 0; i < COUNTERS; i++) {
+            totals.counters[i] += s->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < GAUGES; i++) {
+            totals.gauges[i] += static_cast<int64_t>(s->gauges[i].load(std::memory_order_relaxed));
+        }
+        for (size_t i = 0; i < HISTOGRAMS; i++) {
+            addCells(s->histograms[i], totals.histograms[i]);
+        }
+    }
+    return totals;
+}
+
+uint64_t Metrics::bucketUpper(size_t i) {
+    if (i < SUB_BUCKETS) {
+        return i;
+    }
+    unsigned shift = static_cast<unsigned>(i / SUB_BUCKETS) - 1;
+    uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + i % SUB_BUCKETS) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+uint64_t Metrics::HistogramData::percentile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count));
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return bucketUpper(i);
+        }
+    }
+    return bucketUpper(BUCKETS - 1);
+}
+
+const char* Metrics::name(Counter id) { return COUNTER_NAMES[static_cast<size_t>(id)]; }
+const char* Metrics::name(Gauge id) { return GAUGE_NAMES[static_cast<size_t>(id)]; }
+const char* Metrics::name(Histogram id) { return HISTOGRAM_NAMES[static_cast<size_t>(id)]; }
+const char* Metrics::help(Counter id) { return COUNTER_HELP[static_cast<size_t>(id)]; }
+const char* Metrics::help(Gauge id) { return GAUGE_HELP[static_cast<size_t>(id)]; }
+const char* Metrics::help(Histogram id) { return HISTOGRAM_HELP[static_cast<size_t>(id)]; }
+
+double Metrics::scale(Histogram id) {
+    return endsWith(name(id), "_seconds") ? 1e-9 : 1.0;
+}
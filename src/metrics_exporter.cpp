@@ -0,0 +1,287 @@
+#include "../include/metrics_exporter.hpp"
+#include "../include/metrics.hpp"
+#include "../include/latency_tracker.hpp"
+#include "../include/tracer.hpp"
+#include "../include/utils.hpp"
+#include <iostream>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * METRICS EXPORTER IMPLEMENTATION
+ * ===============================
+ *
+ * The HTTP side is deliberately tiny: read until the end of the request
+ * header, answer GET /metrics or /trace (anything else is 404), close. Sockets are
+ * non-blocking under one epoll instance, so any number of scrapers
+ * share the thread and none can hold it up.
+ *
+ * Histograms are exported with one bucket per power of two. The
+ * registry's finer sub-buckets are summed into them, which keeps every
+ * scrape at the same ~45 lines per histogram.
+ */
+
+namespace {
+
+std::atomic<int> serving_port(0);
+
+struct Connection {
+    std::string request;
+    std::string response;
+    size_t sent = 0;
+    std::chrono::steady_clock::time_point opened;
+};
+
+void appendMetric(std::string& out, const char* name, const char* help, const char* type) {
+    out += "# HELP ";
+    out += name;
+    out += " ";
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += " ";
+    out += type;
+    out += "\n";
+}
+
+std::string formatNumber(double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+std::string httpResponse(const char* status, const char* type, const std::string& body) {
+    return std::string("HTTP/1.1 ") + status + "\r\nContent-Type: " + type +
+           "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+}
+
+std::string answer(const std::string& request) {
+    if (request.compare(0, 12, "GET /metrics") == 0 && (request[12] == ' ' || request[12] == '?')) {
+        return httpResponse("200 OK", "text/plain; version=0.0.4", MetricsExporter::prometheusText());
+    }
+    if (request.compare(0, 10, "GET /trace") == 0 && (request[10] == ' ' || request[10] == '?')) {
+        return httpResponse("200 OK", "application/json", Tracer::dumpJson());
+    }
+    return httpResponse("404 Not Found", "text/plain", "Try /metrics or /trace\n");
+}
+
+void closeConnection(int epoll_fd, std::map<int, Connection>& connections, int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+/**
+ * Writes what the socket takes; true when the response is complete
+ */
+bool sendPending(int fd, Connection& connection) {
+    while (connection.sent < connection.response.size()) {
+        ssize_t n = ::send(fd, connection.response.data() + connection.sent,
+                           connection.response.size() - connection.sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+        }
+        connection.sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void serve(int listen_fd) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        std::cerr << "Metrics: epoll_create1 failed" << std::endl;
+        close(listen_fd);
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    std::map<int, Connection> connections;
+    struct epoll_event events[32];
+    char buffer[2048];
+    for (;;) {
+        int ready = epoll_wait(epoll_fd, events, 32, 1000);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                int client = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (client >= 0) {
+                    ev.events = EPOLLIN;
+                    ev.data.fd = client;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &ev);
+                    connections[client].opened = std::chrono::steady_clock::now();
+                }
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue;
+            }
+            Connection& connection = it->second;
+            if (connection.response.empty()) {
+                ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                        closeConnection(epoll_fd, connections, fd);
+                    }
+                    continue;
+                }
+                connection.request.append(buffer, static_cast<size_t>(n));
+                if (connection.request.find("\r\n\r\n") == std::string::npos) {
+                    if (connection.request.size() > MetricsExporter::MAX_REQUEST) {
+                        closeConnection(epoll_fd, connections, fd);
+                    }
+                    continue;
+                }
+                connection.response = answer(connection.request);
+            }
+            if (sendPending(fd, connection)) {
+                closeConnection(epoll_fd, connections, fd);
+            } else {
+                ev.events = EPOLLOUT;
+                ev.data.fd = fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+            }
+        }
+
+        // Drop connections that never finish their request or never read the answer
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = connections.begin(); it != connections.end();) {
+            auto next = std::next(it);
+            if (now - it->second.opened > std::chrono::seconds(MetricsExporter::REQUEST_TIMEOUT_SECONDS)) {
+                closeConnection(epoll_fd, connections, it->first);
+            }
+            it = next;
+        }
+    }
+    close(epoll_fd);
+    close(listen_fd);
+}
+
+}  // namespace
+
+bool MetricsExporter::startFromEnvironment() {
+    const char* value = std::getenv("CHAT_METRICS_PORT");
+    if (!value || !*value) {
+        return true;
+    }
+    int port = std::atoi(value);
+    if (port <= 0 || port > 65535) {
+        std::cerr << "Metrics: bad CHAT_METRICS_PORT '" << value << "'" << std::endl;
+        return false;
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        std::cerr << "Metrics: socket failed" << std::endl;
+        return false;
+    }
+    int opt = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);     // Never exposed beyond this host
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listen_fd, 16) < 0) {
+        std::cerr << "Metrics: cannot listen on 127.0.0.1:" << port << ": " << strerror(errno) << std::endl;
+        close(listen_fd);
+        return false;
+    }
+
+    serving_port.store(port);
+    std::thread(serve, listen_fd).detach();
+    return true;
+}
+
+int MetricsExporter::port() {
+    return serving_port.load();
+}
+
+std::string MetricsExporter::prometheusText() {
+    Metrics::Snapshot snapshot = Metrics::snapshot();
+    std::string out;
+    out.reserve(16384);
+
+    for (size_t i = 0; i < Metrics::COUNTERS; i++) {
+        Counter id = static_cast<Counter>(i);
+        appendMetric(out, Metrics::name(id), Metrics::help(id), "counter");
+        out += std::string(Metrics::name(id)) + " " + std::to_string(snapshot.counters[i]) + "\n";
+    }
+    for (size_t i = 0; i < Metrics::GAUGES; i++) {
+        Gauge id = static_cast<Gauge>(i);
+        appendMetric(out, Metrics::name(id), Metrics::help(id), "gauge");
+        out += std::string(Metrics::name(id)) + " " + std::to_string(snapshot.gauges[i]) + "\n";
+    }
+    for (size_t i = 0; i < Metrics::HISTOGRAMS; i++) {
+        Histogram id = static_cast<Histogram>(i);
+        const Metrics::HistogramData& data = snapshot.histograms[i];
+        std::string name = Metrics::name(id);
+        double scale = Metrics::scale(id);
+        appendMetric(out, name.c_str(), Metrics::help(id), "histogram");
+
+        // Bucket b ends a power of two when the next one starts a new one
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b + 1 < Metrics::BUCKETS; b++) {
+            cumulative += data.buckets[b];
+            uint64_t upper = Metrics::bucketUpper(b);
+            if ((upper & (upper + 1)) == 0) {
+                out += name + "_bucket{le=\"" + formatNumber(upper * scale) + "\"} " + std::to_string(cumulative) + "\n";
+            }
+        }
+        out += name + "_bucket{le=\"+Inf\"} " + std::to_string(data.count) + "\n";
+        out += name + "_sum " + formatNumber(data.sum * scale) + "\n";
+        out += name + "_count " + std::to_string(data.count) + "\n";
+    }
+    LatencyTracker::appendPrometheus(out);
+    return out;
+}
+
+std::string MetricsExporter::summary() {
+    Metrics::Snapshot s = Metrics::snapshot();
+    auto counter = [&s](Counter id) { return s.counters[static_cast<size_t>(id)]; };
+    auto gauge = [&s](Gauge id) { return s.gauges[static_cast<size_t>(id)]; };
+    auto histogram = [&s](Histogram id) -> const Metrics::HistogramData& {
+        return s.histograms[static_cast<size_t>(id)];
+    };
+    const Metrics::HistogramData& fanout = histogram(Histogram::FANOUT_WIDTH);
+    const Metrics::HistogramData& broadcast = histogram(Histogram::BROADCAST_TIME);
+    const Metrics::HistogramData& rate = histogram(Histogram::TRANSFER_RATE);
+
+    std::string out = "Server stats\n";
+    out += "  Connections: " + std::to_string(gauge(Gauge::ACTIVE_CONNECTIONS)) + " active, " +
+           std::to_string(counter(Counter::CONNECTIONS)) + " total\n";
+    out += "  Messages:    " + std::to_string(counter(Counter::MESSAGES_IN)) + " in (" +
+           Utils::formatFileSize(static_cast<long>(counter(Counter::BYTES_IN))) + "), " +
+           std::to_string(counter(Counter::MESSAGES_OUT)) + " out (" +
+           Utils::formatFileSize(static_cast<long>(counter(Counter::BYTES_OUT))) + ")\n";
+    out += "  Broadcasts:  " + std::to_string(counter(Counter::BROADCASTS)) + ", fan-out p50 " +
+           std::to_string(fanout.percentile(0.5)) + " max " + std::to_string(fanout.percentile(1.0)) +
+           ", time p50 " + Utils::formatDuration(broadcast.percentile(0.5)) + " p99 " +
+           Utils::formatDuration(broadcast.percentile(0.99)) + "\n";
+    out += "  Transfers:   " + std::to_string(gauge(Gauge::ACTIVE_TRANSFERS)) + " active, " +
+           std::to_string(counter(Counter::TRANSFERS)) + " done, " +
+           Utils::formatFileSize(static_cast<long>(counter(Counter::TRANSFER_BYTES))) + ", rate p50 " +
+           Utils::formatFileSize(static_cast<long>(rate.percentile(0.5))) + "/s\n";
+    out += "  Queued:      " + std::to_string(gauge(Gauge::CHAT_QUEUED)) + " chat behind transfers, " +
+           Utils::formatFileSize(static_cast<long>(gauge(Gauge::LOG_QUEUED_BYTES))) + " of log";
+    return out;
+}
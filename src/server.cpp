@@ -1,13 +1,31 @@
 #include "../include/server.hpp"
 #include "../include/utils.hpp"
 #include "../include/file_transfer.hpp"
+#include "../include/traffic_shaper.hpp"
+#include "../include/transfer_scheduler.hpp"
 #include "../include/encryption.hpp"
+#include "../include/secure_channel.hpp"
+#include "../include/end_to_end.hpp"
+#include "../include/tls_transport.hpp"
+#include "../include/cpu_dispatch.hpp"
+#include "../include/async_logger.hpp"
+#include "../include/log_policy.hpp"
+#include "../include/metrics.hpp"
+#include "../include/metrics_exporter.hpp"
+#include "../include/latency_tracker.hpp"
+#include "../include/connection_monitor.hpp"
+#include "../include/tracer.hpp"
 #include <iostream>
 #include <vector>
 #include <cstring>
 #include <thread>
+#include <atomic>
 #include <chrono>
 #include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <pthread.h>
+#include <poll.h>
 
 /**
  * SERVER IMPLEMENTATION
@@ -37,6 +55,46 @@
  *    - Gracefully handles disconnects
  */
 
+namespace {
+
+/**
+ * Describe a transfer for the /file_offer prompt
+ * Single file: "report.pdf, 1.2 MB"  Batch: "photos: 12 files, 3.4 MB"
+ */
+std::string describeTransfer(const std::string& filename, long size, int batch_entries) {
+    if (batch_entries > 0) {
+        return filename + ": " + std::to_string(batch_entries) + " files, " + Utils::formatFileSize(size);
+    }
+    return filename + ", " + Utils::formatFileSize(size);
+}
+
+/**
+ * Build the command that precedes the data stream
+ * Single file: "/file_data <sender> <filename> <size> [chunked]"
+ * Batch:       "/batch_data <sender> <label> <entries> <size>"
+ */
+std::string transferDataCommand(const std::string& sender, const std::string& filename, long size,
+                                int batch_entries, bool chunked = false) {
+    if (batch_entries > 0) {
+        return "/batch_data " + sender + " " + filename + " " + std::to_string(batch_entries) + " " + std::to_string(size);
+    }
+    return "/file_data " + sender + " " + filename + " " + std::to_string(size) + (chunked ? " chunked" : "");
+}
+
+/**
+ * Is the user listed in CHAT_ADMINS (comma-separated usernames)?
+ */
+bool isAdmin(const std::string& username) {
+    const char* admins = std::getenv("CHAT_ADMINS");
+    if (!admins) {
+        return false;
+    }
+    std::vector<std::string> names = Utils::split(admins, ',');
+    return std::find(names.begin(), names.end(), username) != names.end();
+}
+
+}  // namespace
+
 // Constructor: Initialize server configuration
 ChatServer::ChatServer(int port) : server_fd(-1), port(port), running(false) {
     // Zero-initialize the address structure for safety
@@ -94,7 +152,8 @@ bool ChatServer::start() {
     }
     
     running = true;
-    logEvent("Server started on port " + std::to_string(port));
+    ConnectionMonitor::start();
+    logEvent(LogEvent::SERVER_STARTED, port);
     std::cout << "[SERVER] Listening on port " << port << std::endl;
     std::cout << "[SERVER] Encryption: " << (Encryption::isEnabled() ? "ENABLED" : "DISABLED") << std::endl;
     
@@ -121,7 +180,7 @@ void ChatServer::run() {
             continue;
         }
         
-        logEvent("New connection from " + Utils::getIPString(client_addr));
+        logEvent(LogEvent::CONNECTION_NEW, Utils::getIPString(client_addr));
         
         // Spawn a thread to handle this client
         // Detached threads clean up automatically when done
@@ -136,7 +195,7 @@ void ChatServer::run() {
  * This runs in a dedicated thread for each client
  * 
  * Lifecycle:
- * 1. Receive and validate username
+ * 1. Receive and validate username (and the client's session key offer)
  * 2. Register client in global map
  * 3. Loop: Receive and process messages
  * 4. On disconnect: Deregister and cleanup
@@ -144,9 +203,20 @@ void ChatServer::run() {
 void ChatServer::handleClient(int client_socket, sockaddr_in client_addr) {
     char buffer[4096];  // Buffer for receiving messages
     
+    // TLS clients open with a handshake record, plaintext clients with their name
+    if (TlsTransport::serverEnabled() && TlsTransport::looksLikeHandshake(client_socket)) {
+        if (!TlsTransport::accept(client_socket)) {
+            close(client_socket);
+            logEvent(LogEvent::TLS_FAILED, Utils::getIPString(client_addr));
+            return;
+        }
+        logEvent(LogEvent::TLS_ACCEPTED, Utils::getIPString(client_addr), TlsTransport::describe(client_socket));
+    }
+    
     // PHASE 1: Authentication - Get username from client
-    ssize_t bytes_read = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+    ssize_t bytes_read = SecureChannel::recv(client_socket, buffer, sizeof(buffer) - 1, 0);
     if (bytes_read <= 0) {
+        SecureChannel::detach(client_socket);
         close(client_socket);
         return;
     }
@@ -154,12 +224,22 @@ void ChatServer::handleClient(int client_socket, sockaddr_in client_addr) {
     buffer[bytes_read] = '\0';
     std::string username = Utils::trim(buffer);
     
+    // "name KEX1:<hex>" asks for an encrypted session
+    std::string key_offer;
+    size_t offer_pos = username.rfind(' ');
+    if (offer_pos != std::string::npos &&
+        username.compare(offer_pos + 1, 5, SecureChannel::OFFER_PREFIX) == 0) {
+        key_offer = username.substr(offer_pos + 1);
+        username = Utils::trim(username.substr(0, offer_pos));
+    }
+    
     // Validate username format
     if (username.empty() || !isValidUsername(username)) {
         std::string error_msg = "ERROR: Invalid username. Use only alphanumeric, _, and -";
-        send(client_socket, error_msg.c_str(), error_msg.length(), 0);
+        SecureChannel::send(client_socket, error_msg.c_str(), error_msg.length(), 0);
+        SecureChannel::detach(client_socket);
         close(client_socket);
-        logEvent("Rejected invalid username from " + Utils::getIPString(client_addr));
+        logEvent(LogEvent::USERNAME_INVALID, Utils::getIPString(client_addr));
         return;
     }
     
@@ -168,42 +248,107 @@ void ChatServer::handleClient(int client_socket, sockaddr_in client_addr) {
         std::lock_guard<std::mutex> lock(clients_mutex);
         if (clients.find(username) != clients.end()) {
             std::string error_msg = "ERROR: Username '" + username + "' is already taken";
-            send(client_socket, error_msg.c_str(), error_msg.length(), 0);
+            SecureChannel::send(client_socket, error_msg.c_str(), error_msg.length(), 0);
+            SecureChannel::detach(client_socket);
+            close(client_socket);
+            logEvent(LogEvent::USERNAME_DUPLICATE, username);
+            return;
+        }
+    }
+    
+    // Answer the key offer in plaintext; everything after it is sealed
+    if (!key_offer.empty()) {
+        uint8_t client_pub[X25519::KEY_SIZE];
+        SecureChannel::KeyShare share;
+        if (!SecureChannel::parseOffer(key_offer, client_pub) || !SecureChannel::createKeyShare(share)) {
+            std::string error_msg = "ERROR: Invalid key exchange";
+            SecureChannel::send(client_socket, error_msg.c_str(), error_msg.length(), 0);
+            SecureChannel::detach(client_socket);
             close(client_socket);
-            logEvent("Duplicate username attempt: " + username);
+            logEvent(LogEvent::KEY_EXCHANGE_REJECTED, username);
+            return;
+        }
+        if (SecureChannel::send(client_socket, share.offer.c_str(), share.offer.length(), 0) <= 0 ||
+            !SecureChannel::establish(client_socket, share, client_pub, false)) {
+            SecureChannel::detach(client_socket);
+            close(client_socket);
+            logEvent(LogEvent::KEY_EXCHANGE_FAILED, username);
             return;
         }
     }
     
     // PHASE 2: Registration - Add client to registry
     ClientInfo client_info(client_socket, username, client_addr);
+    client_info.transport = std::make_shared<ConnectionRecord>(client_socket, username);
     registerClient(username, client_info);
+    Metrics::count(Counter::CONNECTIONS);
+    Metrics::adjust(Gauge::ACTIVE_CONNECTIONS, 1);
     
     // Send welcome message
-    std::string welcome_msg = "Welcome " + username + "! Type /list, /quit, @user msg, /sendfile user file";
+    std::string welcome_msg = "Welcome " + username + "! Type /list, /quit, @user msg, /join room, /sendfile user file";
     if (Encryption::isEnabled()) {
         welcome_msg = Encryption::encrypt(welcome_msg);
     }
-    send(client_socket, welcome_msg.c_str(), welcome_msg.length(), 0);
+    SecureChannel::send(client_socket, welcome_msg.c_str(), welcome_msg.length(), 0);
     
     // Notify all other users
     std::string join_msg = username + " joined the chat!";
     broadcast(join_msg, username);
-    logEvent("User authenticated: " + username);
+    logEvent(LogEvent::USER_AUTHENTICATED, username,
+             SecureChannel::isSecure(client_socket) ? " (encrypted session)" :
+             TlsTransport::isTls(client_socket) ? " (TLS)" : "");
+    
+    // Push any files that arrived while this user was offline. The
+    // replay runs beside the message loop so the user can chat meanwhile;
+    // replies below go through TrafficShaper and wait for frame boundaries.
+    std::atomic<bool> delivering(true);
+    std::thread delivery([this, client_socket, username, &delivering] {
+        deliverSpooledFiles(client_socket, username);
+        delivering = false;
+    });
+    
+    Tracer::nameThread("client " + username);
     
     // PHASE 3: Message Processing Loop
     while (running) {
-        bytes_read = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+        // A sampled message is timed from the moment its bytes are readable
+        Tracer::Message trace_message;
+        if (trace_message.sampled() && !SecureChannel::hasBuffered(client_socket)) {
+            struct pollfd readable = {client_socket, POLLIN, 0};
+            poll(&readable, 1, -1);
+            trace_message.restart();
+        }
+        {
+            Tracer::Span span("recv");
+            bytes_read = SecureChannel::recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+        }
         if (bytes_read <= 0) {
             break;
         }
         
         buffer[bytes_read] = '\0';
         std::string encrypted_message(buffer, bytes_read);
+        int64_t received_ns = LatencyTracker::now();
+        Metrics::count(Counter::MESSAGES_IN);
+        Metrics::count(Counter::BYTES_IN, static_cast<uint64_t>(bytes_read));
+        Metrics::record(Histogram::MESSAGE_SIZE, static_cast<uint64_t>(bytes_read));
+        
+        // Delta signatures carry a binary blob after their header line
+        if (encrypted_message.compare(0, 10, "/delta_sig") == 0) {
+            receiveDeltaSignatures(client_socket, username, encrypted_message);
+            continue;
+        }
+        
+        // End-to-end messages are routed on their header; the body is opaque
+        if (encrypted_message.compare(0, 5, "/e2e ") == 0) {
+            forwardEndToEnd(encrypted_message, username, client_socket);
+            continue;
+        }
         
         // Decrypt message if encryption is enabled
         std::string message = encrypted_message;
         if (Encryption::isEnabled() && encrypted_message.length() > 0) {
+            Tracer::Span span("decrypt");
             try {
                 message = Encryption::decrypt(encrypted_message);
             } catch (...) {
@@ -212,11 +357,31 @@ void ChatServer::handleClient(int client_socket, sockaddr_in client_addr) {
             }
         }
         
-        message = Utils::trim(message);
+        {
+            Tracer::Span span("trim");
+            message = Utils::trim(message);
+        }
         if (message.empty()) continue;
         
-        logEvent("[" + username + "] " + message);
-        processMessage(message, username, client_socket);
+        // Recipients acknowledge traced messages; nothing to log or route
+        if (message.compare(0, 5, "/ack ") == 0) {
+            LatencyTracker::acknowledge(message.substr(5), client_socket, received_ns);
+            continue;
+        }
+        
+        // Traced messages lose their header here and are timed until routed
+        int64_t sent_ns = 0;
+        bool traced = LatencyTracker::parseTraced(message, sent_ns);
+        LatencyTracker::Scope trace(traced, client_socket, sent_ns, received_ns);
+        
+        {
+            Tracer::Span span("log");
+            logEvent(LogEvent::CHAT_MESSAGE, username, message);
+        }
+        {
+            Tracer::Span span("processMessage");
+            processMessage(message, username, client_socket);
+        }
         
         if (message == "/quit") {
             break;
@@ -224,12 +389,19 @@ void ChatServer::handleClient(int client_socket, sockaddr_in client_addr) {
     }
     
     // PHASE 4: Cleanup - Deregister and notify others
+    if (delivering) {
+        shutdown(client_socket, SHUT_RDWR);  // Unblocks a replay still in progress
+    }
+    delivery.join();
+    
     std::string leave_msg = username + " left the chat";
     broadcast(leave_msg, username);
     
     deregisterClient(username);
+    Metrics::adjust(Gauge::ACTIVE_CONNECTIONS, -1);
+    SecureChannel::detach(client_socket);
     close(client_socket);
-    logEvent("Connection closed for " + username);
+    logEvent(LogEvent::CONNECTION_CLOSED, username);
 }
 
 /**
@@ -247,7 +419,8 @@ void ChatServer::handleClient(int client_socket, sockaddr_in client_addr) {
  */
 void ChatServer::handleFileTransfer(int sender_socket, const std::string& sender_username,
                                    const std::string& recipient_username, 
-                                   const std::string& filename, long file_size) {
+                                   const std::string& filename, long file_size,
+                                   int batch_entries, bool chunked) {
     // Find recipient's socket (thread-safe lookup)
     int recipient_socket = -1;
     {
@@ -258,45 +431,306 @@ void ChatServer::handleFileTransfer(int sender_socket, const std::string& sender
         }
     }
     
-    // Check if recipient is online
+    // Recipient offline: store the file and forward it at their next login
     if (recipient_socket == -1) {
-        std::string error_msg = "ERROR: User '" + recipient_username + "' is not online";
-        send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+        spoolFileTransfer(sender_socket, sender_username, recipient_username, filename, file_size,
+                          batch_entries, chunked);
         return;
     }
     
     // Send file offer to recipient (includes filename now)
     std::string file_offer = "/file_offer from " + sender_username + 
-                            " (" + filename + ", " + Utils::formatFileSize(file_size) + ") - Accept? (y/n)";
-    send(recipient_socket, file_offer.c_str(), file_offer.length(), 0);
+                            " (" + describeTransfer(filename, file_size, batch_entries) + ") - Accept? (y/n)";
+    SecureChannel::send(recipient_socket, file_offer.c_str(), file_offer.length(), 0);
     
     // Wait for recipient to process and auto-accept
     std::this_thread::sleep_for(std::chrono::seconds(2));
     
-    // Tell recipient to prepare for file data - NOW INCLUDES FILENAME
-    std::string file_data_msg = "/file_data " + sender_username + " " + filename + " " + std::to_string(file_size);
-    send(recipient_socket, file_data_msg.c_str(), file_data_msg.length(), 0);
+    bool success;
+    {
+        // Shape the relay. Created before /file_data so chat for the
+        // recipient is held back from then on and, on chunked streams,
+        // rides along as chat frames instead of landing mid-stream.
+        TransferFlow flow(sender_username, recipient_socket, chunked,
+                          sender_username + " -> " + recipient_username + " " + filename, file_size);
+        
+        // Tell recipient to prepare for file data - NOW INCLUDES FILENAME
+        std::string file_data_msg = transferDataCommand(sender_username, filename, file_size, batch_entries, chunked);
+        SecureChannel::send(recipient_socket, file_data_msg.c_str(), file_data_msg.length(), 0);
+        
+        // Small delay to ensure message is processed
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        
+        // Stream file data from sender to recipient (chunk frames are relayed as-is)
+        success = chunked
+            ? FileTransferHandler::relayChunkedStream(sender_socket, recipient_socket, true, file_size, &flow)
+            : FileTransferHandler::streamFileData(
+                  sender_socket, recipient_socket,
+                  sender_username, recipient_username,
+                  filename, file_size, &flow
+              );
+    }
+    
+    if (success) {
+        std::string complete_msg = "[FILE] ✓ Transfer complete!";
+        SecureChannel::send(sender_socket, complete_msg.c_str(), complete_msg.length(), 0);
+        SecureChannel::send(recipient_socket, complete_msg.c_str(), complete_msg.length(), 0);
+        logEvent(LogEvent::FILE_DONE, sender_username, recipient_username, filename);
+    } else {
+        std::string error_msg = "ERROR: File transfer failed";
+        SecureChannel::send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+        SecureChannel::send(recipient_socket, error_msg.c_str(), error_msg.length(), 0);
+        logEvent(LogEvent::FILE_FAILED, sender_username, recipient_username);
+    }
+}
+
+/**
+ * Handle a delta transfer
+ * -----------------------
+ * The recipient's signatures arrive on the recipient's own handler
+ * thread (it owns that socket's reads), so they are handed over through
+ * delta_signatures / delta_cv.
+ */
+void ChatServer::handleDeltaTransfer(int sender_socket, const std::string& sender_username,
+                                     const std::string& recipient_username,
+                                     const std::string& filename, long file_size) {
+    int recipient_socket = -1;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(recipient_username);
+        if (it != clients.end()) {
+            recipient_socket = it->second.socket_fd;
+        }
+    }
     
-    // Small delay to ensure message is processed
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    // Without signatures the sender falls back to the full file, except
+    // over MAX_FILE_SIZE: those only travel as deltas, so it sends nothing
+    auto fall_back = [&]() {
+        const std::string fallback = "/delta_sig none";
+        SecureChannel::send(sender_socket, fallback.c_str(), fallback.length(), 0);
+        if (file_size <= FileTransferHandler::MAX_FILE_SIZE) {
+            handleFileTransfer(sender_socket, sender_username, recipient_username, filename, file_size);
+            return;
+        }
+        std::string error_msg = "ERROR: " + recipient_username + " has no copy to update; files over " +
+                                Utils::formatFileSize(FileTransferHandler::MAX_FILE_SIZE) + " can only be sent as a delta";
+        SecureChannel::send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+    };
     
-    // Stream file data from sender to recipient
-    bool success = FileTransferHandler::streamFileData(
-        sender_socket, recipient_socket, 
-        sender_username, recipient_username,
-        filename, file_size
-    );
+    // Offline recipient has no basis to diff against: spool the full file
+    if (recipient_socket == -1) {
+        fall_back();
+        return;
+    }
+    
+    std::string key = sender_username + ">" + recipient_username;
+    {
+        std::lock_guard<std::mutex> lock(delta_mutex);
+        delta_signatures.erase(key);
+    }
+    
+    std::string delta_offer = "/delta_offer " + sender_username + " " + filename + " " + std::to_string(file_size);
+    SecureChannel::send(recipient_socket, delta_offer.c_str(), delta_offer.length(), 0);
+    
+    // Wait for the recipient's block signatures
+    std::string signatures;
+    {
+        std::unique_lock<std::mutex> lock(delta_mutex);
+        bool posted = delta_cv.wait_for(lock, std::chrono::seconds(30), [&] {
+            return delta_signatures.count(key) > 0;
+        });
+        if (posted) {
+            signatures = std::move(delta_signatures[key]);
+            delta_signatures.erase(key);
+        }
+    }
+    
+    if (signatures.empty()) {
+        logEvent(LogEvent::DELTA_TIMEOUT, sender_username, recipient_username);
+        fall_back();
+        return;
+    }
+    
+    std::string sig_msg = "/delta_sig " + std::to_string(signatures.size()) + "\n" + signatures;
+    if (!Utils::sendAll(sender_socket, sig_msg.data(), sig_msg.size())) {
+        return;
+    }
+    
+    // Relay the delta stream
+    std::string header;
+    long body_len = 0;
+    bool success = FileTransferHandler::receiveDeltaHeader(sender_socket, file_size, header, body_len);
     
     if (success) {
-        std::string complete_msg = "[FILE] ✓ Transfer complete!";
-        send(sender_socket, complete_msg.c_str(), complete_msg.length(), 0);
-        send(recipient_socket, complete_msg.c_str(), complete_msg.length(), 0);
-        logEvent("File transfer completed: " + sender_username + " -> " + recipient_username + " (" + filename + ")");
+        // Holds the recipient's chat from /delta_data until the body is through
+        TransferFlow flow(sender_username, recipient_socket, false,
+                          sender_username + " -> " + recipient_username + " " + filename + " (delta)", body_len);
+        
+        std::string delta_data_msg = "/delta_data " + sender_username + " " + filename + " " + std::to_string(file_size);
+        SecureChannel::send(recipient_socket, delta_data_msg.c_str(), delta_data_msg.length(), 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        
+        success = Utils::sendAll(recipient_socket, header.data(), header.size()) &&
+                  FileTransferHandler::streamFileData(sender_socket, recipient_socket,
+                                                      sender_username, recipient_username,
+                                                      filename, body_len, &flow);
+    }
+    
+    if (success) {
+        std::string complete_msg = "[FILE] ✓ Transfer complete! (delta: " + Utils::formatFileSize(body_len) +
+                                   " for " + Utils::formatFileSize(file_size) + ")";
+        SecureChannel::send(sender_socket, complete_msg.c_str(), complete_msg.length(), 0);
+        SecureChannel::send(recipient_socket, complete_msg.c_str(), complete_msg.length(), 0);
+        logEvent(LogEvent::DELTA_DONE, sender_username, recipient_username, filename, body_len, file_size);
     } else {
         std::string error_msg = "ERROR: File transfer failed";
-        send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
-        send(recipient_socket, error_msg.c_str(), error_msg.length(), 0);
-        logEvent("File transfer failed: " + sender_username + " -> " + recipient_username);
+        SecureChannel::send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+        SecureChannel::send(recipient_socket, error_msg.c_str(), error_msg.length(), 0);
+        logEvent(LogEvent::DELTA_FAILED, sender_username, recipient_username);
+    }
+}
+
+/**
+ * Receive a delta signature blob
+ * ------------------------------
+ * Format: "/delta_sig <sender> <length>\n" followed by <length> bytes.
+ * Part of the blob may already be in first_chunk; the rest is read here.
+ */
+void ChatServer::receiveDeltaSignatures(int client_socket, const std::string& recipient_username,
+                                        const std::string& first_chunk) {
+    static constexpr long MAX_SIGNATURE_BLOB = 16 * 1024 * 1024;
+    
+    size_t newline = first_chunk.find('\n');
+    if (newline == std::string::npos) {
+        return;
+    }
+    
+    std::vector<std::string> parts = Utils::split(first_chunk.substr(0, newline), ' ');
+    if (parts.size() < 3) {
+        return;
+    }
+    long length = std::atol(parts[2].c_str());
+    if (length <= 0 || length > MAX_SIGNATURE_BLOB) {
+        return;
+    }
+    
+    std::string blob = first_chunk.substr(newline + 1, length);
+    size_t have = blob.size();
+    if (have < static_cast<size_t>(length)) {
+        blob.resize(length);
+        if (!Utils::recvAll(client_socket, &blob[have], length - have)) {
+            return;
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(delta_mutex);
+        delta_signatures[parts[1] + ">" + recipient_username] = std::move(blob);
+    }
+    delta_cv.notify_all();
+}
+
+/**
+ * Spool a file for an offline recipient
+ * -------------------------------------
+ * The sender has already been told to stream the file, so the bytes
+ * arrive whether or not the spool accepts them. Rejected uploads are
+ * drained to keep the sender's message stream in sync.
+ */
+void ChatServer::spoolFileTransfer(int sender_socket, const std::string& sender_username,
+                                   const std::string& recipient_username,
+                                   const std::string& filename, long file_size,
+                                   int batch_entries, bool chunked) {
+    SpoolEntry entry;
+    entry.recipient = recipient_username;
+    entry.sender = sender_username;
+    entry.filename = filename;
+    entry.size = file_size;
+    entry.entries = batch_entries;
+    entry.chunked = chunked;
+    
+    std::string reason;
+    if (!isValidUsername(recipient_username)) {
+        reason = "invalid username";
+    } else if (!spool.reserve(entry, reason)) {
+        // reason filled in by reserve()
+    } else {
+        std::string queued_msg = "[FILE] " + recipient_username + " is offline - queuing file for delivery at next login";
+        SecureChannel::send(sender_socket, queued_msg.c_str(), queued_msg.length(), 0);
+        
+        bool received = FileTransferHandler::spoolFileData(sender_socket, entry.data_path, file_size, chunked);
+        if (spool.commit(entry, received)) {
+            std::string complete_msg = "[FILE] ✓ Queued for " + recipient_username + " (" + filename + ")";
+            SecureChannel::send(sender_socket, complete_msg.c_str(), complete_msg.length(), 0);
+            logEvent(LogEvent::SPOOL_STORED, sender_username, recipient_username, filename);
+        } else {
+            std::string error_msg = "ERROR: Could not queue file for " + recipient_username;
+            SecureChannel::send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+            logEvent(LogEvent::SPOOL_FAILED, sender_username, recipient_username);
+        }
+        return;
+    }
+    
+    std::string error_msg = "ERROR: User '" + recipient_username + "' is not online (" + reason + ")";
+    SecureChannel::send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+    if (chunked) {
+        FileTransferHandler::relayChunkedStream(sender_socket, -1, false, file_size);
+    } else {
+        FileTransferHandler::discardFileData(sender_socket, file_size);
+    }
+    logEvent(LogEvent::SPOOL_REJECTED, sender_username, recipient_username, reason);
+}
+
+/**
+ * Deliver spooled files at login
+ * ------------------------------
+ * Runs on its own thread beside the recipient's message loop, so a
+ * long queue never holds up the user's chat. The connection is torn
+ * down only after this returns.
+ */
+void ChatServer::deliverSpooledFiles(int client_socket, const std::string& username) {
+    spool.pruneExpired();
+    std::vector<SpoolEntry> queued = spool.pending(username);
+    if (queued.empty()) {
+        return;
+    }
+    
+    std::string notice = "[FILE] " + std::to_string(queued.size()) + " file(s) were sent to you while you were offline";
+    SecureChannel::send(client_socket, notice.c_str(), notice.length(), 0);
+    
+    for (const auto& entry : queued) {
+        std::string file_offer = "/file_offer from " + entry.sender + 
+                                " (" + describeTransfer(entry.filename, entry.size, entry.entries) + ") - Accept? (y/n)";
+        SecureChannel::send(client_socket, file_offer.c_str(), file_offer.length(), 0);
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        
+        // Chunked payloads are stored as frames, so replay the on-disk size
+        long stored_size = entry.chunked ? Utils::getFileSize(entry.data_path) : entry.size;
+        bool delivered;
+        {
+            // As in the live relay, the flow exists before /file_data: chat
+            // rides along as frames on chunked replays and waits for the
+            // end of raw and batch ones
+            TransferFlow flow(entry.sender, client_socket, entry.chunked,
+                              entry.sender + " -> " + username + " " + entry.filename + " (spooled)", stored_size);
+            
+            std::string file_data_msg = transferDataCommand(entry.sender, entry.filename, entry.size,
+                                                            entry.entries, entry.chunked);
+            SecureChannel::send(client_socket, file_data_msg.c_str(), file_data_msg.length(), 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            
+            delivered = FileTransferHandler::sendSpooledFile(client_socket, entry.data_path, stored_size, &flow,
+                                                             entry.chunked);
+        }
+        if (!delivered) {
+            logEvent(LogEvent::SPOOL_DELIVERY_FAILED, entry.sender, username, entry.filename);
+            break;  // Connection is likely gone; keep the rest for the next login
+        }
+        
+        std::string complete_msg = "[FILE] ✓ Transfer complete!";
+        SecureChannel::send(client_socket, complete_msg.c_str(), complete_msg.length(), 0);
+        spool.remove(entry);
+        logEvent(LogEvent::SPOOL_DELIVERED, entry.sender, username, entry.filename);
     }
 }
 
@@ -307,8 +741,15 @@ void ChatServer::handleFileTransfer(int sender_socket, const std::string& sender
  * 
  * Message types:
  * - /list: Show active users
+ * - /transfers: Show active transfers and their achieved rates
+ * - /log [settings]: Show or change logging settings (admins)
+ * - /stats: Server metrics summary (admins)
+ * - /latency: Delivery latency of traced messages (admins)
+ * - /conninfo [user]: Transport statistics per connection (admins)
+ * - /trace [N|off|dump]: Sampled message tracing (admins)
  * - @user msg: Private message
- * - /sendfile user filename size: File transfer (now includes filename)
+ * - /sendfile user filename size [delta|chunked]: File transfer (now includes filename)
+ * - /sendbatch user label count size: Directory/glob transfer as one stream
  * - /quit: Disconnect
  * - Other: Public broadcast
  */
@@ -322,7 +763,43 @@ void ChatServer::processMessage(const std::string& message, const std::string& s
             user_list = Encryption::encrypt(user_list);
         }
         
-        send(sender_socket, user_list.c_str(), user_list.length(), 0);
+        TrafficShaper::sendChat(sender_socket, user_list);
+    }
+    // Command: Active transfers with scheduler shares and achieved rates
+    else if (message == "/transfers") {
+        std::string table = TransferScheduler::describe();
+        if (Encryption::isEnabled()) {
+            table = Encryption::encrypt(table);
+        }
+        TrafficShaper::sendChat(sender_socket, table);
+    }
+    // Command: Metrics summary (admins only)
+    else if (message == "/stats") {
+        std::string stats = isAdmin(sender_username) ? MetricsExporter::summary() : "ERROR: /stats is for admins";
+        if (Encryption::isEnabled()) {
+            stats = Encryption::encrypt(stats);
+        }
+        TrafficShaper::sendChat(sender_socket, stats);
+    }
+    // Command: Delivery latency per hop and per room (admins only)
+    else if (message == "/latency") {
+        std::string report = isAdmin(sender_username) ? LatencyTracker::describe() : "ERROR: /latency is for admins";
+        if (Encryption::isEnabled()) {
+            report = Encryption::encrypt(report);
+        }
+        TrafficShaper::sendChat(sender_socket, report);
+    }
+    // Command: Transport statistics per connection (admins only)
+    else if (message == "/conninfo" || message.compare(0, 10, "/conninfo ") == 0) {
+        handleConnInfo(message.size() > 10 ? Utils::trim(message.substr(10)) : "", sender_username, sender_socket);
+    }
+    // Command: Sampled message tracing (/trace [N|off|dump], admins only)
+    else if (message == "/trace" || message.compare(0, 7, "/trace ") == 0) {
+        handleTraceCommand(message.size() > 7 ? Utils::trim(message.substr(7)) : "", sender_username, sender_socket);
+    }
+    // Command: Logging settings (/log [settings], admins only)
+    else if (message == "/log" || message.compare(0, 5, "/log ") == 0) {
+        handleLogCommand(message.size() > 5 ? message.substr(5) : "", sender_username, sender_socket);
     }
     // Command: Private message (@username message)
     else if (message.find("@") == 0) {
@@ -336,10 +813,19 @@ void ChatServer::processMessage(const std::string& message, const std::string& s
             if (Encryption::isEnabled()) {
                 error_msg = Encryption::encrypt(error_msg);
             }
-            send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+            TrafficShaper::sendChat(sender_socket, error_msg);
         }
     }
-    // Command: File transfer (/sendfile username filename file_size)
+    // Command: Rooms (/join room, /leave room, #room message)
+    else if (message.compare(0, 6, "/join ") == 0 || message.compare(0, 7, "/leave ") == 0 ||
+             (message[0] == '#' && message.size() > 1)) {
+        handleRoomCommand(message, sender_username, sender_socket);
+    }
+    // Command: End-to-end key directory (/pubkey <hex> or /pubkey <username>)
+    else if (message.compare(0, 8, "/pubkey ") == 0) {
+        handlePublicKey(Utils::trim(message.substr(8)), sender_username, sender_socket);
+    }
+    // Command: File transfer (/sendfile username filename file_size [delta|chunked])
     else if (message.find("/sendfile") == 0) {
         std::vector<std::string> parts = Utils::split(message, ' ');
         if (parts.size() < 4) {  // NOW NEEDS 4 parts: /sendfile user filename size
@@ -347,7 +833,7 @@ void ChatServer::processMessage(const std::string& message, const std::string& s
             if (Encryption::isEnabled()) {
                 error_msg = Encryption::encrypt(error_msg);
             }
-            send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+            TrafficShaper::sendChat(sender_socket, error_msg);
             return;
         }
         
@@ -355,18 +841,59 @@ void ChatServer::processMessage(const std::string& message, const std::string& s
         std::string filename = parts[2];  // NEW: Get filename
         long file_size = std::stol(parts[3]);  // NOW index 3 instead of 2
         
-        // Validate file size
-        if (file_size <= 0 || file_size > 10 * 1024 * 1024) {  // 10MB limit
-            std::string error_msg = "ERROR: Invalid file size (max 10MB)";
+        // Optional 5th argument selects rsync-style delta mode
+        bool delta = parts.size() >= 5 && parts[4] == "delta";
+        
+        // Validate file size. Only the delta stream is relayed in delta
+        // mode, and receiveDeltaHeader caps that at MAX_FILE_SIZE instead.
+        long max_size = delta ? FileTransferHandler::MAX_DELTA_FILE_SIZE : FileTransferHandler::MAX_FILE_SIZE;
+        if (file_size <= 0 || file_size > max_size) {
+            std::string error_msg = "ERROR: Invalid file size (max " + Utils::formatFileSize(max_size) + ")";
             if (Encryption::isEnabled()) {
                 error_msg = Encryption::encrypt(error_msg);
             }
-            send(sender_socket, error_msg.c_str(), error_msg.length(), 0);
+            TrafficShaper::sendChat(sender_socket, error_msg);
+            return;
+        }
+        
+        if (delta) {
+            handleDeltaTransfer(sender_socket, sender_username, target_user, filename, file_size);
             return;
         }
         
+        // "chunked" streams are framed and selectively compressed by the client
+        bool chunked = parts.size() >= 5 && parts[4] == "chunked";
+        
         // Handle file transfer SYNCHRONOUSLY - now passes filename
-        handleFileTransfer(sender_socket, sender_username, target_user, filename, file_size);
+        handleFileTransfer(sender_socket, sender_username, target_user, filename, file_size, 0, chunked);
+    }
+    // Command: Batch transfer (/sendbatch username label entry_count stream_size)
+    else if (message.find("/sendbatch") == 0) {
+        std::vector<std::string> parts = Utils::split(message, ' ');
+        if (parts.size() < 5) {
+            std::string error_msg = "Usage: /sendbatch <username> <label> <entry_count> <stream_size>";
+            TrafficShaper::sendChat(sender_socket, error_msg);
+            return;
+        }
+        
+        std::string target_user = parts[1];
+        std::string label = parts[2];
+        int entry_count = std::atoi(parts[3].c_str());
+        long stream_size = std::atol(parts[4].c_str());
+        
+        if (entry_count <= 0 || entry_count > FileTransferHandler::MAX_BATCH_ENTRIES ||
+            stream_size <= 0 || stream_size > FileTransferHandler::MAX_BATCH_SIZE) {
+            std::string error_msg = "ERROR: Invalid batch (max " + std::to_string(FileTransferHandler::MAX_BATCH_ENTRIES) +
+                                    " files, " + Utils::formatFileSize(FileTransferHandler::MAX_BATCH_SIZE) + ")";
+            TrafficShaper::sendChat(sender_socket, error_msg);
+            if (stream_size > 0 && stream_size <= FileTransferHandler::MAX_BATCH_SIZE) {
+                FileTransferHandler::discardFileData(sender_socket, stream_size);
+            }
+            return;
+        }
+        
+        // One offer and one data stream for the whole batch
+        handleFileTransfer(sender_socket, sender_username, target_user, label, stream_size, entry_count);
     }
     // Command: Disconnect
     else if (message == "/quit") {
@@ -374,7 +901,7 @@ void ChatServer::processMessage(const std::string& message, const std::string& s
         if (Encryption::isEnabled()) {
             goodbye = Encryption::encrypt(goodbye);
         }
-        send(sender_socket, goodbye.c_str(), goodbye.length(), 0);
+        TrafficShaper::sendChat(sender_socket, goodbye);
     }
     // Default: Public broadcast message
     else {
@@ -389,18 +916,143 @@ void ChatServer::processMessage(const std::string& message, const std::string& s
  * Thread-safe iteration over clients map
  */
 void ChatServer::broadcast(const std::string& message, const std::string& sender) {
-    std::string encrypted_message = message;
+    Tracer::Span span("broadcast");
+    std::string encrypted_message = LatencyTracker::route("lobby") + message;
     if (Encryption::isEnabled()) {
-        encrypted_message = Encryption::encrypt(message);
+        Tracer::Span encrypt_span("encrypt");
+        encrypted_message = Encryption::encrypt(encrypted_message);
     }
     
-    std::lock_guard<std::mutex> lock(clients_mutex);
+    // Timed apart: a fan-out stuck on a slow member holds this lock
+    std::unique_lock<std::mutex> lock(clients_mutex, std::defer_lock);
+    {
+        Tracer::Span lock_span("lock");
+        lock.lock();
+    }
+    std::vector<const ClientInfo*> members;
+    members.reserve(clients.size());
     for (const auto& pair : clients) {
-        if (pair.first != sender) {  // Don't send back to sender
-            send(pair.second.socket_fd, encrypted_message.c_str(), encrypted_message.length(), 0);
+        members.push_back(&pair.second);
+    }
+    fanOut(lobby, members, encrypted_message, sender);  // Sender is skipped
+    logEvent(LogEvent::BROADCAST, message);
+}
+
+/**
+ * Encrypt once, send to many
+ * --------------------------
+ * A rotation costs one small key record per secured member, the same
+ * work one per-member broadcast used to cost; every broadcast until the
+ * next join or leave then costs a single encryption.
+ */
+void ChatServer::fanOut(Room& room, const std::vector<const ClientInfo*>& members, const std::string& message,
+                        const std::string& sender) {
+    Tracer::Span span("fanOut");
+    auto started = std::chrono::steady_clock::now();
+    if (room.rekey) {
+        Tracer::Span rekey_span("rekey");
+        uint32_t retired = room.key.id;
+        if (SecureChannel::rotateGroupKey(room.key)) {
+            for (const ClientInfo* member : members) {
+                SecureChannel::sendGroupKey(member->socket_fd, room.key, retired);
+            }
+            room.rekey = false;
+        }
+    }
+    
+    // Empty record (no key, oversized message): every member gets message
+    std::string record;
+    if (!room.rekey) {
+        Tracer::Span seal_span("seal");
+        SecureChannel::sealGroupRecord(room.key, message.data(), message.size(), record);
+    }
+    uint64_t recipients = 0;
+    for (const ClientInfo* member : members) {
+        if (member->username != sender) {
+            Tracer::Span send_span("send");
+            int64_t enqueued = LatencyTracker::startDelivery(member->socket_fd);
+            TrafficShaper::sendGroupChat(member->socket_fd, message, record);
+            LatencyTracker::delivered(enqueued);
+            recipients++;
         }
     }
-    logEvent("Broadcast: " + message);
+    Metrics::count(Counter::BROADCASTS);
+    Metrics::record(Histogram::FANOUT_WIDTH, recipients);
+    Metrics::record(Histogram::BROADCAST_TIME, static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count()));
+}
+
+/**
+ * Room commands
+ * -------------
+ * /join <room>, /leave <room>, #<room> <message>
+ */
+void ChatServer::handleRoomCommand(const std::string& message, const std::string& sender_username, int sender_socket) {
+    bool is_join = message.compare(0, 6, "/join ") == 0;
+    bool is_leave = message.compare(0, 7, "/leave ") == 0;
+    std::string name;
+    std::string text;
+    if (is_join || is_leave) {
+        name = Utils::trim(message.substr(is_join ? 6 : 7));
+        if (!name.empty() && name[0] == '#') {
+            name.erase(0, 1);
+        }
+    } else {
+        size_t space = message.find(' ');
+        name = message.substr(1, space == std::string::npos ? std::string::npos : space - 1);
+        text = space == std::string::npos ? "" : message.substr(space + 1);
+    }
+    
+    std::string reply;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        if (!isValidUsername(name)) {
+            reply = "ERROR: Room names use 1-20 characters: letters, digits, _ and -";
+        } else if (is_join) {
+            Room& room = rooms[name];
+            if (room.members.insert(sender_username).second) {
+                room.rekey = true;
+            }
+            reply = "[ROOM] Joined #" + name + " (" + std::to_string(room.members.size()) + " members)";
+        } else {
+            auto it = rooms.find(name);
+            if (it == rooms.end() || it->second.members.count(sender_username) == 0) {
+                reply = "ERROR: You are not in #" + name + " (use /join " + name + ")";
+            } else if (is_leave) {
+                it->second.members.erase(sender_username);
+                it->second.rekey = true;
+                reply = "[ROOM] Left #" + name;
+            } else if (!text.empty()) {
+                std::vector<const ClientInfo*> members;
+                members.reserve(it->second.members.size());
+                for (const std::string& member : it->second.members) {
+                    auto client = clients.find(member);
+                    if (client != clients.end()) {
+                        members.push_back(&client->second);
+                    }
+                }
+                Tracer::Span span("room");
+                std::string wire = LatencyTracker::route(name) + "[#" + name + "] " + sender_username + ": " + text;
+                if (Encryption::isEnabled()) {
+                    Tracer::Span encrypt_span("encrypt");
+                    wire = Encryption::encrypt(wire);
+                }
+                fanOut(it->second, members, wire, sender_username);
+            }
+            if (it != rooms.end() && it->second.members.empty()) {
+                rooms.erase(it);
+            }
+        }
+    }
+    
+    if (reply.empty()) {
+        return;
+    }
+    logEvent(LogEvent::COMMAND_REPLY, sender_username, reply);
+    if (Encryption::isEnabled()) {
+        reply = Encryption::encrypt(reply);
+    }
+    TrafficShaper::sendChat(sender_socket, reply);
 }
 
 /**
@@ -409,29 +1061,38 @@ void ChatServer::broadcast(const std::string& message, const std::string& sender
  * Sends to both recipient and sender (for confirmation)
  */
 void ChatServer::sendPrivateMessage(const std::string& target, const std::string& message, const std::string& sender) {
-    std::lock_guard<std::mutex> lock(clients_mutex);
+    Tracer::Span span("private");
+    std::unique_lock<std::mutex> lock(clients_mutex, std::defer_lock);
+    {
+        Tracer::Span lock_span("lock");
+        lock.lock();
+    }
     
     auto it = clients.find(target);
     if (it != clients.end()) {
         // Format messages
-        std::string to_recipient = "[PRIVATE] " + sender + " -> You: " + message;
+        std::string to_recipient = LatencyTracker::route("private") + "[PRIVATE] " + sender + " -> You: " + message;
         std::string to_sender = "[PRIVATE] You -> " + target + ": " + message;
         
         // Encrypt if enabled
         if (Encryption::isEnabled()) {
+            Tracer::Span encrypt_span("encrypt");
             to_recipient = Encryption::encrypt(to_recipient);
             to_sender = Encryption::encrypt(to_sender);
         }
         
         // Send to both parties
-        send(it->second.socket_fd, to_recipient.c_str(), to_recipient.length(), 0);
+        Tracer::Span send_span("send");
+        int64_t enqueued = LatencyTracker::startDelivery(it->second.socket_fd);
+        TrafficShaper::sendChat(it->second.socket_fd, to_recipient);
+        LatencyTracker::delivered(enqueued);
         
         auto sender_it = clients.find(sender);
         if (sender_it != clients.end()) {
-            send(sender_it->second.socket_fd, to_sender.c_str(), to_sender.length(), 0);
+            TrafficShaper::sendChat(sender_it->second.socket_fd, to_sender);
         }
         
-        logEvent("Private message: " + sender + " -> " + target);
+        logEvent(LogEvent::PRIVATE_MESSAGE, sender, target);
     } else {
         // Target user not found
         std::string error_msg = "ERROR: User '" + target + "' not found or offline";
@@ -441,10 +1102,185 @@ void ChatServer::sendPrivateMessage(const std::string& target, const std::string
         
         auto sender_it = clients.find(sender);
         if (sender_it != clients.end()) {
-            send(sender_it->second.socket_fd, error_msg.c_str(), error_msg.length(), 0);
+            TrafficShaper::sendChat(sender_it->second.socket_fd, error_msg);
+        }
+        logEvent(LogEvent::PRIVATE_INVALID, target);
+    }
+}
+
+/**
+ * Publish or look up an end-to-end key
+ * ------------------------------------
+ * Usernames are at most 20 characters, so a 64-digit argument is a key
+ */
+void ChatServer::handlePublicKey(const std::string& argument, const std::string& sender_username, int sender_socket) {
+    std::string reply;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        if (EndToEnd::isKeyHex(argument)) {
+            auto it = clients.find(sender_username);
+            if (it != clients.end()) {
+                it->second.e2e_key = argument;
+            }
+            return;
+        }
+        
+        auto it = clients.find(argument);
+        reply = "/pubkey " + argument;
+        if (it != clients.end() && !it->second.e2e_key.empty()) {
+            reply += " " + it->second.e2e_key;
+        }
+    }
+    
+    if (Encryption::isEnabled()) {
+        reply = Encryption::encrypt(reply);
+    }
+    TrafficShaper::sendChat(sender_socket, reply);
+}
+
+/**
+ * Logging settings
+ * ----------------
+ * "/log" shows the settings, "/log <settings>" changes them
+ */
+void ChatServer::handleLogCommand(const std::string& settings, const std::string& sender_username, int sender_socket) {
+    std::string reply;
+    std::string error;
+    if (!isAdmin(sender_username)) {
+        reply = "ERROR: /log is for admins";
+    } else if (settings.empty()) {
+        reply = "Log settings: " + LogPolicy::describe();
+    } else if (LogPolicy::configure(settings, error)) {
+        reply = "Log settings: " + LogPolicy::describe();
+        logEvent(LogEvent::LOG_SETTINGS, sender_username, LogPolicy::describe());
+    } else {
+        reply = "ERROR: bad log setting '" + error + "'";
+    }
+    
+    if (Encryption::isEnabled()) {
+        reply = Encryption::encrypt(reply);
+    }
+    TrafficShaper::sendChat(sender_socket, reply);
+}
+
+/**
+ * Transport statistics
+ * --------------------
+ * "/conninfo" lists every connection, "/conninfo <user>" one
+ */
+void ChatServer::handleConnInfo(const std::string& target, const std::string& sender_username, int sender_socket) {
+    std::string reply;
+    if (!isAdmin(sender_username)) {
+        reply = "ERROR: /conninfo is for admins";
+    } else if (ConnectionMonitor::intervalMs() == 0) {
+        reply = "ERROR: Connection sampling is off (CHAT_CONN_SAMPLE_MS=0)";
+    } else {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        std::string rows;
+        for (const auto& pair : clients) {
+            if ((target.empty() || pair.first == target) && pair.second.transport) {
+                rows += "\n" + ConnectionMonitor::describe(*pair.second.transport);
+            }
+        }
+        reply = rows.empty()
+            ? "ERROR: User '" + target + "' not found or offline"
+            : "Connections (sampled every " + std::to_string(ConnectionMonitor::intervalMs()) + " ms)\n" +
+              ConnectionMonitor::header() + rows;
+    }
+    
+    if (Encryption::isEnabled()) {
+        reply = Encryption::encrypt(reply);
+    }
+    TrafficShaper::sendChat(sender_socket, reply);
+}
+
+/**
+ * Message tracing
+ * ---------------
+ * "/trace" shows the rate, "/trace <N>" samples one message in N per
+ * handler thread ("off" or 0 stops), "/trace dump" writes the buffered
+ * spans as Chrome trace JSON
+ */
+void ChatServer::handleTraceCommand(const std::string& argument, const std::string& sender_username,
+                                    int sender_socket) {
+    std::string reply;
+    if (!isAdmin(sender_username)) {
+        reply = "ERROR: /trace is for admins";
+    } else if (argument == "dump") {
+        std::string path;
+        size_t spans = Tracer::bufferedSpans();
+        reply = Tracer::dumpToFile(path)
+            ? "Trace: " + std::to_string(spans) + " spans written to " + path
+            : "ERROR: Could not write " + path;
+    } else if (!argument.empty()) {
+        long every = argument == "off" ? 0 : std::atol(argument.c_str());
+        if (every < 0 || (every == 0 && argument != "off" && argument != "0")) {
+            reply = "ERROR: Usage: /trace [N|off|dump]";
+        } else {
+            Tracer::setSampling(static_cast<uint32_t>(every));
+            std::string rate = every == 0 ? "off" : "1 in " + std::to_string(every);
+            logEvent(LogEvent::TRACE_SAMPLING, rate, sender_username);
+            reply = "Trace: sampling " + rate + (every == 0 ? "" : " messages per connection");
         }
-        logEvent("Failed private message to invalid user: " + target);
     }
+    if (reply.empty()) {
+        uint32_t every = Tracer::sampling();
+        reply = "Trace: sampling " + (every == 0 ? "off" : "1 in " + std::to_string(every) + " messages per connection") +
+                ", " + std::to_string(Tracer::bufferedSpans()) + " spans buffered";
+    }
+    
+    if (Encryption::isEnabled()) {
+        reply = Encryption::encrypt(reply);
+    }
+    TrafficShaper::sendChat(sender_socket, reply);
+}
+
+/**
+ * Forward an end-to-end message
+ * -----------------------------
+ * The body is never decrypted, re-encrypted, decoded or logged
+ */
+void ChatServer::forwardEndToEnd(const std::string& message, const std::string& sender, int sender_socket) {
+    // "/e2e <target> <key id> <body>"
+    size_t target_end = message.find(' ', 5);
+    size_t key_end = target_end == std::string::npos ? target_end : message.find(' ', target_end + 1);
+    if (key_end == std::string::npos) {
+        std::string error_msg = "ERROR: Invalid end-to-end message";
+        if (Encryption::isEnabled()) {
+            error_msg = Encryption::encrypt(error_msg);
+        }
+        TrafficShaper::sendChat(sender_socket, error_msg);
+        return;
+    }
+    std::string target = message.substr(5, target_end - 5);
+    size_t key_id_len = key_end - target_end - 1;
+    
+    std::string reply;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(target);
+        if (it == clients.end() || it->second.e2e_key.empty()) {
+            reply = "ERROR: User '" + target + "' not found or offline";
+        } else if (key_id_len != EndToEnd::KEY_ID_SIZE ||
+                   it->second.e2e_key.compare(0, key_id_len, message, target_end + 1, key_id_len) != 0) {
+            // Sealed for a key the target no longer has (they logged in again)
+            reply = "/pubkey " + target + " " + it->second.e2e_key + " stale";
+        } else {
+            std::string forwarded;
+            forwarded.reserve(11 + sender.size() + message.size() - key_end);
+            forwarded.append("/e2e_from ").append(sender).append(" ");
+            forwarded.append(message, key_end + 1, std::string::npos);
+            TrafficShaper::sendChat(it->second.socket_fd, forwarded);
+            logEvent(LogEvent::E2E_MESSAGE, sender, target, message.size() - key_end - 1);
+            return;
+        }
+    }
+    
+    if (Encryption::isEnabled()) {
+        reply = Encryption::encrypt(reply);
+    }
+    TrafficShaper::sendChat(sender_socket, reply);
+    logEvent(LogEvent::E2E_UNDELIVERED, sender, target);
 }
 
 /**
@@ -468,7 +1304,11 @@ std::string ChatServer::getActiveUsers() {
 void ChatServer::registerClient(const std::string& username, const ClientInfo& client) {
     std::lock_guard<std::mutex> lock(clients_mutex);
     clients[username] = client;
-    logEvent("Registered user: " + username + " (Total: " + std::to_string(clients.size()) + ")");
+    lobby.rekey = true;
+    if (client.transport) {
+        ConnectionMonitor::track(client.transport);
+    }
+    logEvent(LogEvent::USER_REGISTERED, username, clients.size());
 }
 
 /**
@@ -476,36 +1316,26 @@ void ChatServer::registerClient(const std::string& username, const ClientInfo& c
  */
 void ChatServer::deregisterClient(const std::string& username) {
     std::lock_guard<std::mutex> lock(clients_mutex);
-    clients.erase(username);
-    logEvent("Deregistered user: " + username + " (Remaining: " + std::to_string(clients.size()) + ")");
-}
-
-/**
- * Validate username format
- * ------------------------
- * Rules:
- * - Length: 1-20 characters
- * - Characters: a-z, A-Z, 0-9, underscore, hyphen
- * - Prevents injection attacks
- */
-bool ChatServer::isValidUsername(const std::string& username) {
-    if (username.empty() || username.length() > 20) {
-        return false;
+    auto client = clients.find(username);
+    if (client != clients.end() && client->second.transport) {
+        ConnectionMonitor::untrack(client->second.transport);
     }
-    
-    for (char c : username) {
-        if (!isalnum(c) && c != '_' && c != '-') {
-            return false;
+    clients.erase(username);
+    lobby.rekey = true;
+    for (auto it = rooms.begin(); it != rooms.end(); ) {
+        if (it->second.members.erase(username) > 0) {
+            it->second.rekey = true;
         }
+        it = it->second.members.empty() ? rooms.erase(it) : std::next(it);
     }
-    return true;
+    logEvent(LogEvent::USER_DEREGISTERED, username, clients.size());
 }
 
 /**
- * Log event with timestamp
+ * Validate username format (see Utils::isValidUsername)
  */
-void ChatServer::logEvent(const std::string& event) {
-    Utils::logEvent(event);
+bool ChatServer::isValidUsername(const std::string& username) {
+    return Utils::isValidUsername(username);
 }
 
 /**
@@ -513,11 +1343,40 @@ void ChatServer::logEvent(const std::string& event) {
  */
 void ChatServer::stop() {
     running = false;
+    ConnectionMonitor::stop();
     if (server_fd >= 0) {
         close(server_fd);
         server_fd = -1;
     }
-    logEvent("Server stopped");
+    logEvent(LogEvent::SERVER_STOPPED);
+}
+
+/**
+ * Flush the log on Ctrl+C / SIGTERM
+ * Log lines are written in the background, so dying on the spot would
+ * lose the last few. Both signals are blocked in every thread (call
+ * before any thread starts) and taken here with sigwait(); after the
+ * flush the signal is raised again with its default action, so the
+ * exit status is unchanged.
+ */
+static void flushLogOnTermination() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::thread([signals]() {
+        int sig = 0;
+        if (sigwait(&signals, &sig) != 0) {
+            return;
+        }
+        Utils::logEvent(LogEvent::SERVER_STOPPING, strsignal(sig));
+        AsyncLogger::shutdown();
+        std::signal(sig, SIG_DFL);
+        pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+        raise(sig);
+    }).detach();
 }
 
 /**
@@ -525,12 +1384,46 @@ void ChatServer::stop() {
  * =============
  * Entry point for the server application
  */
-int main() {
+int main(int argc, char* argv[]) {
+    // --selftest: check every SIMD kernel variant against scalar and exit
+    if (argc > 1 && std::string(argv[1]) == "--selftest") {
+        return CpuDispatch::runSelfTests() ? 0 : 1;
+    }
+    // --bench: throughput of every SIMD kernel variant
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        CpuDispatch::runBenchmarks();
+        return 0;
+    }
+    
+    flushLogOnTermination();
+    
     std::cout << "========================================" << std::endl;
     std::cout << "   Network Chat Server - Enhanced" << std::endl;
     std::cout << "   Features: Multi-threaded, Encrypted" << std::endl;
     std::cout << "========================================" << std::endl;
     
+    // Bandwidth limits for relayed file data (CHAT_RATE_* environment variables)
+    TrafficShaper::configureFromEnvironment();
+    
+    // Log levels, chat rate limit and content redaction (CHAT_LOG_* variables)
+    LogPolicy::configureFromEnvironment();
+    
+    // Transport sampling and slow-connection thresholds (CHAT_CONN_SAMPLE_MS, CHAT_SLOW_*)
+    ConnectionMonitor::configureFromEnvironment();
+    
+    // Sampled per-message spans (CHAT_TRACE_SAMPLE, 1 in N)
+    Tracer::configureFromEnvironment();
+    
+    // Optional TLS listener (CHAT_TLS_CERT / CHAT_TLS_KEY, make TLS=1)
+    if (!TlsTransport::initServer()) {
+        std::cerr << "Failed to set up TLS" << std::endl;
+        return 1;
+    }
+    if (TlsTransport::serverEnabled()) {
+        std::cout << "TLS: enabled, kernel offload "
+                  << (TlsTransport::kernelOffloadAvailable() ? "available" : "unavailable (userspace fallback)") << std::endl;
+    }
+    
     ChatServer server(5000);
     
     if (!server.start()) {
@@ -538,6 +1431,16 @@ int main() {
         return 1;
     }
     
+    // Prometheus endpoint on 127.0.0.1 (CHAT_METRICS_PORT)
+    if (!MetricsExporter::startFromEnvironment()) {
+        return 1;
+    }
+    if (MetricsExporter::port() > 0) {
+        std::cout << "Metrics: http://127.0.0.1:" << MetricsExporter::port() << "/metrics" << std::endl;
+    }
+    
+    std::cout << "SIMD: " << CpuDispatch::levelName(CpuDispatch::active()) << " ("
+              << CpuDispatch::levelName(CpuDispatch::detected()) << " supported)" << std::endl;
     std::cout << "\nServer is running. Press Ctrl+C to stop.\n" << std::endl;
     server.run();
     
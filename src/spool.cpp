@@ -0,0 +1,301 @@
+#include "../include/spool.hpp"
+#include "../include/utils.hpp"
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * STORE-AND-FORWARD SPOOL IMPLEMENTATION
+ * ======================================
+ *
+ * Entries move through three states on disk:
+ *   1. <id>.part  - reserve() created it, upload is streaming
+ *   2. <id>.dat + <id>.meta - commit() succeeded, waiting for login
+ *   3. (deleted)  - delivered, expired, or failed
+ *
+ * Only entries with a .meta file are ever delivered, and .meta is
+ * written after the payload is complete, so a crash mid-upload never
+ * hands a truncated file to the recipient. What such a crash leaves (a
+ * .part, or a .dat whose .meta was never written) is expired by mtime.
+ */
+
+FileSpool::FileSpool(const std::string& root_dir, long quota, int files, long expiry,
+                     long all_quota, int all_files)
+    : root(root_dir), user_quota(quota), max_files(files), total_quota(all_quota),
+      total_files(all_files), expiry_seconds(expiry), sequence(0) {
+}
+
+std::string FileSpool::userDir(const std::string& recipient) const {
+    return root + "/" + recipient;
+}
+
+/**
+ * Parse every .meta file in the recipient's spool directory
+ * Entries are returned oldest first so delivery preserves send order
+ */
+std::vector<SpoolEntry> FileSpool::listEntriesLocked(const std::string& recipient) {
+    std::vector<SpoolEntry> entries;
+    std::string dir = userDir(recipient);
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return entries;
+    }
+
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        std::string name = ent->d_name;
+        if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".meta") != 0) {
+            continue;
+        }
+
+        SpoolEntry entry;
+        entry.id = name.substr(0, name.size() - 5);
+        entry.recipient = recipient;
+        entry.data_path = dir + "/" + entry.id + ".dat";
+
+        std::ifstream meta(dir + "/" + name);
+        std::string line;
+        while (std::getline(meta, line)) {
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) continue;
+            std::string key = line.substr(0, eq);
+            std::string value = line.substr(eq + 1);
+
+            if (key == "sender") entry.sender = value;
+            else if (key == "filename") entry.filename = value;
+            else if (key == "size") entry.size = std::atol(value.c_str());
+            else if (key == "entries") entry.entries = std::atoi(value.c_str());
+            else if (key == "chunked") entry.chunked = value == "1";
+            else if (key == "created") entry.created = static_cast<time_t>(std::atoll(value.c_str()));
+        }
+        entries.push_back(entry);
+    }
+    closedir(d);
+
+    std::sort(entries.begin(), entries.end(), [](const SpoolEntry& a, const SpoolEntry& b) {
+        return a.created != b.created ? a.created < b.created : a.id < b.id;
+    });
+    return entries;
+}
+
+void FileSpool::removeEntryLocked(const SpoolEntry& entry) {
+    std::string dir = userDir(entry.recipient);
+    std::remove((dir + "/" + entry.id + ".meta").c_str());
+    std::remove((dir + "/" + entry.id + ".dat").c_str());
+    rmdir(dir.c_str());  // Only succeeds once the directory is empty
+}
+
+/**
+ * Payloads with no .meta: a .part no upload is writing any more, or a
+ * .dat whose .meta was never written
+ */
+int FileSpool::pruneOrphansLocked(const std::string& recipient, time_t cutoff) {
+    std::string dir = userDir(recipient);
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return 0;
+    }
+
+    std::vector<std::string> names;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        names.push_back(ent->d_name);
+    }
+    closedir(d);
+
+    int pruned = 0;
+    for (const auto& name : names) {
+        bool part = name.size() > 5 && name.compare(name.size() - 5, 5, ".part") == 0;
+        bool dat = name.size() > 4 && name.compare(name.size() - 4, 4, ".dat") == 0;
+        std::string path = dir + "/" + name;
+        std::string id = name.substr(0, name.rfind('.'));
+        struct stat st;
+        if ((!part && !dat) || (part && uploading.count(path)) ||
+            (dat && access((dir + "/" + id + ".meta").c_str(), F_OK) == 0) ||
+            stat(path.c_str(), &st) != 0 || st.st_mtime >= cutoff) {
+            continue;
+        }
+        if (std::remove(path.c_str()) == 0) {
+            Utils::logEvent(LogEvent::SPOOL_EXPIRED, name, recipient);
+            pruned++;
+        }
+    }
+    rmdir(dir.c_str());  // Only succeeds once the directory is empty
+    return pruned;
+}
+
+void FileSpool::usageLocked(long& bytes, int& files) {
+    bytes = 0;
+    files = static_cast<int>(uploading.size());
+    for (const auto& user : reserved) {
+        bytes += user.second;
+    }
+
+    DIR* d = opendir(root.c_str());
+    if (!d) {
+        return;
+    }
+    std::vector<std::string> users;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        std::string name = ent->d_name;
+        if (name != "." && name != "..") {
+            users.push_back(name);
+        }
+    }
+    closedir(d);
+
+    for (const auto& user : users) {
+        for (const auto& e : listEntriesLocked(user)) {
+            bytes += e.size;
+            files++;
+        }
+    }
+}
+
+/**
+ * Reserve quota for an upload
+ * ---------------------------
+ * Counts both queued entries and uploads still streaming, so two
+ * concurrent senders cannot jointly exceed the recipient's quota, nor
+ * uploads to many recipients the spool-wide one.
+ */
+bool FileSpool::reserve(SpoolEntry& entry, std::string& error) {
+    pruneExpired();
+
+    std::lock_guard<std::mutex> lock(spool_mutex);
+
+    std::vector<SpoolEntry> queued = listEntriesLocked(entry.recipient);
+    long used = reserved[entry.recipient];
+    for (const auto& e : queued) {
+        used += e.size;
+    }
+
+    if (static_cast<int>(queued.size()) >= max_files) {
+        error = "spool full for " + entry.recipient + " (" + std::to_string(max_files) + " files queued)";
+        return false;
+    }
+    if (used + entry.size > user_quota) {
+        error = "spool quota exceeded for " + entry.recipient + " (" +
+                Utils::formatFileSize(user_quota - used) + " left)";
+        return false;
+    }
+
+    long all_used;
+    int all_queued;
+    usageLocked(all_used, all_queued);
+    if (all_queued >= total_files || all_used + entry.size > total_quota) {
+        error = "server spool is full";
+        return false;
+    }
+
+    // Create spool/<recipient>/ on demand
+    std::string dir = userDir(entry.recipient);
+    if ((mkdir(root.c_str(), 0700) == -1 && errno != EEXIST) ||
+        (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST)) {
+        error = "cannot create spool directory";
+        return false;
+    }
+
+    entry.created = time(nullptr);
+    entry.id = std::to_string(entry.created) + "_" + std::to_string(++sequence);
+    entry.data_path = dir + "/" + entry.id + ".part";
+    reserved[entry.recipient] += entry.size;
+    uploading.insert(entry.data_path);
+    return true;
+}
+
+/**
+ * Finalize an upload
+ * ------------------
+ * Payload is renamed before the .meta file is written: a .meta file
+ * therefore always points at a complete .dat file.
+ */
+bool FileSpool::commit(SpoolEntry& entry, bool success) {
+    std::lock_guard<std::mutex> lock(spool_mutex);
+
+    reserved[entry.recipient] -= entry.size;
+    if (reserved[entry.recipient] <= 0) {
+        reserved.erase(entry.recipient);
+    }
+    uploading.erase(entry.data_path);
+
+    std::string dir = userDir(entry.recipient);
+    std::string final_path = dir + "/" + entry.id + ".dat";
+
+    if (!success || std::rename(entry.data_path.c_str(), final_path.c_str()) != 0) {
+        std::remove(entry.data_path.c_str());
+        rmdir(dir.c_str());
+        return false;
+    }
+    entry.data_path = final_path;
+
+    std::ofstream meta(dir + "/" + entry.id + ".meta");
+    meta << "sender=" << entry.sender << "\n"
+         << "filename=" << entry.filename << "\n"
+         << "size=" << entry.size << "\n"
+         << "entries=" << entry.entries << "\n"
+         << "chunked=" << (entry.chunked ? 1 : 0) << "\n"
+         << "created=" << static_cast<long long>(entry.created) << "\n";
+    meta.close();
+
+    if (meta.fail()) {
+        removeEntryLocked(entry);
+        return false;
+    }
+    return true;
+}
+
+std::vector<SpoolEntry> FileSpool::pending(const std::string& recipient) {
+    std::lock_guard<std::mutex> lock(spool_mutex);
+    return listEntriesLocked(recipient);
+}
+
+void FileSpool::remove(const SpoolEntry& entry) {
+    std::lock_guard<std::mutex> lock(spool_mutex);
+    removeEntryLocked(entry);
+}
+
+/**
+ * Prune expired entries across all recipients
+ * -------------------------------------------
+ * Called on every reservation and login, so the spool stays bounded
+ * without a dedicated cleanup thread.
+ */
+int FileSpool::pruneExpired() {
+    std::lock_guard<std::mutex> lock(spool_mutex);
+
+    DIR* d = opendir(root.c_str());
+    if (!d) {
+        return 0;
+    }
+
+    std::vector<std::string> users;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        std::string name = ent->d_name;
+        if (name != "." && name != "..") {
+            users.push_back(name);
+        }
+    }
+    closedir(d);
+
+    time_t cutoff = time(nullptr) - expiry_seconds;
+    int pruned = 0;
+    for (const auto& user : users) {
+        for (const auto& entry : listEntriesLocked(user)) {
+            if (entry.created < cutoff) {
+                removeEntryLocked(entry);
+                Utils::logEvent(LogEvent::SPOOL_EXPIRED, entry.filename, user);
+                pruned++;
+            }
+        }
+        pruned += pruneOrphansLocked(user, cutoff);
+    }
+    return pruned;
+}
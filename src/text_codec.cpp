@@ -0,0 +1,821 @@
+#include "../include/text_codec.hpp"
+#include "../include/cpu_dispatch.hpp"
+#include <cstring>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEXT_CODEC_X86 1
+#endif
+
+/**
+ * HEX / BASE64 CODEC IMPLEMENTATION
+ * =================================
+ *
+ * Every kernel consumes a prefix of its input in whole units (hex: byte
+ * pairs, base64: 3-byte groups / 4-char quads) and returns how much it
+ * took; the scalar code finishes the rest. Decoding kernels stop before
+ * the first vector holding anything outside the alphabet, so the scalar
+ * code is also what finds (and rejects) bad characters and handles the
+ * padded last quad - validation rules live in one place.
+ *
+ * Vector techniques:
+ * - hex encode: split bytes into nibbles, PSHUFB them through the
+ *   16-digit table, interleave high and low digits
+ * - hex/base64 decode: classify each char with signed range compares
+ *   (bytes >= 0x80 are negative and fall outside every range), add a
+ *   per-class offset to get its value, then merge neighbours with
+ *   PMADDUBSW (x16 + y, or x64 + y) and pack
+ * - base64 encode: shuffle each 3 bytes into a 32-bit lane, move the
+ *   four 6-bit fields to byte boundaries with two 16-bit multiplies,
+ *   then map indices to ASCII with a PSHUFB offset table (Mula/Lemire)
+ *
+ * Base64 decode kernels store 16 bytes per 12 decoded; they only run
+ * while enough input follows that the spare bytes land inside the
+ * caller's buffer and are overwritten later.
+ */
+
+namespace {
+
+const char HEX_LOWER[] = "0123456789abcdef";
+const char HEX_UPPER[] = "0123456789ABCDEF";
+constexpr char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Reverse lookups: digit / sextet value of each byte, or -1
+ */
+struct DecodeTables {
+    int8_t hex[256];
+    int8_t base64[256];
+
+    constexpr DecodeTables() : hex(), base64() {
+        for (int c = 0; c < 256; c++) {
+            hex[c] = -1;
+            base64[c] = -1;
+        }
+        for (int i = 0; i < 10; i++) {
+            hex['0' + i] = static_cast<int8_t>(i);
+        }
+        for (int i = 0; i < 6; i++) {
+            hex['a' + i] = static_cast<int8_t>(10 + i);
+            hex['A' + i] = static_cast<int8_t>(10 + i);
+        }
+        for (int i = 0; i < 64; i++) {
+            base64[static_cast<unsigned char>(BASE64_ALPHABET[i])] = static_cast<int8_t>(i);
+        }
+    }
+};
+
+constexpr DecodeTables TABLES;
+
+inline int hexValue(char c) {
+    return TABLES.hex[static_cast<unsigned char>(c)];
+}
+
+inline int base64Value(char c) {
+    return TABLES.base64[static_cast<unsigned char>(c)];
+}
+
+typedef size_t (*HexEncodeKernel)(const uint8_t* in, size_t len, char* out, const char* digits);
+typedef size_t (*HexDecodeKernel)(const char* in, size_t len, uint8_t* out);
+typedef size_t (*Base64EncodeKernel)(const uint8_t* in, size_t len, char* out);
+typedef size_t (*Base64DecodeKernel)(const char* in, size_t len, uint8_t* out);
+
+/* ---------- Scalar ---------- */
+
+size_t hexEncodeScalar(const uint8_t* in, size_t len, char* out, const char* digits) {
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0F];
+    }
+    return len;
+}
+
+size_t hexDecodeScalar(const char* in, size_t len, uint8_t* out) {
+    size_t i = 0;
+    for (; i + 2 <= len; i += 2) {
+        int hi = hexValue(in[i]);
+        int lo = hexValue(in[i + 1]);
+        if ((hi | lo) < 0) {
+            break;
+        }
+        out[i / 2] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return i;
+}
+
+size_t base64EncodeScalar(const uint8_t* in, size_t len, char* out) {
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3, out += 4) {
+        uint32_t group = (static_cast<uint32_t>(in[i]) << 16) | (static_cast<uint32_t>(in[i + 1]) << 8) | in[i + 2];
+        out[0] = BASE64_ALPHABET[group >> 18];
+        out[1] = BASE64_ALPHABET[(group >> 12) & 0x3F];
+        out[2] = BASE64_ALPHABET[(group >> 6) & 0x3F];
+        out[3] = BASE64_ALPHABET[group & 0x3F];
+    }
+    return i;
+}
+
+/**
+ * Whole quads of alphabet characters only (stops at '=' or anything else)
+ */
+size_t base64DecodeScalar(const char* in, size_t len, uint8_t* out) {
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4, out += 3) {
+        int a = base64Value(in[i]), b = base64Value(in[i + 1]);
+        int c = base64Value(in[i + 2]), d = base64Value(in[i + 3]);
+        if ((a | b | c | d) < 0) {
+            break;
+        }
+        uint32_t group = (static_cast<uint32_t>(a) << 18) | (b << 12) | (c << 6) | d;
+        out[0] = static_cast<uint8_t>(group >> 16);
+        out[1] = static_cast<uint8_t>(group >> 8);
+        out[2] = static_cast<uint8_t>(group);
+    }
+    return i;
+}
+
+/**
+ * Encodes the last 1 or 2 bytes as a padded quad
+ */
+void base64EncodeTail(const uint8_t* in, size_t len, char* out) {
+    uint32_t group = static_cast<uint32_t>(in[0]) << 16;
+    if (len == 2) {
+        group |= static_cast<uint32_t>(in[1]) << 8;
+    }
+    out[0] = BASE64_ALPHABET[group >> 18];
+    out[1] = BASE64_ALPHABET[(group >> 12) & 0x3F];
+    out[2] = (len == 2) ? BASE64_ALPHABET[(group >> 6) & 0x3F] : '=';
+    out[3] = '=';
+}
+
+/**
+ * Decodes one quad that may carry padding ("xx==", "xxx=")
+ * @return Bytes written (1-3; fewer than 3 means padded), -1 if malformed
+ */
+int base64DecodeQuad(const char* quad, uint8_t* out) {
+    int a = base64Value(quad[0]), b = base64Value(quad[1]);
+    if ((a | b) < 0) {
+        return -1;
+    }
+    out[0] = static_cast<uint8_t>((a << 2) | (b >> 4));
+    if (quad[2] == '=') {
+        // Bits of b below the first byte must be zero, or two encodings would decode alike
+        return (quad[3] == '=' && (b & 0x0F) == 0) ? 1 : -1;
+    }
+    int c = base64Value(quad[2]);
+    if (c < 0) {
+        return -1;
+    }
+    out[1] = static_cast<uint8_t>(((b & 0x0F) << 4) | (c >> 2));
+    if (quad[3] == '=') {
+        return (c & 0x03) == 0 ? 2 : -1;
+    }
+    int d = base64Value(quad[3]);
+    if (d < 0) {
+        return -1;
+    }
+    out[2] = static_cast<uint8_t>(((c & 0x03) << 6) | d);
+    return 3;
+}
+
+#ifdef TEXT_CODEC_X86
+/* ---------- SSSE3 ---------- */
+
+__attribute__((target("ssse3")))
+inline __m128i inRange128(__m128i c, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                         _mm_cmplt_epi8(c, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+
+/**
+ * Hex digit values of 16 chars; valid gets 0xFF for each hex digit
+ */
+__attribute__((target("ssse3")))
+inline __m128i hexValues128(__m128i c, __m128i& valid) {
+    __m128i folded = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i digit = inRange128(c, '0', '9');
+    __m128i alpha = inRange128(folded, 'a', 'f');
+    valid = _mm_or_si128(digit, alpha);
+    return _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                        _mm_and_si128(alpha, _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10))));
+}
+
+/**
+ * Base64 sextet values of 16 chars; valid gets 0xFF for each alphabet char
+ */
+__attribute__((target("ssse3")))
+inline __m128i base64Values128(__m128i c, __m128i& valid) {
+    __m128i upper = inRange128(c, 'A', 'Z');
+    __m128i lower = inRange128(c, 'a', 'z');
+    __m128i digit = inRange128(c, '0', '9');
+    __m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+    __m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+    valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+    __m128i shift = _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71)));
+    shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+    shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(19)));
+    shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(16)));
+    return _mm_add_epi8(c, shift);
+}
+
+__attribute__((target("ssse3")))
+size_t hexEncodeSsse3(const uint8_t* in, size_t len, char* out, const char* digits) {
+    const __m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(digits));
+    const __m128i low4 = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+        __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(v, low4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t hexDecodeSsse3(const char* in, size_t len, uint8_t* out) {
+    const __m128i weights = _mm_set1_epi16(0x0110);    // high digit x16, low digit x1
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m128i valid0, valid1;
+        __m128i v0 = hexValues128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), valid0);
+        __m128i v1 = hexValues128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16)), valid1);
+        if (_mm_movemask_epi8(_mm_and_si128(valid0, valid1)) != 0xFFFF) {
+            break;
+        }
+        __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(v0, weights), _mm_maddubs_epi16(v1, weights));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 2), bytes);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t base64EncodeSsse3(const uint8_t* in, size_t len, char* out) {
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i ascii = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                        '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 12, out += 16) {     // Loads 16, uses 12
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), spread);
+        __m128i ac = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+        __m128i bd = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(ac, bd);
+
+        // Class 0: a-z, 1-10: 0-9, 11: '+', 12: '/', 13: A-Z
+        __m128i cls = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        cls = _mm_or_si128(cls, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+        __m128i chars = _mm_add_epi8(indices, _mm_shuffle_epi8(ascii, cls));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3")))
+size_t base64DecodeSsse3(const char* in, size_t len, uint8_t* out) {
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 24 <= len; i += 16, out += 12) {     // Stores 16, keeps 12
+        __m128i valid;
+        __m128i v = base64Values128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF) {
+            break;
+        }
+        __m128i merged = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));     // a x64 + b, c x64 + d
+        merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));           // ab x4096 + cd
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(merged, pack));
+    }
+    return i;
+}
+
+/* ---------- AVX2 ---------- */
+
+__attribute__((target("avx2")))
+inline __m256i inRange256(__m256i c, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), c));
+}
+
+__attribute__((target("avx2")))
+inline __m256i hexValues256(__m256i c, __m256i& valid) {
+    __m256i folded = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i digit = inRange256(c, '0', '9');
+    __m256i alpha = inRange256(folded, 'a', 'f');
+    valid = _mm256_or_si256(digit, alpha);
+    return _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(c, _mm256_set1_epi8('0'))),
+                           _mm256_and_si256(alpha, _mm256_sub_epi8(folded, _mm256_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("avx2")))
+inline __m256i base64Values256(__m256i c, __m256i& valid) {
+    __m256i upper = inRange256(c, 'A', 'Z');
+    __m256i lower = inRange256(c, 'a', 'z');
+    __m256i digit = inRange256(c, '0', '9');
+    __m256i plus = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+    __m256i slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+    valid = _mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+    __m256i shift = _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65)),
+                                    _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(19)));
+    shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(16)));
+    return _mm256_add_epi8(c, shift);
+}
+
+__attribute__((target("avx2")))
+size_t hexEncodeAvx2(const uint8_t* in, size_t len, char* out, const char* digits) {
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(digits)));
+    const __m256i low4 = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4));
+        __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low4));
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);      // bytes 0-7 | 16-23
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);      // bytes 8-15 | 24-31
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t hexDecodeAvx2(const char* in, size_t len, uint8_t* out) {
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i valid0, valid1;
+        __m256i v0 = hexValues256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), valid0);
+        __m256i v1 = hexValues256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 32)), valid1);
+        if (_mm256_movemask_epi8(_mm256_and_si256(valid0, valid1)) != -1) {
+            break;
+        }
+        // packus works per 128-bit lane: restore order with a cross-lane permute
+        __m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(v0, weights), _mm256_maddubs_epi16(v1, weights));
+        bytes = _mm256_permute4x64_epi64(bytes, 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 2), bytes);
+    }
+    return i;
+}
+
+/**
+ * Two SSSE3 steps side by side: lane 0 encodes in[i..i+12), lane 1
+ * in[i+12..i+24)
+ */
+__attribute__((target("avx2")))
+size_t base64EncodeAvx2(const uint8_t* in, size_t len, char* out) {
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i ascii = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    for (; i + 28 <= len; i += 24, out += 32) {
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12)), 1);
+        v = _mm256_shuffle_epi8(v, spread);
+        __m256i ac = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)),
+                                        _mm256_set1_epi32(0x04000040));
+        __m256i bd = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)),
+                                        _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(ac, bd);
+        __m256i cls = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        cls = _mm256_or_si256(cls, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                                                    _mm256_set1_epi8(13)));
+        __m256i chars = _mm256_add_epi8(indices, _mm256_shuffle_epi8(ascii, cls));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chars);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t base64DecodeAvx2(const char* in, size_t len, uint8_t* out) {
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 40 <= len; i += 32, out += 24) {     // Stores 28, keeps 24
+        __m256i valid;
+        __m256i v = base64Values256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), valid);
+        if (_mm256_movemask_epi8(valid) != -1) {
+            break;
+        }
+        __m256i merged = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_shuffle_epi8(_mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000)), pack);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(merged));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12), _mm256_extracti128_si256(merged, 1));
+    }
+    return i;
+}
+#endif
+
+const KernelVariant<HexEncodeKernel> HEX_ENCODE_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", hexEncodeScalar},
+#ifdef TEXT_CODEC_X86
+    {SimdLevel::SSE42, "ssse3", hexEncodeSsse3},
+    {SimdLevel::AVX2, "avx2", hexEncodeAvx2},
+#endif
+};
+
+const KernelVariant<HexDecodeKernel> HEX_DECODE_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", hexDecodeScalar},
+#ifdef TEXT_CODEC_X86
+    {SimdLevel::SSE42, "ssse3", hexDecodeSsse3},
+    {SimdLevel::AVX2, "avx2", hexDecodeAvx2},
+#endif
+};
+
+const KernelVariant<Base64EncodeKernel> BASE64_ENCODE_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", base64EncodeScalar},
+#ifdef TEXT_CODEC_X86
+    {SimdLevel::SSE42, "ssse3", base64EncodeSsse3},
+    {SimdLevel::AVX2, "avx2", base64EncodeAvx2},
+#endif
+};
+
+const KernelVariant<Base64DecodeKernel> BASE64_DECODE_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", base64DecodeScalar},
+#ifdef TEXT_CODEC_X86
+    {SimdLevel::SSE42, "ssse3", base64DecodeSsse3},
+    {SimdLevel::AVX2, "avx2", base64DecodeAvx2},
+#endif
+};
+
+HexEncodeKernel hexEncodeKernel() {
+    static const HexEncodeKernel kernel = CpuDispatch::select("hex.encode", HEX_ENCODE_VARIANTS).fn;
+    return kernel;
+}
+
+HexDecodeKernel hexDecodeKernel() {
+    static const HexDecodeKernel kernel = CpuDispatch::select("hex.decode", HEX_DECODE_VARIANTS).fn;
+    return kernel;
+}
+
+Base64EncodeKernel base64EncodeKernel() {
+    static const Base64EncodeKernel kernel = CpuDispatch::select("base64.encode", BASE64_ENCODE_VARIANTS).fn;
+    return kernel;
+}
+
+Base64DecodeKernel base64DecodeKernel() {
+    static const Base64DecodeKernel kernel = CpuDispatch::select("base64.decode", BASE64_DECODE_VARIANTS).fn;
+    return kernel;
+}
+
+/* ---------- Kernel + scalar finish ---------- */
+
+void hexEncodeWith(HexEncodeKernel kernel, const uint8_t* in, size_t len, char* out, const char* digits) {
+    size_t done = kernel(in, len, out, digits);
+    hexEncodeScalar(in + done, len - done, out + 2 * done, digits);
+}
+
+/**
+ * @return Hex digits consumed; less than len means a bad character
+ */
+size_t hexDecodeWith(HexDecodeKernel kernel, const char* in, size_t len, uint8_t* out) {
+    size_t done = kernel(in, len, out);
+    return done + hexDecodeScalar(in + done, len - done, out + done / 2);
+}
+
+/**
+ * @return Bytes consumed (a multiple of 3; the caller encodes the rest)
+ */
+size_t base64EncodeWith(Base64EncodeKernel kernel, const uint8_t* in, size_t len, char* out) {
+    size_t done = kernel(in, len, out);
+    return done + base64EncodeScalar(in + done, len - done, out + done / 3 * 4);
+}
+
+/**
+ * @return Chars consumed (whole unpadded quads; stops at padding or a bad char)
+ */
+size_t base64DecodeWith(Base64DecodeKernel kernel, const char* in, size_t len, uint8_t* out) {
+    size_t done = kernel(in, len, out);
+    return done + base64DecodeScalar(in + done, len - done, out + done / 4 * 3);
+}
+
+size_t base64EncodeFull(Base64EncodeKernel kernel, const uint8_t* in, size_t len, char* out) {
+    size_t done = base64EncodeWith(kernel, in, len, out);
+    size_t written = done / 3 * 4;
+    if (done < len) {
+        base64EncodeTail(in + done, len - done, out + written);
+        written += 4;
+    }
+    return written;
+}
+
+bool base64DecodeFull(Base64DecodeKernel kernel, const char* in, size_t len, uint8_t* out, size_t& out_len) {
+    out_len = 0;
+    if (len % 4 != 0) {
+        return false;
+    }
+    if (len == 0) {
+        return true;
+    }
+    size_t body = len - 4;      // The last quad may be padded
+    if (base64DecodeWith(kernel, in, body, out) != body) {
+        return false;
+    }
+    int last = base64DecodeQuad(in + body, out + body / 4 * 3);
+    if (last < 0) {
+        return false;
+    }
+    out_len = body / 4 * 3 + static_cast<size_t>(last);
+    return true;
+}
+
+/* ---------- Self-tests ---------- */
+
+std::vector<uint8_t> randomBytes(std::mt19937& rng, size_t len) {
+    std::vector<uint8_t> bytes(len);
+    for (uint8_t& byte : bytes) byte = static_cast<uint8_t>(rng());
+    return bytes;
+}
+
+/**
+ * Test lengths: every length through a few vectors, then sparser
+ */
+size_t nextLength(size_t len) {
+    return len + (len < 300 ? 1 : 97);
+}
+
+bool testHexEncode() {
+    return CpuDispatch::testVariants("hex.encode", HEX_ENCODE_VARIANTS, [](HexEncodeKernel scalar, HexEncodeKernel variant) {
+        std::mt19937 rng(16);
+        for (size_t len = 0; len <= 3000; len = nextLength(len)) {
+            std::vector<uint8_t> data = randomBytes(rng, len + 1);
+            const char* digits = (len & 1) ? HEX_UPPER : HEX_LOWER;
+            std::string expected(2 * len, '\0'), actual(2 * len, '\0');
+            hexEncodeWith(scalar, data.data() + 1, len, &expected[0], digits);
+            hexEncodeWith(variant, data.data() + 1, len, &actual[0], digits);
+            if (expected != actual) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * Mixed-case digits; a third of the inputs get one character replaced
+ * by a random byte (which may or may not be a hex digit)
+ */
+bool testHexDecode() {
+    return CpuDispatch::testVariants("hex.decode", HEX_DECODE_VARIANTS, [](HexDecodeKernel scalar, HexDecodeKernel variant) {
+        std::mt19937 rng(61);
+        for (size_t len = 0; len <= 6000; len = nextLength(len)) {
+            std::string text(len, '0');
+            for (char& c : text) c = ((rng() & 1) ? HEX_UPPER : HEX_LOWER)[rng() % 16];
+            if (len && rng() % 3 == 0) {
+                text[rng() % len] = static_cast<char>(rng());
+            }
+            std::vector<uint8_t> expected(len / 2 + 1), actual(len / 2 + 1);
+            size_t expected_done = hexDecodeWith(scalar, text.data(), len, expected.data());
+            size_t actual_done = hexDecodeWith(variant, text.data(), len, actual.data());
+            if (expected_done != actual_done ||
+                std::memcmp(expected.data(), actual.data(), expected_done / 2) != 0) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+bool testBase64Encode() {
+    return CpuDispatch::testVariants("base64.encode", BASE64_ENCODE_VARIANTS,
+                                     [](Base64EncodeKernel scalar, Base64EncodeKernel variant) {
+        std::mt19937 rng(64);
+        for (size_t len = 0; len <= 3000; len = nextLength(len)) {
+            std::vector<uint8_t> data = randomBytes(rng, len + 3);
+            size_t start = rng() % 3;
+            std::string expected(TextCodec::base64EncodedSize(len), '\0'), actual(expected.size(), '\0');
+            base64EncodeFull(scalar, data.data() + start, len, &expected[0]);
+            base64EncodeFull(variant, data.data() + start, len, &actual[0]);
+            if (expected != actual) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * Valid encodings of every length, some with one character replaced
+ * by a random byte, '=' or whitespace
+ */
+bool testBase64Decode() {
+    return CpuDispatch::testVariants("base64.decode", BASE64_DECODE_VARIANTS,
+                                     [](Base64DecodeKernel scalar, Base64DecodeKernel variant) {
+        std::mt19937 rng(46);
+        for (size_t len = 0; len <= 3000; len = nextLength(len)) {
+            std::vector<uint8_t> data = randomBytes(rng, len);
+            std::string text(TextCodec::base64EncodedSize(len), '\0');
+            base64EncodeFull(base64EncodeScalar, data.data(), len, &text[0]);
+            if (!text.empty() && rng() % 3 == 0) {
+                static const char replacements[] = {'=', ' ', '\n', '-', '_', '\x80'};
+                char bad = (rng() & 1) ? replacements[rng() % sizeof(replacements)] : static_cast<char>(rng());
+                text[rng() % text.size()] = bad;
+            }
+            std::vector<uint8_t> expected(len + 3), actual(len + 3);
+            size_t expected_len, actual_len;
+            bool expected_ok = base64DecodeFull(scalar, text.data(), text.size(), expected.data(), expected_len);
+            bool actual_ok = base64DecodeFull(variant, text.data(), text.size(), actual.data(), actual_len);
+            if (expected_ok != actual_ok ||
+                (expected_ok && (expected_len != actual_len ||
+                                 std::memcmp(expected.data(), actual.data(), expected_len) != 0))) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * Per-variant throughput on a message-sized and a file-sized buffer.
+ * Rates are MB/s of binary data on both sides of the codec.
+ */
+void benchTextCodec() {
+    static const size_t SIZES[] = {1024, 1024 * 1024};
+    std::mt19937 rng(7);
+    std::vector<uint8_t> data = randomBytes(rng, SIZES[1]);
+    std::vector<uint8_t> decoded(SIZES[1] + 16);
+    std::string hex(TextCodec::hexEncodedSize(SIZES[1]), '\0');
+    std::string base64(TextCodec::base64EncodedSize(SIZES[1]), '\0');
+    hexEncodeWith(hexEncodeScalar, data.data(), data.size(), &hex[0], HEX_LOWER);
+    base64EncodeFull(base64EncodeScalar, data.data(), data.size(), &base64[0]);
+    auto rates = [&](const std::function<void(size_t)>& op) {
+        char line[128];
+        int used = 0;
+        for (size_t size : SIZES) {
+            double rate = CpuDispatch::throughput(size, [&]() { op(size); });
+            used += snprintf(line + used, sizeof(line) - used, "%8zu B %8.0f MB/s", size, rate);
+        }
+        return std::string(line);
+    };
+
+    CpuDispatch::benchVariants("hex.encode", HEX_ENCODE_VARIANTS, [&](HexEncodeKernel kernel) {
+        return rates([&](size_t size) { hexEncodeWith(kernel, data.data(), size, &hex[0], HEX_LOWER); });
+    });
+    CpuDispatch::benchVariants("hex.decode", HEX_DECODE_VARIANTS, [&](HexDecodeKernel kernel) {
+        return rates([&](size_t size) { hexDecodeWith(kernel, hex.data(), 2 * size, decoded.data()); });
+    });
+    CpuDispatch::benchVariants("base64.encode", BASE64_ENCODE_VARIANTS, [&](Base64EncodeKernel kernel) {
+        return rates([&](size_t size) { base64EncodeFull(kernel, data.data(), size, &base64[0]); });
+    });
+    // Whole quads of the 1 MB encoding decode on their own, so each size
+    // decodes the unpadded prefix covering size / 3 * 3 bytes
+    CpuDispatch::benchVariants("base64.decode", BASE64_DECODE_VARIANTS, [&](Base64DecodeKernel kernel) {
+        return rates([&](size_t size) {
+            size_t out_len;
+            base64DecodeFull(kernel, base64.data(), size / 3 * 4, decoded.data(), out_len);
+        });
+    });
+}
+
+const bool hex_encode_registered = CpuDispatch::registerSelfTest("hex.encode", testHexEncode);
+const bool hex_decode_registered = CpuDispatch::registerSelfTest("hex.decode", testHexDecode);
+const bool base64_encode_registered = CpuDispatch::registerSelfTest("base64.encode", testBase64Encode);
+const bool base64_decode_registered = CpuDispatch::registerSelfTest("base64.decode", testBase64Decode);
+const bool text_codec_bench_registered = CpuDispatch::registerBenchmark("hex/base64", benchTextCodec);
+
+}  // namespace
+
+void TextCodec::hexEncode(const uint8_t* in, size_t len, char* out, bool upper) {
+    hexEncodeWith(hexEncodeKernel(), in, len, out, upper ? HEX_UPPER : HEX_LOWER);
+}
+
+bool TextCodec::hexDecode(const char* in, size_t len, uint8_t* out) {
+    return len % 2 == 0 && hexDecodeWith(hexDecodeKernel(), in, len, out) == len;
+}
+
+size_t TextCodec::base64Encode(const uint8_t* in, size_t len, char* out) {
+    return base64EncodeFull(base64EncodeKernel(), in, len, out);
+}
+
+bool TextCodec::base64Decode(const char* in, size_t len, uint8_t* out, size_t& out_len) {
+    return base64DecodeFull(base64DecodeKernel(), in, len, out, out_len);
+}
+
+size_t TextCodec::HexDecoder::update(const char* in, size_t len, uint8_t* out) {
+    if (failed || len == 0) {
+        return 0;
+    }
+    size_t written = 0;
+    if (has_pending) {
+        int lo = hexValue(in[0]);
+        if (lo < 0) {
+            failed = true;
+            return 0;
+        }
+        out[written++] = static_cast<uint8_t>((hexValue(pending) << 4) | lo);
+        has_pending = false;
+        in++;
+        len--;
+    }
+
+    size_t whole = len & ~static_cast<size_t>(1);
+    size_t done = hexDecodeWith(hexDecodeKernel(), in, whole, out + written);
+    if (done != whole) {
+        failed = true;
+        return 0;
+    }
+    written += whole / 2;
+
+    if (whole < len) {
+        if (hexValue(in[whole]) < 0) {
+            failed = true;
+            return 0;
+        }
+        pending = in[whole];
+        has_pending = true;
+    }
+    return written;
+}
+
+size_t TextCodec::Base64Encoder::update(const uint8_t* in, size_t len, char* out) {
+    size_t written = 0;
+    if (carry_len) {
+        size_t need = 3 - carry_len;
+        if (len < need) {
+            std::memcpy(carry + carry_len, in, len);
+            carry_len += len;
+            return 0;
+        }
+        uint8_t group[3];
+        std::memcpy(group, carry, carry_len);
+        std::memcpy(group + carry_len, in, need);
+        base64EncodeScalar(group, 3, out);
+        written = 4;
+        carry_len = 0;
+        in += need;
+        len -= need;
+    }
+
+    size_t done = base64EncodeWith(base64EncodeKernel(), in, len, out + written);
+    written += done / 3 * 4;
+    carry_len = len - done;
+    std::memcpy(carry, in + done, carry_len);
+    return written;
+}
+
+size_t TextCodec::Base64Encoder::finish(char* out) {
+    if (carry_len == 0) {
+        return 0;
+    }
+    base64EncodeTail(carry, carry_len, out);
+    carry_len = 0;
+    return 4;
+}
+
+size_t TextCodec::Base64Decoder::update(const char* in, size_t len, uint8_t* out) {
+    if (failed || len == 0) {
+        return 0;
+    }
+    if (padded) {
+        failed = true;      // Data after the padding
+        return 0;
+    }
+
+    size_t written = 0;
+    if (carry_len) {
+        while (carry_len < 4 && len) {
+            carry[carry_len++] = *in++;
+            len--;
+        }
+        if (carry_len < 4) {
+            return 0;
+        }
+        int n = base64DecodeQuad(carry, out);
+        carry_len = 0;
+        if (n < 0 || (n < 3 && len)) {
+            failed = true;
+            return 0;
+        }
+        padded = n < 3;
+        written = static_cast<size_t>(n);
+    }
+
+    size_t whole = len & ~static_cast<size_t>(3);
+    size_t done = base64DecodeWith(base64DecodeKernel(), in, whole, out + written);
+    written += done / 4 * 3;
+
+    // Quads the bulk pass stopped at: padding (must be last) or an error
+    for (; done < whole; done += 4) {
+        int n = base64DecodeQuad(in + done, out + written);
+        if (n < 0 || (n < 3 && done + 4 < len)) {
+            failed = true;
+            return 0;
+        }
+        padded = n < 3;
+        written += static_cast<size_t>(n);
+    }
+
+    carry_len = len - whole;
+    std::memcpy(carry, in + whole, carry_len);
+    return written;
+}
@@ -0,0 +1,413 @@
+#include "../include/tls_transport.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+
+#ifdef CHAT_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include <arpa/inet.h>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <climits>
+#include <poll.h>
+#include <fcntl.h>
+#include <csignal>
+#endif
+
+/**
+ * TLS TRANSPORT IMPLEMENTATION
+ * ============================
+ *
+ * Connections live in a registry keyed by socket fd, like SecureChannel
+ * sessions. Kernel-offloaded connections are registered only so that
+ * detach() can send close_notify and free the SSL object; all their I/O
+ * bypasses this file.
+ *
+ * Userspace connections hold two locks: write_mutex serializes whole
+ * send() calls (OpenSSL requires a write that wants to be retried to be
+ * retried with the same buffer before any other write), and ssl_mutex
+ * is held only around individual SSL_* calls so the reader thread's
+ * SSL_read() and a writer's SSL_write() alternate instead of deadlocking
+ * while one of them waits for the socket.
+ */
+
+bool TlsTransport::kernelOffloadAvailable() {
+    const char* value = std::getenv("CHAT_KTLS");
+    if (value && std::strcmp(value, "0") == 0) {
+        return false;
+    }
+    std::ifstream ulps("/proc/sys/net/ipv4/tcp_available_ulp");
+    std::string name;
+    while (ulps >> name) {
+        if (name == "tls") {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TlsTransport::clientRequested() {
+    const char* value = std::getenv("CHAT_TLS");
+    return value && std::strcmp(value, "1") == 0;
+}
+
+#ifdef CHAT_TLS
+
+namespace {
+
+struct Connection {
+    SSL* ssl = nullptr;
+    bool userspace = false;
+    std::mutex ssl_mutex;               // Held around each SSL_* call
+    std::mutex write_mutex;             // Serializes send() calls
+
+    ~Connection() {
+        SSL_free(ssl);
+    }
+};
+
+std::mutex registry_mutex;
+std::unordered_map<int, std::shared_ptr<Connection>> connections;
+std::atomic<int> userspace_count(0);
+SSL_CTX* server_ctx = nullptr;
+
+std::shared_ptr<Connection> find(int socket) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto it = connections.find(socket);
+    return it == connections.end() ? nullptr : it->second;
+}
+
+void printErrors(const char* what) {
+    unsigned long code = ERR_get_error();
+    std::cerr << "[TLS] " << what;
+    if (code != 0) {
+        char text[256];
+        ERR_error_string_n(code, text, sizeof(text));
+        std::cerr << ": " << text;
+    }
+    std::cerr << std::endl;
+    ERR_clear_error();
+}
+
+/**
+ * Settings shared by both ends; full offload needs TLS 1.2 with AES-GCM
+ */
+void configureContext(SSL_CTX* ctx) {
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+    if (TlsTransport::kernelOffloadAvailable()) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+        SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+        SSL_CTX_set_cipher_list(ctx, "ECDHE+AESGCM");
+    }
+}
+
+/**
+ * Registers a handshaken connection in kernel or userspace mode
+ */
+bool registerConnection(int socket, SSL* ssl) {
+    // OpenSSL writes with plain write(); a vanished peer must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    auto connection = std::make_shared<Connection>();
+    connection->ssl = ssl;
+    connection->userspace = !(BIO_get_ktls_send(SSL_get_wbio(ssl)) && BIO_get_ktls_recv(SSL_get_rbio(ssl)));
+    if (connection->userspace) {
+        int fl = fcntl(socket, F_GETFL, 0);
+        if (fl < 0 || fcntl(socket, F_SETFL, fl | O_NONBLOCK) < 0) {
+            return false;
+        }
+        userspace_count++;
+    }
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    connections[socket] = connection;
+    return true;
+}
+
+/**
+ * Waits for the socket after SSL_ERROR_WANT_READ / WANT_WRITE
+ * @return false on any other error
+ */
+bool waitForSocket(int socket, int ssl_error) {
+    short events;
+    if (ssl_error == SSL_ERROR_WANT_READ) {
+        events = POLLIN;
+    } else if (ssl_error == SSL_ERROR_WANT_WRITE) {
+        events = POLLOUT;
+    } else {
+        return false;
+    }
+    pollfd pfd = {socket, events, 0};
+    while (poll(&pfd, 1, -1) < 0) {
+        if (errno != EINTR) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool TlsTransport::available() {
+    return true;
+}
+
+bool TlsTransport::initServer() {
+    const char* cert = std::getenv("CHAT_TLS_CERT");
+    const char* key = std::getenv("CHAT_TLS_KEY");
+    if (!cert && !key) {
+        return true;
+    }
+    if (!cert || !key) {
+        std::cerr << "[TLS] CHAT_TLS_CERT and CHAT_TLS_KEY must be set together" << std::endl;
+        return false;
+    }
+
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        printErrors("SSL_CTX_new failed");
+        return false;
+    }
+    configureContext(ctx);
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, key, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        printErrors("Cannot load certificate/key");
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    server_ctx = ctx;
+    return true;
+}
+
+bool TlsTransport::serverEnabled() {
+    return server_ctx != nullptr;
+}
+
+bool TlsTransport::looksLikeHandshake(int socket) {
+    unsigned char first = 0;
+    ssize_t n;
+    do {
+        n = ::recv(socket, &first, 1, MSG_PEEK);
+    } while (n < 0 && errno == EINTR);
+    return n == 1 && first == 0x16;
+}
+
+bool TlsTransport::accept(int socket) {
+    SSL* ssl = server_ctx ? SSL_new(server_ctx) : nullptr;
+    if (!ssl || SSL_set_fd(ssl, socket) != 1 || SSL_accept(ssl) != 1) {
+        printErrors("Handshake failed");
+        SSL_free(ssl);
+        return false;
+    }
+    if (!registerConnection(socket, ssl)) {
+        SSL_free(ssl);
+        return false;
+    }
+    return true;
+}
+
+bool TlsTransport::connect(int socket, const std::string& host) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx) {
+        printErrors("SSL_CTX_new failed");
+        return false;
+    }
+    configureContext(ctx);
+
+    const char* ca = std::getenv("CHAT_TLS_CA");
+    if (ca) {
+        if (SSL_CTX_load_verify_locations(ctx, ca, nullptr) != 1) {
+            printErrors("Cannot load CHAT_TLS_CA");
+            SSL_CTX_free(ctx);
+            return false;
+        }
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    } else {
+        std::cerr << "[TLS] CHAT_TLS_CA not set - server certificate is not verified" << std::endl;
+    }
+
+    SSL* ssl = SSL_new(ctx);
+    SSL_CTX_free(ctx);      // The SSL keeps its own reference
+    if (!ssl || SSL_set_fd(ssl, socket) != 1) {
+        printErrors("SSL_new failed");
+        SSL_free(ssl);
+        return false;
+    }
+    if (ca) {
+        in_addr ip;
+        bool ok = inet_pton(AF_INET, host.c_str(), &ip) == 1
+            ? X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str()) == 1
+            : SSL_set1_host(ssl, host.c_str()) == 1;
+        if (!ok) {
+            SSL_free(ssl);
+            return false;
+        }
+    }
+    if (SSL_connect(ssl) != 1) {
+        printErrors("Handshake failed");
+        SSL_free(ssl);
+        return false;
+    }
+    if (!registerConnection(socket, ssl)) {
+        SSL_free(ssl);
+        return false;
+    }
+    return true;
+}
+
+bool TlsTransport::isTls(int socket) {
+    return find(socket) != nullptr;
+}
+
+bool TlsTransport::isUserspace(int socket) {
+    std::shared_ptr<Connection> connection = find(socket);
+    return connection && connection->userspace;
+}
+
+bool TlsTransport::anyUserspace() {
+    return userspace_count.load(std::memory_order_relaxed) > 0;
+}
+
+std::string TlsTransport::describe(int socket) {
+    std::shared_ptr<Connection> connection = find(socket);
+    if (!connection) {
+        return "none";
+    }
+    std::lock_guard<std::mutex> lock(connection->ssl_mutex);
+    std::ostringstream out;
+    out << SSL_get_version(connection->ssl) << " " << SSL_get_cipher_name(connection->ssl)
+        << (connection->userspace ? ", userspace" : ", kernel offload");
+    return out.str();
+}
+
+ssize_t TlsTransport::send(int socket, const void* data, size_t len, int flags) {
+    std::shared_ptr<Connection> connection = find(socket);
+    if (!connection || !connection->userspace) {
+        return ::send(socket, data, len, flags);
+    }
+
+    std::lock_guard<std::mutex> write_lock(connection->write_mutex);
+    const char* p = static_cast<const char*>(data);
+    size_t left = len;
+    while (left > 0) {
+        int want = left < INT_MAX ? static_cast<int>(left) : INT_MAX;
+        int n;
+        int error = SSL_ERROR_NONE;
+        {
+            std::lock_guard<std::mutex> lock(connection->ssl_mutex);
+            n = SSL_write(connection->ssl, p, want);
+            if (n <= 0) error = SSL_get_error(connection->ssl, n);
+        }
+        if (n > 0) {
+            p += n;
+            left -= static_cast<size_t>(n);
+        } else if (!waitForSocket(socket, error)) {
+            ERR_clear_error();
+            errno = EPIPE;
+            return -1;
+        }
+    }
+    return static_cast<ssize_t>(len);
+}
+
+ssize_t TlsTransport::recv(int socket, void* buf, size_t len, int flags) {
+    std::shared_ptr<Connection> connection = find(socket);
+    if (!connection || !connection->userspace) {
+        return ::recv(socket, buf, len, flags);
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    int want = len < INT_MAX ? static_cast<int>(len) : INT_MAX;
+    for (;;) {
+        int n;
+        int error = SSL_ERROR_NONE;
+        {
+            std::lock_guard<std::mutex> lock(connection->ssl_mutex);
+            n = SSL_read(connection->ssl, buf, want);
+            if (n <= 0) error = SSL_get_error(connection->ssl, n);
+        }
+        if (n > 0) {
+            return n;
+        }
+        if (error == SSL_ERROR_ZERO_RETURN) {
+            return 0;
+        }
+        if (error == SSL_ERROR_WANT_READ && (flags & MSG_DONTWAIT)) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (!waitForSocket(socket, error)) {
+            // A peer that closes without close_notify looks like EOF
+            bool eof = error == SSL_ERROR_SYSCALL && errno == 0;
+            ERR_clear_error();
+            if (eof) return 0;
+            errno = ECONNRESET;
+            return -1;
+        }
+    }
+}
+
+bool TlsTransport::hasBuffered(int socket) {
+    std::shared_ptr<Connection> connection = find(socket);
+    if (!connection || !connection->userspace) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(connection->ssl_mutex);
+    return SSL_pending(connection->ssl) > 0;
+}
+
+void TlsTransport::detach(int socket) {
+    std::shared_ptr<Connection> connection;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = connections.find(socket);
+        if (it == connections.end()) {
+            return;
+        }
+        connection = it->second;
+        connections.erase(it);
+    }
+    if (connection->userspace) {
+        userspace_count--;
+    }
+    std::lock_guard<std::mutex> lock(connection->ssl_mutex);
+    SSL_shutdown(connection->ssl);     // Best effort; non-blocking sockets may not finish
+    ERR_clear_error();
+}
+
+#else  // !CHAT_TLS
+
+bool TlsTransport::available() { return false; }
+bool TlsTransport::initServer() {
+    if (std::getenv("CHAT_TLS_CERT") || std::getenv("CHAT_TLS_KEY")) {
+        std::cerr << "[TLS] Built without TLS support (make TLS=1); CHAT_TLS_CERT ignored" << std::endl;
+    }
+    return true;
+}
+bool TlsTransport::serverEnabled() { return false; }
+bool TlsTransport::looksLikeHandshake(int) { return false; }
+bool TlsTransport::accept(int) { return false; }
+bool TlsTransport::connect(int, const std::string&) { return false; }
+bool TlsTransport::isTls(int) { return false; }
+bool TlsTransport::isUserspace(int) { return false; }
+bool TlsTransport::anyUserspace() { return false; }
+std::string TlsTransport::describe(int) { return "none"; }
+ssize_t TlsTransport::send(int socket, const void* data, size_t len, int flags) {
+    return ::send(socket, data, len, flags);
+}
+ssize_t TlsTransport::recv(int socket, void* buf, size_t len, int flags) {
+    return ::recv(socket, buf, len, flags);
+}
+bool TlsTransport::hasBuffered(int) { return false; }
+void TlsTransport::detach(int) {}
+
+#endif  // CHAT_TLS
@@ -0,0 +1,243 @@
+#include "../include/tracer.hpp"
+#include "../include/binary_log.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/**
+ * TRACER IMPLEMENTATION
+ * =====================
+ *
+ * A thread's ring is created on its first sampled span and registered
+ * with the dumper; a thread_local handle marks it finished when the
+ * thread exits, so spans of a client that just left can still be
+ * dumped. Spans are only written for sampled messages, so the ring's
+ * mutex (owner thread vs. a dump) is never taken on the unsampled path.
+ */
+
+namespace {
+
+struct Event {
+    const char* name;
+    int64_t start_ns;
+    int64_t end_ns;
+    uint64_t message;
+};
+
+struct Ring {
+    std::mutex mutex;                   // Owner thread vs. dumps
+    std::vector<Event> events = std::vector<Event>(Tracer::RING_EVENTS);
+    size_t next = 0;                    // Slot for the next span
+    size_t count = 0;
+    long tid = 0;
+    std::string name;
+    std::atomic<bool> finished{false};
+};
+
+/**
+ * Thread-local owner of a ring; marks it finished when the thread exits
+ */
+struct RingHandle {
+    std::shared_ptr<Ring> ring;
+
+    ~RingHandle() {
+        if (ring) {
+            ring->finished.store(true, std::memory_order_release);
+        }
+    }
+};
+
+struct Shared {
+    std::mutex mutex;                   // Protects rings
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::atomic<uint64_t> next_message{1};
+};
+
+Shared& shared() {
+    static Shared* instance = new Shared;
+    return *instance;
+}
+
+thread_local RingHandle local_ring;
+thread_local std::string thread_name;
+thread_local uint64_t current_message = 0;
+thread_local uint32_t since_sample = 0;
+
+Ring& ring() {
+    if (local_ring.ring) {
+        return *local_ring.ring;
+    }
+    auto created = std::make_shared<Ring>();
+    created->tid = static_cast<long>(syscall(SYS_gettid));
+    created->name = thread_name;
+
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    size_t finished = 0;
+    for (const auto& r : s.rings) {
+        finished += r->finished.load(std::memory_order_acquire) ? 1 : 0;
+    }
+    // Oldest finished rings go first
+    for (auto it = s.rings.begin(); it != s.rings.end() && finished >= Tracer::MAX_FINISHED_RINGS;) {
+        if ((*it)->finished.load(std::memory_order_acquire)) {
+            it = s.rings.erase(it);
+            finished--;
+        } else {
+            ++it;
+        }
+    }
+    s.rings.push_back(created);
+    local_ring.ring = created;
+    return *created;
+}
+
+void appendEscaped(std::string& out, const std::string& text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            out += c;
+        }
+    }
+}
+
+}  // namespace
+
+std::atomic<uint32_t> Tracer::sample_every(0);
+thread_local bool Tracer::active = false;
+
+void Tracer::Message::begin(uint32_t every) {
+    if (++since_sample < every) {
+        return;
+    }
+    since_sample = 0;
+    ring();                             // First use allocates; keep that out of the spans
+    current_message = shared().next_message.fetch_add(1, std::memory_order_relaxed);
+    active = true;
+    started = now();
+}
+
+void Tracer::Message::end() {
+    record("message", started, now());
+    active = false;
+}
+
+void Tracer::Message::restart() {
+    if (started != 0) {
+        started = now();
+    }
+}
+
+int64_t Tracer::now() {
+    return static_cast<int64_t>(BinaryLog::monotonicNanos());
+}
+
+void Tracer::record(const char* name, int64_t start_ns, int64_t end_ns) {
+    Ring& r = ring();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.events[r.next] = {name, start_ns, end_ns, current_message};
+    r.next = (r.next + 1) % RING_EVENTS;
+    if (r.count < RING_EVENTS) {
+        r.count++;
+    }
+}
+
+void Tracer::configureFromEnvironment() {
+    if (const char* value = std::getenv("CHAT_TRACE_SAMPLE")) {
+        long every = std::atol(value);
+        setSampling(every > 0 ? static_cast<uint32_t>(every) : 0);
+    }
+}
+
+void Tracer::setSampling(uint32_t every) {
+    sample_every.store(every, std::memory_order_relaxed);
+}
+
+void Tracer::nameThread(const std::string& name) {
+    thread_name = name;
+    if (local_ring.ring) {
+        std::lock_guard<std::mutex> lock(local_ring.ring->mutex);
+        local_ring.ring->name = name;
+    }
+}
+
+size_t Tracer::bufferedSpans() {
+    Shared& s = shared();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    size_t total = 0;
+    for (const auto& r : s.rings) {
+        std::lock_guard<std::mutex> ring_lock(r->mutex);
+        total += r->count;
+    }
+    return total;
+}
+
+std::string Tracer::dumpJson() {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        Shared& s = shared();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        rings = s.rings;
+    }
+
+    long pid = static_cast<long>(getpid());
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    char line[256];
+    std::vector<Event> events;
+    for (const auto& r : rings) {
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(r->mutex);
+            events.clear();
+            size_t start = (r->next + RING_EVENTS - r->count) % RING_EVENTS;
+            for (size_t i = 0; i < r->count; i++) {
+                events.push_back(r->events[(start + i) % RING_EVENTS]);
+            }
+            name = r->name.empty() ? "thread " + std::to_string(r->tid) : r->name;
+        }
+
+        snprintf(line, sizeof(line), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"",
+                 first ? "" : ",", pid, r->tid);
+        out += line;
+        appendEscaped(out, name);
+        out += "\"}}";
+        first = false;
+
+        for (const Event& e : events) {
+            snprintf(line, sizeof(line),
+                     ",\n{\"name\":\"%s\",\"cat\":\"chat\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"pid\":%ld,\"tid\":%ld,\"args\":{\"message\":%llu}}",
+                     e.name, e.start_ns / 1e3, (e.end_ns - e.start_ns) / 1e3, pid, r->tid,
+                     static_cast<unsigned long long>(e.message));
+            out += line;
+        }
+    }
+    out += "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return out;
+}
+
+bool Tracer::dumpToFile(std::string& path) {
+    time_t now_seconds = time(nullptr);
+    struct tm local;
+    localtime_r(&now_seconds, &local);
+    char name[64];
+    strftime(name, sizeof(name), "trace-%Y%m%d-%H%M%S.json", &local);
+    path = name;
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::cerr << "Tracer: cannot write " << path << std::endl;
+        return false;
+    }
+    file << dumpJson();
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,372 @@
+#include "../include/traffic_shaper.hpp"
+#include "../include/file_transfer.hpp"
+#include "../include/transfer_scheduler.hpp"
+#include "../include/utils.hpp"
+#include "../include/secure_channel.hpp"
+#include "../include/metrics.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/sockios.h>
+
+/**
+ * BANDWIDTH SHAPING IMPLEMENTATION
+ * ================================
+ *
+ * Why chat latency suffers without this: a relay thread writes file
+ * data as fast as the sender uploads it, so the recipient's socket
+ * buffer (often several MB) fills up. A chat message sent to the same
+ * socket then waits behind all of it, i.e. buffer_size / link_rate.
+ *
+ * The shaper bounds that queue two ways:
+ * - Rate: token buckets keep bulk data below the configured rates, so
+ *   the link keeps headroom for chat to other users.
+ * - Depth: bulk slices are only written while SIOCOUTQNSD (bytes queued
+ *   but not yet sent; in-flight bytes are excluded so long-RTT links keep
+ *   their full window) is below BULK_QUEUE_LIMIT, and on chunked streams
+ *   chat is framed in between slices. Raw streams hold it until the end.
+ */
+
+double TrafficShaper::transfer_rate = 0;
+double TrafficShaper::user_rate = 0;
+double TrafficShaper::pacing_rate = 0;
+TokenBucket TrafficShaper::global_bucket;
+std::map<std::string, std::weak_ptr<TokenBucket>> TrafficShaper::user_buckets;
+std::map<int, TransferFlow*> TrafficShaper::flows;
+std::mutex TrafficShaper::shaper_mutex;
+
+// ============================================================================
+// TokenBucket
+// ============================================================================
+
+TokenBucket::TokenBucket(double rate_bps, double burst_bytes)
+    : rate(0), burst(0), tokens(0), last_refill(std::chrono::steady_clock::now()) {
+    setRate(rate_bps, burst_bytes);
+    tokens = burst;
+}
+
+void TokenBucket::setRate(double rate_bps, double burst_bytes) {
+    std::lock_guard<std::mutex> lock(bucket_mutex);
+    rate = rate_bps;
+    // Default depth: 100ms of traffic, but never less than one chunk frame
+    burst = burst_bytes > 0 ? burst_bytes : std::max(rate_bps / 10, 256.0 * 1024);
+    tokens = std::min(tokens, burst);
+}
+
+double TokenBucket::reserve(size_t bytes) {
+    std::lock_guard<std::mutex> lock(bucket_mutex);
+    if (rate <= 0) {
+        return 0;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_refill).count();
+    last_refill = now;
+    tokens = std::min(burst, tokens + elapsed * rate);
+
+    // Take the tokens even if that goes into debt; the debt is the wait
+    tokens -= static_cast<double>(bytes);
+    return tokens >= 0 ? 0 : -tokens / rate;
+}
+
+// ============================================================================
+// TransferFlow
+// ============================================================================
+
+TransferFlow::TransferFlow(const std::string& user, int socket, bool interleave_chat,
+                           const std::string& description, long total_bytes)
+    : username(user), out_socket(socket), interleave(interleave_chat && socket >= 0),
+      pacing_set(false), transfer_bucket(TrafficShaper::transferRate()),
+      user_bucket(TrafficShaper::userBucket(user)), chat_failed(false), wake_fd(-1),
+      schedule_id(0), granted(false) {
+    schedule_id = TransferScheduler::registerFlow(this, user, description, total_bytes);
+    unsigned int pacing = static_cast<unsigned int>(std::min(TrafficShaper::pacingRate(), 4.0e9));
+    if (out_socket >= 0 && pacing > 0) {
+        pacing_set = setsockopt(out_socket, SOL_SOCKET, SO_MAX_PACING_RATE, &pacing, sizeof(pacing)) == 0;
+    }
+    if (interleave) {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    if (out_socket >= 0) {
+        TrafficShaper::registerFlow(out_socket, this);
+    }
+}
+
+TransferFlow::~TransferFlow() {
+    TransferScheduler::unregisterFlow(schedule_id);
+    if (out_socket >= 0) {
+        TrafficShaper::unregisterFlow(out_socket);
+        // Stream is over: whatever is still queued goes out as normal messages
+        std::lock_guard<std::mutex> lock(chat_mutex);
+        for (const auto& message : chat_queue) {
+            Utils::sendAll(out_socket, message.data(), message.size());
+        }
+        Metrics::adjust(Gauge::CHAT_QUEUED, -static_cast<int64_t>(chat_queue.size()));
+        chat_queue.clear();
+    }
+    if (wake_fd >= 0) {
+        close(wake_fd);
+    }
+    if (pacing_set) {
+        unsigned int unlimited = ~0U;
+        setsockopt(out_socket, SOL_SOCKET, SO_MAX_PACING_RATE, &unlimited, sizeof(unlimited));
+    }
+}
+
+void TransferFlow::grant() {
+    {
+        std::lock_guard<std::mutex> lock(chat_mutex);
+        granted = true;
+    }
+    chat_cv.notify_one();
+}
+
+void TransferFlow::enqueueChat(const std::string& message) {
+    {
+        std::lock_guard<std::mutex> lock(chat_mutex);
+        chat_queue.push_back(message);
+        Metrics::adjust(Gauge::CHAT_QUEUED, 1);
+    }
+    chat_cv.notify_one();
+    if (wake_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+size_t TransferFlow::queuedChat() {
+    std::lock_guard<std::mutex> lock(chat_mutex);
+    return chat_queue.size();
+}
+
+bool TransferFlow::flushChat() {
+    std::deque<std::string> pending;
+    {
+        std::lock_guard<std::mutex> lock(chat_mutex);
+        pending.swap(chat_queue);
+    }
+    Metrics::adjust(Gauge::CHAT_QUEUED, -static_cast<int64_t>(pending.size()));
+
+    for (const auto& message : pending) {
+        uint32_t len = static_cast<uint32_t>(std::min(message.size(), FileTransferHandler::CHUNKED_BLOCK_SIZE));
+        unsigned char header[FileTransferHandler::CHUNK_HEADER_SIZE];
+        header[0] = FileTransferHandler::CHUNK_FLAG_CHAT;
+        for (int i = 0; i < 4; i++) {
+            header[1 + i] = static_cast<unsigned char>(len >> (24 - 8 * i));
+            header[5 + i] = header[1 + i];  // Chat frames are never compressed
+        }
+        if (!Utils::sendAll(out_socket, header, sizeof(header)) ||
+            !Utils::sendAll(out_socket, message.data(), len)) {
+            chat_failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Wait for bandwidth and queue room
+ * ---------------------------------
+ * Both local buckets are charged at once and the caller waits for the
+ * larger debt, so the slower limit wins without the waits adding up.
+ * The global share is requested from the scheduler in parallel. While
+ * waiting, queued chat is written immediately - chat never waits for
+ * bulk tokens.
+ */
+bool TransferFlow::throttle(size_t bytes) {
+    double wait = transfer_bucket.reserve(bytes);
+    if (user_bucket) {
+        wait = std::max(wait, user_bucket->reserve(bytes));
+    }
+    
+    bool need_grant = TransferScheduler::arbitrating();
+    if (need_grant) {
+        {
+            std::lock_guard<std::mutex> lock(chat_mutex);
+            granted = false;
+        }
+        TransferScheduler::request(schedule_id, bytes);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(wait));
+
+    for (;;) {
+        if (interleave && !flushChat()) {
+            return false;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        int queued = 0;
+        bool queue_full = out_socket >= 0 && ioctl(out_socket, SIOCOUTQNSD, &queued) == 0 &&
+                          static_cast<size_t>(queued) > BULK_QUEUE_LIMIT;
+        bool waiting_grant;
+        {
+            std::lock_guard<std::mutex> lock(chat_mutex);
+            waiting_grant = need_grant && !granted;
+        }
+        if (now >= deadline && !queue_full && !waiting_grant) {
+            TransferScheduler::recordSent(schedule_id, bytes);
+            return !chat_failed;
+        }
+
+        // Sleep until the deadline (or poll the queue), waking early for chat or a grant
+        auto until = queue_full ? std::min(deadline, now + std::chrono::milliseconds(1)) : deadline;
+        if (until <= now) {
+            until = now + (waiting_grant && !queue_full ? std::chrono::milliseconds(100) : std::chrono::milliseconds(1));
+        }
+        std::unique_lock<std::mutex> lock(chat_mutex);
+        chat_cv.wait_until(lock, until, [this, need_grant] {
+            return (interleave && !chat_queue.empty()) || (need_grant && granted);
+        });
+    }
+}
+
+/**
+ * Wait for the sender
+ * -------------------
+ * The relay spends most of a slow upload blocked in recv() on the
+ * sender. Polling the sender together with the flow's eventfd lets
+ * chat go out during that time too.
+ */
+bool TransferFlow::awaitInput(int fd) {
+    if (!interleave) {
+        return true;
+    }
+    for (;;) {
+        if (!flushChat()) {
+            return false;
+        }
+        if (SecureChannel::hasBuffered(fd)) {
+            return true;  // Already decrypted; poll() cannot see it
+        }
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        int ready = poll(fds, wake_fd >= 0 ? 2 : 1, wake_fd >= 0 ? -1 : 10);
+        if (ready < 0 && errno != EINTR) {
+            return true;  // Let the caller's recv() report the error
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t ignored = read(wake_fd, &count, sizeof(count));
+            (void)ignored;
+        }
+        if (fds[0].revents) {
+            return true;
+        }
+    }
+}
+
+// ============================================================================
+// TrafficShaper
+// ============================================================================
+
+std::shared_ptr<TokenBucket> TrafficShaper::userBucket(const std::string& username) {
+    std::lock_guard<std::mutex> lock(shaper_mutex);
+    if (user_rate <= 0) {
+        return nullptr;
+    }
+
+    // One bucket per user, shared by that user's concurrent transfers
+    std::shared_ptr<TokenBucket> bucket = user_buckets[username].lock();
+    if (!bucket) {
+        bucket = std::make_shared<TokenBucket>(user_rate);
+        user_buckets[username] = bucket;
+    }
+
+    // Drop entries whose transfers have all finished
+    for (auto it = user_buckets.begin(); it != user_buckets.end();) {
+        it = it->second.expired() ? user_buckets.erase(it) : std::next(it);
+    }
+    return bucket;
+}
+
+void TrafficShaper::registerFlow(int socket, TransferFlow* flow) {
+    std::lock_guard<std::mutex> lock(shaper_mutex);
+    flows[socket] = flow;
+}
+
+void TrafficShaper::unregisterFlow(int socket) {
+    std::lock_guard<std::mutex> lock(shaper_mutex);
+    flows.erase(socket);
+}
+
+void TrafficShaper::configure(double global_bps, double user_bps, double transfer_bps, double pacing_bps) {
+    std::lock_guard<std::mutex> lock(shaper_mutex);
+    global_bucket.setRate(global_bps);
+    user_rate = user_bps;
+    transfer_rate = transfer_bps;
+    pacing_rate = pacing_bps;
+}
+
+double TrafficShaper::parseRate(const std::string& text) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || value < 0) {
+        return 0;
+    }
+    switch (std::toupper(static_cast<unsigned char>(*end))) {
+        case 'K': value *= 1024; break;
+        case 'M': value *= 1024 * 1024; break;
+        case 'G': value *= 1024.0 * 1024 * 1024; break;
+        default: break;
+    }
+    return value;
+}
+
+void TrafficShaper::configureFromEnvironment() {
+    auto rate = [](const char* name) {
+        const char* value = std::getenv(name);
+        return value ? parseRate(value) : 0.0;
+    };
+    configure(rate("CHAT_RATE_GLOBAL"), rate("CHAT_RATE_USER"),
+              rate("CHAT_RATE_TRANSFER"), rate("CHAT_PACING_RATE"));
+    
+    // Relative shares of the global rate for priority users
+    if (const char* weights = std::getenv("CHAT_USER_WEIGHTS")) {
+        TransferScheduler::configureWeights(weights);
+    }
+}
+
+bool TrafficShaper::sendChat(int socket, const std::string& message) {
+    Metrics::count(Counter::MESSAGES_OUT);
+    Metrics::count(Counter::BYTES_OUT, message.size());
+    {
+        std::lock_guard<std::mutex> lock(shaper_mutex);
+        auto it = flows.find(socket);
+        if (it != flows.end()) {
+            it->second->enqueueChat(message);
+            return true;
+        }
+    }
+    return SecureChannel::send(socket, message.c_str(), message.length(), 0) > 0;
+}
+
+bool TrafficShaper::sendGroupChat(int socket, const std::string& message, const std::string& record) {
+    Metrics::count(Counter::MESSAGES_OUT);
+    Metrics::count(Counter::BYTES_OUT, message.size());
+    {
+        std::lock_guard<std::mutex> lock(shaper_mutex);
+        auto it = flows.find(socket);
+        if (it != flows.end()) {
+            it->second->enqueueChat(message);
+            return true;
+        }
+    }
+    if (record.empty() || !SecureChannel::isSecure(socket)) {
+        return SecureChannel::send(socket, message.c_str(), message.length(), 0) > 0;
+    }
+    return SecureChannel::sendRecord(socket, record);
+}
+
+size_t TrafficShaper::queuedChat(int socket) {
+    std::lock_guard<std::mutex> lock(shaper_mutex);
+    auto it = flows.find(socket);
+    return it == flows.end() ? 0 : it->second->queuedChat();
+}
@@ -0,0 +1,225 @@
+#include "../include/transfer_scheduler.hpp"
+#include "../include/traffic_shaper.hpp"
+#include "../include/utils.hpp"
+#include "../include/metrics.hpp"
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <cstdlib>
+
+/**
+ * DEFICIT ROUND ROBIN SCHEDULER IMPLEMENTATION
+ * ============================================
+ *
+ * Each flow has at most one slice outstanding (the relay thread blocks
+ * until it is granted), so the classic per-flow packet queue reduces to
+ * a single `pending` size. Right after a grant the relay is busy sending
+ * and reading the next slice, so its queue looks empty although it is
+ * backlogged; its turn therefore waits up to GRACE_MS for the next
+ * request. Only a flow still empty after that loses its deficit, as in
+ * standard DRR: idle flows cannot bank credit and burst later. Without
+ * the grace period the scheduler would spin through rounds while the
+ * served flow is busy, and the weights would have no effect.
+ *
+ * Grants are paid for with global bucket tokens, and the scheduler
+ * thread sleeps for the bucket's wait before granting, so the grant
+ * rate - and thus the total relay rate - equals CHAT_RATE_GLOBAL.
+ */
+
+std::map<uint64_t, TransferScheduler::Flow> TransferScheduler::flows;
+std::vector<uint64_t> TransferScheduler::round;
+size_t TransferScheduler::cursor = 0;
+std::map<std::string, double> TransferScheduler::user_weights;
+uint64_t TransferScheduler::next_id = 0;
+bool TransferScheduler::thread_started = false;
+std::mutex TransferScheduler::scheduler_mutex;
+std::condition_variable TransferScheduler::scheduler_cv;
+
+void TransferScheduler::setUserWeight(const std::string& user, double weight) {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    if (weight > 0) {
+        user_weights[user] = weight;
+    } else {
+        user_weights.erase(user);
+    }
+}
+
+void TransferScheduler::configureWeights(const std::string& spec) {
+    for (const auto& item : Utils::split(spec, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) continue;
+        setUserWeight(Utils::trim(item.substr(0, eq)), std::atof(item.substr(eq + 1).c_str()));
+    }
+}
+
+double TransferScheduler::shareLocked(const Flow& flow) {
+    int siblings = 0;
+    for (const auto& entry : flows) {
+        if (entry.second.user == flow.user) {
+            siblings++;
+        }
+    }
+    auto it = user_weights.find(flow.user);
+    double weight = it != user_weights.end() ? it->second : 1.0;
+    return weight / std::max(1, siblings);
+}
+
+uint64_t TransferScheduler::registerFlow(TransferFlow* flow, const std::string& user,
+                                         const std::string& description, long total_bytes) {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    uint64_t id = ++next_id;
+
+    Flow entry;
+    entry.flow = flow;
+    entry.user = user;
+    entry.description = description;
+    entry.total_bytes = total_bytes;
+    entry.sent_bytes = 0;
+    entry.pending = 0;
+    entry.deficit = 0;
+    entry.started = std::chrono::steady_clock::now();
+    entry.last_grant = entry.started;
+    flows[id] = entry;
+    round.push_back(id);
+    Metrics::adjust(Gauge::ACTIVE_TRANSFERS, 1);
+
+    if (!thread_started) {
+        std::thread(run).detach();
+        thread_started = true;
+    }
+    return id;
+}
+
+void TransferScheduler::unregisterFlow(uint64_t id) {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    auto it = flows.find(id);
+    if (it == flows.end()) {
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - it->second.started).count();
+    long rate = static_cast<long>(it->second.sent_bytes / std::max(seconds, 0.001));
+    if (!it->second.description.empty()) {
+        Utils::logEvent(LogEvent::TRANSFER_FINISHED, it->second.description, it->second.sent_bytes, rate);
+    }
+    Metrics::adjust(Gauge::ACTIVE_TRANSFERS, -1);
+    Metrics::count(Counter::TRANSFERS);
+    Metrics::record(Histogram::TRANSFER_RATE, static_cast<uint64_t>(rate));
+    flows.erase(it);
+
+    auto pos = std::find(round.begin(), round.end(), id);
+    if (pos != round.end()) {
+        if (static_cast<size_t>(pos - round.begin()) < cursor) {
+            cursor--;  // Keep the rotation on the same next flow
+        }
+        round.erase(pos);
+    }
+}
+
+bool TransferScheduler::arbitrating() {
+    return !TrafficShaper::globalBucket().unlimited();
+}
+
+void TransferScheduler::request(uint64_t id, size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(scheduler_mutex);
+        auto it = flows.find(id);
+        if (it == flows.end()) {
+            return;
+        }
+        it->second.pending = std::max<size_t>(bytes, 1);
+    }
+    scheduler_cv.notify_one();
+}
+
+void TransferScheduler::recordSent(uint64_t id, size_t bytes) {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    auto it = flows.find(id);
+    if (it != flows.end()) {
+        it->second.sent_bytes += bytes;
+    }
+    Metrics::count(Counter::TRANSFER_BYTES, bytes);
+}
+
+/**
+ * Scheduler loop
+ * --------------
+ * Visits flows round robin. Rounds in which no pending slice fits its
+ * deficit yet cost only a pass over the flow list; the thread sleeps
+ * only on the global bucket (pacing) or when nothing is pending.
+ */
+void TransferScheduler::run() {
+    std::unique_lock<std::mutex> lock(scheduler_mutex);
+    for (;;) {
+        scheduler_cv.wait(lock, [] {
+            return std::any_of(flows.begin(), flows.end(),
+                               [](const std::pair<const uint64_t, Flow>& f) { return f.second.pending > 0; });
+        });
+
+        if (cursor >= round.size()) {
+            cursor = 0;
+        }
+        uint64_t id = round[cursor++];
+        
+        // A flow served moments ago is still backlogged; give it time to ask again
+        auto grace_end = flows[id].last_grant + std::chrono::milliseconds(GRACE_MS);
+        scheduler_cv.wait_until(lock, grace_end, [id] {
+            auto it = flows.find(id);
+            return it == flows.end() || it->second.pending > 0;
+        });
+        auto current = flows.find(id);
+        if (current == flows.end()) {
+            continue;
+        }
+        Flow& flow = current->second;
+
+        if (flow.pending == 0) {
+            flow.deficit = 0;  // Idle flows do not accumulate credit
+            continue;
+        }
+
+        flow.deficit += QUANTUM * shareLocked(flow);
+        if (flow.pending > flow.deficit) {
+            continue;
+        }
+
+        size_t bytes = flow.pending;
+        flow.deficit -= bytes;
+
+        // Pay for the slice outside the lock so flows can come and go
+        lock.unlock();
+        double wait = TrafficShaper::globalBucket().reserve(bytes);
+        if (wait > 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+        }
+        lock.lock();
+
+        auto it = flows.find(id);
+        if (it != flows.end()) {
+            it->second.pending = 0;
+            it->second.last_grant = std::chrono::steady_clock::now();
+            it->second.flow->grant();
+        }
+    }
+}
+
+std::string TransferScheduler::describe() {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    if (flows.empty()) {
+        return "No active transfers";
+    }
+
+    std::ostringstream out;
+    out << "Active transfers: " << flows.size();
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& entry : flows) {
+        const Flow& flow = entry.second;
+        double seconds = std::max(0.001, std::chrono::duration<double>(now - flow.started).count());
+        out << "\n  " << flow.description << "  "
+            << Utils::formatFileSize(flow.sent_bytes) << " / " << Utils::formatFileSize(flow.total_bytes) << "  "
+            << Utils::formatFileSize(static_cast<long>(flow.sent_bytes / seconds)) << "/s  share "
+            << std::fixed << std::setprecision(2) << shareLocked(flow);
+    }
+    return out.str();
+}
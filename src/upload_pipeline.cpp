@@ -0,0 +1,295 @@
+#include "../include/upload_pipeline.hpp"
+#include "../include/file_transfer.hpp"
+#include "../include/compression.hpp"
+#include "../include/encryption.hpp"
+#include "../include/spsc_queue.hpp"
+#include "../include/thread_pool.hpp"
+#include "../include/utils.hpp"
+#include "../include/checksum.hpp"
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * UPLOAD PIPELINE IMPLEMENTATION
+ * ==============================
+ *
+ * Rings carry raw PipelineChunk pointers; nullptr marks end of file.
+ * Every ring holds all CHUNKS pointers, so a push never blocks on a
+ * full ring - stages only ever wait for input. Ownership of a chunk
+ * moves with the pointer; the vector in run() keeps them alive.
+ */
+
+namespace {
+
+typedef SpscQueue<PipelineChunk*> ChunkRing;
+
+/**
+ * Reads up to `want` bytes into a chunk; returns bytes read (0 = EOF/error)
+ */
+size_t fillChunk(int fd, PipelineChunk* chunk, size_t want) {
+    size_t filled = 0;
+    while (filled < want) {
+        ssize_t n = read(fd, chunk->raw.data() + filled, want - filled);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        filled += n;
+    }
+    chunk->raw_len = filled;
+    chunk->packed.clear();
+    chunk->flags = 0;
+    return filled;
+}
+
+/**
+ * Compresses (if it pays off) and encrypts one chunk in place
+ */
+void encodeChunk(PipelineChunk* chunk, bool encrypt) {
+    if (ChunkCodec::compressChunk(chunk->raw.data(), chunk->raw_len, chunk->packed)) {
+        chunk->flags |= FileTransferHandler::CHUNK_FLAG_COMPRESSED;
+    } else {
+        chunk->packed.clear();
+    }
+    if (encrypt) {
+        uint8_t* data = chunk->packed.empty() ? chunk->raw.data() : chunk->packed.data();
+        Encryption::encryptInPlace(data, chunk->payloadSize());
+        chunk->flags |= FileTransferHandler::CHUNK_FLAG_ENCRYPTED;
+    }
+}
+
+/**
+ * Writes one chunk as a frame and updates the byte counts
+ */
+bool sendChunk(int socket, const PipelineChunk* chunk, UploadPipeline::Result& result) {
+    uint32_t raw_len = static_cast<uint32_t>(chunk->raw_len);
+    uint32_t wire_len = static_cast<uint32_t>(chunk->payloadSize());
+    unsigned char header[FileTransferHandler::CHUNK_HEADER_SIZE];
+    header[0] = chunk->flags;
+    for (int i = 0; i < 4; i++) {
+        header[1 + i] = static_cast<unsigned char>(raw_len >> (24 - 8 * i));
+        header[5 + i] = static_cast<unsigned char>(wire_len >> (24 - 8 * i));
+    }
+    if (!Utils::sendAll(socket, header, sizeof(header)) ||
+        !Utils::sendAll(socket, chunk->payload(), wire_len)) {
+        return false;
+    }
+    result.raw_bytes += raw_len;
+    result.wire_bytes += sizeof(header) + wire_len;
+    return true;
+}
+
+/**
+ * Issues WILLNEED for the next window once reading gets close to it
+ */
+void adviseAhead(int fd, long total, long& advised) {
+    if (total + UploadPipeline::READAHEAD / 2 >= advised) {
+        posix_fadvise(fd, advised, UploadPipeline::READAHEAD, POSIX_FADV_WILLNEED);
+        advised += UploadPipeline::READAHEAD;
+    }
+}
+
+/**
+ * Read stage: fill recycled chunks from the file
+ */
+void readStage(int fd, long file_size, ChunkRing& free_chunks, ChunkRing& out, std::atomic<bool>& abort) {
+    const size_t block = FileTransferHandler::CHUNKED_BLOCK_SIZE;
+    long total = 0;
+    long advised = 0;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (total < file_size) {
+        // Keep the kernel reading a window ahead of us
+        adviseAhead(fd, total, advised);
+
+        PipelineChunk* chunk;
+        if (!free_chunks.pop(chunk, abort)) {
+            return;
+        }
+
+        size_t filled = fillChunk(fd, chunk, static_cast<size_t>(std::min<long>(block, file_size - total)));
+        if (filled == 0) {
+            break;  // File shrank; the send stage reports the short count
+        }
+        total += filled;
+        if (!out.push(chunk, abort)) {
+            return;
+        }
+    }
+    out.push(nullptr, abort);
+}
+
+/**
+ * Hash stage: running CRC32 over the raw file, in file order
+ */
+void hashStage(ChunkRing& in, ChunkRing& out, uint32_t& crc, std::atomic<bool>& abort) {
+    uint32_t running = 0;
+    PipelineChunk* chunk;
+    while (in.pop(chunk, abort)) {
+        if (!chunk) {
+            crc = running;  // Published to send by the nullptr push below
+            out.push(nullptr, abort);
+            return;
+        }
+        running = Checksum::crc32(running, chunk->raw.data(), chunk->raw_len);
+        if (!out.push(chunk, abort)) {
+            return;
+        }
+    }
+}
+
+/**
+ * Encode stage: compress/encrypt on the pool, forward in order
+ * The window keeps every worker busy while preserving chunk order.
+ */
+void encodeStage(ChunkRing& in, ChunkRing& out, std::atomic<bool>& abort) {
+    // Shared by all uploads of this process; created on first use
+    static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+
+    const size_t window = pool.size() * 2;
+    const bool encrypt = Encryption::isEnabled();
+    std::deque<std::pair<PipelineChunk*, std::future<void>>> inflight;
+    bool eof = false;
+
+    while (!eof || !inflight.empty()) {
+        while (!eof && inflight.size() < window) {
+            PipelineChunk* chunk;
+            // Block for input only when nothing is in flight
+            bool got = inflight.empty() ? in.pop(chunk, abort) : in.tryPop(chunk);
+            if (!got) {
+                if (abort.load()) {
+                    eof = true;
+                }
+                break;
+            }
+            if (!chunk) {
+                eof = true;
+                break;
+            }
+            inflight.emplace_back(chunk, pool.submit([chunk, encrypt] { encodeChunk(chunk, encrypt); }));
+        }
+        if (inflight.empty()) {
+            continue;
+        }
+
+        inflight.front().second.wait();
+        PipelineChunk* ready = inflight.front().first;
+        inflight.pop_front();
+        if (!abort.load()) {
+            out.push(ready, abort);  // On abort keep draining so no job outlives its chunk
+        }
+    }
+    if (!abort.load()) {
+        out.push(nullptr, abort);
+    }
+}
+
+/**
+ * All stages on the calling thread
+ * With a single CPU the stages cannot overlap, and the thread handoffs
+ * only add context switches, so one chunk goes through them at a time.
+ */
+bool runInline(int socket, int fd, long file_size, UploadPipeline::Result& result, uint32_t& crc,
+               const std::function<void(long)>& progress) {
+    PipelineChunk chunk;
+    chunk.raw.resize(FileTransferHandler::CHUNKED_BLOCK_SIZE);
+    const bool encrypt = Encryption::isEnabled();
+    uint32_t running = 0;
+    long advised = 0;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    while (result.raw_bytes < file_size) {
+        adviseAhead(fd, result.raw_bytes, advised);
+        size_t want = static_cast<size_t>(std::min<long>(FileTransferHandler::CHUNKED_BLOCK_SIZE,
+                                                         file_size - result.raw_bytes));
+        if (fillChunk(fd, &chunk, want) == 0) {
+            return false;
+        }
+        running = Checksum::crc32(running, chunk.raw.data(), chunk.raw_len);
+        encodeChunk(&chunk, encrypt);
+        if (!sendChunk(socket, &chunk, result)) {
+            return false;
+        }
+        if (progress) {
+            progress(result.raw_bytes);
+        }
+    }
+    crc = running;
+    return true;
+}
+
+/**
+ * Stages on their own threads; the send stage runs on the calling thread
+ */
+bool runStaged(int socket, int fd, long file_size, UploadPipeline::Result& result, uint32_t& crc,
+               const std::function<void(long)>& progress) {
+    const size_t CHUNKS = UploadPipeline::CHUNKS;
+    std::vector<std::unique_ptr<PipelineChunk>> chunks;
+    ChunkRing free_chunks(CHUNKS), read_out(CHUNKS), hash_out(CHUNKS), encode_out(CHUNKS);
+    for (size_t i = 0; i < CHUNKS; i++) {
+        chunks.emplace_back(new PipelineChunk());
+        chunks.back()->raw.resize(FileTransferHandler::CHUNKED_BLOCK_SIZE);
+        free_chunks.tryPush(chunks.back().get());
+    }
+
+    std::atomic<bool> abort(false);
+    std::thread reader(readStage, fd, file_size, std::ref(free_chunks), std::ref(read_out), std::ref(abort));
+    std::thread hasher(hashStage, std::ref(read_out), std::ref(hash_out), std::ref(crc), std::ref(abort));
+    std::thread encoder(encodeStage, std::ref(hash_out), std::ref(encode_out), std::ref(abort));
+
+    bool ok = false;
+    PipelineChunk* chunk;
+    while (encode_out.pop(chunk, abort)) {
+        if (!chunk) {
+            ok = true;
+            break;
+        }
+
+        if (!sendChunk(socket, chunk, result)) {
+            abort = true;
+            break;
+        }
+        free_chunks.push(chunk, abort);
+        if (progress) {
+            progress(result.raw_bytes);
+        }
+    }
+
+    reader.join();
+    hasher.join();
+    encoder.join();
+    return ok;
+}
+
+}  // namespace
+
+bool UploadPipeline::run(int socket, int fd, long file_size, Result& result,
+                         const std::function<void(long)>& progress) {
+    static const bool staged = std::thread::hardware_concurrency() > 1;
+
+    result.raw_bytes = 0;
+    result.wire_bytes = 0;
+    uint32_t crc = 0;
+    bool ok = staged ? runStaged(socket, fd, file_size, result, crc, progress)
+                     : runInline(socket, fd, file_size, result, crc, progress);
+    ok = ok && result.raw_bytes == file_size;
+
+    // Trailer: END frame carrying the whole-file checksum in the raw_len field.
+    // Sent even after a read error or a file that shrank, so the relay is not
+    // left waiting for frames; it fails the transfer on the short raw total.
+    result.crc = crc;
+    unsigned char trailer[FileTransferHandler::CHUNK_HEADER_SIZE] = {0};
+    trailer[0] = FileTransferHandler::CHUNK_FLAG_END | FileTransferHandler::CHUNK_FLAG_CHECKSUM;
+    for (int i = 0; i < 4; i++) {
+        trailer[1 + i] = static_cast<unsigned char>(crc >> (24 - 8 * i));
+    }
+    result.wire_bytes += sizeof(trailer);
+    return Utils::sendAll(socket, trailer, sizeof(trailer)) && ok;
+}
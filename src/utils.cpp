@@ -1,9 +1,26 @@
 #include "../include/utils.hpp"
+#include "../include/secure_channel.hpp"
+#include "../include/cpu_dispatch.hpp"
+#include "../include/async_logger.hpp"
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <vector>
 #include <chrono>
-#include <iomanip>
+#include <functional>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <cctype>
+#include <cstring>
+#include <random>
+#include <ctime>
+#include <cstdlib>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTILS_X86 1
+#endif
 
 /**
  * UTILITY FUNCTIONS IMPLEMENTATION
@@ -20,6 +37,289 @@
  * 5. Network utilities: IP address conversion
  */
 
+namespace {
+
+/**
+ * Trim kernels: [first, end) is the span without leading/trailing
+ * spaces; first == end when the string is all spaces
+ */
+typedef void (*TrimKernel)(const char* s, size_t len, size_t& first, size_t& end);
+
+/**
+ * Per-thread "YYYY-MM-DD HH:MM:SS." for the second last formatted
+ */
+struct TimestampCache {
+    time_t second = -1;
+    char prefix[Utils::TIMESTAMP_LENGTH];       // 20 chars + terminator
+};
+
+thread_local TimestampCache timestamp_cache;
+
+/**
+ * CLOCK_REALTIME_COARSE skips reading the hardware counter but only
+ * ticks once per jiffy. It is used when that is fine enough for the
+ * milliseconds shown (HZ=1000); CHAT_COARSE_CLOCK=1 / 0 force it on /
+ * off.
+ */
+clockid_t timestampClock() {
+    static const clockid_t clock = []() {
+        tzset();
+        const char* forced = std::getenv("CHAT_COARSE_CLOCK");
+        if (forced) {
+            return std::strcmp(forced, "1") == 0 ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME;
+        }
+        struct timespec resolution;
+        bool fine = clock_getres(CLOCK_REALTIME_COARSE, &resolution) == 0 &&
+                    resolution.tv_sec == 0 && resolution.tv_nsec <= 1000000;
+        return fine ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME;
+    }();
+    return clock;
+}
+
+void trimScalar(const char* s, size_t len, size_t& first, size_t& end) {
+    first = 0;
+    while (first < len && s[first] == ' ') first++;
+    end = len;
+    while (end > first && s[end - 1] == ' ') end--;
+}
+
+/**
+ * Username kernels: true if every one of len (1..20) chars is allowed
+ */
+typedef bool (*UsernameKernel)(const char* s, size_t len);
+
+bool usernameScalar(const char* s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-') {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef UTILS_X86
+/**
+ * Vector trim: compare a register of bytes with ' ' and locate the first
+ * (or last) mismatch from the movemask; names and chat lines rarely
+ * need more than one compare per end
+ */
+__attribute__((target("sse2")))
+void trimSse2(const char* s, size_t len, size_t& first, size_t& end) {
+    const __m128i space = _mm_set1_epi8(' ');
+    first = 0;
+    for (;;) {
+        if (first + 16 > len) {
+            while (first < len && s[first] == ' ') first++;
+            break;
+        }
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + first));
+        unsigned others = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, space))) & 0xffff;
+        if (others) {
+            first += __builtin_ctz(others);
+            break;
+        }
+        first += 16;
+    }
+    end = len;
+    while (end >= first + 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + end - 16));
+        unsigned others = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, space))) & 0xffff;
+        if (others) {
+            end -= __builtin_clz(others) - 16;
+            return;
+        }
+        end -= 16;
+    }
+    while (end > first && s[end - 1] == ' ') end--;
+}
+
+__attribute__((target("avx2")))
+void trimAvx2(const char* s, size_t len, size_t& first, size_t& end) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    first = 0;
+    for (;;) {
+        if (first + 32 > len) {
+            while (first < len && s[first] == ' ') first++;
+            break;
+        }
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + first));
+        unsigned others = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, space)));
+        if (others) {
+            first += __builtin_ctz(others);
+            break;
+        }
+        first += 32;
+    }
+    end = len;
+    while (end >= first + 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + end - 32));
+        unsigned others = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, space)));
+        if (others) {
+            end -= __builtin_clz(others);
+            return;
+        }
+        end -= 32;
+    }
+    while (end > first && s[end - 1] == ' ') end--;
+}
+
+/**
+ * Vector username check: the name is copied into a zeroed 32-byte
+ * buffer and each byte classified with signed range compares (bytes
+ * >= 0x80 are negative and fail every range); padding bytes are masked
+ * off by length
+ */
+__attribute__((target("sse2")))
+inline __m128i inRangeSse2(__m128i x, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                         _mm_cmplt_epi8(x, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+
+__attribute__((target("sse2")))
+__m128i usernameClassSse2(__m128i v) {
+    __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));     // 'A'-'Z' -> 'a'-'z'
+    __m128i ok = _mm_or_si128(inRangeSse2(folded, 'a', 'z'), inRangeSse2(v, '0', '9'));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    return _mm_or_si128(ok, _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+}
+
+__attribute__((target("sse2")))
+bool usernameSse2(const char* s, size_t len) {
+    alignas(16) char padded[32] = {0};
+    std::memcpy(padded, s, len);
+    unsigned lo = _mm_movemask_epi8(usernameClassSse2(_mm_load_si128(reinterpret_cast<const __m128i*>(padded))));
+    unsigned hi = _mm_movemask_epi8(usernameClassSse2(_mm_load_si128(reinterpret_cast<const __m128i*>(padded + 16))));
+    uint32_t ok = lo | (hi << 16);
+    uint32_t wanted = (len >= 32) ? ~0u : ((1u << len) - 1);
+    return (ok & wanted) == wanted;
+}
+
+__attribute__((target("avx2")))
+inline __m256i inRangeAvx2(__m256i x, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), x));
+}
+
+__attribute__((target("avx2")))
+bool usernameAvx2(const char* s, size_t len) {
+    alignas(32) char padded[32] = {0};
+    std::memcpy(padded, s, len);
+    __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(padded));
+    __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i ok = _mm256_or_si256(inRangeAvx2(folded, 'a', 'z'), inRangeAvx2(v, '0', '9'));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+    uint32_t wanted = (len >= 32) ? ~0u : ((1u << len) - 1);
+    return (mask & wanted) == wanted;
+}
+#endif
+
+const KernelVariant<TrimKernel> TRIM_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", trimScalar},
+#ifdef UTILS_X86
+    {SimdLevel::SSE2, "sse2", trimSse2},
+    {SimdLevel::AVX2, "avx2", trimAvx2},
+#endif
+};
+
+const KernelVariant<UsernameKernel> USERNAME_VARIANTS[] = {
+    {SimdLevel::SCALAR, "scalar", usernameScalar},
+#ifdef UTILS_X86
+    {SimdLevel::SSE2, "sse2", usernameSse2},
+    {SimdLevel::AVX2, "avx2", usernameAvx2},
+#endif
+};
+
+/**
+ * Space runs of every length on either side of short and long bodies,
+ * including all-space strings
+ */
+bool testTrim() {
+    return CpuDispatch::testVariants("utils.trim", TRIM_VARIANTS, [](TrimKernel scalar, TrimKernel variant) {
+        std::mt19937 rng(7);
+        for (size_t lead = 0; lead <= 70; lead++) {
+            for (size_t body : {0, 1, 2, 17, 40, 100}) {
+                for (size_t trail = 0; trail <= 70; trail += 1 + rng() % 3) {
+                    std::string text(lead, ' ');
+                    for (size_t i = 0; i < body; i++) {
+                        text += (i == 0 || i + 1 == body) ? 'x' : static_cast<char>(" ab\t"[rng() % 4]);
+                    }
+                    text.append(trail, ' ');
+                    size_t expected_first, expected_end, first, end;
+                    scalar(text.data(), text.size(), expected_first, expected_end);
+                    variant(text.data(), text.size(), first, end);
+                    if (first != expected_first || end != expected_end) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * Every byte value at every position of names of every allowed length
+ */
+bool testUsername() {
+    return CpuDispatch::testVariants("utils.username", USERNAME_VARIANTS,
+                                     [](UsernameKernel scalar, UsernameKernel variant) {
+        for (size_t len = 1; len <= Utils::MAX_USERNAME_LENGTH; len++) {
+            for (size_t pos = 0; pos < len; pos++) {
+                for (int c = 0; c < 256; c++) {
+                    std::string name(len, 'a');
+                    name[pos] = static_cast<char>(c);
+                    if (scalar(name.data(), len) != variant(name.data(), len)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    });
+}
+
+/**
+ * getCurrentTimestamp() as it was before the per-thread cache: a
+ * stringstream, std::localtime() and put_time() on every call
+ */
+std::string legacyTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time_t = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
+    ss << '.' << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+/**
+ * Nanoseconds per call of the old formatter, getCurrentTimestamp() and
+ * the allocation-free formatTimestamp()
+ */
+void benchTimestamp() {
+    char out[Utils::TIMESTAMP_LENGTH];
+    auto report = [](const char* variant, const std::function<void()>& op) {
+        // throughput() of 1 MB per call is calls per second
+        double per_second = CpuDispatch::throughput(1024 * 1024, op);
+        char line[64];
+        snprintf(line, sizeof(line), "%8.0f ns/call", 1e9 / per_second);
+        std::cout << "  " << std::left << std::setw(20) << "utils.timestamp" << std::setw(10) << variant << line
+                  << std::endl;
+    };
+    report("old", []() { legacyTimestamp(); });
+    report("get()", []() { Utils::getCurrentTimestamp(); });
+    report("format()", [&]() { Utils::formatTimestamp(out); });
+}
+
+const bool trim_registered = CpuDispatch::registerSelfTest("utils.trim", testTrim);
+const bool username_registered = CpuDispatch::registerSelfTest("utils.username", testUsername);
+const bool timestamp_bench_registered = CpuDispatch::registerBenchmark("utils.timestamp", benchTimestamp);
+
+}  // namespace
+
 /**
  * Log an event with timestamp
  * ---------------------------
@@ -30,26 +330,28 @@
  * - Real-time monitoring (console)
  * - Historical analysis (log file)
  * - Debugging (persistent record)
+ *
+ * The line is only queued here; AsyncLogger's writer thread does the
+ * I/O, so callers on the message path never wait for the disk.
  */
 void Utils::logEvent(const std::string& event) {
-    std::string timestamped_event = "[" + getCurrentTimestamp() + "] " + event;
-    std::cout << timestamped_event << std::endl;
-    logToFile(timestamped_event);
+    logEvent(LogEvent::TEXT, event);
 }
 
 /**
  * Append event to log file
  * ------------------------
- * Creates or appends to "server_log.txt"
- * Thread-safe due to POSIX file locking (automatic in append mode)
+ * Queues the line for "server_log.txt" only (no console echo); in
+ * binary mode it becomes a TEXT record
  */
 void Utils::logToFile(const std::string& event) {
-    std::ofstream log_file("server_log.txt", std::ios::app);
-    if (log_file.is_open()) {
-        log_file << event << std::endl;
-        log_file.close();
+    if (AsyncLogger::binary()) {
+        LogRecord record(LogEvent::TEXT);
+        record.add(event);
+        record.submit(false);
+        return;
     }
-    // Silently fail if file can't be opened (e.g., permissions)
+    AsyncLogger::write(event, false);
 }
 
 /**
@@ -92,11 +394,33 @@ std::vector<std::string> Utils::split(const std::string& str, char delimiter) {
  * - Copy-paste may include extra whitespace
  */
 std::string Utils::trim(const std::string& str) {
-    size_t first = str.find_first_not_of(' ');
-    if (first == std::string::npos) return "";  // All spaces
+    static const TrimKernel kernel = CpuDispatch::select("utils.trim", TRIM_VARIANTS).fn;
+
+    size_t first, end;
+    kernel(str.data(), str.size(), first, end);
+    if (first == end) return "";  // All spaces
     
-    size_t last = str.find_last_not_of(' ');
-    return str.substr(first, (last - first + 1));
+    return str.substr(first, end - first);
+}
+
+/**
+ * Validate username format
+ * ------------------------
+ * Rules:
+ * - Length: 1-20 characters
+ * - Characters: a-z, A-Z, 0-9, underscore, hyphen
+ * - Prevents injection attacks
+ *
+ * Checked on every login and private message, so the vector kernels
+ * classify the whole name in one pass instead of a call per character.
+ */
+bool Utils::isValidUsername(const std::string& username) {
+    static const UsernameKernel kernel = CpuDispatch::select("utils.username", USERNAME_VARIANTS).fn;
+
+    if (username.empty() || username.length() > MAX_USERNAME_LENGTH) {
+        return false;
+    }
+    return kernel(username.data(), username.size());
 }
 
 /**
@@ -104,34 +428,41 @@ std::string Utils::trim(const std::string& str) {
  * ------------------------------------------------
  * Returns: YYYY-MM-DD HH:MM:SS.mmm
  * 
- * Uses std::chrono for high-precision timing
- * 
  * Technical details:
- * - system_clock: Wall clock time (what users see)
+ * - Wall clock time (what users see), read with clock_gettime (vDSO,
+ *   no system call)
  * - milliseconds: Precision suitable for event correlation
- * - localtime: Convert to local timezone
+ * - localtime_r: Convert to local timezone, once per second per thread;
+ *   within a second only the ".mmm" digits change
  * 
  * Why milliseconds matter:
  * - Distinguish events happening in quick succession
  * - Measure network latency
  * - Debug race conditions
  */
+size_t Utils::formatTimestamp(char* out) {
+    struct timespec now;
+    clock_gettime(timestampClock(), &now);
+
+    TimestampCache& cache = timestamp_cache;
+    if (now.tv_sec != cache.second) {
+        struct tm local;
+        localtime_r(&now.tv_sec, &local);
+        strftime(cache.prefix, sizeof(cache.prefix), "%Y-%m-%d %H:%M:%S.", &local);
+        cache.second = now.tv_sec;
+    }
+
+    std::memcpy(out, cache.prefix, TIMESTAMP_LENGTH - 3);
+    unsigned ms = static_cast<unsigned>(now.tv_nsec / 1000000);
+    out[TIMESTAMP_LENGTH - 3] = static_cast<char>('0' + ms / 100);
+    out[TIMESTAMP_LENGTH - 2] = static_cast<char>('0' + ms / 10 % 10);
+    out[TIMESTAMP_LENGTH - 1] = static_cast<char>('0' + ms % 10);
+    return TIMESTAMP_LENGTH;
+}
+
 std::string Utils::getCurrentTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    
-    // Extract milliseconds component
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()) % 1000;
-    
-    // Format: YYYY-MM-DD HH:MM:SS
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-    
-    // Add milliseconds: .mmm
-    ss << '.' << std::setfill('0') << std::setw(3) << ms.count();
-    
-    return ss.str();
+    char buffer[TIMESTAMP_LENGTH];
+    return std::string(buffer, formatTimestamp(buffer));
 }
 
 /**
@@ -172,46 +503,6 @@ long Utils::getFileSize(const std::string& filepath) {
     return -1;
 }
 
-/**
- * Format file size for human-readable display
- * -------------------------------------------
- * Converts bytes to appropriate unit
- * 
- * Logic:
- * - < 1024 bytes: Display as "X B"
- * - < 1MB: Display as "X.Y KB"
- * - >= 1MB: Display as "X.Y MB"
- * 
- * Examples:
- *   formatFileSize(500) -> "500 B"
- *   formatFileSize(1536) -> "1.5 KB"
- *   formatFileSize(2097152) -> "2.0 MB"
- * 
- * Why one decimal place:
- * - Good balance between precision and readability
- * - "1.5 MB" is clearer than "1572864 B"
- */
-std::string Utils::formatFileSize(long size) {
-    if (size < 1024) {
-        // Less than 1KB: Show bytes
-        return std::to_string(size) + " B";
-    }
-    
-    if (size < 1024 * 1024) {
-        // Less than 1MB: Show kilobytes with one decimal
-        double kb = size / 1024.0;
-        char buffer[32];
-        snprintf(buffer, sizeof(buffer), "%.1f KB", kb);
-        return std::string(buffer);
-    }
-    
-    // 1MB or more: Show megabytes with one decimal
-    double mb = size / (1024.0 * 1024.0);
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%.1f MB", mb);
-    return std::string(buffer);
-}
-
 /**
  * Convert socket address to IP string
  * -----------------------------------
@@ -238,4 +529,38 @@ std::string Utils::getIPString(struct sockaddr_in addr) {
     inet_ntop(AF_INET, &addr.sin_addr, ip_str, INET_ADDRSTRLEN);
     
     return std::string(ip_str);
+}
+
+/**
+ * Send a whole buffer
+ * -------------------
+ * Loops until every byte is written; EINTR is retried
+ */
+bool Utils::sendAll(int socket, const void* data, size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = SecureChannel::send(socket, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * Receive an exact number of bytes
+ * --------------------------------
+ * Loops until len bytes arrived; returns false if the peer disconnects
+ */
+bool Utils::recvAll(int socket, void* data, size_t len) {
+    char* p = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = SecureChannel::recv(socket, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
 }
\ No newline at end of file